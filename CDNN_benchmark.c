@@ -0,0 +1,2511 @@
+/*
+ *  benchmark.c - timing tests for the neural network library
+ *  
+ *  C Deeply
+ *  Copyright (C) 2023 C Deeply, LLC
+ *  
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *  
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+    // The benchmark includes the library source directly so that it can time its internals.
+
+#include "cdeeply_neural_network.c"
+#include <time.h>
+#include <stdarg.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <dlfcn.h>
+
+
+double rand01()  {  return ((double) rand())/RAND_MAX;  }
+
+double seconds()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + 1e-9*t.tv_nsec;
+}
+
+
+    // Settings from the command line:  CDNN_benchmark [seed] [-layers n] [-width n] [-fanin n] [-json file].
+    // The network size settings apply to the run_CDNN() and end-to-end training benchmarks.
+
+int benchLayers = 8, benchWidth = 256, benchFanIn = 2;
+
+
+    // Every result is also recorded for the -json report, as a name, a value and a unit
+
+#define MAX_RESULTS 256
+
+typedef struct {
+    char name[64];
+    const char *unit;
+    double value;
+} resultType;
+
+resultType results[MAX_RESULTS];
+int numResults = 0;
+
+void record(const char *unit, double value, const char *nameFormat, ...)
+{
+    va_list args;
+    
+    if (numResults == MAX_RESULTS)  return;
+    va_start(args, nameFormat);
+    vsnprintf(results[numResults].name, sizeof(results[numResults].name), nameFormat, args);
+    va_end(args);
+    results[numResults].unit = unit;
+    results[numResults].value = value;
+    numResults++;
+}
+
+    // non-finite values (a timing that rounded to zero, say) are written as null, which JSON can represent
+
+int writeResults(const char *fileName, unsigned int seed)
+{
+    int r;
+    FILE *fileP = fopen(fileName, "w");
+    
+    if (fileP == NULL)  return CD_FILE_ERROR;
+    fprintf(fileP, "{\n  \"seed\": %u,\n  \"layers\": %i,\n  \"width\": %i,\n  \"fanIn\": %i,\n  \"simdLevel\": %i,\n",
+            seed, benchLayers, benchWidth, benchFanIn, CDNN_max_simd_level());
+    fprintf(fileP, "  \"results\": [\n");
+    for (r = 0; r < numResults; r++)  {
+        fprintf(fileP, "    { \"name\": \"%s\", \"value\": ", results[r].name);
+        if (isfinite(results[r].value))  fprintf(fileP, "%.17g", results[r].value);
+        else  fprintf(fileP, "null");
+        fprintf(fileP, ", \"unit\": \"%s\" }%s\n", results[r].unit, (r < numResults-1) ? "," : "");
+    }
+    fprintf(fileP, "  ]\n}\n");
+    
+    if (ferror(fileP))  {
+        fclose(fileP);
+        return CD_FILE_ERROR;     }
+    if (fclose(fileP) != 0)  return CD_FILE_ERROR;
+    
+    return 0;
+}
+
+
+    // The number readers as they were before the dedicated parser:  find the next delimiter,
+    // overwrite it with a 0 and sscanf() the number.
+
+char *legacyCharPtr, *legacyEndChars;
+
+int legacyReadNum(void *theNum, int mode)
+{
+    int rtrn;
+    char *numEnd = legacyCharPtr;
+    
+    while ((*numEnd != ',') && (*numEnd != ';'))  {
+        numEnd++;
+        if (numEnd > legacyEndChars)  return CD_NN_READ_ERROR;   }
+    *numEnd = 0;
+    
+    if (mode == 0)  rtrn = sscanf(legacyCharPtr, "%i", (int *) theNum);
+    else  rtrn = sscanf(legacyCharPtr, "%lg", (double *) theNum);
+    
+    if (rtrn != 1)  return CD_NN_READ_ERROR;
+    
+    legacyCharPtr = numEnd+1;
+    while ((*legacyCharPtr == ',') || (*legacyCharPtr == ';'))  legacyCharPtr++;
+    
+    return 0;
+}
+
+int legacyReadInts(int *theInts, int numInts)
+{
+    int i;
+    for (i = 0; i < numInts; i++)  {
+    if (legacyReadNum((void *) (theInts + i), 0) != 0)  {
+        return CD_NN_READ_ERROR;
+    }}
+    return 0;
+}
+
+int legacyReadFloats(double *theFloats, int numFloats)
+{
+    int i;
+    for (i = 0; i < numFloats; i++)  {
+    if (legacyReadNum((void *) (theFloats + i), 1) != 0)  {
+        return CD_NN_READ_ERROR;
+    }}
+    return 0;
+}
+
+
+    // Synthetic server responses:  comma-separated numbers in the formats the server sends,
+    // ending with a ';' like every section of a network.
+
+char *syntheticResponse(int numNums, int mode, long *numChars)
+{
+    char *text, *c;
+    int n;
+    double w;
+    
+    text = malloc(32*(long) numNums + 1);
+    if (text == NULL)  return NULL;
+    
+    c = text;
+    for (n = 0; n < numNums; n++)  {
+        if (mode == 0)  c += sprintf(c, "%i", rand() % 4096);
+        else  {
+            w = (2.*rand01()-1.) * pow(10., rand() % 7 - 3);
+            if (mode == 1)  c += sprintf(c, "%.17g", w);
+            else  c += sprintf(c, "%.6g", w);
+        }
+        *(c++) = (n < numNums-1) ? ',' : ';';
+    }
+    *c = 0;
+    *numChars = c-text;
+    
+    return text;
+}
+
+
+int benchmarkReader(void)
+{
+    const int numNums = 2000000;
+    const char *formats[3] = { "integers", "doubles (%.17g)", "doubles (%.6g)" }, *names[3] = { "int", "g17", "g6" };
+    char *text, *scratch;
+    long numChars, pos;
+    int mode, n, rtrn, numMismatches, *ints[2];
+    double *floats[2], t0, legacyTime, newTime;
+    NNreaderType reader;
+    
+    ints[0] = malloc(numNums*sizeof(int));
+    ints[1] = malloc(numNums*sizeof(int));
+    floats[0] = malloc(numNums*sizeof(double));
+    floats[1] = malloc(numNums*sizeof(double));
+    if ((ints[0] == NULL) || (ints[1] == NULL) || (floats[0] == NULL) || (floats[1] == NULL))  {
+        printf("Out of memory\n");
+        return 1;     }
+    
+    printf("Reading %i numbers from synthetic server responses\n", numNums);
+    for (mode = 0; mode < 3; mode++)  {
+        text = syntheticResponse(numNums, mode, &numChars);
+        scratch = malloc(numChars+1);
+        if ((text == NULL) || (scratch == NULL))  {
+            printf("Out of memory\n");
+            return 1;     }
+        
+            // the old reader writes into its buffer, so it gets a fresh copy (not timed)
+        memcpy(scratch, text, numChars+1);
+        legacyCharPtr = scratch;
+        legacyEndChars = scratch+numChars;
+        t0 = seconds();
+        if (mode == 0)  rtrn = legacyReadInts(ints[0], numNums);
+        else  rtrn = legacyReadFloats(floats[0], numNums);
+        legacyTime = seconds()-t0;
+        if (rtrn != 0)  printf("  sscanf() reader failed on %s\n", formats[mode]);
+        
+            // the new reader is fed the text in the CURL_MAX_WRITE_SIZE chunks that libcurl delivers it in
+        initReader(&reader, NULL, NULL, 0, NONSPARSE_WEIGHTS, errMsgChars);
+        reader.stage = READ_SAMPLE_OUTPUTS;
+        reader.destMode = (mode > 0);
+        if (mode == 0)  reader.dest = ints[1];
+        else  reader.dest = floats[1];
+        reader.destLeft = numNums;
+        t0 = seconds();
+        for (pos = 0; (pos < numChars) && (reader.rtrn == 0); pos += CURL_MAX_WRITE_SIZE)  {
+            feedReader(&reader, text+pos, (numChars-pos < CURL_MAX_WRITE_SIZE) ? numChars-pos : CURL_MAX_WRITE_SIZE);   }
+        rtrn = finishReader(&reader);
+        newTime = seconds()-t0;
+        if (rtrn != 0)  printf("  new reader failed on %s\n", formats[mode]);
+        
+        numMismatches = 0;
+        for (n = 0; n < numNums; n++)  {
+            if (mode == 0)  numMismatches += (ints[0][n] != ints[1][n]);
+            else  numMismatches += (memcmp(&floats[0][n], &floats[1][n], sizeof(double)) != 0);
+        }
+        
+        printf("  %s, %.1f MB:\n", formats[mode], numChars*1e-6);
+        printf("    sscanf():  %8.1f MB/s  %7.1f ns/number\n", numChars*1e-6/legacyTime, legacyTime*1e9/numNums);
+        printf("    new:       %8.1f MB/s  %7.1f ns/number   (%.1fx)\n",
+                numChars*1e-6/newTime, newTime*1e9/numNums, legacyTime/newTime);
+        printf("    %i mismatched numbers\n", numMismatches);
+        record("MB/s", numChars*1e-6/legacyTime, "reader.%s.sscanf", names[mode]);
+        record("MB/s", numChars*1e-6/newTime, "reader.%s.new", names[mode]);
+        record("count", numMismatches, "reader.%s.mismatches", names[mode]);
+        
+        free(scratch);
+        free(text);
+    }
+    
+    free(ints[0]);
+    free(ints[1]);
+    free(floats[0]);
+    free(floats[1]);
+    
+    return 0;
+}
+
+
+    // the training data table as it was built before the shortest round-trip formatter:  6 significant digits
+
+char *legacyData2table(double *data, int numIOs, int numSamples)
+{
+    int i1, i2, numLength;
+    char *table, *charPtr;
+    double *numPtr;
+    
+    table = malloc(25*(long) numIOs*numSamples);
+    if (table == NULL)  return table;
+    
+    charPtr = table;
+    numPtr = data;
+    for (i1 = 0; i1 < numSamples; i1++)  {
+        if (i1 > 0)  {  *charPtr = '\n';  charPtr++;  }
+        for (i2 = 0; i2 < numIOs; i2++)  {
+            if (i2 > 0)  {  *charPtr = ',';  charPtr++;  }
+            sprintf(charPtr, "%g%n", *numPtr, &numLength);
+            charPtr += numLength;
+            numPtr++;
+    }   }
+    *charPtr = 0;
+    
+    return table;
+}
+
+
+    // reads a table back and counts the cells that don't match the original data bit for bit
+
+long tableMismatches(const char *table, const double *data, long numCells)
+{
+    const char *c = table, *end = table + strlen(table);
+    long n, numMismatches = 0;
+    double value;
+    
+    for (n = 0; n < numCells; n++)  {
+        c = parseDouble(c, end, &value);
+        if (c == NULL)  return numCells;
+        if (memcmp(&value, &data[n], sizeof(double)) != 0)  numMismatches++;
+        if ((c < end) && ((*c == ',') || (*c == '\n')))  c++;
+    }
+    
+    return numMismatches;
+}
+
+    // streams a table through the read callback the way curl does, into a buffer of the default upload size;
+    // the text is only kept if copy != NULL
+
+size_t streamTable(tableType *table, char *copy)
+{
+    char buffer[65536];
+    size_t numBytes, numChars = 0;
+    
+    tableSeekCallback(table, 0, SEEK_SET);
+    do  {
+        numBytes = tableReadCallback(buffer, 1, sizeof(buffer), table);
+        if (copy != NULL)  memcpy(copy + numChars, buffer, numBytes);
+        numChars += numBytes;
+    }  while (numBytes > 0);
+    
+    return numChars;
+}
+
+int benchmarkTable(void)
+{
+    const int numIOs = 10, numSamples = 1000000;
+    long n, numCells = (long) numIOs*numSamples;
+    double *data, t0, legacyTime, sizingTime, streamingTime;
+    char *legacyTable, *newTable;
+    size_t legacyChars, newChars;
+    tableType table;
+    
+    data = malloc(numCells*sizeof(double));
+    if (data == NULL)  {
+        printf("Out of memory\n");
+        return 1;     }
+    for (n = 0; n < numCells; n++)  data[n] = (2.*rand01()-1.) * pow(10., rand() % 9 - 4);
+    
+    t0 = seconds();
+    legacyTable = legacyData2table(data, numIOs, numSamples);
+    legacyTime = seconds()-t0;
+    
+    t0 = seconds();
+    initTable(&table, data, numIOs, numSamples, SAMPLE_FEATURE_ARRAY);
+    measureTable(&table);
+    sizingTime = seconds()-t0;
+    t0 = seconds();
+    newChars = streamTable(&table, NULL);
+    streamingTime = seconds()-t0;
+    
+        // the whole text is only needed to check the round trip
+    newTable = malloc(table.numChars+1);
+    if ((legacyTable == NULL) || (newTable == NULL))  {
+        printf("Out of memory\n");
+        return 1;     }
+    newTable[streamTable(&table, newTable)] = 0;
+    legacyChars = strlen(legacyTable);
+    
+    printf("Formatting a %i x %i table of training data\n", numSamples, numIOs);
+    printf("    %%g:        %8.1f MB/s  %7.1f ns/number   %.1f MB, %li numbers changed by the round trip\n",
+            legacyChars*1e-6/legacyTime, legacyTime*1e9/numCells, legacyChars*1e-6, tableMismatches(legacyTable, data, numCells));
+    printf("    new:       %8.1f MB/s  %7.1f ns/number   %.1f MB, %li numbers changed by the round trip   (%.1fx)\n",
+            newChars*1e-6/streamingTime, streamingTime*1e9/numCells, newChars*1e-6, tableMismatches(newTable, data, numCells),
+            legacyTime/streamingTime);
+    printf("    sizing pass before the upload:  %.1f ms (%i threads)%s\n", sizingTime*1e3,
+            numTableThreads(numCells, numSamples), (newChars == table.numChars) ? "" : ", WRONG LENGTH");
+    record("MB/s", legacyChars*1e-6/legacyTime, "table.g");
+    record("MB/s", newChars*1e-6/streamingTime, "table.new");
+    record("ms", sizingTime*1e3, "table.sizing");
+    record("count", tableMismatches(newTable, data, numCells), "table.mismatches");
+    
+    free(legacyTable);
+    free(newTable);
+    free(data);
+    
+    return 0;
+}
+
+    // A random network in the text format the server sends, followed by numOutputs*numSamples sample outputs.
+    // Each layer after the input layer reads from the layer before it and up to fanIn-1 earlier layers.
+
+char *syntheticNetwork(int numLayers, int width, int numInputs, int numOutputs, int fanIn, int weightSparsity,
+        int numSamples, long *numChars)
+{
+    int l, l0, li, n, arr, *layerSize, *numLayerInputs, **layerInputs, **wSize;
+    long capacity = 1 << 16, length = 0;
+    char *text, *newText;
+    
+    layerSize = malloc(numLayers*sizeof(int));
+    numLayerInputs = malloc(numLayers*sizeof(int));
+    layerInputs = malloc(numLayers*sizeof(int *));
+    wSize = malloc(numLayers*sizeof(int *));
+    text = malloc(capacity);
+    if ((layerSize == NULL) || (numLayerInputs == NULL) || (layerInputs == NULL) || (wSize == NULL) || (text == NULL))  return NULL;
+    
+    for (l = 0; l < numLayers; l++)  {
+        if (l == 0)  layerSize[l] = 1;
+        else if (l == 1)  layerSize[l] = numInputs;
+        else if (l == numLayers-1)  layerSize[l] = numOutputs;
+        else  layerSize[l] = 1 + rand() % width;
+        
+        numLayerInputs[l] = 0;
+        layerInputs[l] = malloc(numLayers*sizeof(int));
+        wSize[l] = malloc(numLayers*sizeof(int));
+        if ((layerInputs[l] == NULL) || (wSize[l] == NULL))  return NULL;
+        if (l < 2)  continue;
+        
+            // the bias layer, then the layer before, then any others
+        for (l0 = 0; l0 < l; l0++)  {
+        if ((l0 == 0) || (l0 == l-1) || ((numLayerInputs[l] < fanIn) && (rand() % 2 == 0)))  {
+            layerInputs[l][numLayerInputs[l]] = l0;
+            wSize[l][numLayerInputs[l]] = (weightSparsity == SPARSE_WEIGHTS) ?
+                    1 + rand() % (layerSize[l]*layerSize[l0]) : layerSize[l]*layerSize[l0];
+            numLayerInputs[l]++;
+    }}  }
+        
+        // leaves room for the longest number plus a delimiter
+#define APPEND(...)  {  \
+        if (capacity-length < 64)  {  \
+            capacity *= 2;  \
+            newText = realloc(text, capacity);  \
+            if (newText == NULL)  return NULL;  \
+            text = newText;     }  \
+        length += sprintf(text+length, __VA_ARGS__);  }
+    
+    APPEND("%i,%i,%i;", numLayers, numLayers/2, 0);
+    for (l = 0; l < numLayers; l++)  APPEND("%i%c", layerSize[l], (l < numLayers-1) ? ',' : ';');
+    for (l = 0; l < numLayers; l++)  APPEND("%i%c", (l < 2) ? 0 : rand() % 6, (l < numLayers-1) ? ',' : ';');
+    for (l = 0; l < numLayers; l++)  APPEND("%i%c", numLayerInputs[l], (l < numLayers-1) ? ',' : ';');
+    for (l = 0; l < numLayers; l++)  {
+    for (li = 0; li < numLayerInputs[l]; li++)  {
+        APPEND("%i,", layerInputs[l][li]);
+    }}
+    text[length-1] = ';';
+    if (weightSparsity == SPARSE_WEIGHTS)  {
+        for (l = 0; l < numLayers; l++)  {
+        for (li = 0; li < numLayerInputs[l]; li++)  {
+            APPEND("%i,", wSize[l][li]);
+        }}
+        text[length-1] = ';';
+    }
+    
+        // sparse networks list the input neuron and the output neuron of each weight before the weights
+    for (arr = (weightSparsity == SPARSE_WEIGHTS) ? 0 : 2; arr < 3; arr++)  {
+        for (l = 0; l < numLayers; l++)  {
+        for (li = 0; li < numLayerInputs[l]; li++)  {
+        for (n = 0; n < wSize[l][li]; n++)  {
+            if (arr == 0)  APPEND("%i,", rand() % layerSize[layerInputs[l][li]])
+            else if (arr == 1)  APPEND("%i,", rand() % layerSize[l])
+            else  APPEND("%.17g,", (2.*rand01()-1.)/sqrt(layerSize[layerInputs[l][li]]))
+        }}}
+        text[length-1] = ';';
+    }
+    
+    for (n = 0; n < numOutputs*numSamples; n++)  APPEND("%.17g%c", rand01(), (n < numOutputs*numSamples-1) ? ',' : ';');
+#undef APPEND
+    
+    for (l = 0; l < numLayers; l++)  {
+        free(layerInputs[l]);
+        free(wSize[l]);     }
+    free(layerSize);
+    free(numLayerInputs);
+    free(layerInputs);
+    free(wSize);
+
+    *numChars = length;
+    return text;
+}
+
+
+    // A stand-in for the server on the loopback interface, answering every POST with a canned response:
+    // the one numbered by the request's maxWeights field, or the first one if maxWeights isn't set.
+    // Each connection gets its own thread, and is kept open for the next request.  A maxWeights of
+    // stallResponse gets half of the first response, and then nothing until the client hangs up.
+
+typedef struct {
+    int listenSocket, port, numResponses, stallResponse;
+    char **responses;
+    long *responseChars;
+    pthread_t acceptThread;
+    pthread_mutex_t lock;
+    pthread_cond_t closed;
+    int numConnections;
+} mockServerType;
+
+typedef struct {
+    mockServerType *server;
+    int socket;
+} mockConnectionType;
+
+int sendAll(int socket, const char *data, long numBytes)
+{
+    long numSent;
+    
+    while (numBytes > 0)  {
+        numSent = send(socket, data, numBytes, MSG_NOSIGNAL);
+        if (numSent <= 0)  return -1;
+        data += numSent;
+        numBytes -= numSent;
+    }
+    
+    return 0;
+}
+
+void *mockConnection(void *arg)
+{
+    mockConnectionType *connection = (mockConnectionType *) arg;
+    mockServerType *server = connection->server;
+    char *buffer, *newBuffer, *field, header[64];
+    long capacity = 1 << 16, length = 0, headerLength, requestLength, numRead;
+    int r, ifStall;
+    
+    buffer = malloc(capacity+1);
+    while (buffer != NULL)  {
+        
+            // reads the headers, answers an "Expect: 100-continue", then reads the body
+        headerLength = requestLength = 0;
+        for (;;)  {
+            buffer[length] = 0;
+            if ((headerLength == 0) && ((field = strstr(buffer, "\r\n\r\n")) != NULL))  {
+                headerLength = field+4-buffer;
+                field = strstr(buffer, "Content-Length:");
+                requestLength = headerLength + ((field != NULL) ? atol(field+15) : 0);
+                if (strstr(buffer, "100-continue") != NULL)  sendAll(connection->socket, "HTTP/1.1 100 Continue\r\n\r\n", 25);
+            }
+            if ((headerLength > 0) && (length >= requestLength))  break;
+            
+            if (capacity-length < 4096)  {
+                capacity *= 2;
+                newBuffer = realloc(buffer, capacity+1);
+                if (newBuffer == NULL)  break;
+                buffer = newBuffer;     }
+            numRead = recv(connection->socket, buffer+length, capacity-length, 0);
+            if (numRead <= 0)  break;
+            length += numRead;
+        }
+        if ((headerLength == 0) || (length < requestLength))  break;
+        
+        field = strstr(buffer+headerLength, "name=\"maxWeights\"\r\n\r\n");
+        r = (field != NULL) ? atoi(field+21) : 0;
+        ifStall = (r == server->stallResponse);
+        if ((r < 0) || (r >= server->numResponses))  r = 0;
+        sprintf(header, "HTTP/1.1 200 OK\r\nContent-Length: %li\r\n\r\n", server->responseChars[r]);
+        if (sendAll(connection->socket, header, strlen(header)) != 0)  break;
+        if (ifStall)  {
+            sendAll(connection->socket, server->responses[r], server->responseChars[r]/2);
+            while (recv(connection->socket, buffer, capacity, 0) > 0);
+            break;     }
+        if (sendAll(connection->socket, server->responses[r], server->responseChars[r]) != 0)  break;
+        
+        memmove(buffer, buffer+requestLength, length-requestLength);
+        length -= requestLength;
+    }
+    
+    close(connection->socket);
+    free(buffer);
+    free(connection);
+    
+    pthread_mutex_lock(&server->lock);
+    server->numConnections--;
+    pthread_cond_signal(&server->closed);
+    pthread_mutex_unlock(&server->lock);
+    
+    return NULL;
+}
+
+void *mockAccept(void *arg)
+{
+    mockServerType *server = (mockServerType *) arg;
+    mockConnectionType *connection;
+    pthread_t thread;
+    int socket;
+    
+    while ((socket = accept(server->listenSocket, NULL, NULL)) >= 0)  {
+        connection = malloc(sizeof(mockConnectionType));
+        if (connection == NULL)  {
+            close(socket);
+            continue;     }
+        connection->server = server;
+        connection->socket = socket;
+        pthread_mutex_lock(&server->lock);
+        if (pthread_create(&thread, NULL, mockConnection, connection) == 0)  {
+            server->numConnections++;
+            pthread_detach(thread);     }
+        else  {
+            close(socket);
+            free(connection);     }
+        pthread_mutex_unlock(&server->lock);
+    }
+    
+    return NULL;
+}
+
+int startMockServer(mockServerType *server, char **responses, long *responseChars, int numResponses)
+{
+    struct sockaddr_in address;
+    socklen_t addressLength = sizeof(address);
+    
+    server->responses = responses;
+    server->responseChars = responseChars;
+    server->numResponses = numResponses;
+    server->stallResponse = -1;
+    server->numConnections = 0;
+    pthread_mutex_init(&server->lock, NULL);
+    pthread_cond_init(&server->closed, NULL);
+    
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0;
+    
+    server->listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+    if (server->listenSocket < 0)  return -1;
+    if ((bind(server->listenSocket, (struct sockaddr *) &address, sizeof(address)) != 0) ||
+            (listen(server->listenSocket, 256) != 0) ||
+            (getsockname(server->listenSocket, (struct sockaddr *) &address, &addressLength) != 0) ||
+            (pthread_create(&server->acceptThread, NULL, mockAccept, server) != 0))  {
+        close(server->listenSocket);
+        return -1;     }
+    server->port = ntohs(address.sin_port);
+    
+    return 0;
+}
+
+    // waits for the clients to close the connections that are still open
+
+void stopMockServer(mockServerType *server)
+{
+    shutdown(server->listenSocket, SHUT_RDWR);
+    close(server->listenSocket);
+    pthread_join(server->acceptThread, NULL);
+    
+    pthread_mutex_lock(&server->lock);
+    while (server->numConnections > 0)  pthread_cond_wait(&server->closed, &server->lock);
+    pthread_mutex_unlock(&server->lock);
+    pthread_mutex_destroy(&server->lock);
+    pthread_cond_destroy(&server->closed);
+}
+
+
+    // Many threads training networks at once with the synchronous functions, against the stand-in server.
+    // Every network they get back is checked against one built beforehand from the same response.
+
+#define STRESS_RESPONSES 4
+#define STRESS_THREADS 16
+#define STRESS_BUILDS 8
+#define STRESS_INPUTS 8
+#define STRESS_SAMPLES 100
+
+typedef struct {
+    double *samples, referenceOutputs[STRESS_RESPONSES][STRESS_SAMPLES];
+    double testInput[STRESS_INPUTS], referenceRun[STRESS_RESPONSES][STRESS_INPUTS];
+    int thread, numOutputs[STRESS_RESPONSES], numFailed, numMismatched;
+} stressType;
+
+int stressBuild(CDNN *NN, stressType *stress, int r, double *sampleOutputs, char **errMsg)
+{
+    AFlist allowedAFs = { ALLOWED_AF, ALLOWED_AF, ALLOWED_AF, ALLOWED_AF, ALLOWED_AF };
+    quantizationType noQuantization = { OFF, 0, 0, 0. };
+    int outputColumn = STRESS_INPUTS;
+    
+    return CDNN_tabular_regressor(NN, STRESS_INPUTS, 1, STRESS_SAMPLES, stress->samples, SAMPLE_FEATURE_ARRAY, &outputColumn, NULL,
+            r, NO_MAX, NO_MAX, NO_MAX, 1., SOFT_LIMIT, SOFT_LIMIT, SOFT_LIMIT, allowedAFs, noQuantization, noQuantization,
+            (r % 2 == 0) ? NONSPARSE_WEIGHTS : SPARSE_WEIGHTS, ALLOW_NEGATIVE_WEIGHTS, HAS_BIAS, ALLOW_IO_CONNECTIONS,
+            sampleOutputs, errMsg);
+}
+
+CDNN_request *stressRequest(CDNN_session *session, CDNN *NN, double *samples, int r, double *sampleOutputs,
+        CDNN_callback callback, void *userData)
+{
+    AFlist allowedAFs = { ALLOWED_AF, ALLOWED_AF, ALLOWED_AF, ALLOWED_AF, ALLOWED_AF };
+    quantizationType noQuantization = { OFF, 0, 0, 0. };
+    int outputColumn = STRESS_INPUTS;
+    
+    return CDNN_tabular_regressor_async(session, NN, STRESS_INPUTS, 1, STRESS_SAMPLES, samples, SAMPLE_FEATURE_ARRAY, &outputColumn, NULL,
+            r, NO_MAX, NO_MAX, NO_MAX, 1., SOFT_LIMIT, SOFT_LIMIT, SOFT_LIMIT, allowedAFs, noQuantization, noQuantization,
+            (r % 2 == 0) ? NONSPARSE_WEIGHTS : SPARSE_WEIGHTS, ALLOW_NEGATIVE_WEIGHTS, HAS_BIAS, ALLOW_IO_CONNECTIONS,
+            sampleOutputs, callback, userData);
+}
+
+    // whether a network and its sample outputs are the ones built beforehand from response r
+
+int stressMatches(stressType *stress, CDNN *NN, int r, double *sampleOutputs)
+{
+    return (memcmp(sampleOutputs, stress->referenceOutputs[r], STRESS_SAMPLES*sizeof(double)) == 0) &&
+            (memcmp(run_CDNN(NN, stress->testInput), stress->referenceRun[r], stress->numOutputs[r]*sizeof(double)) == 0);
+}
+
+void *stressThread(void *arg)
+{
+    stressType *stress = (stressType *) arg;
+    double sampleOutputs[STRESS_SAMPLES];
+    char *errMsg;
+    int b, r;
+    CDNN NN;
+    
+    stress->numFailed = stress->numMismatched = 0;
+    for (b = 0; b < STRESS_BUILDS; b++)  {
+        r = (stress->thread + b) % STRESS_RESPONSES;
+        if (stressBuild(&NN, stress, r, sampleOutputs, &errMsg) != 0)  {
+            stress->numFailed++;
+            continue;     }
+        
+        if (!stressMatches(stress, &NN, r, sampleOutputs))  stress->numMismatched++;
+        free_CDNN(&NN);
+    }
+    
+    return NULL;
+}
+
+
+
+    // A session caching networks in a new directory:  a repeated request has to come from the cache with the same network
+    // and sample outputs, a table that differs in one number has to miss, and a cache file that's damaged in its weights
+    // or in its sample outputs has to be fetched again.  Then, with a byte limit that holds two of the three networks
+    // stored, the one used least recently has to be evicted.  The files' times are set back by hand to order them,
+    // as they only have a resolution of a second.
+
+#define CACHE_STEPS 13
+
+    // runs a request through the session, returning 1 if it came from the cache, 0 if from the server,
+    // or -1 if it failed or didn't give the network built beforehand from response r
+
+int cachedBuild(CDNN_session *session, stressType *stress, double *samples, int r)
+{
+    double sampleOutputs[STRESS_SAMPLES];
+    CDNN_request *request;
+    CDNN_build_stats stats;
+    int rtrn;
+    CDNN NN;
+    
+    request = stressRequest(session, &NN, samples, r, sampleOutputs, NULL, NULL);
+    if (request == NULL)  return -1;
+    rtrn = CDNN_request_wait(request);
+    CDNN_request_stats(request, &stats);
+    CDNN_request_free(request);
+    if (rtrn != 0)  return -1;
+    
+    if (!stressMatches(stress, &NN, r, sampleOutputs))  stats.fromCache = -1;
+    free_CDNN(&NN);
+    
+    return stats.fromCache;
+}
+
+    // the bytes in the cache's network files; each file is also made ageSeconds older,
+    // or flips the byte damageFraction of the way through, or is deleted if ifRemove
+
+long long cacheFiles(const char *dirName, int ageSeconds, double damageFraction, int ifRemove)
+{
+    char path[512];
+    DIR *dirP;
+    struct dirent *entry;
+    struct stat fileStats;
+    struct utimbuf times;
+    long long totalBytes = 0;
+    FILE *fileP;
+    int byte;
+    
+    dirP = opendir(dirName);
+    if (dirP == NULL)  return 0;
+    while ((entry = readdir(dirP)) != NULL)  {
+        if (entry->d_name[0] == '.')  continue;
+        snprintf(path, sizeof(path), "%s/%s", dirName, entry->d_name);
+        if (stat(path, &fileStats) != 0)  continue;
+        totalBytes += fileStats.st_size;
+        if (ageSeconds > 0)  {
+            times.actime = fileStats.st_atime - ageSeconds;
+            times.modtime = fileStats.st_mtime - ageSeconds;
+            utime(path, &times);     }
+        if ((damageFraction >= 0.) && ((fileP = fopen(path, "r+b")) != NULL))  {
+            if ((fseek(fileP, (long) (damageFraction*(fileStats.st_size-1)), SEEK_SET) == 0) && ((byte = fgetc(fileP)) != EOF) &&
+                    (fseek(fileP, -1, SEEK_CUR) == 0))  fputc(byte ^ 0x10, fileP);
+            fclose(fileP);     }
+        if (ifRemove)  remove(path);
+    }
+    closedir(dirP);
+    
+    return totalBytes;
+}
+
+int checkCache(stressType *stress)
+{
+    const int expected[CACHE_STEPS] = { 0, 1, 0, 0, 1, 0, 1,    0, 0, 1, 0, 1, 1 };
+    char dirName[64];
+    double changedSamples[(STRESS_INPUTS+1)*STRESS_SAMPLES];
+    int step = 0, results[CACHE_STEPS], numWrong = 0;
+    long long bytesA, bytesAB;
+    CDNN_session *session;
+    
+    memcpy(changedSamples, stress->samples, sizeof(changedSamples));
+    changedSamples[(STRESS_INPUTS+1)*STRESS_SAMPLES/2] += 0.5;
+    
+    printf("Caching networks trained against the stand-in server\n");
+    sprintf(dirName, "/tmp/CDNN_cache_%i", (int) getpid());
+    session = CDNN_session_init();
+    if ((session == NULL) || (CDNN_session_set_cache(session, dirName, 0) != 0))  {
+        printf("Couldn't set up a cache in %s\n", dirName);
+        return 1;     }
+    
+    results[step++] = cachedBuild(session, stress, stress->samples, 0);
+    results[step++] = cachedBuild(session, stress, stress->samples, 0);
+    results[step++] = cachedBuild(session, stress, changedSamples, 0);
+    cacheFiles(dirName, 0, 0.5, 0);
+    results[step++] = cachedBuild(session, stress, stress->samples, 0);
+    results[step++] = cachedBuild(session, stress, stress->samples, 0);
+    cacheFiles(dirName, 0, 1., 0);
+    results[step++] = cachedBuild(session, stress, stress->samples, 0);
+    results[step++] = cachedBuild(session, stress, stress->samples, 0);
+    
+        // A (response 0) is made 30 s old and B (response 1) 10 s, then A is used; C (response 1 from the changed table)
+        // is the same size as B, so the limit only leaves room for A and C
+    cacheFiles(dirName, 0, -1., 1);
+    results[step++] = cachedBuild(session, stress, stress->samples, 0);
+    bytesA = cacheFiles(dirName, 20, -1., 0);
+    results[step++] = cachedBuild(session, stress, stress->samples, 1);
+    bytesAB = cacheFiles(dirName, 10, -1., 0);
+    results[step++] = cachedBuild(session, stress, stress->samples, 0);
+    CDNN_session_set_cache(session, dirName, bytesA + 2*(bytesAB-bytesA) - 1);
+    results[step++] = cachedBuild(session, stress, changedSamples, 1);
+    results[step++] = cachedBuild(session, stress, stress->samples, 0);
+    results[step++] = cachedBuild(session, stress, changedSamples, 1);
+    
+    for (step = 0; step < CACHE_STEPS; step++)  {
+    if (results[step] != expected[step])  {
+        printf("    cache step %i:  expected %s, got %s\n", step+1, expected[step] ? "a hit" : "a miss",
+                (results[step] < 0) ? "a failed or wrong network" : (results[step] ? "a hit" : "a miss"));
+        numWrong++;
+    }}
+    
+        // and B has to have been evicted
+    if (cachedBuild(session, stress, stress->samples, 1) != 0)  {
+        printf("    the least recently used network wasn't evicted\n");
+        numWrong++;     }
+    
+    CDNN_session_free(session);
+    cacheFiles(dirName, 0, -1., 1);
+    rmdir(dirName);
+    
+    printf("    %i of %i requests were or weren't found in the cache as they should have been\n", CACHE_STEPS+1-numWrong, CACHE_STEPS+1);
+    record("count", numWrong, "cache.wrong");
+    
+    return (numWrong > 0);
+}
+
+
+
+
+    // Requests submitted all at once through the _async() functions, both regressors and encoders, and run by
+    // CDNN_session_poll() and CDNN_request_wait().  Each one's callback has to run once, with the network built
+    // beforehand from its response.  Another request, whose response stalls halfway, is freed while it's downloading,
+    // and its callback must never run.
+
+#define ASYNC_REQUESTS 12
+
+typedef struct {
+    CDNN NN;
+    double sampleOutputs[STRESS_SAMPLES];
+    int r, numCalls, status;
+} asyncType;
+
+void asyncCallback(CDNN_request *request, int status, void *userData)
+{
+    asyncType *async = (asyncType *) userData;
+    
+    async->numCalls++;
+    async->status = status;
+}
+
+int checkAsync(stressType *stress, int stallResponse)
+{
+    AFlist allowedAFs = { ALLOWED_AF, ALLOWED_AF, ALLOWED_AF, ALLOWED_AF, ALLOWED_AF };
+    quantizationType noQuantization = { OFF, 0, 0, 0. };
+    CDNN_request *requests[ASYNC_REQUESTS], *stalled;
+    asyncType async[ASYNC_REQUESTS], stalledAsync;
+    CDNN_session *session;
+    int q, ifCancelled, numIntact = 0;
+    double t0;
+    
+    printf("Training %i networks asynchronously from one session against a stand-in server\n", ASYNC_REQUESTS);
+    session = CDNN_session_init();
+    if (session == NULL)  {
+        printf("Out of memory\n");
+        return 1;     }
+    
+    stalledAsync.numCalls = 0;
+    stalled = stressRequest(session, &stalledAsync.NN, stress->samples, stallResponse, stalledAsync.sampleOutputs,
+            asyncCallback, &stalledAsync);
+    
+    for (q = 0; q < ASYNC_REQUESTS; q++)  {
+        async[q].r = q % STRESS_RESPONSES;
+        async[q].numCalls = 0;
+        if (q % 3 < 2)  requests[q] = stressRequest(session, &async[q].NN, stress->samples, async[q].r, async[q].sampleOutputs,
+                asyncCallback, &async[q]);
+        else  requests[q] = CDNN_tabular_encoder_async(session, &async[q].NN, STRESS_INPUTS+1, STRESS_SAMPLES, stress->samples,
+                SAMPLE_FEATURE_ARRAY, NULL, DO_ENCODER, NO_DECODER, 1, 0, NORMAL_DIST,
+                async[q].r, NO_MAX, NO_MAX, NO_MAX, 1., SOFT_LIMIT, SOFT_LIMIT, SOFT_LIMIT, allowedAFs, noQuantization, noQuantization,
+                (async[q].r % 2 == 0) ? NONSPARSE_WEIGHTS : SPARSE_WEIGHTS, ALLOW_NEGATIVE_WEIGHTS, HAS_BIAS,
+                async[q].sampleOutputs, asyncCallback, &async[q]);
+        if (requests[q] == NULL)  {
+            printf("Out of memory\n");
+            return 1;
+    }   }
+    if (stalled == NULL)  {
+        printf("Out of memory\n");
+        return 1;     }
+    
+        // the stalled request is cancelled once part of its response has arrived
+    t0 = seconds();
+    while ((stalled->firstByteNs == 0) && (seconds()-t0 < 10.))  CDNN_session_poll(session, 100);
+    ifCancelled = (stalled->firstByteNs != 0);
+    if (ifCancelled)  CDNN_request_free(stalled);
+    else  printf("    the stalled request never started downloading\n");
+    
+    CDNN_request_wait(requests[ASYNC_REQUESTS-1]);
+    while (CDNN_session_poll(session, 100) > 0);
+    
+    for (q = 0; q < ASYNC_REQUESTS; q++)  {
+        if ((async[q].numCalls == 1) && (async[q].status == 0) && (CDNN_request_status(requests[q]) == 0))  {
+            numIntact += stressMatches(stress, &async[q].NN, async[q].r, async[q].sampleOutputs);
+            free_CDNN(&async[q].NN);     }
+        CDNN_request_free(requests[q]);
+    }
+    if (!ifCancelled)  CDNN_request_free(stalled);
+    CDNN_session_free(session);
+    
+    printf("    %i of %i came back intact; the cancelled request's callback ran %i times\n", numIntact, ASYNC_REQUESTS, stalledAsync.numCalls);
+    record("count", ASYNC_REQUESTS-numIntact, "async.mismatches");
+    record("count", stalledAsync.numCalls, "async.cancelled.callbacks");
+    
+    return (numIntact < ASYNC_REQUESTS) || !ifCancelled || (stalledAsync.numCalls != 0);
+}
+
+
+int stressTest(void)
+{
+    char *responses[STRESS_RESPONSES], url[64], *errMsg;
+    long responseChars[STRESS_RESPONSES];
+    double samples[(STRESS_INPUTS+1)*STRESS_SAMPLES], t0, buildTime;
+    stressType shared, stress[STRESS_THREADS];
+    pthread_t threads[STRESS_THREADS];
+    mockServerType server;
+    int r, t, rtrn, numFailed = 0, numMismatched = 0;
+    CDNN NN;
+    
+    for (r = 0; r < STRESS_RESPONSES; r++)  {
+        responses[r] = syntheticNetwork(6 + 2*r, 64, STRESS_INPUTS, 1, 3, (r % 2 == 0) ? NONSPARSE_WEIGHTS : SPARSE_WEIGHTS,
+                STRESS_SAMPLES, &responseChars[r]);
+        if (responses[r] == NULL)  {
+            printf("Out of memory\n");
+            return 1;
+    }   }
+    for (t = 0; t < (STRESS_INPUTS+1)*STRESS_SAMPLES; t++)  samples[t] = rand01();
+    for (t = 0; t < STRESS_INPUTS; t++)  shared.testInput[t] = rand01();
+    shared.samples = samples;
+    
+    if (startMockServer(&server, responses, responseChars, STRESS_RESPONSES) != 0)  {
+        printf("Couldn't start the stand-in server\n");
+        return 1;     }
+    sprintf(url, "http://127.0.0.1:%i/myNN.php", server.port);
+    setenv("CDNN_URL", url, 1);
+    
+    for (r = 0; r < STRESS_RESPONSES; r++)  {
+        rtrn = stressBuild(&NN, &shared, r, shared.referenceOutputs[r], &errMsg);
+        if (rtrn != 0)  {
+            printf("Building a network from the stand-in server failed (%i)\n", rtrn);
+            return 1;     }
+        shared.numOutputs[r] = NN.layerSize[NN.numLayers-1];
+        memcpy(shared.referenceRun[r], run_CDNN(&NN, shared.testInput), shared.numOutputs[r]*sizeof(double));
+        free_CDNN(&NN);
+    }
+    
+    t0 = seconds();
+    for (t = 0; t < STRESS_THREADS; t++)  {
+        stress[t] = shared;
+        stress[t].thread = t;
+        pthread_create(&threads[t], NULL, stressThread, &stress[t]);     }
+    for (t = 0; t < STRESS_THREADS; t++)  {
+        pthread_join(threads[t], NULL);
+        numFailed += stress[t].numFailed;
+        numMismatched += stress[t].numMismatched;     }
+    buildTime = seconds()-t0;
+    
+    printf("Training %i networks from %i threads at once against a stand-in server\n", STRESS_THREADS*STRESS_BUILDS, STRESS_THREADS);
+    printf("    %.1f ms, %.2f ms per network; %i failed, %i differ from the networks built one at a time\n",
+            buildTime*1e3, buildTime*1e3/(STRESS_THREADS*STRESS_BUILDS), numFailed, numMismatched);
+    record("ms/network", buildTime*1e3/(STRESS_THREADS*STRESS_BUILDS), "stress.build");
+    record("count", numFailed, "stress.failed");
+    record("count", numMismatched, "stress.mismatches");
+    
+    rtrn = checkCache(&shared);
+    server.stallResponse = STRESS_RESPONSES;
+    if (rtrn == 0)  rtrn = checkAsync(&shared, STRESS_RESPONSES);
+    
+    stopMockServer(&server);
+    unsetenv("CDNN_URL");
+    for (r = 0; r < STRESS_RESPONSES; r++)  free(responses[r]);
+    
+    return (numFailed > 0) || (numMismatched > 0) || (rtrn != 0);
+}
+
+
+    // Networks of the size set on the command line, trained one after another against the stand-in server:
+    // CDNN_tabular_regressor() end to end, from uploading the training table to building the network from the response
+
+#define BUILD_REPEATS 16
+#define BUILD_INPUTS 16
+#define BUILD_SAMPLES 1000
+
+int benchmarkBuild(void)
+{
+    const char *kinds[2] = { "dense", "sparse" };
+    AFlist allowedAFs = { ALLOWED_AF, ALLOWED_AF, ALLOWED_AF, ALLOWED_AF, ALLOWED_AF };
+    quantizationType noQuantization = { OFF, 0, 0, 0. };
+    char *responses[2], url[64], *errMsg;
+    long responseChars[2];
+    double *samples, *sampleOutputs, t0, buildTime;
+    int k, b, rtrn = 0, weightSparsity, outputColumn = BUILD_INPUTS;
+    mockServerType server;
+    CDNN_build_stats stats;
+    CDNN NN;
+    
+    samples = malloc((BUILD_INPUTS+1)*BUILD_SAMPLES*sizeof(double));
+    sampleOutputs = malloc(BUILD_SAMPLES*sizeof(double));
+    for (k = 0; k < 2; k++)  responses[k] = syntheticNetwork(benchLayers, benchWidth, BUILD_INPUTS, 1, benchFanIn,
+            (k == 0) ? NONSPARSE_WEIGHTS : SPARSE_WEIGHTS, BUILD_SAMPLES, &responseChars[k]);
+    if ((samples == NULL) || (sampleOutputs == NULL) || (responses[0] == NULL) || (responses[1] == NULL))  {
+        printf("Out of memory\n");
+        return 1;     }
+    for (b = 0; b < (BUILD_INPUTS+1)*BUILD_SAMPLES; b++)  samples[b] = rand01();
+    
+    if (startMockServer(&server, responses, responseChars, 2) != 0)  {
+        printf("Couldn't start the stand-in server\n");
+        return 1;     }
+    sprintf(url, "http://127.0.0.1:%i/myNN.php", server.port);
+    setenv("CDNN_URL", url, 1);
+    
+        // the stand-in server picks the response by the maxWeights field
+    printf("Training %i-layer networks one after another against a stand-in server\n", benchLayers);
+    for (k = 0; (k < 2) && (rtrn == 0); k++)  {
+        weightSparsity = (k == 0) ? NONSPARSE_WEIGHTS : SPARSE_WEIGHTS;
+        t0 = seconds();
+        for (b = 0; (b < BUILD_REPEATS) && (rtrn == 0); b++)  {
+            rtrn = CDNN_tabular_regressor(&NN, BUILD_INPUTS, 1, BUILD_SAMPLES, samples, SAMPLE_FEATURE_ARRAY, &outputColumn, NULL,
+                    k, NO_MAX, NO_MAX, NO_MAX, 1., SOFT_LIMIT, SOFT_LIMIT, SOFT_LIMIT, allowedAFs, noQuantization, noQuantization,
+                    weightSparsity, ALLOW_NEGATIVE_WEIGHTS, HAS_BIAS, ALLOW_IO_CONNECTIONS, sampleOutputs, &errMsg);
+            if (rtrn == 0)  free_CDNN(&NN);
+        }
+        buildTime = (seconds()-t0)/BUILD_REPEATS;
+        if (rtrn != 0)  {
+            printf("  building the %s network failed (%i)\n", kinds[k], rtrn);
+            break;     }
+        
+        CDNN_last_build_stats(&stats);
+        printf("  %s, %.1f MB response:  %7.2f ms per network, %7.1f MB/s\n",
+                kinds[k], responseChars[k]*1e-6, buildTime*1e3, responseChars[k]*1e-6/buildTime);
+        printf("    last one:  sizing %.2f ms, connecting %.2f ms, upload %.2f ms (formatting %.2f ms), server %.2f ms,\n",
+                stats.sizingSeconds*1e3, stats.connectSeconds*1e3, stats.uploadSeconds*1e3, stats.formattingSeconds*1e3,
+                stats.serverSeconds*1e3);
+        printf("               download %.2f ms (parsing %.2f ms), %.2f ms in all\n",
+                stats.downloadSeconds*1e3, stats.parsingSeconds*1e3, stats.totalSeconds*1e3);
+        record("ms/network", buildTime*1e3, "build.%s", kinds[k]);
+        record("MB/s", responseChars[k]*1e-6/buildTime, "build.%s.response", kinds[k]);
+        record("ms", stats.sizingSeconds*1e3, "build.%s.sizing", kinds[k]);
+        record("ms", stats.uploadSeconds*1e3, "build.%s.upload", kinds[k]);
+        record("ms", stats.formattingSeconds*1e3, "build.%s.formatting", kinds[k]);
+        record("ms", stats.serverSeconds*1e3, "build.%s.server", kinds[k]);
+        record("ms", stats.downloadSeconds*1e3, "build.%s.download", kinds[k]);
+        record("ms", stats.parsingSeconds*1e3, "build.%s.parsing", kinds[k]);
+    }
+    
+    stopMockServer(&server);
+    unsetenv("CDNN_URL");
+    free(responses[0]);
+    free(responses[1]);
+    free(samples);
+    free(sampleOutputs);
+    
+    return (rtrn != 0);
+}
+
+
+    // The double- and single-precision batch paths over the same synthetic networks, one dense and one sparse.
+    // The float outputs have to be within F32_TOLERANCE of the double ones, relative to 1 + |output|.
+
+#define F32_SAMPLES 4096
+#define F32_INPUTS 256
+#define F32_TOLERANCE 1e-5
+
+int readNetwork(CDNN *NN, const char *text, long numChars, int weightSparsity)
+{
+    long pos;
+    double *sampleOutputs = malloc(F32_SAMPLES*sizeof(double));
+    NNreaderType reader;
+    
+    if (sampleOutputs == NULL)  return CD_OUT_OF_MEMORY_ERROR;
+    initReader(&reader, NN, sampleOutputs, 1, weightSparsity, errMsgChars);
+    for (pos = 0; (pos < numChars) && (reader.rtrn == 0); pos += CURL_MAX_WRITE_SIZE)  {
+        feedReader(&reader, text+pos, (numChars-pos < CURL_MAX_WRITE_SIZE) ? numChars-pos : CURL_MAX_WRITE_SIZE);   }
+    free(sampleOutputs);
+    
+    return finishReader(&reader);
+}
+
+int benchmarkF32(void)
+{
+    const char *kinds[2] = { "dense", "sparse" };
+    char *text;
+    long numChars, i;
+    int k, rtrn, weightSparsity;
+    double *inputs, *outputs, t0, doubleTime, floatTime, maxDeviation, deviation, relDeviation;
+    float *inputsF32, *outputsF32;
+    CDNN NN;
+    
+    inputs = malloc(F32_INPUTS*F32_SAMPLES*sizeof(double));
+    outputs = malloc(F32_SAMPLES*sizeof(double));
+    inputsF32 = malloc(F32_INPUTS*F32_SAMPLES*sizeof(float));
+    outputsF32 = malloc(F32_SAMPLES*sizeof(float));
+    if ((inputs == NULL) || (outputs == NULL) || (inputsF32 == NULL) || (outputsF32 == NULL))  {
+        printf("Out of memory\n");
+        return 1;     }
+    for (i = 0; i < F32_INPUTS*F32_SAMPLES; i++)  {
+        inputs[i] = 2.*rand01()-1.;
+        inputsF32[i] = (float) inputs[i];     }
+    
+    printf("Running %i samples through double- and single-precision networks\n", F32_SAMPLES);
+    for (k = 0; k < 2; k++)  {
+        weightSparsity = (k == 0) ? NONSPARSE_WEIGHTS : SPARSE_WEIGHTS;
+        text = syntheticNetwork(8, 512, F32_INPUTS, 1, 2, weightSparsity, 1, &numChars);
+        if (text == NULL)  {
+            printf("Out of memory\n");
+            return 1;     }
+        rtrn = readNetwork(&NN, text, numChars, weightSparsity);
+        free(text);
+        if (rtrn == 0)  rtrn = CDNN_make_f32(&NN);
+        if (rtrn != 0)  {
+            printf("  couldn't build the %s network (%i)\n", kinds[k], rtrn);
+            return 1;     }
+        CDNN_set_simd_level(&NN.model, CDNN_SIMD_BEST);
+        
+        t0 = seconds();
+        run_CDNN_batch(&NN, inputs, F32_SAMPLES, SAMPLE_FEATURE_ARRAY, outputs);
+        doubleTime = seconds()-t0;
+        t0 = seconds();
+        run_CDNN_batch_f32(&NN, inputsF32, F32_SAMPLES, SAMPLE_FEATURE_ARRAY, outputsF32);
+        floatTime = seconds()-t0;
+        rtrn = CDNN_f32_deviation(&NN, inputs, F32_SAMPLES, SAMPLE_FEATURE_ARRAY, &maxDeviation);
+        relDeviation = 0.;
+        for (i = 0; i < F32_SAMPLES; i++)  {
+            deviation = fabs(outputsF32[i] - outputs[i])/(1. + fabs(outputs[i]));
+            if (!(deviation <= relDeviation))  relDeviation = deviation;     }
+        
+        printf("  %s:\n", kinds[k]);
+        printf("    double:  %7.2f us/sample\n", doubleTime*1e6/F32_SAMPLES);
+        printf("    float:   %7.2f us/sample   (%.1fx)\n", floatTime*1e6/F32_SAMPLES, doubleTime/floatTime);
+        printf("    largest difference in the outputs:  %.3g, or %.3g relative to 1 + |output| (tolerance %g)\n",
+                maxDeviation, relDeviation, F32_TOLERANCE);
+        record("us/sample", doubleTime*1e6/F32_SAMPLES, "f32.%s.double", kinds[k]);
+        record("us/sample", floatTime*1e6/F32_SAMPLES, "f32.%s.float", kinds[k]);
+        record("abs", maxDeviation, "f32.%s.deviation", kinds[k]);
+        
+        free_CDNN(&NN);
+        if ((rtrn != 0) || !(relDeviation <= F32_TOLERANCE))  return 1;
+    }
+    
+    free(inputs);
+    free(outputs);
+    free(inputsF32);
+    free(outputsF32);
+    
+    return 0;
+}
+
+
+    // The quantized networks over the same samples, against the double-precision batch path
+
+long weightCount(CDNN *NN)
+{
+    int l, li;
+    long numWeights = 0;
+    
+    for (l = 0; l < NN->numLayers; l++)  {
+    for (li = 0; li < NN->numLayerInputs[l]; li++)  {
+        if (NN->n0 != NULL)  numWeights += NN->wSize[l][li];
+        else  numWeights += NN->layerSize[l]*NN->layerSize[NN->layerInputs[l][li]];
+    }}
+    
+    return numWeights;
+}
+
+    // Weights and activations on the server's grid for QUANTIZE:  (q - zeroInt)*range/(2^bits - 1).  snapWeights() rounds
+    // every weight onto the weight grid, zeroing repeated (input, output) pairs of a sparse block so that its dense copy,
+    // which adds them up, stays on the grid too.  gridOutputs() is what the server sends back as the sampleOutputs of
+    // such a network:  the double-precision network, with the inputs and every hidden layer rounded onto the activation grid.
+
+double gridStep(quantizationType quantization)
+{
+    return quantization.range/((1 << quantization.bits) - 1);
+}
+
+double snapToGrid(double x, quantizationType quantization)
+{
+    int minQ = -quantization.zeroInt, maxQ = (1 << quantization.bits) - 1 - quantization.zeroInt;
+    
+    if (minQ < -CDNN_Q_INT16_MAX)  minQ = -CDNN_Q_INT16_MAX;
+    if (maxQ > CDNN_Q_INT16_MAX)  maxQ = CDNN_Q_INT16_MAX;
+    return gridStep(quantization)*quantizeQ(x, gridStep(quantization), minQ, maxQ);
+}
+
+void snapWeights(CDNN *NN, quantizationType weightQuantization)
+{
+    int l, li, i, numIn;
+    long j;
+    double *dense;
+    const CDNN_model *model = &NN->model;
+    
+    for (l = 0; l < NN->numLayers; l++)  {
+    for (li = 0; li < NN->numLayerInputs[l]; li++)  {
+        numIn = NN->layerSize[NN->layerInputs[l][li]];
+        if (NN->n0 == NULL)  {
+            for (j = 0; j < (long) NN->layerSize[l]*numIn; j++)  NN->weights[l][li][j] = snapToGrid(NN->weights[l][li][j], weightQuantization);
+            continue;     }
+        
+        for (i = 0; i < NN->layerSize[l]; i++)  {
+        for (j = model->rowStart[l][li][i]; j < model->rowStart[l][li][i+1]; j++)  {
+            if ((j > model->rowStart[l][li][i]) && (NN->n0[l][li][j] == NN->n0[l][li][j-1]))  NN->weights[l][li][j] = 0.;
+            else  NN->weights[l][li][j] = snapToGrid(NN->weights[l][li][j], weightQuantization);
+        }}
+        dense = model->denseWeights[l][li];
+        if (dense != NULL)  {
+            for (j = 0; j < (long) NN->layerSize[l]*numIn; j++)  dense[j] = 0.;
+            for (j = 0; j < NN->wSize[l][li]; j++)  dense[(long) NN->nf[l][li][j]*numIn + NN->n0[l][li][j]] += NN->weights[l][li][j];
+    }}  }
+}
+
+int gridOutputs(CDNN *NN, const double *inputs, int numSamples, quantizationType activationQuantization, double *outputs)
+{
+    int l, li, l0, i, s, numIn, numOutputs = NN->layerSize[NN->numLayers-1];
+    long j;
+    double **y, *w;
+    const CDNN_model *model = &NN->model;
+    
+    y = malloc(NN->numLayers*sizeof(double *));
+    if (y == NULL)  return CD_OUT_OF_MEMORY_ERROR;
+    for (l = 0; l < NN->numLayers; l++)  y[l] = malloc(NN->layerSize[l]*sizeof(double));
+    for (l = 0; l < NN->numLayers; l++)  {
+    if (y[l] == NULL)  {
+        for (l = 0; l < NN->numLayers; l++)  free(y[l]);
+        free(y);
+        return CD_OUT_OF_MEMORY_ERROR;
+    }}
+    
+    for (s = 0; s < numSamples; s++)  {
+        y[0][0] = 1.;
+        for (i = 0; i < NN->layerSize[1]; i++)  y[1][i] = snapToGrid(inputs[(long) s*NN->layerSize[1] + i], activationQuantization);
+        for (l = 2; l < NN->numLayers; l++)  {
+            for (i = 0; i < NN->layerSize[l]; i++)  {
+                y[l][i] = 0.;
+                for (li = 0; li < NN->numLayerInputs[l]; li++)  {
+                    l0 = NN->layerInputs[l][li];
+                    numIn = NN->layerSize[l0];
+                    if (NN->n0 != NULL)  {
+                        w = NN->weights[l][li];
+                        for (j = model->rowStart[l][li][i]; j < model->rowStart[l][li][i+1]; j++)  y[l][i] += w[j]*y[l0][NN->n0[l][li][j]];     }
+                    else  {
+                        w = NN->weights[l][li] + (long) i*numIn;
+                        for (j = 0; j < numIn; j++)  y[l][i] += w[j]*y[l0][j];
+            }   }   }
+            applyAF(model, NN->layerAFs[l], y[l], NN->layerSize[l]);
+            if (l < NN->numLayers-1)  {
+                for (i = 0; i < NN->layerSize[l]; i++)  y[l][i] = snapToGrid(y[l][i], activationQuantization);
+        }   }
+        memcpy(outputs + (long) s*numOutputs, y[NN->numLayers-1], numOutputs*sizeof(double));
+    }
+    
+    for (l = 0; l < NN->numLayers; l++)  free(y[l]);
+    free(y);
+    
+    return 0;
+}
+
+    // Puts a network on a grid of weightBits-bit weights and activationBits-bit activations, wide enough that no
+    // activation is clipped, and quantizes it with the same quantizationTypes.  The integer kernels then compute
+    // the same sums as gridOutputs() exactly, so the outputs have to be within the output layer's quantization step.
+
+int benchmarkQuantizedGrid(CDNN *NN, const char *kind, const char *caseName, int weightBits, int activationBits, const double *inputs)
+{
+    quantizationType weightQuantization = { QUANTIZE, weightBits, 1 << (weightBits-1), 0. };
+    quantizationType activationQuantization = { QUANTIZE, activationBits, 1 << (activationBits-1), 0. };
+    int l, li, rtrn, maxQ;
+    long j, numWeights;
+    double *layerMax, *reference, maxWeight = 0., maxActivation = 0., maxDeviation, outputStep;
+    char label[16];
+    
+    maxQ = (weightBits <= 8) ? CDNN_Q_INT8_MAX : CDNN_Q_INT16_MAX;
+    for (l = 0; l < NN->numLayers; l++)  {
+    for (li = 0; li < NN->numLayerInputs[l]; li++)  {
+        if (NN->n0 != NULL)  numWeights = NN->wSize[l][li];
+        else  numWeights = (long) NN->layerSize[l]*NN->layerSize[NN->layerInputs[l][li]];
+        for (j = 0; j < numWeights; j++)  if (fabs(NN->weights[l][li][j]) > maxWeight)  maxWeight = fabs(NN->weights[l][li][j]);
+    }}
+    weightQuantization.range = maxWeight/maxQ*((1 << weightBits) - 1);
+    snapWeights(NN, weightQuantization);
+    
+    layerMax = malloc(NN->numLayers*sizeof(double));
+    reference = malloc(F32_SAMPLES*NN->layerSize[NN->numLayers-1]*sizeof(double));
+    rtrn = ((layerMax == NULL) || (reference == NULL)) ? CD_OUT_OF_MEMORY_ERROR : 0;
+    if (rtrn == 0)  rtrn = calibrateLayers(NN, inputs, F32_SAMPLES, SAMPLE_FEATURE_ARRAY, layerMax);
+    if (rtrn == 0)  {
+        for (l = 1; l < NN->numLayers-1; l++)  if (layerMax[l] > maxActivation)  maxActivation = layerMax[l];
+        activationQuantization.range = 1.25*maxActivation/((1 << (activationBits-1)) - 1)*((1 << activationBits) - 1);
+        rtrn = gridOutputs(NN, inputs, F32_SAMPLES, activationQuantization, reference);     }
+    if (rtrn == 0)  rtrn = CDNN_make_quantized(NN, weightQuantization, activationQuantization, NULL, 0, SAMPLE_FEATURE_ARRAY);
+    if (rtrn == 0)  rtrn = CDNN_quantized_deviation(NN, inputs, reference, F32_SAMPLES, SAMPLE_FEATURE_ARRAY, &maxDeviation);
+    free(layerMax);
+    free(reference);
+    if (rtrn != 0)  {
+        printf("  couldn't quantize the %s network onto a %s grid (%i)\n", kind, caseName, rtrn);
+        return 1;     }
+    
+    outputStep = NN->model.yScaleQ[NN->numLayers-1];
+    sprintf(label, "%s:", caseName);
+    printf("    %-8s largest difference from the grid network's sample outputs %.3g (output step %.3g)\n", label, maxDeviation, outputStep);
+    record("abs", maxDeviation, "quantized.%s.%s.grid.deviation", kind, caseName);
+    if (!(maxDeviation <= outputStep))  {
+        printf("  the %s %s network's outputs are further than a quantization step from the grid network's\n", kind, caseName);
+        return 1;     }
+    
+    return 0;
+}
+
+    // int8 weights with int16 activations, int8 with int8 (from 8-bit calibrated activations) and int16 with int16;
+    // step layers are made ReLUs.  Calibrated on the samples, each output has to be within QUANT_TOLERANCE times a step
+    // of the weights plus one of the activations, relative to 1 + the largest output:  over 3x the rounding seen across
+    // random networks, and well short of the errors of a kernel that reads the wrong weights or scales.  Then each
+    // network is put on the server's grid, where the integer kernels are exact.
+
+#define QUANT_CASES 3
+#define QUANT_TOLERANCE 2.
+
+int benchmarkQuantized(void)
+{
+    const char *kinds[2] = { "dense", "sparse" }, *caseNames[QUANT_CASES] = { "int8", "int8x8", "int16" };
+    const int caseBits[QUANT_CASES] = { 8, 8, 16 }, caseActivationBits[QUANT_CASES] = { 16, 8, 16 };
+    const int caseGridActivationBits[QUANT_CASES] = { 8, 7, 16 };
+    char label[16];
+    quantizationType noQuantization = { OFF, 0, 0, 0. }, weightQuantization = { QUANTIZE, 8, 0, 0. };
+    quantizationType activationQuantization = { QUANTIZE, 8, 0, 0. };
+    char *text;
+    long numChars, i;
+    int k, c, l, rtrn, weightSparsity;
+    double *inputs, *outputs, t0, doubleTime, intTime, maxDeviation, maxOutput, tolerance;
+    CDNN NN;
+    
+    inputs = malloc(F32_INPUTS*F32_SAMPLES*sizeof(double));
+    outputs = malloc(F32_SAMPLES*sizeof(double));
+    if ((inputs == NULL) || (outputs == NULL))  {
+        printf("Out of memory\n");
+        return 1;     }
+    for (i = 0; i < F32_INPUTS*F32_SAMPLES; i++)  inputs[i] = 2.*rand01()-1.;
+    
+    printf("Running %i samples through quantized networks, calibrated on the same samples and then on the server's grid\n", F32_SAMPLES);
+    for (k = 0; k < 2; k++)  {
+        weightSparsity = (k == 0) ? NONSPARSE_WEIGHTS : SPARSE_WEIGHTS;
+        text = syntheticNetwork(8, 512, F32_INPUTS, 1, 2, weightSparsity, 1, &numChars);
+        if (text == NULL)  {
+            printf("Out of memory\n");
+            return 1;     }
+        rtrn = readNetwork(&NN, text, numChars, weightSparsity);
+        free(text);
+        if (rtrn != 0)  {
+            printf("  couldn't build the %s network (%i)\n", kinds[k], rtrn);
+            return 1;     }
+        CDNN_set_simd_level(&NN.model, CDNN_SIMD_BEST);
+        for (l = 2; l < NN.numLayers; l++)  if (NN.layerAFs[l] == STEP_AF)  NN.layerAFs[l] = RELU_AF;
+        
+        t0 = seconds();
+        run_CDNN_batch(&NN, inputs, F32_SAMPLES, SAMPLE_FEATURE_ARRAY, outputs);
+        doubleTime = seconds()-t0;
+        maxOutput = 0.;
+        for (i = 0; i < F32_SAMPLES; i++)  if (fabs(outputs[i]) > maxOutput)  maxOutput = fabs(outputs[i]);
+        printf("  %s, %.1f MB of double weights:\n", kinds[k], weightCount(&NN)*sizeof(double)*1e-6);
+        printf("    double:  %7.2f us/sample\n", doubleTime*1e6/F32_SAMPLES);
+        record("us/sample", doubleTime*1e6/F32_SAMPLES, "quantized.%s.double", kinds[k]);
+        
+        for (c = 0; c < QUANT_CASES; c++)  {
+            weightQuantization.bits = caseBits[c];
+            rtrn = CDNN_make_quantized(&NN, weightQuantization, (c == 1) ? activationQuantization : noQuantization,
+                    inputs, F32_SAMPLES, SAMPLE_FEATURE_ARRAY);
+            if (rtrn == 0)  {
+                t0 = seconds();
+                rtrn = run_CDNN_batch_quantized(&NN, inputs, F32_SAMPLES, SAMPLE_FEATURE_ARRAY, outputs);
+                intTime = seconds()-t0;     }
+            if (rtrn == 0)  rtrn = CDNN_quantized_deviation(&NN, inputs, NULL, F32_SAMPLES, SAMPLE_FEATURE_ARRAY, &maxDeviation);
+            if (rtrn != 0)  {
+                free_CDNN(&NN);
+                return 1;     }
+            tolerance = QUANT_TOLERANCE*(pow(2., 1-caseBits[c]) + pow(2., 1-caseActivationBits[c]))*(1. + maxOutput);
+            sprintf(label, "%s:", caseNames[c]);
+            printf("    %-8s %7.2f us/sample   (%.1fx), %.1f MB of weights, largest difference in the outputs %.3g (tolerance %.3g)\n",
+                    label, intTime*1e6/F32_SAMPLES, doubleTime/intTime, weightCount(&NN)*(caseBits[c]/8)*1e-6, maxDeviation, tolerance);
+            record("us/sample", intTime*1e6/F32_SAMPLES, "quantized.%s.%s", kinds[k], caseNames[c]);
+            record("abs", maxDeviation, "quantized.%s.%s.deviation", kinds[k], caseNames[c]);
+            if (!(maxDeviation <= tolerance))  {
+                printf("  the %s %s network's outputs are further from the double-precision ones than its steps allow\n",
+                        kinds[k], caseNames[c]);
+                free_CDNN(&NN);
+                return 1;
+        }   }
+        
+        for (c = 0; c < QUANT_CASES; c++)  {
+        if (benchmarkQuantizedGrid(&NN, kinds[k], caseNames[c], caseBits[c], caseGridActivationBits[c], inputs) != 0)  {
+            free_CDNN(&NN);
+            return 1;
+        }}
+        
+        free_CDNN(&NN);
+    }
+    
+    free(inputs);
+    free(outputs);
+    
+    return 0;
+}
+
+
+    // Each SIMD level's denseMV(), denseMM() and sparseMV() against the scalar kernels, on random weights in sizes that
+    // leave tails, and on a full tile and a partial one.  They may differ only in the rounding of the sums, so each
+    // output has to be within KERNEL_TOLERANCE of the scalar one, relative to the sum of the absolute values that went into it,
+    // or KERNEL_TOLERANCE_F32 for the single-precision kernels.  The integer dotI*MM() kernels, which have two more levels
+    // for AVX512BW and VNNI, have to give exactly the scalar sums, on rows of every length up to KERNEL_IN.
+
+#define KERNEL_OUT 37
+#define KERNEL_IN 131
+#define KERNEL_STRIDE_Q 135
+#define KERNEL_TOLERANCE 1e-12
+#define KERNEL_TOLERANCE_F32 1e-5
+
+long kernelMismatches(const double *y, const double *yRef, const double *absSum, int n, int stride, int numTile)
+{
+    int i, s;
+    long numMismatches = 0;
+    
+    for (i = 0; i < n; i++)  {
+    for (s = 0; s < numTile; s++)  {
+        if (!(fabs(y[i*stride+s] - yRef[i*stride+s]) <= KERNEL_TOLERANCE*absSum[i*stride+s]))  numMismatches++;
+    }}
+    
+    return numMismatches;
+}
+
+long kernelMismatchesF32(const float *y, const float *yRef, const double *absSum, int n, int stride, int numTile)
+{
+    int i, s;
+    long numMismatches = 0;
+    
+    for (i = 0; i < n; i++)  {
+    for (s = 0; s < numTile; s++)  {
+        if (!(fabs((double) y[i*stride+s] - yRef[i*stride+s]) <= KERNEL_TOLERANCE_F32*absSum[i*stride+s]))  numMismatches++;
+    }}
+    
+    return numMismatches;
+}
+
+int checkKernels(void)
+{
+    const int tileSizes[2] = { CDNN_BATCH_TILE, 29 };
+    int level, maxLevel = CDNN_max_simd_level(), t, i, j, s, n, numTile, rowStart[KERNEL_OUT+1], *n0;
+    long numMismatches, numOutputs;
+    long long sums[CDNN_BATCH_TILE], sumsRef[CDNN_BATCH_TILE];
+    double *w, *x, *y, *yRef, *absSum;
+    float *wF, *xF, *yF, *yRefF;
+    signed char *w8, *x8;
+    short *w16, *x16;
+    
+    w = malloc(KERNEL_OUT*KERNEL_IN*sizeof(double));
+    x = malloc(KERNEL_IN*CDNN_BATCH_TILE*sizeof(double));
+    y = malloc(KERNEL_OUT*CDNN_BATCH_TILE*sizeof(double));
+    yRef = malloc(KERNEL_OUT*CDNN_BATCH_TILE*sizeof(double));
+    absSum = malloc(KERNEL_OUT*CDNN_BATCH_TILE*sizeof(double));
+    n0 = malloc(KERNEL_OUT*KERNEL_IN*sizeof(int));
+    wF = malloc(KERNEL_OUT*KERNEL_IN*sizeof(float));
+    xF = malloc(KERNEL_IN*CDNN_BATCH_TILE*sizeof(float));
+    yF = malloc(KERNEL_OUT*CDNN_BATCH_TILE*sizeof(float));
+    yRefF = malloc(KERNEL_OUT*CDNN_BATCH_TILE*sizeof(float));
+    w8 = malloc(KERNEL_IN*sizeof(signed char));
+    x8 = malloc(KERNEL_STRIDE_Q*CDNN_BATCH_TILE*sizeof(signed char));
+    w16 = malloc(KERNEL_IN*sizeof(short));
+    x16 = malloc(KERNEL_STRIDE_Q*CDNN_BATCH_TILE*sizeof(short));
+    if ((w == NULL) || (x == NULL) || (y == NULL) || (yRef == NULL) || (absSum == NULL) || (n0 == NULL) || (wF == NULL) || (xF == NULL)
+            || (yF == NULL) || (yRefF == NULL) || (w8 == NULL) || (x8 == NULL) || (w16 == NULL) || (x16 == NULL))  {
+        printf("Out of memory\n");
+        return 1;     }
+    
+    for (j = 0; j < KERNEL_OUT*KERNEL_IN; j++)  wF[j] = (float) (w[j] = 2.*rand01()-1.);
+    for (j = 0; j < KERNEL_IN*CDNN_BATCH_TILE; j++)  xF[j] = (float) (x[j] = 2.*rand01()-1.);
+    
+        // the integer weights and activations span the full range that CDNN_make_quantized() gives them
+    for (j = 0; j < KERNEL_IN; j++)  {
+        w8[j] = (signed char) (rand() % (2*CDNN_Q_INT8_MAX+1) - CDNN_Q_INT8_MAX);
+        w16[j] = (short) (rand() % (2*CDNN_Q_INT16_MAX+1) - CDNN_Q_INT16_MAX);     }
+    for (j = 0; j < KERNEL_STRIDE_Q*CDNN_BATCH_TILE; j++)  {
+        x8[j] = (signed char) (rand() % (2*CDNN_Q_INT8_MAX+1) - CDNN_Q_INT8_MAX);
+        x16[j] = (short) (rand() % (2*CDNN_Q_INT16_MAX+1) - CDNN_Q_INT16_MAX);     }
+    
+        // the sparse rows take their weights from w[], with anywhere from none to KERNEL_IN random inputs each
+    rowStart[0] = 0;
+    for (i = 0; i < KERNEL_OUT; i++)  {
+        rowStart[i+1] = rowStart[i] + rand() % (KERNEL_IN+1);
+        for (j = rowStart[i]; j < rowStart[i+1]; j++)  n0[j] = rand() % KERNEL_IN;
+    }
+    
+    printf("Checking the SIMD kernels against the scalar ones\n");
+    for (level = CDNN_SIMD_SSE2; level <= maxLevel; level++)  {
+        numMismatches = numOutputs = 0;
+        
+        for (i = 0; i < KERNEL_OUT; i++)  {
+            y[i] = yRef[i] = 2.*rand01()-1.;
+            absSum[i] = fabs(y[i]);
+            for (j = 0; j < KERNEL_IN; j++)  absSum[i] += fabs(w[i*KERNEL_IN+j]*x[j]);
+        }
+        kernels[CDNN_SIMD_SCALAR].denseMV(w, x, yRef, KERNEL_OUT, KERNEL_IN);
+        kernels[level].denseMV(w, x, y, KERNEL_OUT, KERNEL_IN);
+        numMismatches += kernelMismatches(y, yRef, absSum, KERNEL_OUT, 1, 1);
+        numOutputs += KERNEL_OUT;
+        
+        for (i = 0; i < KERNEL_OUT; i++)  {
+            y[i] = yRef[i] = 2.*rand01()-1.;
+            absSum[i] = fabs(y[i]);
+            for (j = rowStart[i]; j < rowStart[i+1]; j++)  absSum[i] += fabs(w[j]*x[n0[j]]);
+        }
+        kernels[CDNN_SIMD_SCALAR].sparseMV(w, n0, rowStart, x, yRef, KERNEL_OUT);
+        kernels[level].sparseMV(w, n0, rowStart, x, y, KERNEL_OUT);
+        numMismatches += kernelMismatches(y, yRef, absSum, KERNEL_OUT, 1, 1);
+        numOutputs += KERNEL_OUT;
+        
+        for (t = 0; t < 2; t++)  {
+            numTile = tileSizes[t];
+            for (i = 0; i < KERNEL_OUT; i++)  {
+            for (s = 0; s < CDNN_BATCH_TILE; s++)  {
+                y[i*CDNN_BATCH_TILE+s] = yRef[i*CDNN_BATCH_TILE+s] = 2.*rand01()-1.;
+                absSum[i*CDNN_BATCH_TILE+s] = fabs(y[i*CDNN_BATCH_TILE+s]);
+                for (j = 0; j < KERNEL_IN; j++)  absSum[i*CDNN_BATCH_TILE+s] += fabs(w[i*KERNEL_IN+j]*x[j*CDNN_BATCH_TILE+s]);
+            }}
+            kernels[CDNN_SIMD_SCALAR].denseMM(w, x, yRef, KERNEL_OUT, KERNEL_IN, numTile);
+            kernels[level].denseMM(w, x, y, KERNEL_OUT, KERNEL_IN, numTile);
+            numMismatches += kernelMismatches(y, yRef, absSum, KERNEL_OUT, CDNN_BATCH_TILE, numTile);
+            numOutputs += KERNEL_OUT*numTile;
+        }
+        
+        printf("  SIMD level %i:  %li of %li outputs differ from the scalar kernels'\n", level, numMismatches, numOutputs);
+        record("count", numMismatches, "kernels.simd%i.mismatches", level);
+        if (numMismatches > 0)  return 1;
+    }
+    
+    for (level = CDNN_SIMD_SSE2; level <= maxLevel; level++)  {
+        numMismatches = numOutputs = 0;
+        
+        for (i = 0; i < KERNEL_OUT; i++)  {
+            yF[i] = yRefF[i] = (float) (y[i] = 2.*rand01()-1.);
+            absSum[i] = fabs(y[i]);
+            for (j = 0; j < KERNEL_IN; j++)  absSum[i] += fabs(w[i*KERNEL_IN+j]*x[j]);
+        }
+        kernels[CDNN_SIMD_SCALAR].denseMVf(wF, xF, yRefF, KERNEL_OUT, KERNEL_IN);
+        kernels[level].denseMVf(wF, xF, yF, KERNEL_OUT, KERNEL_IN);
+        numMismatches += kernelMismatchesF32(yF, yRefF, absSum, KERNEL_OUT, 1, 1);
+        numOutputs += KERNEL_OUT;
+        
+        for (i = 0; i < KERNEL_OUT; i++)  {
+            yF[i] = yRefF[i] = (float) (y[i] = 2.*rand01()-1.);
+            absSum[i] = fabs(y[i]);
+            for (j = rowStart[i]; j < rowStart[i+1]; j++)  absSum[i] += fabs(w[j]*x[n0[j]]);
+        }
+        kernels[CDNN_SIMD_SCALAR].sparseMVf(wF, n0, rowStart, xF, yRefF, KERNEL_OUT);
+        kernels[level].sparseMVf(wF, n0, rowStart, xF, yF, KERNEL_OUT);
+        numMismatches += kernelMismatchesF32(yF, yRefF, absSum, KERNEL_OUT, 1, 1);
+        numOutputs += KERNEL_OUT;
+        
+        for (t = 0; t < 2; t++)  {
+            numTile = tileSizes[t];
+            for (i = 0; i < KERNEL_OUT; i++)  {
+            for (s = 0; s < CDNN_BATCH_TILE; s++)  {
+                yF[i*CDNN_BATCH_TILE+s] = yRefF[i*CDNN_BATCH_TILE+s] = (float) (y[i*CDNN_BATCH_TILE+s] = 2.*rand01()-1.);
+                absSum[i*CDNN_BATCH_TILE+s] = fabs(y[i*CDNN_BATCH_TILE+s]);
+                for (j = 0; j < KERNEL_IN; j++)  absSum[i*CDNN_BATCH_TILE+s] += fabs(w[i*KERNEL_IN+j]*x[j*CDNN_BATCH_TILE+s]);
+            }}
+            kernels[CDNN_SIMD_SCALAR].denseMMf(wF, xF, yRefF, KERNEL_OUT, KERNEL_IN, numTile);
+            kernels[level].denseMMf(wF, xF, yF, KERNEL_OUT, KERNEL_IN, numTile);
+            numMismatches += kernelMismatchesF32(yF, yRefF, absSum, KERNEL_OUT, CDNN_BATCH_TILE, numTile);
+            numOutputs += KERNEL_OUT*numTile;
+        }
+        
+        printf("  SIMD level %i:  %li of %li single-precision outputs differ from the scalar kernels'\n", level, numMismatches, numOutputs);
+        record("count", numMismatches, "kernels.simd%i.f32.mismatches", level);
+        if (numMismatches > 0)  return 1;
+    }
+    
+    for (level = CDNN_SIMD_SSE2; level <= quantKernelRow(maxLevel); level++)  {
+        numMismatches = numOutputs = 0;
+        
+        for (n = 0; n <= KERNEL_IN; n++)  {
+        for (t = 0; t < 2; t++)  {
+            numTile = tileSizes[t];
+            quantKernels[CDNN_SIMD_SCALAR].dotI8MM(w8, x16, KERNEL_STRIDE_Q, n, numTile, sumsRef);
+            quantKernels[level].dotI8MM(w8, x16, KERNEL_STRIDE_Q, n, numTile, sums);
+            for (s = 0; s < numTile; s++)  numMismatches += (sums[s] != sumsRef[s]);
+            quantKernels[CDNN_SIMD_SCALAR].dotI16MM(w16, x16, KERNEL_STRIDE_Q, n, numTile, sumsRef);
+            quantKernels[level].dotI16MM(w16, x16, KERNEL_STRIDE_Q, n, numTile, sums);
+            for (s = 0; s < numTile; s++)  numMismatches += (sums[s] != sumsRef[s]);
+            quantKernels[CDNN_SIMD_SCALAR].dotI8x8MM(w8, x8, KERNEL_STRIDE_Q, n, numTile, sumsRef);
+            quantKernels[level].dotI8x8MM(w8, x8, KERNEL_STRIDE_Q, n, numTile, sums);
+            for (s = 0; s < numTile; s++)  numMismatches += (sums[s] != sumsRef[s]);
+            numOutputs += 3*numTile;
+        }}
+        
+        printf("  integer kernel level %i:  %li of %li sums differ from the scalar kernels'\n", level, numMismatches, numOutputs);
+        record("count", numMismatches, "kernels.quant%i.mismatches", level);
+        if (numMismatches > 0)  return 1;
+    }
+    
+    free(w);
+    free(x);
+    free(y);
+    free(yRef);
+    free(absSum);
+    free(n0);
+    free(wF);
+    free(xF);
+    free(yF);
+    free(yRefF);
+    free(w8);
+    free(x8);
+    free(w16);
+    free(x16);
+    
+    return 0;
+}
+
+
+    // run_CDNN() one sample at a time, timing each call for its latency percentiles and the whole loop for its throughput,
+    // then run_CDNN_batch() over the same samples, on dense and sparse networks of the size set on the command line.
+    // The loop is run again with the per-layer profile on, for its overhead and the layer that takes the longest.
+
+#define RUN_SAMPLES 4096
+#define RUN_INPUTS 64
+
+int compareDoubles(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+int benchmarkRun(void)
+{
+    const char *kinds[2] = { "dense", "sparse" };
+    char *text;
+    long numChars, i;
+    int k, l, s, rtrn, weightSparsity, slowestLayer;
+    long long totalNs;
+    double *inputs, *outputs, *latencies, t0, t1, loopTime, batchTime, profiledTime, slowestShare, nsPerMAC;
+    CDNN NN;
+    
+    inputs = malloc(RUN_INPUTS*RUN_SAMPLES*sizeof(double));
+    outputs = malloc(RUN_SAMPLES*sizeof(double));
+    latencies = malloc(RUN_SAMPLES*sizeof(double));
+    if ((inputs == NULL) || (outputs == NULL) || (latencies == NULL))  {
+        printf("Out of memory\n");
+        return 1;     }
+    for (i = 0; i < RUN_INPUTS*RUN_SAMPLES; i++)  inputs[i] = 2.*rand01()-1.;
+    
+    printf("Running %i samples through %i-layer networks up to %i neurons wide, each layer reading up to %i others\n",
+            RUN_SAMPLES, benchLayers, benchWidth, benchFanIn);
+    for (k = 0; k < 2; k++)  {
+        weightSparsity = (k == 0) ? NONSPARSE_WEIGHTS : SPARSE_WEIGHTS;
+        text = syntheticNetwork(benchLayers, benchWidth, RUN_INPUTS, 1, benchFanIn, weightSparsity, 1, &numChars);
+        if (text == NULL)  {
+            printf("Out of memory\n");
+            return 1;     }
+        rtrn = readNetwork(&NN, text, numChars, weightSparsity);
+        free(text);
+        if (rtrn != 0)  {
+            printf("  couldn't build the %s network (%i)\n", kinds[k], rtrn);
+            return 1;     }
+        
+        t0 = seconds();
+        for (s = 0; s < RUN_SAMPLES; s++)  {
+            t1 = seconds();
+            outputs[s] = run_CDNN(&NN, inputs + s*RUN_INPUTS)[0];
+            latencies[s] = seconds()-t1;     }
+        loopTime = seconds()-t0;
+        t0 = seconds();
+        run_CDNN_batch(&NN, inputs, RUN_SAMPLES, SAMPLE_FEATURE_ARRAY, outputs);
+        batchTime = seconds()-t0;
+        qsort(latencies, RUN_SAMPLES, sizeof(double), compareDoubles);
+        
+        if (CDNN_profile(&NN, 1) != 0)  {
+            printf("Out of memory\n");
+            return 1;     }
+        t0 = seconds();
+        for (s = 0; s < RUN_SAMPLES; s++)  run_CDNN(&NN, inputs + s*RUN_INPUTS);
+        profiledTime = seconds()-t0;
+        totalNs = 0;
+        slowestLayer = 2;
+        for (l = 2; l < NN.numLayers; l++)  {
+            totalNs += NN.profile[l].ns;
+            if (NN.profile[l].ns > NN.profile[slowestLayer].ns)  slowestLayer = l;     }
+        slowestShare = (double) NN.profile[slowestLayer].ns/totalNs;
+        nsPerMAC = (double) NN.profile[slowestLayer].ns/NN.profile[slowestLayer].MACs;
+        CDNN_profile(&NN, 0);
+        
+        printf("  %s, %li weights:\n", kinds[k], weightCount(&NN));
+        printf("    run_CDNN():        %7.2f us median, %7.2f us 99th percentile, %9.0f samples/s\n",
+                latencies[RUN_SAMPLES/2]*1e6, latencies[RUN_SAMPLES*99/100]*1e6, RUN_SAMPLES/loopTime);
+        printf("    run_CDNN_batch():  %9.0f samples/s   (%.1fx)\n", RUN_SAMPLES/batchTime, loopTime/batchTime);
+        printf("    profiled:          %7.1f%% slower; layer %i takes %.0f%% of the time, %.2f ns per multiply-accumulate\n",
+                (profiledTime/loopTime-1.)*100., slowestLayer, slowestShare*100., nsPerMAC);
+        record("percent", (profiledTime/loopTime-1.)*100., "run.%s.profile.overhead", kinds[k]);
+        record("us", latencies[RUN_SAMPLES/2]*1e6, "run.%s.latency.p50", kinds[k]);
+        record("us", latencies[RUN_SAMPLES*99/100]*1e6, "run.%s.latency.p99", kinds[k]);
+        record("samples/s", RUN_SAMPLES/loopTime, "run.%s.throughput", kinds[k]);
+        record("samples/s", RUN_SAMPLES/batchTime, "run.%s.batch.throughput", kinds[k]);
+        
+        free_CDNN(&NN);
+    }
+    
+    free(inputs);
+    free(outputs);
+    free(latencies);
+    
+    return 0;
+}
+
+
+    // Single samples through wide networks whose layers read from several others, on one thread and on a pool.
+    // The outputs should match bit for bit.
+
+#define PARALLEL_SAMPLES 256
+#define PARALLEL_INPUTS 256
+
+int benchmarkParallel(void)
+{
+    const char *kinds[2] = { "dense", "sparse" };
+    char *text;
+    long numChars, i;
+    int k, s, rtrn, weightSparsity, numMismatched = 0;
+    double *inputs, *outputs[2], t0, serialTime, parallelTime;
+    CDNN NN;
+    CDNN_pool *pool;
+    
+    inputs = malloc(PARALLEL_INPUTS*PARALLEL_SAMPLES*sizeof(double));
+    outputs[0] = malloc(PARALLEL_SAMPLES*sizeof(double));
+    outputs[1] = malloc(PARALLEL_SAMPLES*sizeof(double));
+    pool = CDNN_pool_init(0);
+    if ((inputs == NULL) || (outputs[0] == NULL) || (outputs[1] == NULL) || (pool == NULL))  {
+        printf("Out of memory\n");
+        return 1;     }
+    for (i = 0; i < PARALLEL_INPUTS*PARALLEL_SAMPLES; i++)  inputs[i] = 2.*rand01()-1.;
+    
+    printf("Running %i samples one at a time through 12-layer networks up to 1024 neurons wide, on 1 and %i threads\n",
+            PARALLEL_SAMPLES, CDNN_pool_threads(pool));
+    for (k = 0; k < 2; k++)  {
+        weightSparsity = (k == 0) ? NONSPARSE_WEIGHTS : SPARSE_WEIGHTS;
+        text = syntheticNetwork(12, 1024, PARALLEL_INPUTS, 16, 3, weightSparsity, 1, &numChars);
+        if (text == NULL)  {
+            printf("Out of memory\n");
+            return 1;     }
+        rtrn = readNetwork(&NN, text, numChars, weightSparsity);
+        free(text);
+        if (rtrn != 0)  {
+            printf("  couldn't build the %s network (%i)\n", kinds[k], rtrn);
+            return 1;     }
+        
+        t0 = seconds();
+        for (s = 0; s < PARALLEL_SAMPLES; s++)  outputs[0][s] = run_CDNN(&NN, inputs + s*PARALLEL_INPUTS)[0];
+        serialTime = seconds()-t0;
+        t0 = seconds();
+        for (s = 0; s < PARALLEL_SAMPLES; s++)  outputs[1][s] = run_CDNN_pool(&NN, pool, inputs + s*PARALLEL_INPUTS)[0];
+        parallelTime = seconds()-t0;
+        for (s = 0; s < PARALLEL_SAMPLES; s++)  numMismatched += (memcmp(&outputs[0][s], &outputs[1][s], sizeof(double)) != 0);
+        
+        printf("  %s, %li weights:\n", kinds[k], weightCount(&NN));
+        printf("    run_CDNN():       %8.2f us/sample\n", serialTime*1e6/PARALLEL_SAMPLES);
+        printf("    run_CDNN_pool():  %8.2f us/sample   (%.1fx)\n", parallelTime*1e6/PARALLEL_SAMPLES, serialTime/parallelTime);
+        record("us/sample", serialTime*1e6/PARALLEL_SAMPLES, "parallel.%s.serial", kinds[k]);
+        record("us/sample", parallelTime*1e6/PARALLEL_SAMPLES, "parallel.%s.pool", kinds[k]);
+        
+        free_CDNN(&NN);
+    }
+    if (numMismatched > 0)  printf("    %i samples differ\n", numMismatched);
+    
+    CDNN_pool_free(pool);
+    free(inputs);
+    free(outputs[0]);
+    free(outputs[1]);
+    
+    return (numMismatched > 0);
+}
+
+
+    // Sigmoid and tanh layers with the libm functions and with their polynomial approximations
+
+int benchmarkActivations(void)
+{
+    int l, rtrn;
+    long numChars, i;
+    char *text;
+    double *inputs, *outputs[2], t0, exactTime, fastTime, maxDeviation = 0.;
+    CDNN NN;
+    
+    inputs = malloc(F32_INPUTS*F32_SAMPLES*sizeof(double));
+    outputs[0] = malloc(F32_SAMPLES*sizeof(double));
+    outputs[1] = malloc(F32_SAMPLES*sizeof(double));
+    text = syntheticNetwork(8, 512, F32_INPUTS, 1, 1, SPARSE_WEIGHTS, 1, &numChars);
+    if ((inputs == NULL) || (outputs[0] == NULL) || (outputs[1] == NULL) || (text == NULL))  {
+        printf("Out of memory\n");
+        return 1;     }
+    for (i = 0; i < F32_INPUTS*F32_SAMPLES; i++)  inputs[i] = 2.*rand01()-1.;
+    
+    rtrn = readNetwork(&NN, text, numChars, SPARSE_WEIGHTS);
+    free(text);
+    if (rtrn != 0)  {
+        printf("Couldn't build the activation function network (%i)\n", rtrn);
+        return 1;     }
+    
+        // every layer after the inputs is sigmoid or tanh, alternately
+    for (l = 2; l < NN.numLayers; l++)  NN.layerAFs[l] = (l % 2 == 0) ? SIGMOID_AF : TANH_AF;
+    
+    CDNN_set_exact_activations(&NN.model, 1);
+    t0 = seconds();
+    run_CDNN_batch(&NN, inputs, F32_SAMPLES, SAMPLE_FEATURE_ARRAY, outputs[0]);
+    exactTime = seconds()-t0;
+    CDNN_set_exact_activations(&NN.model, 0);
+    t0 = seconds();
+    run_CDNN_batch(&NN, inputs, F32_SAMPLES, SAMPLE_FEATURE_ARRAY, outputs[1]);
+    fastTime = seconds()-t0;
+    for (i = 0; i < F32_SAMPLES; i++)  {
+        if (fabs(outputs[0][i] - outputs[1][i]) > maxDeviation)  maxDeviation = fabs(outputs[0][i] - outputs[1][i]);     }
+    
+    printf("Running %i samples through sigmoid and tanh layers\n", F32_SAMPLES);
+    printf("    libm:         %7.2f us/sample\n", exactTime*1e6/F32_SAMPLES);
+    printf("    polynomial:   %7.2f us/sample   (%.1fx), largest difference in the outputs %.3g\n",
+            fastTime*1e6/F32_SAMPLES, exactTime/fastTime, maxDeviation);
+    record("us/sample", exactTime*1e6/F32_SAMPLES, "activations.libm");
+    record("us/sample", fastTime*1e6/F32_SAMPLES, "activations.polynomial");
+    record("abs", maxDeviation, "activations.deviation");
+    
+    free_CDNN(&NN);
+    free(inputs);
+    free(outputs[0]);
+    free(outputs[1]);
+    
+    return 0;
+}
+
+
+    // Batches through a deep network with the tile buffers sharing memory as planned, and with a buffer for each layer
+    // (set up here, since the library always plans them).  The outputs should match bit for bit.
+
+int benchmarkActivationPlan(void)
+{
+    int l, rtrn, numMismatched = 0;
+    long numChars, numNeurons, i;
+    char *text;
+    double *inputs, *outputs[2], t0, plannedTime, separateTime;
+    CDNN NN;
+    CDNN_context ctx;
+    
+    inputs = malloc(F32_INPUTS*F32_SAMPLES*sizeof(double));
+    outputs[0] = malloc(F32_SAMPLES*sizeof(double));
+    outputs[1] = malloc(F32_SAMPLES*sizeof(double));
+    text = syntheticNetwork(32, 512, F32_INPUTS, 1, 2, NONSPARSE_WEIGHTS, 1, &numChars);
+    if ((inputs == NULL) || (outputs[0] == NULL) || (outputs[1] == NULL) || (text == NULL))  {
+        printf("Out of memory\n");
+        return 1;     }
+    for (i = 0; i < F32_INPUTS*F32_SAMPLES; i++)  inputs[i] = 2.*rand01()-1.;
+    
+    rtrn = readNetwork(&NN, text, numChars, NONSPARSE_WEIGHTS);
+    free(text);
+    if (rtrn != 0)  {
+        printf("Couldn't build the activation plan network (%i)\n", rtrn);
+        return 1;     }
+    CDNN_set_simd_level(&NN.model, CDNN_SIMD_BEST);
+    
+    if (CDNN_context_init(&ctx, &NN.model) != 0)  {
+        printf("Out of memory\n");
+        return 1;     }
+    run_CDNN_batch_ctx(&NN.model, &ctx, inputs, CDNN_BATCH_TILE, SAMPLE_FEATURE_ARRAY, outputs[0]);
+    t0 = seconds();
+    run_CDNN_batch_ctx(&NN.model, &ctx, inputs, F32_SAMPLES, SAMPLE_FEATURE_ARRAY, outputs[0]);
+    plannedTime = seconds()-t0;
+    CDNN_context_free(&ctx);
+    
+    if (CDNN_context_init(&ctx, &NN.model) != 0)  {
+        printf("Out of memory\n");
+        return 1;     }
+    ctx.ty = malloc(NN.numLayers*sizeof(double *));
+    numNeurons = 0;
+    for (l = 0; l < NN.numLayers; l++)  numNeurons += NN.layerSize[l];
+    if (ctx.ty != NULL)  ctx.ty[0] = calloc(numNeurons*CDNN_BATCH_TILE, sizeof(double));
+    if ((ctx.ty == NULL) || (ctx.ty[0] == NULL))  {
+        printf("Out of memory\n");
+        return 1;     }
+    for (l = 1; l < NN.numLayers; l++)  ctx.ty[l] = ctx.ty[l-1] + NN.layerSize[l-1]*CDNN_BATCH_TILE;
+    run_CDNN_batch_ctx(&NN.model, &ctx, inputs, CDNN_BATCH_TILE, SAMPLE_FEATURE_ARRAY, outputs[1]);
+    t0 = seconds();
+    run_CDNN_batch_ctx(&NN.model, &ctx, inputs, F32_SAMPLES, SAMPLE_FEATURE_ARRAY, outputs[1]);
+    separateTime = seconds()-t0;
+    CDNN_context_free(&ctx);
+    
+    for (i = 0; i < F32_SAMPLES; i++)  numMismatched += (memcmp(&outputs[0][i], &outputs[1][i], sizeof(double)) != 0);
+    
+    printf("Running %i samples through a %i-layer network\n", F32_SAMPLES, NN.numLayers);
+    printf("    a buffer per layer:  %7.2f us/sample, %7.1f kB of activations\n",
+            separateTime*1e6/F32_SAMPLES, CDNN_activation_bytes(&NN.model, 0)/1024.);
+    printf("    planned:             %7.2f us/sample, %7.1f kB of activations (%.1fx less)\n",
+            plannedTime*1e6/F32_SAMPLES, CDNN_activation_bytes(&NN.model, 1)/1024.,
+            (double) CDNN_activation_bytes(&NN.model, 0)/CDNN_activation_bytes(&NN.model, 1));
+    if (numMismatched > 0)  printf("    %i samples differ\n", numMismatched);
+    record("us/sample", separateTime*1e6/F32_SAMPLES, "plan.separate");
+    record("us/sample", plannedTime*1e6/F32_SAMPLES, "plan.planned");
+    record("bytes", CDNN_activation_bytes(&NN.model, 0), "plan.separate.bytes");
+    record("bytes", CDNN_activation_bytes(&NN.model, 1), "plan.planned.bytes");
+    
+    free_CDNN(&NN);
+    free(inputs);
+    free(outputs[0]);
+    free(outputs[1]);
+    
+    return (numMismatched > 0);
+}
+
+
+    // A dense network with linear layers, zeros in a third of its weights and some neurons that nothing reads,
+    // before and after CDNN_optimize()
+
+int benchmarkOptimize(void)
+{
+    int l, li, l0, i, rtrn;
+    long numChars, j;
+    char *text;
+    double *inputs, *outputs[2], t0, plainTime, optimizedTime, maxDeviation = 0.;
+    CDNN NN;
+    CDNN_optimize_stats stats;
+    
+    inputs = malloc(F32_INPUTS*F32_SAMPLES*sizeof(double));
+    outputs[0] = malloc(F32_SAMPLES*sizeof(double));
+    outputs[1] = malloc(F32_SAMPLES*sizeof(double));
+    text = syntheticNetwork(16, 512, F32_INPUTS, 1, 2, NONSPARSE_WEIGHTS, 1, &numChars);
+    if ((inputs == NULL) || (outputs[0] == NULL) || (outputs[1] == NULL) || (text == NULL))  {
+        printf("Out of memory\n");
+        return 1;     }
+    for (j = 0; j < F32_INPUTS*F32_SAMPLES; j++)  inputs[j] = 2.*rand01()-1.;
+    
+    rtrn = readNetwork(&NN, text, numChars, NONSPARSE_WEIGHTS);
+    free(text);
+    if (rtrn != 0)  {
+        printf("Couldn't build the network to optimize (%i)\n", rtrn);
+        return 1;     }
+    
+        // every third hidden layer is linear, and every eighth neuron of the others is read by no one
+    for (l = 2; l < NN.numLayers-1; l++)  {
+    if (l % 3 == 0)  NN.layerAFs[l] = LINEAR_AF;
+    }
+    for (l = 2; l < NN.numLayers; l++)  {
+    for (li = 0; li < NN.numLayerInputs[l]; li++)  {
+        l0 = NN.layerInputs[l][li];
+        for (j = 0; j < (long) NN.layerSize[l]*NN.layerSize[l0]; j++)  {
+            i = j % NN.layerSize[l0];
+            if ((rand() % 3 == 0) || ((l0 >= 2) && (NN.layerAFs[l0] != LINEAR_AF) && (i % 8 == 7)))  NN.weights[l][li][j] = 0.;
+    }}  }
+    
+    t0 = seconds();
+    run_CDNN_batch(&NN, inputs, F32_SAMPLES, SAMPLE_FEATURE_ARRAY, outputs[0]);
+    plainTime = seconds()-t0;
+    if (CDNN_optimize(&NN, &stats) != 0)  {
+        printf("Out of memory\n");
+        return 1;     }
+    t0 = seconds();
+    run_CDNN_batch(&NN, inputs, F32_SAMPLES, SAMPLE_FEATURE_ARRAY, outputs[1]);
+    optimizedTime = seconds()-t0;
+    for (i = 0; i < F32_SAMPLES; i++)  {
+        if (fabs(outputs[0][i] - outputs[1][i]) > maxDeviation)  maxDeviation = fabs(outputs[0][i] - outputs[1][i]);     }
+    
+    printf("Optimizing a %i-layer network:  %lli zero weights dropped, %i neurons and %i layers removed, %i layers folded\n",
+            (int) (NN.numLayers + stats.layersRemoved), stats.zeroWeights, stats.neuronsRemoved, stats.layersRemoved, stats.layersFolded);
+    printf("    before:      %9lli weights, %9lli multiply-accumulates, %7.2f us/sample\n",
+            stats.weightsBefore, stats.MACsBefore, plainTime*1e6/F32_SAMPLES);
+    printf("    after:       %9lli weights, %9lli multiply-accumulates, %7.2f us/sample   (%.1fx), stored %s\n",
+            stats.weightsAfter, stats.MACsAfter, optimizedTime*1e6/F32_SAMPLES, plainTime/optimizedTime, stats.ifSparse ? "sparse" : "dense");
+    printf("    largest difference in the outputs %.3g\n", maxDeviation);
+    record("count", stats.weightsBefore-stats.weightsAfter, "optimize.weights.removed");
+    record("count", stats.MACsBefore-stats.MACsAfter, "optimize.MACs.removed");
+    record("us/sample", plainTime*1e6/F32_SAMPLES, "optimize.before");
+    record("us/sample", optimizedTime*1e6/F32_SAMPLES, "optimize.after");
+    record("abs", maxDeviation, "optimize.deviation");
+    
+    free_CDNN(&NN);
+    free(inputs);
+    free(outputs[0]);
+    free(outputs[1]);
+    
+    return (maxDeviation > 1e-9);
+}
+
+
+    // Step-function networks run with bit-packed activations:  with binary (+-c or 0) weights that run_CDNN_bitpacked()
+    // sums with popcounts, and with general dense and sparse weights, whose biases are set so about 10% of the neurons fire
+    // (the sparse networks have biases for only some of their neurons, so more of those fire)
+
+    // sets the biases of each step and ReLU layer so the given fraction of its neurons are nonzero on the given samples
+    // (a bias is the weight from layer 0, which sparse blocks may store for only some of the neurons)
+
+int calibrateActivity(CDNN *NN, const double *inputs, int numSamples, double fraction)
+{
+    int l, li, n, s, AF;
+    long j;
+    double *preActivations, threshold;
+    
+    for (l = 2; l < NN->numLayers-1; l++)  {
+    if ((NN->layerAFs[l] == STEP_AF) || (NN->layerAFs[l] == RELU_AF))  {
+        preActivations = malloc((long) numSamples*NN->layerSize[l]*sizeof(double));
+        if (preActivations == NULL)  return 1;
+        AF = NN->layerAFs[l];
+        NN->layerAFs[l] = LINEAR_AF;
+        for (s = 0; s < numSamples; s++)  {
+            run_CDNN(NN, (double *) inputs + s*NN->layerSize[1]);
+            memcpy(preActivations + (long) s*NN->layerSize[l], NN->y[l], NN->layerSize[l]*sizeof(double));     }
+        NN->layerAFs[l] = AF;
+        qsort(preActivations, (long) numSamples*NN->layerSize[l], sizeof(double), compareDoubles);
+        j = (long) ((1.-fraction)*numSamples*NN->layerSize[l]);
+        threshold = (j > 0) ? (preActivations[j-1] + preActivations[j])/2. : preActivations[0]-1.;
+        free(preActivations);
+        
+        for (li = 0; li < NN->numLayerInputs[l]; li++)  {
+        if (NN->layerInputs[l][li] == 0)  {
+            if (NN->n0 == NULL)  {
+                for (n = 0; n < NN->layerSize[l]; n++)  NN->weights[l][li][n] -= threshold;
+            }
+            else  {
+                for (j = 0; j < NN->wSize[l][li]; j++)  NN->weights[l][li][j] -= threshold;
+                if (NN->model.denseWeights[l][li] != NULL)  {
+                    for (j = 0; j < NN->wSize[l][li]; j++)  NN->model.denseWeights[l][li][NN->nf[l][li][j]] -= threshold;
+            }   }
+    }}  }}
+    
+    return 0;
+}
+
+#define BITPACKED_SAMPLES 256
+#define BITPACKED_OUTPUTS 16
+#define BITPACKED_ACTIVE 0.1
+
+int benchmarkBitpacked(void)
+{
+    const char *kinds[3] = { "binary", "general", "sparse" };
+    char *text;
+    long numChars, j, numActive, numStep;
+    int k, l, li, s, rtrn, weightSparsity;
+    double *inputs, *outputs[2], *y, t0, plainTime, packedTime, maxDeviation = 0.;
+    CDNN NN;
+    
+    inputs = malloc(PARALLEL_INPUTS*BITPACKED_SAMPLES*sizeof(double));
+    outputs[0] = malloc(BITPACKED_OUTPUTS*BITPACKED_SAMPLES*sizeof(double));
+    outputs[1] = malloc(BITPACKED_OUTPUTS*BITPACKED_SAMPLES*sizeof(double));
+    if ((inputs == NULL) || (outputs[0] == NULL) || (outputs[1] == NULL))  {
+        printf("Out of memory\n");
+        return 1;     }
+    for (j = 0; j < PARALLEL_INPUTS*BITPACKED_SAMPLES; j++)  inputs[j] = 2.*rand01()-1.;
+    
+    printf("Running %i samples through 10-layer step-function networks 1024 neurons wide, with bit-packed activations\n", BITPACKED_SAMPLES);
+    for (k = 0; k < 3; k++)  {
+        weightSparsity = (k == 2) ? SPARSE_WEIGHTS : NONSPARSE_WEIGHTS;
+        text = syntheticNetwork(10, 1024, PARALLEL_INPUTS, BITPACKED_OUTPUTS, 2, weightSparsity, 1, &numChars);
+        if (text == NULL)  {
+            printf("Out of memory\n");
+            return 1;     }
+        rtrn = readNetwork(&NN, text, numChars, weightSparsity);
+        free(text);
+        if (rtrn != 0)  {
+            printf("  couldn't build the %s network (%i)\n", kinds[k], rtrn);
+            return 1;     }
+        
+        for (l = 2; l < NN.numLayers-1; l++)  NN.layerAFs[l] = STEP_AF;
+        if (k == 0)  {
+            for (l = 2; l < NN.numLayers; l++)  {
+            for (li = 0; li < NN.numLayerInputs[l]; li++)  {
+                for (j = 0; j < (long) NN.layerSize[l]*NN.layerSize[NN.layerInputs[l][li]]; j++)  {
+                    NN.weights[l][li][j] = (rand() % 3 == 0) ? 0. : (rand() % 2 == 0) ? 0.25 : -0.25;
+            }}  }
+        }
+        else if (calibrateActivity(&NN, inputs, 64, BITPACKED_ACTIVE) != 0)  {
+            printf("Out of memory\n");
+            return 1;     }
+        if (CDNN_make_bitpacked(&NN) != 0)  {
+            printf("Out of memory\n");
+            return 1;     }
+        
+        numActive = numStep = 0;
+        t0 = seconds();
+        for (s = 0; s < BITPACKED_SAMPLES; s++)  {
+            y = run_CDNN(&NN, inputs + s*PARALLEL_INPUTS);
+            memcpy(outputs[0] + s*BITPACKED_OUTPUTS, y, BITPACKED_OUTPUTS*sizeof(double));     }
+        plainTime = seconds()-t0;
+        for (l = 2; l < NN.numLayers-1; l++)  {
+            for (j = 0; j < NN.layerSize[l]; j++)  numActive += (NN.y[l][j] != 0.);
+            numStep += NN.layerSize[l];     }
+        t0 = seconds();
+        for (s = 0; s < BITPACKED_SAMPLES; s++)  {
+            y = run_CDNN_bitpacked(&NN, inputs + s*PARALLEL_INPUTS);
+            memcpy(outputs[1] + s*BITPACKED_OUTPUTS, y, BITPACKED_OUTPUTS*sizeof(double));     }
+        packedTime = seconds()-t0;
+        for (j = 0; j < BITPACKED_OUTPUTS*BITPACKED_SAMPLES; j++)  {
+            if (fabs(outputs[0][j] - outputs[1][j]) > maxDeviation)  maxDeviation = fabs(outputs[0][j] - outputs[1][j]);     }
+        
+        printf("  %s weights, %.0f%% of the step neurons firing:\n", kinds[k], 100.*numActive/numStep);
+        printf("    run_CDNN():            %8.2f us/sample\n", plainTime*1e6/BITPACKED_SAMPLES);
+        printf("    run_CDNN_bitpacked():  %8.2f us/sample   (%.1fx)\n", packedTime*1e6/BITPACKED_SAMPLES, plainTime/packedTime);
+        record("us/sample", plainTime*1e6/BITPACKED_SAMPLES, "bitpacked.%s.plain", kinds[k]);
+        record("us/sample", packedTime*1e6/BITPACKED_SAMPLES, "bitpacked.%s.packed", kinds[k]);
+        
+        free_CDNN(&NN);
+    }
+    printf("    largest difference in the outputs %.3g\n", maxDeviation);
+    record("abs", maxDeviation, "bitpacked.deviation");
+    
+    free(inputs);
+    free(outputs[0]);
+    free(outputs[1]);
+    
+    return (maxDeviation > 1e-9);
+}
+
+
+    // ReLU networks run event-driven, with the biases set so that 10% or 30% of the hidden neurons are nonzero
+    // (as when trained with a low maxActivationRate), and with dense and sparse weights
+
+#define EVENT_SAMPLES 256
+#define EVENT_OUTPUTS 16
+
+int benchmarkEvents(void)
+{
+    const char *kinds[3] = { "dense", "dense", "sparse" };
+    const double activity[3] = { 0.1, 0.3, 0.1 };
+    char *text;
+    long numChars, j, numActive, numHidden;
+    int k, l, s, rtrn, weightSparsity;
+    double *inputs, *outputs[2], *y, t0, plainTime, eventTime, maxDeviation = 0.;
+    CDNN NN;
+    
+    inputs = malloc(PARALLEL_INPUTS*EVENT_SAMPLES*sizeof(double));
+    outputs[0] = malloc(EVENT_OUTPUTS*EVENT_SAMPLES*sizeof(double));
+    outputs[1] = malloc(EVENT_OUTPUTS*EVENT_SAMPLES*sizeof(double));
+    if ((inputs == NULL) || (outputs[0] == NULL) || (outputs[1] == NULL))  {
+        printf("Out of memory\n");
+        return 1;     }
+    for (j = 0; j < PARALLEL_INPUTS*EVENT_SAMPLES; j++)  inputs[j] = 2.*rand01()-1.;
+    
+    printf("Running %i samples event-driven through 10-layer ReLU networks 1024 neurons wide\n", EVENT_SAMPLES);
+    for (k = 0; k < 3; k++)  {
+        weightSparsity = (k == 2) ? SPARSE_WEIGHTS : NONSPARSE_WEIGHTS;
+        text = syntheticNetwork(10, 1024, PARALLEL_INPUTS, EVENT_OUTPUTS, 2, weightSparsity, 1, &numChars);
+        if (text == NULL)  {
+            printf("Out of memory\n");
+            return 1;     }
+        rtrn = readNetwork(&NN, text, numChars, weightSparsity);
+        free(text);
+        if (rtrn != 0)  {
+            printf("  couldn't build the %s network (%i)\n", kinds[k], rtrn);
+            return 1;     }
+        
+        for (l = 2; l < NN.numLayers-1; l++)  NN.layerAFs[l] = RELU_AF;
+        if ((calibrateActivity(&NN, inputs, 64, activity[k]) != 0) || (CDNN_make_event_driven(&NN) != 0))  {
+            printf("Out of memory\n");
+            return 1;     }
+        
+        numActive = numHidden = 0;
+        t0 = seconds();
+        for (s = 0; s < EVENT_SAMPLES; s++)  {
+            y = run_CDNN(&NN, inputs + s*PARALLEL_INPUTS);
+            memcpy(outputs[0] + s*EVENT_OUTPUTS, y, EVENT_OUTPUTS*sizeof(double));     }
+        plainTime = seconds()-t0;
+        for (l = 2; l < NN.numLayers-1; l++)  {
+            for (j = 0; j < NN.layerSize[l]; j++)  numActive += (NN.y[l][j] != 0.);
+            numHidden += NN.layerSize[l];     }
+        t0 = seconds();
+        for (s = 0; s < EVENT_SAMPLES; s++)  {
+            y = run_CDNN_events(&NN, inputs + s*PARALLEL_INPUTS);
+            memcpy(outputs[1] + s*EVENT_OUTPUTS, y, EVENT_OUTPUTS*sizeof(double));     }
+        eventTime = seconds()-t0;
+        for (j = 0; j < EVENT_OUTPUTS*EVENT_SAMPLES; j++)  {
+            if (fabs(outputs[0][j] - outputs[1][j]) > maxDeviation*(1. + fabs(outputs[0][j])))
+                maxDeviation = fabs(outputs[0][j] - outputs[1][j])/(1. + fabs(outputs[0][j]));     }
+        
+        printf("  %s weights, %.0f%% of the hidden neurons nonzero:\n", kinds[k], 100.*numActive/numHidden);
+        printf("    run_CDNN():         %8.2f us/sample\n", plainTime*1e6/EVENT_SAMPLES);
+        printf("    run_CDNN_events():  %8.2f us/sample   (%.1fx), %.0f%% of the multiply-accumulates skipped\n",
+                eventTime*1e6/EVENT_SAMPLES, plainTime/eventTime, 100.*CDNN_skip_ratio(&NN.events));
+        record("us/sample", plainTime*1e6/EVENT_SAMPLES, "events.%s%.0f.plain", kinds[k], 100.*activity[k]);
+        record("us/sample", eventTime*1e6/EVENT_SAMPLES, "events.%s%.0f.events", kinds[k], 100.*activity[k]);
+        record("ratio", CDNN_skip_ratio(&NN.events), "events.%s%.0f.skipped", kinds[k], 100.*activity[k]);
+        
+        free_CDNN(&NN);
+    }
+    printf("    largest difference in the outputs, relative to 1 + |output|:  %.3g\n", maxDeviation);
+    record("rel", maxDeviation, "events.deviation");
+    
+    free(inputs);
+    free(outputs[0]);
+    free(outputs[1]);
+    
+    return (maxDeviation > 1e-9);
+}
+
+
+    // Exports networks as C, compiles them into shared libraries with the system's C compiler ($CC, or cc),
+    // and checks them against run_CDNN() in exact mode on the scalar kernels, which they should match bit for bit.
+    // The timings compare them with run_CDNN() as it normally runs.
+
+#define CODEGEN_SAMPLES 4096
+#define CODEGEN_INPUTS 32
+
+int benchmarkCodegen(void)
+{
+    const char *kinds[2] = { "dense", "sparse" };
+    char sourceName[64], libraryName[64], command[512], *text;
+    const char *compiler = getenv("CC");
+    long numChars, i;
+    int k, s, rtrn, weightSparsity, numOutputs, numMismatched;
+    double *inputs, *outputs, t0, interpretedTime, compiledTime, maxDeviation;
+    void *library;
+    void (*compiledNN)(const double *, double *);
+    CDNN NN;
+    
+    if (compiler == NULL)  compiler = "cc";
+    sprintf(sourceName, "/tmp/CDNN_codegen_%i.c", (int) getpid());
+    sprintf(libraryName, "/tmp/CDNN_codegen_%i.so", (int) getpid());
+    
+    inputs = malloc(CODEGEN_INPUTS*CODEGEN_SAMPLES*sizeof(double));
+    outputs = malloc(2*CODEGEN_SAMPLES*sizeof(double));
+    if ((inputs == NULL) || (outputs == NULL))  {
+        printf("Out of memory\n");
+        return 1;     }
+    for (i = 0; i < CODEGEN_INPUTS*CODEGEN_SAMPLES; i++)  inputs[i] = 2.*rand01()-1.;
+    
+    printf("Running %i samples through networks exported as C\n", CODEGEN_SAMPLES);
+    for (k = 0; k < 2; k++)  {
+        weightSparsity = (k == 0) ? NONSPARSE_WEIGHTS : SPARSE_WEIGHTS;
+        text = syntheticNetwork(8, 64, CODEGEN_INPUTS, 1, 2, weightSparsity, 1, &numChars);
+        if (text == NULL)  {
+            printf("Out of memory\n");
+            return 1;     }
+        rtrn = readNetwork(&NN, text, numChars, weightSparsity);
+        free(text);
+        if (rtrn == 0)  rtrn = CDNN_export_c(&NN, sourceName, "compiledNN");
+        if (rtrn != 0)  {
+            printf("  couldn't export the %s network (%i)\n", kinds[k], rtrn);
+            return 1;     }
+        numOutputs = NN.layerSize[NN.numLayers-1];
+        
+        snprintf(command, sizeof(command), "%s -O3 -march=native -ffp-contract=off -shared -fPIC -o %s %s -lm", compiler, libraryName, sourceName);
+        library = NULL;
+        if (system(command) == 0)  library = dlopen(libraryName, RTLD_NOW);
+        remove(sourceName);
+        if (library == NULL)  {
+            printf("  couldn't compile the exported code with %s; skipping\n", compiler);
+            free_CDNN(&NN);
+            break;     }
+        compiledNN = (void (*)(const double *, double *)) dlsym(library, "compiledNN");
+        
+        t0 = seconds();
+        for (s = 0; s < CODEGEN_SAMPLES; s++)  run_CDNN(&NN, inputs + s*CODEGEN_INPUTS);
+        interpretedTime = seconds()-t0;
+        t0 = seconds();
+        for (s = 0; s < CODEGEN_SAMPLES; s++)  compiledNN(inputs + s*CODEGEN_INPUTS, outputs + s*numOutputs);
+        compiledTime = seconds()-t0;
+        
+        CDNN_set_simd_level(&NN.model, CDNN_SIMD_SCALAR);
+        CDNN_set_exact_activations(&NN.model, 1);
+        numMismatched = 0;
+        maxDeviation = 0.;
+        for (s = 0; s < CODEGEN_SAMPLES; s++)  {
+            double *expected = run_CDNN(&NN, inputs + s*CODEGEN_INPUTS);
+            if (memcmp(expected, outputs + s*numOutputs, numOutputs*sizeof(double)) != 0)  numMismatched++;
+            for (i = 0; i < numOutputs; i++)  {
+            if (fabs(expected[i] - outputs[s*numOutputs+i]) > maxDeviation)  {
+                maxDeviation = fabs(expected[i] - outputs[s*numOutputs+i]);
+        }}  }
+        
+        printf("  %s:\n", kinds[k]);
+        printf("    run_CDNN():  %7.2f us/sample\n", interpretedTime*1e6/CODEGEN_SAMPLES);
+        printf("    compiled:    %7.2f us/sample   (%.1fx), with the libm activation functions\n",
+                compiledTime*1e6/CODEGEN_SAMPLES, interpretedTime/compiledTime);
+        printf("    %i samples differ from exact scalar run_CDNN(), by up to %.3g\n", numMismatched, maxDeviation);
+        record("us/sample", interpretedTime*1e6/CODEGEN_SAMPLES, "codegen.%s.run_CDNN", kinds[k]);
+        record("us/sample", compiledTime*1e6/CODEGEN_SAMPLES, "codegen.%s.compiled", kinds[k]);
+        record("count", numMismatched, "codegen.%s.mismatches", kinds[k]);
+        
+        dlclose(library);
+        remove(libraryName);
+        free_CDNN(&NN);
+        if (numMismatched > 0)  return 1;
+    }
+    
+    free(inputs);
+    free(outputs);
+    
+    return 0;
+}
+
+
+    // Saves networks with CDNN_save() and loads them back with CDNN_load(), whose outputs have to match the original's
+    // bit for bit -- also when the file was written in the other byte order, which is made by byte-swapping the network
+    // in place.  Every truncation of a file that cuts into its header or its model data has to be rejected.
+
+#define FILE_SAMPLES 1024
+#define FILE_INPUTS 32
+#define FILE_OUTPUTS 4
+
+int saveSwapped(CDNN *NN, const char *fileName)
+{
+    fileHeaderType header;
+    FILE *fileP;
+    char *modelData;
+    int rtrn = 0;
+    
+    fillFileHeader(NN, &header);
+    swapBytes(&header.endianTag, 9, 4);
+    swapBytes(&header.modelDataBytes, 1, 8);
+    
+        // the weights are swapped in place and back, and the topology (which they are indexed by) in a copy
+    modelData = malloc(NN->model.modelDataBytes);
+    if (modelData == NULL)  return CD_OUT_OF_MEMORY_ERROR;
+    swapModelData(NN);
+    memcpy(modelData, NN->model.modelData, NN->model.modelDataBytes);
+    swapModelData(NN);
+    swapBytes(modelData, topologyLength((const int *) NN->model.modelData, NN->model.numLayers), sizeof(int));
+    
+    fileP = fopen(fileName, "wb");
+    if (fileP == NULL)  rtrn = CD_FILE_ERROR;
+    else  {
+        if ((fwrite(&header, sizeof(header), 1, fileP) != 1)
+                || (fwrite(modelData, 1, NN->model.modelDataBytes, fileP) != NN->model.modelDataBytes))  rtrn = CD_FILE_ERROR;
+        if (fclose(fileP) != 0)  rtrn = CD_FILE_ERROR;
+    }
+    free(modelData);
+    
+    return rtrn;
+}
+
+    // the number of samples whose outputs differ at all from expectedOutputs
+
+int outputMismatches(CDNN *NN, const double *inputs, const double *expectedOutputs)
+{
+    int s, numMismatched = 0;
+    double *outputs;
+    
+    for (s = 0; s < FILE_SAMPLES; s++)  {
+        outputs = run_CDNN(NN, (double *) inputs + s*FILE_INPUTS);
+        if ((outputs == NULL) || (memcmp(outputs, expectedOutputs + s*FILE_OUTPUTS, FILE_OUTPUTS*sizeof(double)) != 0))  numMismatched++;
+    }
+    
+    return numMismatched;
+}
+
+int benchmarkFiles(void)
+{
+    const char *kinds[2] = { "dense", "sparse" };
+    char fileName[64], cutFileName[64], *text, *fileData;
+    long numChars, numBytes, cuts[5];
+    int k, c, s, rtrn, weightSparsity, numMismatched, numSwapMismatched, numAccepted;
+    double *inputs, *outputs, t0, loadTime;
+    FILE *fileP;
+    CDNN NN, loadedNN;
+    
+    sprintf(fileName, "/tmp/CDNN_file_%i.cdnn", (int) getpid());
+    sprintf(cutFileName, "/tmp/CDNN_file_%i_cut.cdnn", (int) getpid());
+    
+    inputs = malloc(FILE_INPUTS*FILE_SAMPLES*sizeof(double));
+    outputs = malloc(FILE_OUTPUTS*FILE_SAMPLES*sizeof(double));
+    if ((inputs == NULL) || (outputs == NULL))  {
+        printf("Out of memory\n");
+        return 1;     }
+    for (s = 0; s < FILE_INPUTS*FILE_SAMPLES; s++)  inputs[s] = 2.*rand01()-1.;
+    
+    printf("Saving and loading networks\n");
+    for (k = 0; k < 2; k++)  {
+        weightSparsity = (k == 0) ? NONSPARSE_WEIGHTS : SPARSE_WEIGHTS;
+        text = syntheticNetwork(8, 64, FILE_INPUTS, FILE_OUTPUTS, 2, weightSparsity, 1, &numChars);
+        if (text == NULL)  {
+            printf("Out of memory\n");
+            return 1;     }
+        rtrn = readNetwork(&NN, text, numChars, weightSparsity);
+        free(text);
+        if (rtrn == 0)  rtrn = CDNN_save(&NN, fileName);
+        if (rtrn != 0)  {
+            printf("  couldn't save the %s network (%i)\n", kinds[k], rtrn);
+            return 1;     }
+        for (s = 0; s < FILE_SAMPLES; s++)  memcpy(outputs + s*FILE_OUTPUTS, run_CDNN(&NN, inputs + s*FILE_INPUTS), FILE_OUTPUTS*sizeof(double));
+        
+        t0 = seconds();
+        rtrn = CDNN_load(&loadedNN, fileName);
+        loadTime = seconds()-t0;
+        if (rtrn != 0)  {
+            printf("  couldn't load the %s network (%i)\n", kinds[k], rtrn);
+            return 1;     }
+        numMismatched = outputMismatches(&loadedNN, inputs, outputs);
+        free_CDNN(&loadedNN);
+        
+            // the file's first byte, a header cut short, the whole header, and model data cut short
+        fileData = NULL;
+        numBytes = 0;
+        fileP = fopen(fileName, "rb");
+        if ((fileP != NULL) && (fseek(fileP, 0, SEEK_END) == 0) && ((numBytes = ftell(fileP)) > 0)
+                && ((fileData = malloc(numBytes)) != NULL) && (fseek(fileP, 0, SEEK_SET) == 0))  {
+            if (fread(fileData, 1, numBytes, fileP) != (size_t) numBytes)  numBytes = 0;   }
+        if (fileP != NULL)  fclose(fileP);
+        if ((fileData == NULL) || (numBytes <= CDNN_FILE_HEADER_BYTES))  {
+            printf("  couldn't read back the %s network's file\n", kinds[k]);
+            return 1;     }
+        cuts[0] = 1;
+        cuts[1] = CDNN_FILE_HEADER_BYTES/2;
+        cuts[2] = CDNN_FILE_HEADER_BYTES;
+        cuts[3] = CDNN_FILE_HEADER_BYTES + (numBytes-CDNN_FILE_HEADER_BYTES)/2;
+        cuts[4] = numBytes-1;
+        numAccepted = 0;
+        for (c = 0; c < 5; c++)  {
+            fileP = fopen(cutFileName, "wb");
+            if ((fileP == NULL) || (fwrite(fileData, 1, cuts[c], fileP) != (size_t) cuts[c]))  rtrn = CD_FILE_ERROR;
+            if ((fileP != NULL) && (fclose(fileP) != 0))  rtrn = CD_FILE_ERROR;
+            if (rtrn != 0)  {
+                printf("  couldn't write %s\n", cutFileName);
+                return 1;     }
+            rtrn = CDNN_load(&loadedNN, cutFileName);
+            if (rtrn == 0)  free_CDNN(&loadedNN);
+            if ((rtrn != CD_NN_READ_ERROR) && (rtrn != CD_FILE_ERROR))  {
+                printf("    a file cut to %li of its %li bytes loaded with code %i\n", cuts[c], numBytes, rtrn);
+                numAccepted++;     }
+            rtrn = 0;
+        }
+        remove(cutFileName);
+        free(fileData);
+        
+        rtrn = saveSwapped(&NN, fileName);
+        if (rtrn == 0)  rtrn = CDNN_load(&loadedNN, fileName);
+        if (rtrn != 0)  {
+            printf("  couldn't load the %s network in the other byte order (%i)\n", kinds[k], rtrn);
+            return 1;     }
+        numSwapMismatched = outputMismatches(&loadedNN, inputs, outputs);
+        free_CDNN(&loadedNN);
+        remove(fileName);
+        
+        printf("  %s:  %.1f kB, loaded in %.3f ms;  %i samples differ from the saved network, %i in the other byte order;  "
+                "%i of 5 truncated files accepted\n", kinds[k], numBytes/1024., loadTime*1e3, numMismatched, numSwapMismatched, numAccepted);
+        record("ms", loadTime*1e3, "files.%s.load", kinds[k]);
+        record("count", numMismatched, "files.%s.mismatches", kinds[k]);
+        record("count", numSwapMismatched, "files.%s.swapped.mismatches", kinds[k]);
+        record("count", numAccepted, "files.%s.truncated.accepted", kinds[k]);
+        
+        free_CDNN(&NN);
+        if ((numMismatched > 0) || (numSwapMismatched > 0) || (numAccepted > 0))  return 1;
+    }
+    
+    free(inputs);
+    free(outputs);
+    
+    return 0;
+}
+
+
+int main(int argc, char **argv)
+{
+    unsigned int seed = 1;
+    const char *jsonFileName = NULL;
+    int a, rtrn;
+    
+    for (a = 1; a < argc; a++)  {
+        if ((strcmp(argv[a], "-json") == 0) && (a+1 < argc))  jsonFileName = argv[++a];
+        else if ((strcmp(argv[a], "-layers") == 0) && (a+1 < argc))  benchLayers = atoi(argv[++a]);
+        else if ((strcmp(argv[a], "-width") == 0) && (a+1 < argc))  benchWidth = atoi(argv[++a]);
+        else if ((strcmp(argv[a], "-fanin") == 0) && (a+1 < argc))  benchFanIn = atoi(argv[++a]);
+        else if (ifDigit(argv[a][0]))  seed = atoi(argv[a]);
+        else  benchLayers = 0;
+    }
+    if ((benchLayers < 3) || (benchWidth < 1) || (benchFanIn < 1))  {
+        printf("Usage:  %s [seed] [-layers n (at least 3)] [-width n] [-fanin n] [-json file]\n", argv[0]);
+        return 1;     }
+    srand(seed);
+    
+    rtrn = benchmarkReader();
+    if (rtrn == 0)  rtrn = benchmarkTable();
+    if (rtrn == 0)  rtrn = checkKernels();
+    if (rtrn == 0)  rtrn = benchmarkRun();
+    if (rtrn == 0)  rtrn = benchmarkParallel();
+    if (rtrn == 0)  rtrn = benchmarkF32();
+    if (rtrn == 0)  rtrn = benchmarkQuantized();
+    if (rtrn == 0)  rtrn = benchmarkActivations();
+    if (rtrn == 0)  rtrn = benchmarkActivationPlan();
+    if (rtrn == 0)  rtrn = benchmarkOptimize();
+    if (rtrn == 0)  rtrn = benchmarkBitpacked();
+    if (rtrn == 0)  rtrn = benchmarkEvents();
+    if (rtrn == 0)  rtrn = benchmarkCodegen();
+    if (rtrn == 0)  rtrn = benchmarkFiles();
+    if (rtrn == 0)  rtrn = benchmarkBuild();
+    if (rtrn == 0)  rtrn = stressTest();
+    
+        // the results so far are written even if a benchmark failed
+    if ((jsonFileName != NULL) && (writeResults(jsonFileName, seed) != 0))  {
+        printf("Couldn't write %s\n", jsonFileName);
+        rtrn = 1;     }
+    
+    return rtrn;
+}
@@ -31,6 +31,27 @@
  *  * The ifQuantize field of weightQuantization and activationQuantization should be either QUANTIZE or OFF.
  *  * trainingOutputs[], if passed, has numOutputs*numSamples elements and should agree with what's computed locally.
  *  * errorMessage, if passed, does not allocate a string and therefore does not need to be freed if it is set (i.e. if errCode != 0).
+ *        The message belongs to the calling thread, and lasts until that thread trains another network.
+ *  
+ *  To train several networks at once, send the requests off through a session and collect them as they finish:
+ *  
+ *  CDNN_session *mySession = CDNN_session_init();
+ *  CDNN_request *myRequest = CDNN_tabular_regressor_async( CDNN_session *mySession, <same arguments as above, minus errorMessage>,
+ *                void (*callback)(CDNN_request *, int errCode, void *userData) or NULL, void *userData );
+ *  (likewise CDNN_tabular_encoder_async)
+ *  int numRunning = CDNN_session_poll(CDNN_session *mySession, int timeoutMs);   or   int errCode = CDNN_request_wait(CDNN_request *myRequest);
+ *  CDNN_request_free(CDNN_request *myRequest);
+ *  CDNN_session_free(CDNN_session *mySession);
+ *  
+ *  * The session reuses its connections.  Requests go to CDNN_session_set_url(CDNN_session *mySession, char *url), or else to
+ *        the CDNN_URL environment variable if set, or else to the C Deeply server; this is also true for the synchronous functions.
+ *  * CDNN_session_set_timeouts(CDNN_session *mySession, long connectTimeoutMs, long timeoutMs) limits the request time (0 = no limit).
+ *  * CDNN_session_set_cache(CDNN_session *mySession, char *dirName, long long maxBytes) caches networks in dirName, so repeated requests
+ *        don't go to the server; or set the CDNN_CACHE_DIR and CDNN_CACHE_BYTES environment variables.
+ *  * The training data and the network must stay valid until the request has finished.
+ *  * CDNN_request_status() is CD_REQUEST_RUNNING until then; CDNN_request_error() is the error message.
+ *  * CDNN_request_stats(CDNN_request *myRequest, CDNN_build_stats *stats) then gives the time and bytes of each phase of the request,
+ *        and CDNN_last_build_stats(CDNN_build_stats *stats) those of the calling thread's last synchronous request.
  *  
  *  
  *  2) Run the network on a (single) new sample
@@ -43,559 +64,6935 @@
  *    If it's a decoder/autoencoder network having numVariationalFeatures > 0, then oneSampleInput has numEncodingFeatures/numInputFeatures sample inputs
  *        followed by numVariationalFeatures random numbers drawn from variationalDistribution.
  *  
+ *  To run many samples at once:
+ *  
+ *  int errCode = run_CDNN_batch(CDNN *myNN, double *sampleInputs, int numSamples, FEATURE_SAMPLE_ARRAY or SAMPLE_FEATURE_ARRAY, double *sampleOutputs);
+ *  
+ *  where sampleInputs has numInputFeatures*numSamples elements and sampleOutputs has numOutputFeatures*numSamples elements,
+ *        both ordered according to the index order argument.
+ *  The layers' batch buffers share memory where they can; the bytes they take per context are given by
+ *  
+ *  size_t numBytes = CDNN_activation_bytes(&myNN.model, 1);
+ *  
+ *  To share one network between threads, give each thread its own context:
+ *  
+ *  CDNN_context myContext;
+ *  int errCode = CDNN_context_init(&myContext, &myNN.model);
+ *  double *oneSampleOutput = run_CDNN_ctx(&myNN.model, &myContext, double *oneSampleInput, double *outputBuffer or NULL);
+ *  int errCode = run_CDNN_batch_ctx(&myNN.model, &myContext, double *sampleInputs, int numSamples, indexOrder, double *sampleOutputs);
+ *  CDNN_context_free(&myContext);
+ *  
+ *  To run a single sample on several threads:
+ *  
+ *  CDNN_pool *myPool = CDNN_pool_init(int numThreads or 0 for one per CPU);
+ *  double *oneSampleOutput = run_CDNN_pool(CDNN *myNN, CDNN_pool *myPool, double *oneSampleInput);
+ *  double *oneSampleOutput = run_CDNN_pool_ctx(&myNN.model, &myContext, CDNN_pool *myPool, double *oneSampleInput, double *outputBuffer or NULL);
+ *  CDNN_pool_free(CDNN_pool *myPool);
+ *  
+ *  To profile each layer, call CDNN_context_profile(&myContext, 1) or CDNN_profile(CDNN *myNN, 1); myContext.profile[l] or
+ *        myNN->profile[l] then counts the samples, nanoseconds, multiply-accumulates and nonzero activations of layer l.
+ *  
+ *  To run in single precision, convert the network once; the _ctx() versions work the same way:
+ *  
+ *  int errCode = CDNN_make_f32(CDNN *myNN);
+ *  float *oneSampleOutput = run_CDNN_f32(CDNN *myNN, float *oneSampleInput);
+ *  int errCode = run_CDNN_batch_f32(CDNN *myNN, float *sampleInputs, int numSamples, indexOrder, float *sampleOutputs);
+ *  int errCode = CDNN_f32_deviation(CDNN *myNN, double *sampleInputs, int numSamples, indexOrder, double *maxDeviation);
+ *  
+ *  Or to run on int8 or int16 weights and int8 or int16 activations:
+ *  
+ *  int errCode = CDNN_make_quantized(CDNN *myNN, quantizationType weightQuantization, quantizationType activationQuantization,
+ *                double *calibrationInputs or NULL, int numSamples, indexOrder);
+ *  double *oneSampleOutput = run_CDNN_quantized(CDNN *myNN, double *oneSampleInput);
+ *  int errCode = run_CDNN_batch_quantized(CDNN *myNN, double *sampleInputs, int numSamples, indexOrder, double *sampleOutputs);
+ *  int errCode = CDNN_quantized_deviation(CDNN *myNN, double *sampleInputs, double *referenceOutputs or NULL,
+ *                int numSamples, indexOrder, double *maxDeviation);
+ *  
+ *  Or to store the activations of step-function layers as bits, and sum binary weights with popcounts:
+ *  
+ *  int errCode = CDNN_make_bitpacked(CDNN *myNN);
+ *  double *oneSampleOutput = run_CDNN_bitpacked(CDNN *myNN, double *oneSampleInput);
+ *  
+ *  Or to skip the weights of neurons that are 0, and see how many multiply-accumulates that skipped:
+ *  
+ *  int errCode = CDNN_make_event_driven(CDNN *myNN);
+ *  double *oneSampleOutput = run_CDNN_events(CDNN *myNN, double *oneSampleInput);
+ *  double skipRatio = CDNN_skip_ratio(&myNN->events);
+ *  
+ *  
+ *  Networks can be saved to disk and loaded back without contacting the server:
+ *  
+ *  int errCode = CDNN_save(CDNN *myNN, char *fileName);
+ *  int errCode = CDNN_load(CDNN *myNN, char *fileName);
+ *  
+ *  To drop zero weights, dead neurons and linear layers (rebuilding the network, so contexts and converted copies must be made again):
+ *  
+ *  CDNN_optimize_stats stats;
+ *  int errCode = CDNN_optimize(CDNN *myNN, &stats or NULL);
+ *  
+ *  Networks can also be exported as C source that runs them without the library:
+ *  
+ *  int errCode = CDNN_export_c(CDNN *myNN, char *fileName, char *functionName);
+ *  
  *  
  *  3) Free memory
  * 
  *  free_CDNN(CDNN *myNN);
 */
 
+    // POSIX and the platform extensions (clock_gettime, posix_memalign, fileno, MAP_ANONYMOUS, madvise) are hidden under -std=c99
+#if defined(__unix__) || defined(__APPLE__)
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE
+#endif
+#ifndef _DARWIN_C_SOURCE
+#define _DARWIN_C_SOURCE
+#endif
+#endif
+
 #include <math.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <limits.h>
+#include <float.h>
+#include <locale.h>
+#include <time.h>
 #include "cdeeply_neural_network.h"
 #include <curl/curl.h>
+#include <stdint.h>
+#if defined(__unix__) || defined(__APPLE__)
+#define CDNN_MMAP_FILES
+#define CDNN_THREADS
+#define CDNN_CACHE_EVICTION
+#define CDNN_CLOCK_MONOTONIC
+#define CDNN_POSIX_MEMALIGN
+#include <sys/mman.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <utime.h>
+#endif
+#if defined(_MSC_VER)
+#include <malloc.h>
+#define CDNN_THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__)
+#define CDNN_THREAD_LOCAL __thread
+#else
+#define CDNN_THREAD_LOCAL _Thread_local
+#endif
 
 
-typedef struct { const char *name; char **data; } postField;
-typedef struct { void *nextBuffer; int numChars; } bufferType;
+    // the clock for the build statistics and the layer profiles
 
-char *charPtr, *endChars;
-long curlWriteDataSize;
-bufferType *readBuffer;
-
-
-int cdReadNum(void *theNum, int mode)
+long long nanoseconds(void)
 {
-    int rtrn;
-    char *numEnd = charPtr;
-    
-    while ((*numEnd != ',') && (*numEnd != ';'))  {
-        numEnd++;
-        if (numEnd > endChars)  return CD_NN_READ_ERROR;   }
-    *numEnd = 0;
+    struct timespec t;
     
-    if (mode == 0)  rtrn = sscanf(charPtr, "%i", (int *) theNum);
-    else  rtrn = sscanf(charPtr, "%lg", (double *) theNum);
+#ifdef CDNN_CLOCK_MONOTONIC
+    clock_gettime(CLOCK_MONOTONIC, &t);
+#else
+    timespec_get(&t, TIME_UTC);
+#endif
     
-    if (rtrn != 1)  return CD_NN_READ_ERROR;
-    
-    charPtr = numEnd+1;
-    while ((*charPtr == ',') || (*charPtr == ';'))  charPtr++;
-    
-    return 0;
+    return t.tv_sec*1000000000LL + t.tv_nsec;
 }
 
-int cdReadInt(int *theInt)  {  return cdReadNum((void *) theInt, 0);  }
-int cdReadInts(int *theInts, int numInts)
+double secondsBetween(long long t0, long long t1)
 {
-    int i;
-    for (i = 0; i < numInts; i++)  {
-    if (cdReadInt(theInts + i) != 0)  {
-        return CD_NN_READ_ERROR;
-    }}
-    return 0;
+    if ((t0 == 0) || (t1 < t0))  return 0.;
+    return (t1-t0)*1e-9;
 }
 
-int cdReadFloat(double *theFloat)  {  return cdReadNum((void *) theFloat, 1);  }
-int cdReadFloats(double *theFloats, int numFloats)
+
+    // Number parsing.  These don't modify the text, don't depend on the locale, and round correctly:
+    // a decimal with at most 19 significant digits and a small power of 10 is exactly representable
+    // as an integer times/divided by an exact power of 10, so one (long double) operation is enough,
+    // and anything else -- or a long double result that lands too close to halfway between two
+    // doubles -- goes to strtod().
+
+const double powersOf10[23] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+#if LDBL_MANT_DIG == 64
+const long double longPowersOf10[28] = { 1e0L, 1e1L, 1e2L, 1e3L, 1e4L, 1e5L, 1e6L, 1e7L, 1e8L, 1e9L,
+        1e10L, 1e11L, 1e12L, 1e13L, 1e14L, 1e15L, 1e16L, 1e17L, 1e18L, 1e19L, 1e20L, 1e21L, 1e22L,
+        1e23L, 1e24L, 1e25L, 1e26L, 1e27L };
+#endif
+
+int ifDigit(char c)  {  return ((c >= '0') && (c <= '9'));  }
+int ifSpace(char c)  {  return ((c == ' ') || (c == '\t') || (c == '\r') || (c == '\n'));  }
+
+const char *skipSpaces(const char *c, const char *end)
 {
-    int i;
-    for (i = 0; i < numFloats; i++)  {
-    if (cdReadFloat(theFloats + i) != 0)  {
-        return CD_NN_READ_ERROR;
-    }}
-    return 0;
+    while ((c < end) && ifSpace(*c))  c++;
+    return c;
 }
 
 
-char *data2table(double *data, int numIOs, int numSamples, int indexOrder)
+const char *parseInt(const char *c, const char *end, int *theInt)
 {
-    int dim1, dim2, i1, i2, numLength;
-    char *table, *charPtr;
-    double *numPtr;
+    long long value = 0;
+    int ifNegative = 0;
+    const char *digitsStart;
     
-    table = malloc(25*numIOs*numSamples);
-    if (table == NULL)  return table;
+    c = skipSpaces(c, end);
+    if ((c < end) && ((*c == '-') || (*c == '+')))  {
+        ifNegative = (*c == '-');
+        c++;     }
     
-    if (indexOrder == FEATURE_SAMPLE_ARRAY)  {  dim1 = numIOs; dim2 = numSamples;  }
-    else  {  dim1 = numSamples; dim2 = numIOs;  }
-    
-    charPtr = table;
-    numPtr = data;
-    for (i1 = 0; i1 < dim1; i1++)  {
-        if (i1 > 0)  {  *charPtr = '\n';  charPtr++;  }
-        for (i2 = 0; i2 < dim2; i2++)  {
-            if (i2 > 0)  {  *charPtr = ',';  charPtr++;  }
-            sprintf(charPtr, "%g%n", *numPtr, &numLength);
-            charPtr += numLength;
-            numPtr++;
-    }   }
-    *charPtr = 0;
-    
-    return table;
+    digitsStart = c;
+    while ((c < end) && ifDigit(*c))  {
+        value = 10*value + (*c - '0');
+        if (value > (long long) INT_MAX + ifNegative)  return NULL;
+        c++;
+    }
+    if (c == digitsStart)  return NULL;
+
+    *theInt = (int) (ifNegative ? -value : value);
+    return c;
 }
 
 
-int getNN(CDNN *NN, char *NNchars, long numChars, double *sampleOutputs, int numSamples, int weightSparsity)
+double strtodAnyLocale(const char *numStart, const char *numEnd, int *ifOK)
 {
-    char header[100];
-    int loopChar, rtrn, l, li, numWeights, arr, arr0;
-    void ***arrays[3];
+    char numChars[80], *copy = numChars, *copyEnd, decimalPoint = localeconv()->decimal_point[0];
+    long i, numLength = numEnd-numStart;
+    double theDouble;
     
-    NNchars[numChars] = ';';
+    if (numLength >= (long) sizeof(numChars))  {
+        copy = malloc(numLength+1);
+        if (copy == NULL)  {  *ifOK = 0;  return 0.;  }
+    }
+    for (i = 0; i < numLength; i++)  {
+        copy[i] = numStart[i];
+        if (copy[i] == '.')  copy[i] = decimalPoint;
+    }
+    copy[numLength] = 0;
     
-    charPtr = NNchars;
-    endChars = charPtr+numChars;
+    theDouble = strtod(copy, &copyEnd);
+    *ifOK = ((copyEnd == copy+numLength) && (numLength > 0));
+    if (copy != numChars)  free(copy);
     
-    if (cdReadInt(&NN->numLayers) != 0)  return CD_NN_READ_ERROR;
-    if (cdReadInt(&NN->encoderLayer) != 0)  return CD_NN_READ_ERROR;
-    if (cdReadInt(&NN->variationalLayer) != 0)  return CD_NN_READ_ERROR;
+    return theDouble;
+}
+
+
+const char *parseDouble(const char *c, const char *end, double *theDouble)
+{
+    uint64_t mantissa = 0;
+    int ifNegative = 0, ifDigits = 0, ifTruncated = 0, numDigits = 0, exp10 = 0, expSign = 1, expValue = 0, ifOK;
+    const char *numStart, *expStart;
+    double value;
     
-    NN->layerSize = malloc(NN->numLayers*sizeof(int));
-    NN->layerAFs = malloc(NN->numLayers*sizeof(int));
-    NN->numLayerInputs = malloc(NN->numLayers*sizeof(int));
-    NN->layerInputs = malloc(NN->numLayers*sizeof(int *));
-    arrays[2] = (void ***) (NN->weights = malloc(NN->numLayers*sizeof(double **)));
-    NN->y = malloc(NN->numLayers*sizeof(double *));
-    if ((NN->layerSize == NULL) || (NN->layerAFs == NULL) || (NN->numLayerInputs == NULL)
-            || (NN->layerInputs == NULL) || (NN->weights == NULL) || (NN->y == NULL))
-        return CD_OUT_OF_MEMORY_ERROR;
+    c = skipSpaces(c, end);
+    numStart = c;
+    if ((c < end) && ((*c == '-') || (*c == '+')))  {
+        ifNegative = (*c == '-');
+        c++;     }
     
-   if (weightSparsity == SPARSE_WEIGHTS)  {
-        arr0 = 0;
-        NN->wSize = malloc(NN->numLayers*sizeof(int *));
-        arrays[0] = (void ***) (NN->n0 = malloc(NN->numLayers*sizeof(int **)));
-        arrays[1] = (void ***) (NN->nf = malloc(NN->numLayers*sizeof(int **)));
-        if ((NN->n0 == NULL) || (NN->nf == NULL))  {
-            return CD_OUT_OF_MEMORY_ERROR;
+    for (; (c < end) && ifDigit(*c); c++)  {
+        ifDigits = 1;
+        if (numDigits < 19)  {
+            mantissa = 10*mantissa + (*c - '0');
+            if (mantissa != 0)  numDigits++;     }
+        else  {
+            exp10++;
+            if (*c != '0')  ifTruncated = 1;
     }   }
-    else  {
-        NN->n0 = NN->nf = NULL;
-        NN->wSize = NULL;
-        arr0 = 2;          }
-    
-    if (cdReadInts(NN->layerSize, NN->numLayers) != 0)  return CD_NN_READ_ERROR;
-    if (cdReadInts(NN->layerAFs, NN->numLayers) != 0)  return CD_NN_READ_ERROR;
-    if (cdReadInts(NN->numLayerInputs, NN->numLayers) != 0)  return CD_NN_READ_ERROR;
+    if ((c < end) && (*c == '.'))  {
+    for (c++; (c < end) && ifDigit(*c); c++)  {
+        ifDigits = 1;
+        if (numDigits < 19)  {
+            mantissa = 10*mantissa + (*c - '0');
+            if (mantissa != 0)  numDigits++;
+            exp10--;     }
+        else if (*c != '0')  ifTruncated = 1;
+    }}
     
-    for (l = 0; l < NN->numLayers; l++)  {
-        NN->layerInputs[l] = malloc(NN->numLayerInputs[l]*sizeof(int));
-        NN->y[l] = malloc(NN->layerSize[l]*sizeof(double));
-        if ((NN->layerInputs[l] == NULL) || (NN->y[l] == NULL))  return CD_OUT_OF_MEMORY_ERROR;
-        
-        if (cdReadInts(NN->layerInputs[l], NN->numLayerInputs[l]) != 0)  return CD_NN_READ_ERROR;
+    if (!ifDigits)  {          // inf, nan
+        while ((c < end) && (*c != ',') && (*c != ';') && !ifSpace(*c))  c++;
+        *theDouble = strtodAnyLocale(numStart, c, &ifOK);
+        if (!ifOK)  return NULL;
+        return c;
     }
     
-    for (l = 0; l < NN->numLayers; l++)  {
-        
-        if (weightSparsity == SPARSE_WEIGHTS)  {
-            NN->wSize[l] = malloc(NN->numLayerInputs[l]*sizeof(int));
-            NN->n0[l] = malloc(NN->numLayerInputs[l]*sizeof(int *));
-            NN->nf[l] = malloc(NN->numLayerInputs[l]*sizeof(int *));
-            if ((NN->wSize[l] == NULL) || (NN->n0[l] == NULL) || (NN->nf[l] == NULL))  return CD_OUT_OF_MEMORY_ERROR;
-            
-            if (cdReadInts(NN->wSize[l], NN->numLayerInputs[l]) != 0)  return CD_NN_READ_ERROR;
-        }
-        
-        NN->weights[l] = malloc(NN->numLayerInputs[l]*sizeof(double *));
-        if (NN->weights[l] == NULL)  return CD_OUT_OF_MEMORY_ERROR;
-        
-        for (li = 0; li < NN->numLayerInputs[l]; li++)  {
-            if (weightSparsity == SPARSE_WEIGHTS)  {
-                numWeights = NN->wSize[l][li];
-                NN->n0[l][li] = malloc(numWeights*sizeof(int));
-                NN->nf[l][li] = malloc(numWeights*sizeof(int));
-                if ((NN->n0[l][li] == NULL) || (NN->nf[l][li] == NULL))  return CD_OUT_OF_MEMORY_ERROR;
-            }
-            else  numWeights = NN->layerSize[l]*NN->layerSize[NN->layerInputs[l][li]];
-            
-            NN->weights[l][li] = malloc(numWeights*sizeof(double));
-            if (NN->weights[l][li] == NULL)  return CD_OUT_OF_MEMORY_ERROR;
+    if ((c < end) && ((*c == 'e') || (*c == 'E')))  {
+        expStart = c;
+        c++;
+        if ((c < end) && ((*c == '-') || (*c == '+')))  {
+            if (*c == '-')  expSign = -1;
+            c++;     }
+        if ((c == end) || !ifDigit(*c))  c = expStart;
+        for (; (c < end) && ifDigit(*c); c++)  {
+            if (expValue < 100000)  expValue = 10*expValue + (*c - '0');
     }   }
+    exp10 += expSign*expValue;
     
-    for (arr = arr0; arr < 3; arr++)  {
-        for (l = 0; l < NN->numLayers; l++)  {
-        for (li = 0; li < NN->numLayerInputs[l]; li++)  {
-            
-            if (weightSparsity == SPARSE_WEIGHTS)  numWeights = NN->wSize[l][li];
-            else  numWeights = NN->layerSize[l]*NN->layerSize[NN->layerInputs[l][li]];
-            
-            if (arr < 2)  {  if (cdReadInts((int *) arrays[arr][l][li], numWeights) != 0)  return CD_NN_READ_ERROR;  }
-            else  {  if (cdReadFloats((double *) arrays[arr][l][li], numWeights) != 0)  return CD_NN_READ_ERROR;  }
-    }   }}
+    if (mantissa == 0)  value = 0.;
+    else if (!ifTruncated && (mantissa <= ((uint64_t) 1 << 53)) && (exp10 >= -22) && (exp10 <= 22))  {
+        if (exp10 < 0)  value = (double) mantissa / powersOf10[-exp10];
+        else  value = (double) mantissa * powersOf10[exp10];
+    }
+#if LDBL_MANT_DIG == 64
+    else if (!ifTruncated && (exp10 >= -27) && (exp10 <= 27))  {
+        long double longValue;
+        uint64_t lowBits;
+        int binaryExp;
+        
+        if (exp10 < 0)  longValue = (long double) mantissa / longPowersOf10[-exp10];
+        else  longValue = (long double) mantissa * longPowersOf10[exp10];
+        lowBits = ((uint64_t) ldexpl(frexpl(longValue, &binaryExp), 64)) & 0x7FF;
+        if ((lowBits >= 0x3FF) && (lowBits <= 0x401))  {
+            value = strtodAnyLocale(numStart, c, &ifOK);
+            if (!ifOK)  return NULL;
+            *theDouble = value;
+            return c;
+        }
+        value = (double) longValue;
+    }
+#endif
+    else  {
+        value = strtodAnyLocale(numStart, c, &ifOK);
+        if (!ifOK)  return NULL;
+        *theDouble = value;
+        return c;
+    }
+
+    *theDouble = ifNegative ? -value : value;
+    return c;
+}
+
+
+    // Number formatting:  Grisu2 (Loitsch, "Printing floating-point numbers quickly and accurately with integers",
+    // PLDI 2010) finds the shortest digit string that reads back as the same double using a few 64-bit products,
+    // rather than the big-integer arithmetic of printf().  Its output always round-trips, and is the shortest
+    // possible for all but a fraction of a percent of doubles, which get a digit or so more.
+
+#define CDNN_MAX_NUM_CHARS 25
+
+typedef struct { uint64_t f; int e; } diyFp;
+
+const uint64_t cachedPowersF[87] = {
+        0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL, 0xcf42894a5dce35eaULL,
+        0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL, 0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL,
+        0xbe5691ef416bd60cULL, 0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+        0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL, 0xc21094364dfb5637ULL,
+        0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL, 0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL,
+        0xb23867fb2a35b28eULL, 0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+        0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL, 0xb5b5ada8aaff80b8ULL,
+        0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL, 0x964e858c91ba2655ULL, 0xdff9772470297ebdULL,
+        0xa6dfbd9fb8e5b88fULL, 0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+        0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL, 0xaa242499697392d3ULL,
+        0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL, 0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL,
+        0x9c40000000000000ULL, 0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+        0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL, 0x9f4f2726179a2245ULL,
+        0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL, 0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL,
+        0x924d692ca61be758ULL, 0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+        0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL, 0x952ab45cfa97a0b3ULL,
+        0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL, 0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL,
+        0x88fcf317f22241e2ULL, 0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+        0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL, 0x8bab8eefb6409c1aULL,
+        0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL, 0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL,
+        0x80444b5e7aa7cf85ULL, 0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+        0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL
+};
+
+const short cachedPowersE[87] = {
+        -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954, -927, -901, -874, -847, -821,
+        -794, -768, -741, -715, -688, -661, -635, -608, -582, -555, -529, -502, -475, -449, -422, -396,
+        -369, -343, -316, -289, -263, -236, -210, -183, -157, -130, -103, -77, -50, -24, 3, 30,
+        56, 83, 109, 136, 162, 189, 216, 242, 269, 295, 322, 348, 375, 402, 428, 455,
+        481, 508, 534, 561, 588, 614, 641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+        907, 933, 960, 986, 1013, 1039, 1066
+};
+
+const uint32_t uintPowersOf10[10] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000 };
+
+diyFp multiplyFp(diyFp x, diyFp y)
+{
+    uint64_t a = x.f >> 32, b = x.f & 0xFFFFFFFF, c = y.f >> 32, d = y.f & 0xFFFFFFFF, middle;
+    diyFp product;
     
-    if (sampleOutputs != NULL)  {
-    if (cdReadFloats(sampleOutputs, NN->layerSize[NN->numLayers-1]*numSamples) != 0)  {
-        return CD_NN_READ_ERROR;
-    }}
+    middle = ((b*d) >> 32) + ((a*d) & 0xFFFFFFFF) + ((b*c) & 0xFFFFFFFF) + ((uint64_t) 1 << 31);
+    product.f = a*c + ((a*d) >> 32) + ((b*c) >> 32) + (middle >> 32);
+    product.e = x.e + y.e + 64;
     
-    return 0;
+    return product;
 }
 
+diyFp normalizeFp(diyFp x)
+{
+#ifdef __GNUC__
+    int shift = __builtin_clzll(x.f);
+    x.f <<= shift;
+    x.e -= shift;
+#else
+    while (!(x.f & ((uint64_t) 1 << 63)))  {
+        x.f <<= 1;
+        x.e--;     }
+#endif
+    return x;
+}
 
 
-static size_t curlWriteCallback(void *newData, size_t typeSize, size_t dataLength, void *ptr)
+    // writes the shortest digits of a positive finite double to digits[]; the value is digits * 10^(*exp10)
+
+int grisu2(double theDouble, char *digits, int *exp10)
 {
-    size_t numBytes = dataLength*typeSize;
-    bufferType *newBuffer;
+    uint64_t bits, delta, rest, tenKappa, wpw, p2;
+    uint32_t p1, d;
+    diyFp v, plus, minus, cached, w, wPlus, wMinus, one;
+    int k, index, kappa, ifInInterval = 0, numDigits = 0;
     
-    newBuffer = (bufferType *) malloc(sizeof(bufferType) + numBytes);
-    if (newBuffer == NULL)  return 0;
+    memcpy(&bits, &theDouble, sizeof(bits));
+    v.f = bits & (((uint64_t) 1 << 52) - 1);
+    v.e = (int) ((bits >> 52) & 0x7FF);
+    if (v.e != 0)  {
+        v.f += (uint64_t) 1 << 52;
+        v.e -= 1075;     }
+    else  v.e = -1074;
     
-    newBuffer->nextBuffer = NULL;
-    newBuffer->numChars = numBytes;
-    memcpy((void *) (newBuffer + 1), newData, numBytes);
-    curlWriteDataSize += numBytes;
+        // the halfway points to the neighbouring doubles; the lower one is closer at a power of 2
+    plus.f = (v.f << 1) + 1;
+    plus.e = v.e - 1;
+    plus = normalizeFp(plus);
+    if (v.f == ((uint64_t) 1 << 52))  {
+        minus.f = (v.f << 2) - 1;
+        minus.e = v.e - 2;     }
+    else  {
+        minus.f = (v.f << 1) - 1;
+        minus.e = v.e - 1;     }
+    minus.f <<= minus.e - plus.e;
+    minus.e = plus.e;
     
-    if (*(bufferType **) ptr == NULL)  *(bufferType **) ptr = newBuffer;
-    else  readBuffer->nextBuffer = (bufferType *) newBuffer;
-    readBuffer = newBuffer;
+        // scale by a cached power of 10 so that the binary exponent lands in [-60, -32]
+    k = (int) ceil((-61 - plus.e) * 0.30102999566398114) + 347;
+    index = (k >> 3) + 1;
+    *exp10 = 348 - 8*index;
+    cached.f = cachedPowersF[index];
+    cached.e = cachedPowersE[index];
     
-    return numBytes;
+    w = multiplyFp(normalizeFp(v), cached);
+    wPlus = multiplyFp(plus, cached);
+    wMinus = multiplyFp(minus, cached);
+    wMinus.f++;
+    wPlus.f--;
+    delta = wPlus.f - wMinus.f;
+    wpw = wPlus.f - w.f;
+    
+        // generate digits of wPlus until they're inside the rounding interval
+    one.e = wPlus.e;
+    one.f = (uint64_t) 1 << -one.e;
+    p1 = (uint32_t) (wPlus.f >> -one.e);
+    p2 = wPlus.f & (one.f - 1);
+    for (kappa = 10; (kappa > 1) && (p1 < uintPowersOf10[kappa-1]); kappa--);
+    
+    while (kappa > 0)  {
+        d = p1 / uintPowersOf10[kappa-1];
+        p1 %= uintPowersOf10[kappa-1];
+        if ((d != 0) || (numDigits > 0))  digits[numDigits++] = '0' + d;
+        kappa--;
+        rest = ((uint64_t) p1 << -one.e) + p2;
+        if (rest <= delta)  {
+            tenKappa = (uint64_t) uintPowersOf10[kappa] << -one.e;
+            ifInInterval = 1;
+            break;
+    }   }
+    
+    while (!ifInInterval)  {
+        p2 *= 10;
+        delta *= 10;
+        d = (uint32_t) (p2 >> -one.e);
+        if ((d != 0) || (numDigits > 0))  digits[numDigits++] = '0' + d;
+        p2 &= one.f - 1;
+        kappa--;
+        if (p2 < delta)  {
+            rest = p2;
+            tenKappa = one.f;
+            wpw *= (-kappa < 10) ? uintPowersOf10[-kappa] : 0;
+            ifInInterval = 1;
+    }   }
+    *exp10 += kappa;
+    
+        // move the last digit towards w while that stays inside the interval and gets closer
+    while ((rest < wpw) && (delta - rest >= tenKappa)
+            && ((rest + tenKappa < wpw) || (wpw - rest > rest + tenKappa - wpw)))  {
+        digits[numDigits-1]--;
+        rest += tenKappa;     }
+    
+    return numDigits;
 }
 
 
-char errMsgChars[400];
+    // Writes a double the way JavaScript does (plain decimal between 1e-6 and 1e21, exponent notation otherwise)
+    // and returns its length, at most CDNN_MAX_NUM_CHARS.  Nothing is lost in the round trip back to a double.
 
-void setErrMsg(char *msg)
+int formatDouble(double theDouble, char *c)
 {
-    int i;
-    char *c = errMsgChars;
+    char digits[20], *start = c;
+    int numDigits, exp10, kk, i;
     
-    for (i = 0; i < sizeof(errMsgChars)-4; i++)  {
-        *c = msg[i];
-        if (*c == 0)  return;
-        c++;
+    if (theDouble != theDouble)  {
+        memcpy(c, "nan", 3);
+        return 3;     }
+    if (signbit(theDouble))  {
+        *(c++) = '-';
+        theDouble = -theDouble;     }
+    if (theDouble == 0.)  {
+        *(c++) = '0';
+        return c-start;     }
+    if (isinf(theDouble))  {
+        memcpy(c, "inf", 3);
+        return c+3-start;     }
+    
+    numDigits = grisu2(theDouble, digits, &exp10);
+    kk = numDigits + exp10;         // 10^(kk-1) <= theDouble < 10^kk
+    
+    if ((exp10 >= 0) && (kk <= 21))  {          // 1234e7 -> 12340000000
+        memcpy(c, digits, numDigits);
+        memset(c+numDigits, '0', exp10);
+        c += kk;     }
+    else if ((kk > 0) && (kk <= 21))  {         // 1234e-2 -> 12.34
+        memcpy(c, digits, kk);
+        c[kk] = '.';
+        memcpy(c+kk+1, digits+kk, numDigits-kk);
+        c += numDigits+1;     }
+    else if ((kk > -6) && (kk <= 0))  {         // 1234e-6 -> 0.001234
+        c[0] = '0';
+        c[1] = '.';
+        memset(c+2, '0', -kk);
+        memcpy(c+2-kk, digits, numDigits);
+        c += 2-kk+numDigits;     }
+    else  {                                     // 1234e30 -> 1.234e+33
+        *(c++) = digits[0];
+        if (numDigits > 1)  {
+            *(c++) = '.';
+            memcpy(c, digits+1, numDigits-1);
+            c += numDigits-1;     }
+        kk--;
+        *(c++) = 'e';
+        *(c++) = (kk < 0) ? '-' : '+';
+        if (kk < 0)  kk = -kk;
+        for (i = 100; i > kk && i > 1; i /= 10);
+        for (; i > 0; i /= 10)  *(c++) = '0' + (kk/i) % 10;
     }
     
-    c[0] = c[1] = c[2] = '.';
-    c[3] = 0;
+    return c-start;
 }
 
-int buildNN(CDNN *NN, double *sampleOutputs, int numSamples, int weightSparsity, postField *toPOST, int numPostFields)
+
+    // Training data is sent as text that is formatted as curl uploads it, so the table never exists in memory
+    // as a whole.  curl needs the length up front, which several threads work out by each formatting a range
+    // of rows and counting the characters.
+
+#define CDNN_MAX_THREADS 64
+#define CDNN_CELLS_PER_THREAD 65536
+
+typedef struct {
+    const double *data;
+    int dim1, dim2;
+    size_t numCells, cell, numChars;
+    char pending[CDNN_MAX_NUM_CHARS+1];
+    int pendingStart, pendingEnd;
+    long long formattingNs, lastReadNs;
+} tableType;
+
+typedef struct { const char *name; char *const *data; tableType *table; } postField;
+
+typedef struct {
+    const double *data;
+    int dim2, row0, row1;
+    size_t numChars;
+} tableRowsType;
+
+void *measureTableRows(void *ptr)
 {
-    int p, rtrn;
-    bufferType *readBuffer1;
-    char *readBufferChars, *readBufferScanner;
-    CURL *curlP;
-    curl_mime *mime;
-    curl_mimepart *mimePart;
-    
-    curl_global_init(CURL_GLOBAL_ALL);
-    curlP = curl_easy_init();
-    if (curlP != NULL)  mime = curl_mime_init(curlP);
-    if ((curlP == NULL) || (mime == NULL))  return CD_OUT_OF_MEMORY_ERROR;
+    tableRowsType *rows = (tableRowsType *) ptr;
+    const double *numPtr = rows->data + (size_t) rows->row0*rows->dim2;
+    size_t cell, numCells = (size_t) (rows->row1 - rows->row0)*rows->dim2;
+    char scratch[CDNN_MAX_NUM_CHARS];
     
-    curl_easy_setopt(curlP, CURLOPT_URL, "https://cdeeply.com/myNN.php");
+        // one delimiter before every number but the first
+    rows->numChars = numCells;
+    if ((rows->row0 == 0) && (numCells > 0))  rows->numChars--;
+    for (cell = 0; cell < numCells; cell++)  rows->numChars += formatDouble(numPtr[cell], scratch);
     
-    for (p = 0; p < numPostFields; p++)  {
-        mimePart = curl_mime_addpart(mime);
-        if (mimePart == NULL)  return CD_OUT_OF_MEMORY_ERROR;
-        rtrn = curl_mime_name(mimePart, toPOST[p].name);
-        if (rtrn != CURLE_OK)  return rtrn;
-        rtrn = curl_mime_data(mimePart, *toPOST[p].data, CURL_ZERO_TERMINATED);
-        if (rtrn != CURLE_OK)  return rtrn;
-    }
-    curl_easy_setopt(curlP, CURLOPT_MIMEPOST, mime);
+    return NULL;
+}
+
+int numTableThreads(size_t numCells, int numRows)
+{
+    int numThreads = 1;
     
-    readBuffer1 = NULL;
-    curlWriteDataSize = 0;
-    curl_easy_setopt(curlP, CURLOPT_WRITEFUNCTION, curlWriteCallback);
-    curl_easy_setopt(curlP, CURLOPT_WRITEDATA, (void *) &readBuffer1);
+#ifdef CDNN_THREADS
+    long numCPUs = sysconf(_SC_NPROCESSORS_ONLN);
     
-    rtrn = curl_easy_perform(curlP);
-    if (rtrn != CURLE_OK)  return rtrn;
+    if (numCPUs > CDNN_MAX_THREADS)  numCPUs = CDNN_MAX_THREADS;
+    if (numCells/CDNN_CELLS_PER_THREAD < (size_t) numCPUs)  numThreads = (int) (numCells/CDNN_CELLS_PER_THREAD);
+    else  numThreads = (int) numCPUs;
+    if (numThreads > numRows)  numThreads = numRows;
+    if (numThreads < 1)  numThreads = 1;
+#endif
     
-    curl_mime_free(mime);
+    return numThreads;
+}
+
+void initTable(tableType *table, const double *data, int numIOs, int numSamples, int indexOrder)
+{
+        // the data is written out in memory order, a row being the inner index
+    if (indexOrder == FEATURE_SAMPLE_ARRAY)  {  table->dim1 = numIOs;  table->dim2 = numSamples;  }
+    else  {  table->dim1 = numSamples;  table->dim2 = numIOs;  }
+    table->data = data;
+    table->numCells = (size_t) numIOs*numSamples;
+    table->cell = 0;
+    table->pendingStart = table->pendingEnd = 0;
+    table->numChars = 0;
+    table->formattingNs = table->lastReadNs = 0;
+}
+
+    // the sizing pass, which is put off until the table is about to be uploaded
+
+void measureTable(tableType *table)
+{
+    int t, numThreads;
+    tableRowsType rows[CDNN_MAX_THREADS];
+#ifdef CDNN_THREADS
+    pthread_t threads[CDNN_MAX_THREADS];
+    int ifThread[CDNN_MAX_THREADS];
+#endif
     
-    readBufferScanner = readBufferChars = malloc(curlWriteDataSize+1);
-    if (readBufferChars == NULL)  return CD_OUT_OF_MEMORY_ERROR;
-    readBuffer = readBuffer1;
-    while (readBuffer != NULL)  {
-        memcpy(readBufferScanner, readBuffer+1, readBuffer->numChars);
-        readBufferScanner += readBuffer->numChars;
-        readBuffer1 = readBuffer;
-        readBuffer = (bufferType *) readBuffer->nextBuffer;
-        free(readBuffer1);
+    numThreads = numTableThreads(table->numCells, table->dim1);
+    for (t = 0; t < numThreads; t++)  {
+        rows[t].data = table->data;
+        rows[t].dim2 = table->dim2;
+        rows[t].row0 = (int) ((long) table->dim1*t/numThreads);
+        rows[t].row1 = (int) ((long) table->dim1*(t+1)/numThreads);
     }
-    *readBufferScanner = 0;
     
-    if (!((*readBufferChars >= '0') && (*readBufferChars <= '9')))  {
-        setErrMsg(readBufferChars);
-        rtrn = CD_PARAMS_ERR;
+#ifdef CDNN_THREADS
+    for (t = 1; t < numThreads; t++)  {
+        ifThread[t] = (pthread_create(&threads[t], NULL, measureTableRows, &rows[t]) == 0);
+        if (!ifThread[t])  measureTableRows(&rows[t]);
     }
-    else  {
-        rtrn = getNN(NN, readBufferChars, curlWriteDataSize, sampleOutputs, numSamples, weightSparsity);
-        if (rtrn == CD_NN_READ_ERROR)  setErrMsg("Problem reading neural network from server");
-        else if (rtrn == CD_NN_READ_ERROR)  setErrMsg(readBufferChars);
+#endif
+    measureTableRows(&rows[0]);
+#ifdef CDNN_THREADS
+    for (t = 1; t < numThreads; t++)  {
+        if (ifThread[t])  pthread_join(threads[t], NULL);
     }
+#endif
+    
+    table->numChars = 0;
+    for (t = 0; t < numThreads; t++)  table->numChars += rows[t].numChars;
+}
+
+int formatTableCell(tableType *table, char *c)
+{
+    int numChars = 0;
     
-    free(readBufferChars);
-    curl_easy_cleanup(curlP);
-    curl_global_cleanup();
+    if (table->cell > 0)  {
+        if (table->cell % table->dim2 == 0)  c[0] = '\n';
+        else  c[0] = ',';
+        numChars = 1;     }
+    numChars += formatDouble(table->data[table->cell], c+numChars);
+    table->cell++;
     
-    return rtrn;
+    return numChars;
 }
 
 
-char *checked[3] = { "", "on", "off" };
-char *vDists[2] = { "uniform", "normal" };
-char *NNtypes[2] = { "autoencoder", "regressor" };
-char *SubmitStr = "Submit";
-char *sourceStr = "C_API";
-char *rowcol[2] = { "rows", "columns" };
+    // formats numbers straight into curl's buffer, and the one that doesn't fit at the end into pending[],
+    // to be copied out on the next call
 
-int CDNN_tabular_regressor(CDNN *NN, int numInputs, int numOutputs, int numSamples,
-        double *trainingSamples, int indexOrder, int *outputRowsColumns, double *importances,
-        int maxWeights, int maxNeurons, int maxLayers, int maxWeightDepth, double maxActivationRate,
-        int maxWeightsHardLimit, int maxNeuronsHardLimit, int maxActivationsHardLimit,
-        AFlist allowedAFs, quantizationType weightQuantization, quantizationType activationQuantization,
-        int weightSparsity, int allowNegativeWeights, int hasBias, int allowIOconnections, double *sampleOutputs, char **errMsg)
+size_t readTable(tableType *table, char *buffer, size_t numBytes)
 {
-    int o, charIdx, rtrn;
-    char *outputRowsColsStr, *trainingSamplesStr, *trainingSampleImportancesStr, strs[280], *maxWeightsStr = &strs[0];
-    char *maxNeuronsStr = &strs[20], *maxLayersStr = &strs[40], *maxWeightDepthStr = &strs[60], *maxActivationRateStr = &strs[80];
-    char *wQuantBitsStr = &strs[120], *wQuantZeroStr = &strs[140], *wQuantRangeStr = &strs[160];
-    char *yQuantBitsStr = &strs[200], *yQuantZeroStr = &strs[220], *yQuantRangeStr = &strs[240];
-    postField toPOST[] = {
-        { "samples", &trainingSamplesStr },
-        { "importances", &trainingSampleImportancesStr },
-        { "rowscols", &rowcol[indexOrder] },
-        { "rowcolRange", &outputRowsColsStr },
-        { "maxWeights", &maxWeightsStr },
-        { "maxNeurons", &maxNeuronsStr },
-        { "maxLayers", &maxLayersStr },
-        { "maxWeightDepth", &maxWeightDepthStr },
-        { "maxActivationRate", &maxActivationRateStr },
-        { "maxWeightsHardLimit", &checked[maxWeightsHardLimit] },
-        { "maxNeuronsHardLimit", &checked[maxNeuronsHardLimit] },
-        { "maxActivationsHardLimit", &checked[maxActivationsHardLimit] },
-        { "step", &checked[allowedAFs.stepAF] },
-        { "ReLU", &checked[allowedAFs.ReLUAF] },
-        { "ReLU1", &checked[allowedAFs.ReLU1AF] },
-        { "sigmoid", &checked[allowedAFs.sigmoidAF] },
-        { "tanh", &checked[allowedAFs.tanhAF] },
-        { "quantizeWeights", &checked[weightQuantization.ifQuantize] },
-        { "wQuantBits", &wQuantBitsStr },
-        { "wQuantZero", &wQuantZeroStr },
-        { "wQuantRange", &wQuantRangeStr },
-        { "quantizeActivations", &checked[activationQuantization.ifQuantize] },
-        { "yQuantBits", &yQuantBitsStr },
-        { "yQuantZero", &yQuantZeroStr },
-        { "yQuantRange", &yQuantRangeStr },
-        { "sparseWeights", &checked[weightSparsity] },
-        { "allowNegativeWeights", &checked[allowNegativeWeights] },
-        { "hasBias", &checked[hasBias] },
-        { "allowIO", &checked[allowIOconnections] },
-        { "submitStatus", &SubmitStr },
-        { "NNtype", &NNtypes[1] },
-        { "formSource", &sourceStr }
-    };
-    
-    trainingSamplesStr = data2table(trainingSamples, numInputs+numOutputs, numSamples, indexOrder);
-    if (importances == NULL)  trainingSampleImportancesStr = "";
-    else  trainingSampleImportancesStr = data2table(importances, numOutputs, numSamples, indexOrder);
-    if ((trainingSamplesStr == NULL) || (trainingSampleImportancesStr == NULL)) return CD_OUT_OF_MEMORY_ERROR;
-    
-    outputRowsColsStr = malloc(numOutputs*20*sizeof(int));
-    if (outputRowsColsStr == NULL)  return CD_OUT_OF_MEMORY_ERROR;
-    
-    if (numOutputs <= 0)  {  charIdx = 0; outputRowsColsStr[0] = 0;  }
-    else  {
-        charIdx = sprintf(outputRowsColsStr, "%i", outputRowsColumns[0]+1);
-        for (o = 1; o < numOutputs; o++)  {
-            charIdx += sprintf(outputRowsColsStr + charIdx, ",%i", outputRowsColumns[o]+1);
-    }   }
+    size_t n = 0, numPending;
     
-    maxWeightsStr[0] = maxNeuronsStr[0] = maxLayersStr[0] = maxWeightDepthStr[0] = 0;
-    if (maxWeights >= 0)  sprintf((char *) maxWeightsStr, "%i", maxWeights);
-    if (maxNeurons >= 0)  sprintf(maxNeuronsStr, "%i", maxNeurons);
-    if (maxLayers >= 0)  sprintf(maxLayersStr, "%i", maxLayers);
-    if (maxWeightDepth >= 0)  sprintf(maxWeightDepthStr, "%i", maxWeightDepth);
-    sprintf(maxActivationRateStr, "%1.17g", maxActivationRate);
-    if (weightQuantization.ifQuantize)  {
-        sprintf(wQuantBitsStr, "%i", weightQuantization.bits);
-        sprintf(wQuantZeroStr, "%i", weightQuantization.zeroInt);
-        sprintf(wQuantRangeStr, "%1.17g", weightQuantization.range);
-    }
-    if (activationQuantization.ifQuantize)  {
-        sprintf(yQuantBitsStr, "%i", activationQuantization.bits);
-        sprintf(yQuantZeroStr, "%i", activationQuantization.zeroInt);
-        sprintf(yQuantRangeStr, "%1.17g", activationQuantization.range);
+    for (;;)  {
+        numPending = table->pendingEnd - table->pendingStart;
+        if (numPending > numBytes - n)  numPending = numBytes - n;
+        memcpy(buffer + n, table->pending + table->pendingStart, numPending);
+        table->pendingStart += numPending;
+        n += numPending;
+        if ((table->pendingStart < table->pendingEnd) || (table->cell == table->numCells))  return n;
+        
+        while ((numBytes - n >= CDNN_MAX_NUM_CHARS+1) && (table->cell < table->numCells))  {
+            n += formatTableCell(table, buffer + n);     }
+        if ((table->cell == table->numCells) || (n == numBytes))  return n;
+        
+        table->pendingStart = 0;
+        table->pendingEnd = formatTableCell(table, table->pending);
     }
+}
+
+    // curl's read callback; the time it takes is the time spent formatting
+
+static size_t tableReadCallback(char *buffer, size_t typeSize, size_t numItems, void *ptr)
+{
+    tableType *table = (tableType *) ptr;
+    long long t0 = nanoseconds();
+    size_t numBytes = readTable(table, buffer, typeSize*numItems);
     
-    rtrn = buildNN(NN, sampleOutputs, numSamples, weightSparsity, toPOST, sizeof(toPOST)/sizeof(postField));
-    if (errMsg != NULL)  *errMsg = &errMsgChars[0];
-    
-    free(outputRowsColsStr);
-    free(trainingSamplesStr);
-    if (importances != NULL)  free(trainingSampleImportancesStr);
+    table->lastReadNs = nanoseconds();
+    table->formattingNs += table->lastReadNs - t0;
     
-    return rtrn;
+    return numBytes;
 }
 
-int CDNN_tabular_encoder(CDNN *NN, int numFeatures, int numSamples,
-        double *trainingSamples, int indexOrder, double *importances,
-        int doEncoder, int doDecoder, int numEncodingFeatures, int numVariationalFeatures, int variationalDist,
-        int maxWeights, int maxNeurons, int maxLayers, int maxWeightDepth, double maxActivationRate,
-        int maxWeightsHardLimit, int maxNeuronsHardLimit, int maxActivationsHardLimit,
-        AFlist allowedAFs, quantizationType weightQuantization, quantizationType activationQuantization,
-        int weightSparsity, int allowNegativeWeights, int hasBias, double *sampleOutputs, char **errMsg)
+    // curl rewinds the upload if it has to resend it (after a redirect, say)
+
+static int tableSeekCallback(void *ptr, curl_off_t offset, int origin)
 {
-    int rtrn;
-    char *trainingSamplesStr, *trainingSampleImportancesStr, strs[320], *numEncodingFeaturesStr = &strs[0];
-    char *numVFsStr = &strs[20], *maxWeightsStr = &strs[40], *maxNeuronsStr = &strs[60];
-    char *maxLayersStr = &strs[80], *maxWeightDepthStr = &strs[100], *maxActivationRateStr = &strs[120];
-    char *wQuantBitsStr = &strs[160], *wQuantZeroStr = &strs[180], *wQuantRangeStr = &strs[200];
-    char *yQuantBitsStr = &strs[240], *yQuantZeroStr = &strs[260], *yQuantRangeStr = &strs[280];
-    postField toPOST[] = {
-        { "samples", &trainingSamplesStr },
-        { "importances", &trainingSampleImportancesStr },
-        { "rowscols", &rowcol[indexOrder] },
-        { "numFeatures", &numEncodingFeaturesStr },
-        { "doEncoder", &checked[doEncoder] },
-        { "doDecoder", &checked[doDecoder] },
-        { "numVPs", &numVFsStr },
-        { "variationalDist", &vDists[variationalDist] },
-        { "maxWeights", &maxWeightsStr },
-        { "maxNeurons", &maxNeuronsStr },
-        { "maxLayers", &maxLayersStr },
-        { "maxWeightDepth", &maxWeightDepthStr },
-        { "maxActivationRate", &maxActivationRateStr },
-        { "maxWeightsHardLimit", &checked[maxWeightsHardLimit] },
-        { "maxNeuronsHardLimit", &checked[maxNeuronsHardLimit] },
-        { "maxActivationsHardLimit", &checked[maxActivationsHardLimit] },
-        { "step", &checked[allowedAFs.stepAF] },
-        { "ReLU", &checked[allowedAFs.ReLUAF] },
-        { "ReLU1", &checked[allowedAFs.ReLU1AF] },
-        { "sigmoid", &checked[allowedAFs.sigmoidAF] },
-        { "tanh", &checked[allowedAFs.tanhAF] },
-        { "quantizeWeights", &checked[weightQuantization.ifQuantize] },
-        { "wQuantBits", &wQuantBitsStr },
-        { "wQuantZero", &wQuantZeroStr },
-        { "wQuantRange", &wQuantRangeStr },
-        { "quantizeActivations", &checked[activationQuantization.ifQuantize] },
-        { "yQuantBits", &yQuantBitsStr },
-        { "yQuantZero", &yQuantZeroStr },
-        { "yQuantRange", &yQuantRangeStr },
-        { "sparseWeights", &checked[weightSparsity] },
-        { "allowNegativeWeights", &checked[allowNegativeWeights] },
-        { "hasBias", &checked[hasBias] },
-        { "submitStatus", &SubmitStr },
-        { "NNtype", &NNtypes[0] },
-        { "formSource", &sourceStr }
-    };
+    tableType *table = (tableType *) ptr;
     
-    trainingSamplesStr = data2table(trainingSamples, numFeatures, numSamples, indexOrder);
-    if (importances == NULL)  trainingSampleImportancesStr = "";
-    else  trainingSampleImportancesStr = data2table(importances, numFeatures, numSamples, indexOrder);
-    if ((trainingSamplesStr == NULL) || (trainingSampleImportancesStr == NULL)) return CD_OUT_OF_MEMORY_ERROR;
-    
-    sprintf(numEncodingFeaturesStr, "%i", numEncodingFeatures);
-    sprintf(numVFsStr, "%i", numVariationalFeatures);
-    maxWeightsStr[0] = maxNeuronsStr[0] = maxLayersStr[0] = maxWeightDepthStr[0] = 0;
-    if (maxWeights >= 0)  sprintf(maxWeightsStr, "%i", maxWeights);
-    if (maxNeurons >= 0)  sprintf(maxNeuronsStr, "%i", maxNeurons);
-    if (maxLayers >= 0)  sprintf(maxLayersStr, "%i", maxLayers);
-    if (maxWeightDepth >= 0)  sprintf(maxWeightDepthStr, "%i", maxWeightDepth);
-    sprintf(maxActivationRateStr, "%1.17g", maxActivationRate);
-    if (weightQuantization.ifQuantize)  {
-        sprintf(wQuantBitsStr, "%i", weightQuantization.bits);
-        sprintf(wQuantZeroStr, "%i", weightQuantization.zeroInt);
-        sprintf(wQuantRangeStr, "%1.17g", weightQuantization.range);
-    }
-    if (activationQuantization.ifQuantize)  {
-        sprintf(yQuantBitsStr, "%i", activationQuantization.bits);
-        sprintf(yQuantZeroStr, "%i", activationQuantization.zeroInt);
-        sprintf(yQuantRangeStr, "%1.17g", activationQuantization.range);
-    }
+    if ((origin != SEEK_SET) || (offset != 0))  return CURL_SEEKFUNC_CANTSEEK;
+    table->cell = 0;
+    table->pendingStart = table->pendingEnd = 0;
     
-    rtrn = buildNN(NN, sampleOutputs, numSamples, weightSparsity, toPOST, sizeof(toPOST)/sizeof(postField));
-    if (errMsg != NULL)  *errMsg = &errMsgChars[0];
+    return CURL_SEEKFUNC_OK;
+}
     
-    free(trainingSamplesStr);
-    if (importances != NULL)  free(trainingSampleImportancesStr);
     
-    return rtrn;
-}
+    // The whole network lives in one CDNN_ALIGN-aligned arena, in two parts:  the pointer tables and the
+    // activations of CDNN.y, followed by the model data -- the topology, then each layer's weight blocks
+    // in the order run_CDNN() reads them.  The model data holds no pointers, so it is also the body of a
+    // saved network file, and CDNN_load() can point the tables straight into a mapping of that file.
+    // layoutModel() is run twice:  once with NULL arena bases to size the arena, then to place the arrays.
+    // Build with -DCDNN_HUGE_PAGES to back large arenas with transparent huge pages.
 
+#define CDNN_ALIGN 64
+#define CDNN_DENSE_BLOCK_DENSITY 0.3
 
+#define MALLOC_ARENA 0
+#define ANONYMOUS_MMAP_ARENA 1
 
+#define DATA_IN_ARENA 0
+#define DATA_IN_MAPPED_FILE 1
+#define DATA_IN_FILE_COPY 2
 
-double linearAF(const double x)  {  return x;  }
-double stepAF(const double x)  {  if (x <= 0.)  return 0.;  else  return 1.;  }
-double ReLUAF(const double x)  {  if (x <= 0.)  return 0.;  else  return x;  }
-double ReLU1AF(const double x)  {  if (x <= 0.)  return 0.;  else if (x >= 1.)  return 1.;  else  return x;  }
-double sigmoidAF(const double x)  {  return 1. / (1. + exp(-x));  }
+#define CDNN_FILE_HEADER_BYTES 64
 
-double (*fs[6])(const double) = { &linearAF, &stepAF, &ReLUAF, &ReLU1AF, &sigmoidAF, &tanh };
+    // CDNN_ALIGN-aligned blocks, which are released with alignedFree() and never free():  posix_memalign() on Unix,
+    // _aligned_malloc() under MSVC, and otherwise a malloc() block that is rounded up, with the offset in the byte below
 
-double *run_CDNN(CDNN *NN, double *inputs)
+void *alignedAlloc(size_t numBytes)
 {
-    int l, li, l0, n, i, i0, j, sparseWeights = (NN->n0 != NULL);
-    double *w;
-    
-    NN->y[0][0] = 1;
-    memcpy(NN->y[1], inputs, NN->layerSize[1]*sizeof(double));
-    if (NN->variationalLayer > 0)  memcpy(NN->y[NN->variationalLayer],
-            inputs+NN->layerSize[1], NN->layerSize[NN->variationalLayer]*sizeof(double));
+#if defined(_MSC_VER)
+    return _aligned_malloc(numBytes, CDNN_ALIGN);
+#elif defined(CDNN_POSIX_MEMALIGN)
+    void *ptr;
     
-    for (l = 2; l < NN->numLayers; l++)  {
-    if (l != NN->variationalLayer)  {
-        for (n = 0; n < NN->layerSize[l]; n++)  NN->y[l][n] = 0.;
-        for (li = 0; li < NN->numLayerInputs[l]; li++)  {
-            l0 = NN->layerInputs[l][li];
-            w = NN->weights[l][li];
-            if (sparseWeights)  {
-                int *n0 = NN->n0[l][li], *nf = NN->nf[l][li];
-                for (j = 0; j < NN->wSize[l][li]; j++)  {
-                    NN->y[l][nf[j]] += w[j] * NN->y[l0][n0[j]];
-            }   }
-            else  {
-                for (i = 0; i < NN->layerSize[l]; i++)  {
-                for (i0 = 0; i0 < NN->layerSize[l0]; i0++)  {
-                    NN->y[l][i] += (*w) * NN->y[l0][i0];
-                    w++;
-        }   }   }}
-        for (n = 0; n < NN->layerSize[l]; n++)  {
-            NN->y[l][n] = fs[NN->layerAFs[l]](NN->y[l][n]);
-    }}  }
+    if (posix_memalign(&ptr, CDNN_ALIGN, numBytes) != 0)  return NULL;
+    return ptr;
+#else
+    char *block = malloc(numBytes + CDNN_ALIGN), *ptr;
     
-    return NN->y[NN->numLayers-1];
+    if (block == NULL)  return NULL;
+    ptr = block + CDNN_ALIGN - (uintptr_t) block % CDNN_ALIGN;
+    ptr[-1] = (char) (ptr - block);
+    return ptr;
+#endif
 }
 
-
-void free_CDNN(CDNN *NN)
+void alignedFree(void *ptr)
+{
+#if defined(_MSC_VER)
+    _aligned_free(ptr);
+#elif defined(CDNN_POSIX_MEMALIGN)
+    free(ptr);
+#else
+    if (ptr != NULL)  free((char *) ptr - ((unsigned char *) ptr)[-1]);
+#endif
+}
+
+
+typedef struct { char *base; size_t numBytes; } arenaType;
+
+void *arenaAlloc(arenaType *arena, size_t numBytes)
+{
+    void *ptr = NULL;
+    
+    if (arena->base != NULL)  ptr = arena->base + arena->numBytes;
+    arena->numBytes += (numBytes + CDNN_ALIGN-1) & ~((size_t) CDNN_ALIGN-1);
+    
+    return ptr;
+}
+
+
+int ifDenseBlock(int numWeights, int numOut, int numIn)
+{
+    return (numWeights >= CDNN_DENSE_BLOCK_DENSITY*numOut*numIn);
+}
+    
+    
+    // topology[] holds layerSize[], layerAFs[], numLayerInputs[], then all layerInputs[][], then all wSize[][]
+    // (which are unused if the weights are not sparse)
+
+int topologyLength(const int *topology, int numLayers)
+{
+    int l, numBlocks = 0;
+    
+    for (l = 0; l < numLayers; l++)  numBlocks += topology[2*numLayers+l];
+    
+    return 3*numLayers + 2*numBlocks;
+}
+
+    // Plans the batch tile buffers.  A layer is live from when it is written (the start of a tile, for the bias,
+    // input and variational layers) up to its last consumer, or to the end of the tile for the output layer.
+    // Each layer gets the lowest offset into a shared pool that doesn't overlap a layer it is live alongside;
+    // a layer is always live alongside its own inputs, so no kernel reads and writes the same memory.
+    // Offsets are in neurons, layer 0 is placed first (at offset 0), and yPlanSize is the pool size.
+
+void planActivations(CDNN_model *NN)
 {
-    int l, li, isSparse = (NN->n0 != NULL);
+    int l, l2, li, first, first2, ifMoved;
+    long offset;
     
     for (l = 0; l < NN->numLayers; l++)  {
-        for (li = 0; li < NN->numLayerInputs[l]; li++)  {
-            free(NN->weights[l][li]);
-            if (isSparse)  {
-                free(NN->n0[l][li]);
-                free(NN->nf[l][li]);
+        if ((l <= 1) || (l == NN->variationalLayer))  NN->lastConsumer[l] = 0;
+        else  NN->lastConsumer[l] = l;
+        for (li = 0; li < NN->numLayerInputs[l]; li++)  NN->lastConsumer[NN->layerInputs[l][li]] = l;
+    }
+    NN->lastConsumer[NN->numLayers-1] = NN->numLayers;
+    
+    NN->yPlanSize = 0;
+    for (l = 0; l < NN->numLayers; l++)  {
+        first = ((l <= 1) || (l == NN->variationalLayer)) ? 0 : l;
+        offset = 0;
+        do  {
+            ifMoved = 0;
+            for (l2 = 0; l2 < l; l2++)  {
+                first2 = ((l2 <= 1) || (l2 == NN->variationalLayer)) ? 0 : l2;
+                if ((first2 > NN->lastConsumer[l]) || (first > NN->lastConsumer[l2]))  continue;
+                if ((offset < NN->yPlan[l2] + NN->layerSize[l2]) && (NN->yPlan[l2] < offset + NN->layerSize[l]))  {
+                    offset = NN->yPlan[l2] + NN->layerSize[l2];
+                    ifMoved = 1;
+        }   }   }
+        while (ifMoved);
+        
+        NN->yPlan[l] = offset;
+        if (offset + NN->layerSize[l] > NN->yPlanSize)  NN->yPlanSize = offset + NN->layerSize[l];
+}   }
+
+
+void layoutModel(CDNN *NN, arenaType *tables, arenaType *data, const int *topology, int weightSparsity)
+{
+    int l, li, l0, b, numBlocks, numWeights, numLayers = NN->model.numLayers, ifPlace = (tables->base != NULL);
+    const int *layerSize = topology, *numLayerInputs = topology + 2*numLayers, *layerInputs = topology + 3*numLayers, *wSize;
+    int *topologyCopy, **layerInputsTable, **wSizeTable, ***n0Table, ***nfTable, ***rowStartTable, *lastTable;
+    double ***weightsTable, ***denseTable, **yTable;
+    long *planTable;
+    
+    numBlocks = (topologyLength(topology, numLayers) - 3*numLayers)/2;
+    wSize = layerInputs + numBlocks;
+    
+    layerInputsTable = arenaAlloc(tables, numLayers*sizeof(int *));
+    weightsTable = arenaAlloc(tables, numLayers*sizeof(double **));
+    yTable = arenaAlloc(tables, numLayers*sizeof(double *));
+    lastTable = arenaAlloc(tables, numLayers*sizeof(int));
+    planTable = arenaAlloc(tables, numLayers*sizeof(long));
+    if (weightSparsity == SPARSE_WEIGHTS)  {
+        wSizeTable = arenaAlloc(tables, numLayers*sizeof(int *));
+        n0Table = arenaAlloc(tables, numLayers*sizeof(int **));
+        nfTable = arenaAlloc(tables, numLayers*sizeof(int **));
+        rowStartTable = arenaAlloc(tables, numLayers*sizeof(int **));
+        denseTable = arenaAlloc(tables, numLayers*sizeof(double **));
+    }
+    else  {
+        wSizeTable = NULL;
+        n0Table = nfTable = rowStartTable = NULL;
+        denseTable = NULL;     }
+    
+    topologyCopy = arenaAlloc(data, (3*numLayers + 2*numBlocks)*sizeof(int));
+    
+    if (ifPlace)  {
+        if (topologyCopy != topology)  memcpy(topologyCopy, topology, (3*numLayers + 2*numBlocks)*sizeof(int));
+        NN->model.modelData = data->base;
+        NN->model.layerSize = topologyCopy;
+        NN->model.layerAFs = topologyCopy + numLayers;
+        NN->model.numLayerInputs = topologyCopy + 2*numLayers;
+        NN->model.layerInputs = layerInputsTable;
+        NN->model.weights = weightsTable;
+        NN->y = yTable;
+        NN->model.wSize = wSizeTable;
+        NN->model.n0 = n0Table;
+        NN->model.nf = nfTable;
+        NN->model.rowStart = rowStartTable;
+        NN->model.denseWeights = denseTable;
+        NN->model.lastConsumer = lastTable;
+        NN->model.yPlan = planTable;
+    }
+    
+    b = 0;
+    for (l = 0; l < numLayers; l++)  {
+        double **weightPtrs = arenaAlloc(tables, numLayerInputs[l]*sizeof(double *));
+        int **n0Ptrs = NULL, **nfPtrs = NULL, **rowStartPtrs = NULL;
+        double **densePtrs = NULL;
+        
+        if (weightSparsity == SPARSE_WEIGHTS)  {
+            n0Ptrs = arenaAlloc(tables, numLayerInputs[l]*sizeof(int *));
+            nfPtrs = arenaAlloc(tables, numLayerInputs[l]*sizeof(int *));
+            rowStartPtrs = arenaAlloc(tables, numLayerInputs[l]*sizeof(int *));
+            densePtrs = arenaAlloc(tables, numLayerInputs[l]*sizeof(double *));
+        }
+        if (ifPlace)  {
+            NN->model.layerInputs[l] = topologyCopy + 3*numLayers + b;
+            NN->model.weights[l] = weightPtrs;
+            if (weightSparsity == SPARSE_WEIGHTS)  {
+                NN->model.wSize[l] = topologyCopy + 3*numLayers + numBlocks + b;
+                NN->model.n0[l] = n0Ptrs;
+                NN->model.nf[l] = nfPtrs;
+                NN->model.rowStart[l] = rowStartPtrs;
+                NN->model.denseWeights[l] = densePtrs;
         }   }
         
-        free(NN->layerInputs[l]);
-        free(NN->weights[l]);
-        free(NN->y[l]);
-        if (isSparse)  {
-            free(NN->wSize[l]);
-            free(NN->n0[l]);
-            free(NN->nf[l]);
+        for (li = 0; li < numLayerInputs[l]; li++)  {
+            int *n0, *nf, *rowStart;
+            double *weights, *dense = NULL;
+            
+            l0 = layerInputs[b+li];
+            if (weightSparsity == SPARSE_WEIGHTS)  numWeights = wSize[b+li];
+            else  numWeights = layerSize[l]*layerSize[l0];
+            
+            weights = arenaAlloc(data, numWeights*sizeof(double));
+            if (ifPlace)  weightPtrs[li] = weights;
+            
+            if (weightSparsity == SPARSE_WEIGHTS)  {
+                n0 = arenaAlloc(data, numWeights*sizeof(int));
+                nf = arenaAlloc(data, numWeights*sizeof(int));
+                rowStart = arenaAlloc(data, (layerSize[l]+1)*sizeof(int));
+                if (ifDenseBlock(numWeights, layerSize[l], layerSize[l0]))  {
+                    dense = arenaAlloc(data, (size_t) layerSize[l]*layerSize[l0]*sizeof(double));
+                }
+                if (ifPlace)  {
+                    n0Ptrs[li] = n0;
+                    nfPtrs[li] = nf;
+                    rowStartPtrs[li] = rowStart;
+                    densePtrs[li] = dense;
+        }   }   }
+        b += numLayerInputs[l];
+    }
+    
+    for (l = 0; l < numLayers; l++)  {
+        double *y = arenaAlloc(tables, layerSize[l]*sizeof(double));
+        if (ifPlace)  NN->y[l] = y;
+    }
+    
+    if (ifPlace)  {
+        NN->model.modelDataBytes = data->numBytes;
+        planActivations(&NN->model);
+}   }
+    
+    
+    // copies the model's topology and weight pointers into the CDNN's own fields of the same names,
+    // so that code reading myNN.layerSize[] etc. sees the same arena as the model
+
+void shareModelFields(CDNN *NN)
+{
+    NN->numLayers = NN->model.numLayers;
+    NN->encoderLayer = NN->model.encoderLayer;
+    NN->variationalLayer = NN->model.variationalLayer;
+    NN->layerSize = NN->model.layerSize;
+    NN->layerAFs = NN->model.layerAFs;
+    NN->numLayerInputs = NN->model.numLayerInputs;
+    NN->layerInputs = NN->model.layerInputs;
+    NN->wSize = NN->model.wSize;
+    NN->n0 = NN->model.n0;
+    NN->nf = NN->model.nf;
+    NN->weights = NN->model.weights;
+}
+
+
+    // sizes the arena; if modelData != NULL the model data is already in memory (a loaded file)
+    // and only the tables are allocated
+
+int allocModel(CDNN *NN, const int *topology, int weightSparsity, char *modelData, size_t modelDataBytes)
+{
+    arenaType tables, data;
+    
+    tables.base = data.base = NULL;
+    tables.numBytes = data.numBytes = 0;
+    layoutModel(NN, &tables, &data, topology, weightSparsity);
+    if ((modelData != NULL) && (data.numBytes != modelDataBytes))  return CD_NN_READ_ERROR;
+    
+    NN->model.arenaBytes = tables.numBytes;
+    if (modelData == NULL)  NN->model.arenaBytes += data.numBytes;
+    NN->model.arenaKind = MALLOC_ARENA;
+    
+#if defined(CDNN_HUGE_PAGES) && defined(MADV_HUGEPAGE)
+    if (NN->model.arenaBytes >= (1 << 21))  {
+        tables.base = mmap(NULL, NN->model.arenaBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (tables.base == MAP_FAILED)  tables.base = NULL;
+        else  {
+            madvise(tables.base, NN->model.arenaBytes, MADV_HUGEPAGE);
+            NN->model.arenaKind = ANONYMOUS_MMAP_ARENA;
     }   }
+    if (tables.base == NULL)
+#endif
+    tables.base = alignedAlloc(NN->model.arenaBytes);
+    
+    NN->model.arena = tables.base;
+    if (tables.base == NULL)  return CD_OUT_OF_MEMORY_ERROR;
+    
+    if (modelData == NULL)  data.base = tables.base + tables.numBytes;
+    else  data.base = modelData;
+    tables.numBytes = data.numBytes = 0;
+    layoutModel(NN, &tables, &data, topology, weightSparsity);
+    shareModelFields(NN);
+    
+    return 0;
+}
+
+
+    // a network starts out with no arenas, and without the single-precision, quantized, bit-packed or column-major copies of its weights
+
+void initArenas(CDNN *NN)
+{
+    NN->model.arena = NN->model.f32Arena = NN->model.quantArena = NN->model.bitArena = NN->model.eventArena = NULL;
+    NN->model.weightsF32 = NN->model.denseWeightsF32 = NULL;
+    NN->model.quantBits = 0;
+    NN->model.dataKind = DATA_IN_ARENA;
+    NN->yF32 = NULL;
+    NN->yQ = NULL;
+    NN->yBits = NULL;
+    NN->active = NULL;
+    NN->numActive = NULL;
+    NN->profile = NULL;
+}
+
+
+void freeArena(CDNN_model *model)
+{
+#if defined(CDNN_HUGE_PAGES) && defined(MADV_HUGEPAGE)
+    if (model->arenaKind == ANONYMOUS_MMAP_ARENA)  munmap(model->arena, model->arenaBytes);
+    else
+#endif
+    alignedFree(model->arena);
+    model->arena = NULL;
+    
+#ifdef CDNN_MMAP_FILES
+    if (model->dataKind == DATA_IN_MAPPED_FILE)  munmap(model->modelData - CDNN_FILE_HEADER_BYTES,
+            model->modelDataBytes + CDNN_FILE_HEADER_BYTES);
+#endif
+    if (model->dataKind == DATA_IN_FILE_COPY)  alignedFree(model->modelData - CDNN_FILE_HEADER_BYTES);
+    model->dataKind = DATA_IN_ARENA;
+    
+    alignedFree(model->f32Arena);
+    model->f32Arena = NULL;
+    model->weightsF32 = model->denseWeightsF32 = NULL;
+    
+    alignedFree(model->quantArena);
+    model->quantArena = NULL;
+    model->quantBits = 0;
+    
+    alignedFree(model->bitArena);
+    model->bitArena = NULL;
+    
+    alignedFree(model->eventArena);
+    model->eventArena = NULL;
+}
+    
+    
+    // Sorts the weights of each sparse block by (output neuron, input neuron) and indexes where each
+    // output neuron's weights start; blocks that are dense enough are also expanded into a full matrix,
+    // which the dense kernels get through faster than the gather over n0[]
+
+int makeSparseRows(CDNN_model *NN)
+{
+    int l, li, l0, i, j, k, pass, numW, numOut, numIn, maxW, maxN, *key, *count, *tmpN0, *tmpNf;
+    double *tmpW, *dense;
+    
+    maxW = maxN = 0;
+    for (l = 0; l < NN->numLayers; l++)  {
+        if (NN->layerSize[l] > maxN)  maxN = NN->layerSize[l];
+        for (li = 0; li < NN->numLayerInputs[l]; li++)  {
+        if (NN->wSize[l][li] > maxW)  {
+            maxW = NN->wSize[l][li];
+    }}  }
+    
+    count = malloc((maxN+1)*sizeof(int));
+    tmpN0 = malloc(maxW*sizeof(int));
+    tmpNf = malloc(maxW*sizeof(int));
+    tmpW = malloc(maxW*sizeof(double));
+    if ((count == NULL) || (tmpN0 == NULL) || (tmpNf == NULL) || (tmpW == NULL))  {
+        free(count);  free(tmpN0);  free(tmpNf);  free(tmpW);
+        return CD_OUT_OF_MEMORY_ERROR;     }
+    
+    for (l = 0; l < NN->numLayers; l++)  {
+    for (li = 0; li < NN->numLayerInputs[l]; li++)  {
+        l0 = NN->layerInputs[l][li];
+        numOut = NN->layerSize[l];
+        numIn = NN->layerSize[l0];
+        numW = NN->wSize[l][li];
+        
+        for (j = 0; j < numW; j++)  {
+        if ((NN->nf[l][li][j] < 0) || (NN->nf[l][li][j] >= numOut) || (NN->n0[l][li][j] < 0) || (NN->n0[l][li][j] >= numIn))  {
+            free(count);  free(tmpN0);  free(tmpNf);  free(tmpW);
+            return CD_NN_READ_ERROR;
+        }}
+        
+            // two stable counting sorts:  first by input neuron, then by output neuron
+        for (pass = 0; pass < 2; pass++)  {
+            key = (pass == 0) ? NN->n0[l][li] : NN->nf[l][li];
+            for (i = 0; i <= maxN; i++)  count[i] = 0;
+            for (j = 0; j < numW; j++)  count[key[j]+1]++;
+            for (i = 1; i <= maxN; i++)  count[i] += count[i-1];
+            for (j = 0; j < numW; j++)  {
+                k = count[key[j]]++;
+                tmpN0[k] = NN->n0[l][li][j];
+                tmpNf[k] = NN->nf[l][li][j];
+                tmpW[k] = NN->weights[l][li][j];
+            }
+            memcpy(NN->n0[l][li], tmpN0, numW*sizeof(int));
+            memcpy(NN->nf[l][li], tmpNf, numW*sizeof(int));
+            memcpy(NN->weights[l][li], tmpW, numW*sizeof(double));
+        }
+        
+        for (i = 0; i <= numOut; i++)  NN->rowStart[l][li][i] = 0;
+        for (j = 0; j < numW; j++)  NN->rowStart[l][li][NN->nf[l][li][j]+1]++;
+        for (i = 0; i < numOut; i++)  NN->rowStart[l][li][i+1] += NN->rowStart[l][li][i];
+        
+        dense = NN->denseWeights[l][li];
+        if (dense != NULL)  {
+            memset(dense, 0, (size_t) numOut*numIn*sizeof(double));
+            for (j = 0; j < numW; j++)  dense[(long) NN->nf[l][li][j]*numIn + NN->n0[l][li][j]] += NN->weights[l][li][j];
+    }   }}
+    
+    free(count);
+    free(tmpN0);
+    free(tmpNf);
+    free(tmpW);
+    
+    return 0;
+}
+
+
+    // checks the topology read from the server
+
+int checkLayers(const int *topology, int numLayers)
+{
+    int l;
+    
+    for (l = 0; l < numLayers; l++)  {
+    if ((topology[l] <= 0) || (topology[numLayers+l] < 0) || (topology[numLayers+l] > 5)
+            || (topology[2*numLayers+l] < 0) || (topology[2*numLayers+l] > l))  {
+        return CD_NN_READ_ERROR;
+    }}
+    
+    return 0;
+}
+
+int checkLayerInputs(const int *topology, int numLayers, int weightSparsity)
+{
+    int l, li, b, numBlocks = (topologyLength(topology, numLayers) - 3*numLayers)/2;
+    
+    b = 3*numLayers;
+    for (l = 0; l < numLayers; l++)  {
+    for (li = 0; li < topology[2*numLayers+l]; li++)  {
+        if ((topology[b] < 0) || (topology[b] >= l))  return CD_NN_READ_ERROR;
+        if ((weightSparsity == SPARSE_WEIGHTS) && (topology[b+numBlocks] < 0))  return CD_NN_READ_ERROR;
+        b++;
+    }}
+    
+    return 0;
+}
+
+    // checks the sparse indices of a loaded network, which the kernels index with unchecked
+
+int checkSparseIndices(const CDNN_model *NN)
+{
+    int l, li, i, j, numOut, numIn;
+    const int *rowStart;
+    
+    for (l = 0; l < NN->numLayers; l++)  {
+    for (li = 0; li < NN->numLayerInputs[l]; li++)  {
+        numOut = NN->layerSize[l];
+        numIn = NN->layerSize[NN->layerInputs[l][li]];
+        rowStart = NN->rowStart[l][li];
+        for (j = 0; j < NN->wSize[l][li]; j++)  {
+        if ((NN->nf[l][li][j] < 0) || (NN->nf[l][li][j] >= numOut) || (NN->n0[l][li][j] < 0) || (NN->n0[l][li][j] >= numIn))  {
+            return CD_NN_READ_ERROR;
+        }}
+        if ((rowStart[0] != 0) || (rowStart[numOut] != NN->wSize[l][li]))  return CD_NN_READ_ERROR;
+        for (i = 0; i < numOut; i++)  {
+        if (rowStart[i+1] < rowStart[i])  {
+            return CD_NN_READ_ERROR;
+    }}  }}
+    
+    return 0;
+}
+
+#define CDNN_ERR_MSG_CHARS 400
+
+    // Each request has its own error message.  The synchronous functions hand theirs back in a per-thread copy,
+    // which stays valid until the same thread trains another network.
+
+CDNN_THREAD_LOCAL char errMsgChars[CDNN_ERR_MSG_CHARS];
+
+void setErrMsg(char *errMsg, const char *msg)
+{
+    int i;
+    char *c = errMsg;
+    
+    for (i = 0; i < CDNN_ERR_MSG_CHARS-4; i++)  {
+        *c = msg[i];
+        if (*c == 0)  return;
+        c++;
+    }
+    
+    c[0] = c[1] = c[2] = '.';
+    c[3] = 0;
+}
+
+
+    // The server's response is parsed as curl delivers it, straight into the arena:  a state machine
+    // reads the header and topology into a scratch buffer, allocates the arena once it knows the sizes,
+    // then reads each array in turn.  Only a number that straddles two chunks is copied (into token[]).
+
+#define READ_HEADER 0
+#define READ_LAYERS 1
+#define READ_LAYER_INPUTS 2
+#define READ_WEIGHT_COUNTS 3
+#define READ_WEIGHTS 4
+#define READ_SAMPLE_OUTPUTS 5
+#define READ_DONE 6
+#define READ_ERROR_TEXT 7
+
+#define READER_TOKEN_CHARS 512
+
+typedef struct {
+    CDNN *NN;
+    double *sampleOutputs;
+    int numSamples, weightSparsity;
+    int stage, rtrn, header[3], *topology, ifArena;
+    int arr, l, li;
+    void *dest;
+    int destMode;
+    long destLeft, numCharsRead;
+    char token[READER_TOKEN_CHARS];
+    int tokenLength;
+    char *errMsg;
+} NNreaderType;
+
+void initReader(NNreaderType *reader, CDNN *NN, double *sampleOutputs, int numSamples, int weightSparsity, char *errMsg)
+{
+    reader->NN = NN;
+    reader->sampleOutputs = sampleOutputs;
+    reader->numSamples = numSamples;
+    reader->weightSparsity = weightSparsity;
+    reader->stage = READ_HEADER;
+    reader->rtrn = 0;
+    reader->topology = NULL;
+    reader->ifArena = 0;
+    reader->dest = reader->header;
+    reader->destMode = 0;
+    reader->destLeft = 3;
+    reader->numCharsRead = 0;
+    reader->tokenLength = 0;
+    reader->errMsg = errMsg;
+    
+    if (NN != NULL)  initArenas(NN);
+}
+
+
+    // called when the current array is full:  sets up the next one
+
+int advanceReader(NNreaderType *reader)
+{
+    CDNN *NN = reader->NN;
+    int numLayers, numBlocks, *newTopology, rtrn;
+    
+    switch (reader->stage)  {
+        
+        case READ_HEADER:
+            NN->model.numLayers = reader->header[0];
+            NN->model.encoderLayer = reader->header[1];
+            NN->model.variationalLayer = reader->header[2];
+            if ((NN->model.numLayers < 2) || (NN->model.variationalLayer >= NN->model.numLayers))  return CD_NN_READ_ERROR;
+            CDNN_set_simd_level(&NN->model, CDNN_SIMD_BEST);
+            NN->model.exactAFs = 0;
+            
+            reader->topology = malloc(3*NN->model.numLayers*sizeof(int));
+            if (reader->topology == NULL)  return CD_OUT_OF_MEMORY_ERROR;
+            reader->dest = reader->topology;
+            reader->destLeft = 3*NN->model.numLayers;
+            reader->stage = READ_LAYERS;
+            return 0;
+        
+        case READ_LAYERS:
+            numLayers = NN->model.numLayers;
+            if (checkLayers(reader->topology, numLayers) != 0)  return CD_NN_READ_ERROR;
+            numBlocks = (topologyLength(reader->topology, numLayers) - 3*numLayers)/2;
+            newTopology = realloc(reader->topology, (3*numLayers + 2*numBlocks)*sizeof(int));
+            if (newTopology == NULL)  return CD_OUT_OF_MEMORY_ERROR;
+            reader->topology = newTopology;
+            reader->dest = reader->topology + 3*numLayers;
+            reader->destLeft = numBlocks;
+            reader->stage = READ_LAYER_INPUTS;
+            return 0;
+        
+        case READ_LAYER_INPUTS:
+            numLayers = NN->model.numLayers;
+            numBlocks = (topologyLength(reader->topology, numLayers) - 3*numLayers)/2;
+            reader->stage = READ_WEIGHT_COUNTS;
+            if (reader->weightSparsity == SPARSE_WEIGHTS)  {
+                reader->dest = reader->topology + 3*numLayers + numBlocks;
+                reader->destLeft = numBlocks;
+                return 0;     }
+            memset(reader->topology + 3*numLayers + numBlocks, 0, numBlocks*sizeof(int));
+            return advanceReader(reader);
+        
+        case READ_WEIGHT_COUNTS:
+            rtrn = checkLayerInputs(reader->topology, NN->model.numLayers, reader->weightSparsity);
+            if (rtrn == 0)  rtrn = allocModel(NN, reader->topology, reader->weightSparsity, NULL, 0);
+            free(reader->topology);
+            reader->topology = NULL;
+            if (rtrn != 0)  return rtrn;
+            reader->ifArena = 1;
+            
+            reader->stage = READ_WEIGHTS;
+            reader->arr = (reader->weightSparsity == SPARSE_WEIGHTS) ? 0 : 2;
+            reader->l = 0;
+            reader->li = -1;
+            return advanceReader(reader);
+        
+        case READ_WEIGHTS:
+                // the n0 arrays of every block, then the nf arrays, then the weights
+            reader->li++;
+            while (reader->li >= NN->model.numLayerInputs[reader->l])  {
+                reader->li = 0;
+                reader->l++;
+                if (reader->l == NN->model.numLayers)  {
+                    reader->l = 0;
+                    reader->arr++;
+                    if (reader->arr == 3)  {
+                        reader->stage = READ_SAMPLE_OUTPUTS;
+                        reader->dest = reader->sampleOutputs;
+                        reader->destMode = 1;
+                        if (reader->sampleOutputs == NULL)  reader->destLeft = 0;
+                        else  reader->destLeft = (long) NN->model.layerSize[NN->model.numLayers-1]*reader->numSamples;
+                        return 0;
+            }   }   }
+            
+            if (reader->weightSparsity == SPARSE_WEIGHTS)  reader->destLeft = NN->model.wSize[reader->l][reader->li];
+            else  reader->destLeft = (long) NN->model.layerSize[reader->l]*NN->model.layerSize[NN->model.layerInputs[reader->l][reader->li]];
+            if (reader->arr == 0)  reader->dest = NN->model.n0[reader->l][reader->li];
+            else if (reader->arr == 1)  reader->dest = NN->model.nf[reader->l][reader->li];
+            else  reader->dest = NN->model.weights[reader->l][reader->li];
+            reader->destMode = (reader->arr == 2);
+            return 0;
+        
+        case READ_SAMPLE_OUTPUTS:
+            reader->stage = READ_DONE;
+            reader->dest = NULL;
+            return 0;
+    }
+    
+    return 0;
+}
+
+
+    // moves on to where the next number goes
+
+int nextNumber(NNreaderType *reader)
+{
+    int rtrn;
+    
+    if (reader->destMode == 0)  reader->dest = (int *) reader->dest + 1;
+    else  reader->dest = (double *) reader->dest + 1;
+    
+    reader->destLeft--;
+    while ((reader->destLeft == 0) && (reader->stage != READ_DONE))  {
+        rtrn = advanceReader(reader);
+        if (rtrn != 0)  return rtrn;     }
+    
+    return 0;
+}
+
+const char *parseNumber(NNreaderType *reader, const char *c, const char *end)
+{
+    if (reader->destMode == 0)  return parseInt(c, end, (int *) reader->dest);
+    else  return parseDouble(c, end, (double *) reader->dest);
+}
+
+
+    // reads one number, which fills [c, end) apart from spaces; empty tokens (from ',;' and the like) are skipped
+
+int readToken(NNreaderType *reader, const char *c, const char *end)
+{
+    c = skipSpaces(c, end);
+    if (c == end)  return 0;
+    
+    c = parseNumber(reader, c, end);
+    if ((c == NULL) || (skipSpaces(c, end) != end))  return CD_NN_READ_ERROR;
+    
+    return nextNumber(reader);
+}
+
+int appendToken(NNreaderType *reader, const char *c, const char *end)
+{
+    if (reader->tokenLength + (end-c) > READER_TOKEN_CHARS)  return CD_NN_READ_ERROR;
+    memcpy(reader->token + reader->tokenLength, c, end-c);
+    reader->tokenLength += end-c;
+    
+    return 0;
+}
+
+
+    // Parses the next chunk of the response.  A response that doesn't start with a digit is an error message,
+    // which is kept in reader->errMsg.
+
+int feedReader(NNreaderType *reader, const char *chars, long numChars)
+{
+    const char *c = chars, *end = chars+numChars, *tokenEnd;
+    long numErrChars;
     
-    free(NN->layerSize);
-    free(NN->layerAFs);
-    free(NN->numLayerInputs);
-    free(NN->layerInputs);
-    free(NN->weights);
-    free(NN->y);
-    if (isSparse)  {
-        free(NN->wSize);
-        free(NN->n0);
-        free(NN->nf);
+    if ((reader->stage == READ_HEADER) && (reader->numCharsRead == 0) && (numChars > 0) && !ifDigit(*c))  reader->stage = READ_ERROR_TEXT;
+    
+    if (reader->stage == READ_ERROR_TEXT)  {
+        numErrChars = CDNN_ERR_MSG_CHARS-1 - reader->numCharsRead;
+        if (numErrChars > numChars)  numErrChars = numChars;
+        if (numErrChars > 0)  {
+            memcpy(reader->errMsg + reader->numCharsRead, c, numErrChars);
+            reader->errMsg[reader->numCharsRead + numErrChars] = 0;     }
+        reader->numCharsRead += numChars;
+        return 0;
+    }
+    reader->numCharsRead += numChars;
+    
+    while ((c < end) && (reader->rtrn == 0) && (reader->stage != READ_DONE))  {
+        
+            // usually the number and its delimiter are both in this chunk, and it's read in place
+        if (reader->tokenLength == 0)  {
+            tokenEnd = parseNumber(reader, c, end);
+            if (tokenEnd != NULL)  tokenEnd = skipSpaces(tokenEnd, end);
+            if ((tokenEnd != NULL) && (tokenEnd < end) && ((*tokenEnd == ',') || (*tokenEnd == ';')))  {
+                reader->rtrn = nextNumber(reader);
+                c = tokenEnd+1;
+                continue;
+        }   }
+        
+        tokenEnd = c;
+        while ((tokenEnd < end) && (*tokenEnd != ',') && (*tokenEnd != ';'))  tokenEnd++;
+        
+        if (tokenEnd == end)  reader->rtrn = appendToken(reader, c, end);
+        else if (reader->tokenLength > 0)  {
+            reader->rtrn = appendToken(reader, c, tokenEnd);
+            if (reader->rtrn == 0)  reader->rtrn = readToken(reader, reader->token, reader->token + reader->tokenLength);
+            reader->tokenLength = 0;     }
+        else  reader->rtrn = readToken(reader, c, tokenEnd);
+        
+        c = tokenEnd+1;
     }
+    
+    return reader->rtrn;
+}
+
+
+    // called after the last chunk; frees the network if it is incomplete
+
+int finishReader(NNreaderType *reader)
+{
+    if ((reader->stage == READ_HEADER) && (reader->numCharsRead == 0))  {
+        reader->errMsg[0] = 0;
+        reader->stage = READ_ERROR_TEXT;     }
+    
+    if ((reader->rtrn == 0) && (reader->stage == READ_ERROR_TEXT))  {
+        if (reader->numCharsRead > CDNN_ERR_MSG_CHARS-1)  setErrMsg(reader->errMsg, reader->errMsg);
+        reader->rtrn = CD_PARAMS_ERR;     }
+    
+    if ((reader->rtrn == 0) && (reader->tokenLength > 0))  {
+        reader->rtrn = readToken(reader, reader->token, reader->token + reader->tokenLength);
+        reader->tokenLength = 0;     }
+    if ((reader->rtrn == 0) && (reader->stage != READ_DONE))  reader->rtrn = CD_NN_READ_ERROR;
+    
+    if ((reader->rtrn == 0) && (reader->weightSparsity == SPARSE_WEIGHTS) && (reader->NN != NULL))  {
+        reader->rtrn = makeSparseRows(&reader->NN->model);     }
+    
+    free(reader->topology);
+    reader->topology = NULL;
+    if ((reader->rtrn != 0) && reader->ifArena)  freeArena(&reader->NN->model);
+    reader->ifArena = 0;
+    
+    return reader->rtrn;
+}
+    
+    
+    
+    // Network files:  a CDNN_FILE_HEADER_BYTES header, then the model data exactly as it is laid out in the arena.
+    // A file written on a machine of the other byte order is read into memory and byte-swapped;
+    // otherwise it is mapped read-only, so its pages are loaded on demand and shared between processes.
+
+#define CDNN_FILE_VERSION 1
+#define CDNN_ENDIAN_TAG 0x01020304
+
+typedef struct {
+    char magic[4];
+    uint32_t endianTag, version, flags, alignment, intBytes, doubleBytes;
+    int32_t numLayers, encoderLayer, variationalLayer;
+    uint64_t modelDataBytes;
+    char unused[16];
+} fileHeaderType;
+
+void swapBytes(void *data, size_t numElements, int elementBytes)
+{
+    size_t e;
+    int b;
+    char *bytes = data, tmp;
+    
+    for (e = 0; e < numElements; e++)  {
+        for (b = 0; b < elementBytes/2; b++)  {
+            tmp = bytes[b];
+            bytes[b] = bytes[elementBytes-1-b];
+            bytes[elementBytes-1-b] = tmp;
+        }
+        bytes += elementBytes;
+}   }
+
+void fillFileHeader(CDNN *NN, fileHeaderType *header)
+{
+    memset(header, 0, sizeof(fileHeaderType));
+    memcpy(header->magic, "CDNN", 4);
+    header->endianTag = CDNN_ENDIAN_TAG;
+    header->version = CDNN_FILE_VERSION;
+    header->flags = (NN->model.n0 != NULL) ? SPARSE_WEIGHTS : NONSPARSE_WEIGHTS;
+    header->alignment = CDNN_ALIGN;
+    header->intBytes = sizeof(int);
+    header->doubleBytes = sizeof(double);
+    header->numLayers = NN->model.numLayers;
+    header->encoderLayer = NN->model.encoderLayer;
+    header->variationalLayer = NN->model.variationalLayer;
+    header->modelDataBytes = NN->model.modelDataBytes;
+}
+
+int writeNetwork(CDNN *NN, FILE *fileP)
+{
+    fileHeaderType header;
+    
+    fillFileHeader(NN, &header);
+    if (fwrite(&header, sizeof(header), 1, fileP) != 1)  return CD_FILE_ERROR;
+    if (fwrite(NN->model.modelData, 1, NN->model.modelDataBytes, fileP) != NN->model.modelDataBytes)  return CD_FILE_ERROR;
+    
+    return 0;
+}
+
+int CDNN_save(CDNN *NN, const char *fileName)
+{
+    FILE *fileP;
+    int rtrn;
+    
+    fileP = fopen(fileName, "wb");
+    if (fileP == NULL)  return CD_FILE_ERROR;
+    rtrn = writeNetwork(NN, fileP);
+    if (fclose(fileP) != 0)  rtrn = CD_FILE_ERROR;
+    
+    return rtrn;
+}
+
+void swapModelData(CDNN *NN)
+{
+    int l, li, numWeights;
+    
+    for (l = 0; l < NN->model.numLayers; l++)  {
+    for (li = 0; li < NN->model.numLayerInputs[l]; li++)  {
+        if (NN->model.n0 != NULL)  numWeights = NN->model.wSize[l][li];
+        else  numWeights = NN->model.layerSize[l]*NN->model.layerSize[NN->model.layerInputs[l][li]];
+        swapBytes(NN->model.weights[l][li], numWeights, sizeof(double));
+        if (NN->model.n0 != NULL)  {
+            swapBytes(NN->model.n0[l][li], numWeights, sizeof(int));
+            swapBytes(NN->model.nf[l][li], numWeights, sizeof(int));
+            swapBytes(NN->model.rowStart[l][li], NN->model.layerSize[l]+1, sizeof(int));
+            if (NN->model.denseWeights[l][li] != NULL)  swapBytes(NN->model.denseWeights[l][li],
+                    (size_t) NN->model.layerSize[l]*NN->model.layerSize[NN->model.layerInputs[l][li]], sizeof(double));
+    }}  }
+}
+
+int CDNN_load(CDNN *NN, const char *fileName)
+{
+    fileHeaderType header;
+    FILE *fileP;
+    long fileBytes;
+    int ifSwap, weightSparsity, rtrn, *topology;
+    size_t numBytes;
+    char *fileData = NULL;
+    
+    initArenas(NN);
+    
+    fileP = fopen(fileName, "rb");
+    if (fileP == NULL)  return CD_FILE_ERROR;
+    if ((fread(&header, sizeof(header), 1, fileP) != 1) || (fseek(fileP, 0, SEEK_END) != 0))  {
+        fclose(fileP);
+        return CD_FILE_ERROR;    }
+    fileBytes = ftell(fileP);
+    
+    ifSwap = (header.endianTag != CDNN_ENDIAN_TAG);
+    if (ifSwap)  swapBytes(&header.endianTag, 9, 4);
+    if (ifSwap)  swapBytes(&header.modelDataBytes, 1, 8);
+    numBytes = CDNN_FILE_HEADER_BYTES + header.modelDataBytes;
+    if ((memcmp(header.magic, "CDNN", 4) != 0) || (header.endianTag != CDNN_ENDIAN_TAG) || (header.version != CDNN_FILE_VERSION)
+            || (header.alignment != CDNN_ALIGN) || (header.intBytes != sizeof(int)) || (header.doubleBytes != sizeof(double))
+            || (header.numLayers < 2) || (header.variationalLayer >= header.numLayers)
+            || (header.encoderLayer < -1) || (header.encoderLayer >= header.numLayers)
+            || ((size_t) 3*header.numLayers*sizeof(int) > header.modelDataBytes) || (fileBytes < 0) || ((size_t) fileBytes < numBytes))  {
+        fclose(fileP);
+        return CD_NN_READ_ERROR;    }
+    
+    weightSparsity = (header.flags & 1) ? SPARSE_WEIGHTS : NONSPARSE_WEIGHTS;
+    NN->model.numLayers = header.numLayers;
+    NN->model.encoderLayer = header.encoderLayer;
+    NN->model.variationalLayer = header.variationalLayer;
+    
+#ifdef CDNN_MMAP_FILES
+    if (!ifSwap)  {
+        fileData = mmap(NULL, numBytes, PROT_READ, MAP_SHARED, fileno(fileP), 0);
+        if (fileData == MAP_FAILED)  fileData = NULL;
+        else  NN->model.dataKind = DATA_IN_MAPPED_FILE;
+    }
+#endif
+    if (fileData == NULL)  {
+        if ((fileData = alignedAlloc(numBytes)) == NULL)  {
+            fclose(fileP);
+            return CD_OUT_OF_MEMORY_ERROR;     }
+        if ((fseek(fileP, 0, SEEK_SET) != 0) || (fread(fileData, 1, numBytes, fileP) != numBytes))  {
+            alignedFree(fileData);
+            fclose(fileP);
+            return CD_FILE_ERROR;     }
+        NN->model.dataKind = DATA_IN_FILE_COPY;
+    }
+    fclose(fileP);
+    NN->model.modelData = fileData + CDNN_FILE_HEADER_BYTES;
+    NN->model.modelDataBytes = header.modelDataBytes;
+    
+    topology = (int *) (fileData + CDNN_FILE_HEADER_BYTES);
+    if (ifSwap)  swapBytes(topology, 3*NN->model.numLayers, sizeof(int));
+    rtrn = checkLayers(topology, NN->model.numLayers);
+    if ((rtrn == 0) && ((size_t) topologyLength(topology, NN->model.numLayers)*sizeof(int) > header.modelDataBytes))  rtrn = CD_NN_READ_ERROR;
+    if ((rtrn == 0) && ifSwap)  swapBytes(topology + 3*NN->model.numLayers, topologyLength(topology, NN->model.numLayers) - 3*NN->model.numLayers, sizeof(int));
+    if (rtrn == 0)  rtrn = checkLayerInputs(topology, NN->model.numLayers, weightSparsity);
+    if (rtrn == 0)  rtrn = allocModel(NN, topology, weightSparsity, NN->model.modelData, header.modelDataBytes);
+    if (rtrn != 0)  {
+        freeArena(&NN->model);
+        return rtrn;    }
+    
+    if (ifSwap)  swapModelData(NN);
+    if ((weightSparsity == SPARSE_WEIGHTS) && (checkSparseIndices(&NN->model) != 0))  {
+        freeArena(&NN->model);
+        return CD_NN_READ_ERROR;    }
+    CDNN_set_simd_level(&NN->model, CDNN_SIMD_BEST);
+    NN->model.exactAFs = 0;
+    shareModelFields(NN);
+    
+    return 0;
+}
+
+
+    // The network cache:  a directory of network files, each named by the SHA-256 hash of everything that was sent to the
+    // server to train it.  The network is followed by an entry header -- the number of bytes that were hashed and the POST
+    // fields (with tables given by their shape) -- which a hit has to match, then the sample outputs that the server sent
+    // back (if they were asked for).  The entry header also has the SHA-256 hashes of the network and of the outputs,
+    // so a file that was damaged after it was written is read as a miss.  The hash streams over the training data in place, as the table text is a function
+    // of the numbers it holds.  Files are touched when they're used, and the least recently used ones are deleted once
+    // the directory holds more than its limit.  Errors just mean that a network isn't cached.
+
+#define CDNN_CACHE_KEY_CHARS 65
+#define CDNN_CACHE_VERSION "CDNN cache 3"
+#define CDNN_DEFAULT_CACHE_BYTES (1LL << 30)
+
+typedef struct {
+    char magic[16];
+    uint64_t numHashedBytes, numFieldChars, numOutputs;
+    unsigned char networkDigest[32], outputsDigest[32];
+} cacheHeaderType;
+
+typedef struct {
+    uint32_t state[8];
+    uint64_t numBytes;
+    unsigned char block[64];
+} hashType;
+
+const uint32_t sha256K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROTR32(x, n) (((x) >> (n)) | ((x) << (32-(n))))
+
+void initHash(hashType *hash)
+{
+    const uint32_t state0[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+    
+    memcpy(hash->state, state0, sizeof(state0));
+    hash->numBytes = 0;
+}
+
+void hashBlock(hashType *hash, const unsigned char *block)
+{
+    uint32_t w[64], v[8], t1, t2;
+    int i;
+    
+    for (i = 0; i < 16; i++)  {
+        w[i] = ((uint32_t) block[4*i] << 24) | ((uint32_t) block[4*i+1] << 16) | ((uint32_t) block[4*i+2] << 8) | block[4*i+3];     }
+    for (i = 16; i < 64; i++)  {
+        w[i] = w[i-16] + w[i-7] + (ROTR32(w[i-15], 7) ^ ROTR32(w[i-15], 18) ^ (w[i-15] >> 3))
+                + (ROTR32(w[i-2], 17) ^ ROTR32(w[i-2], 19) ^ (w[i-2] >> 10));     }
+    
+    memcpy(v, hash->state, sizeof(v));
+    for (i = 0; i < 64; i++)  {
+        t1 = v[7] + (ROTR32(v[4], 6) ^ ROTR32(v[4], 11) ^ ROTR32(v[4], 25)) + ((v[4] & v[5]) ^ (~v[4] & v[6])) + sha256K[i] + w[i];
+        t2 = (ROTR32(v[0], 2) ^ ROTR32(v[0], 13) ^ ROTR32(v[0], 22)) + ((v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]));
+        memmove(v+1, v, 7*sizeof(uint32_t));
+        v[4] += t1;
+        v[0] = t1 + t2;
+    }
+    for (i = 0; i < 8; i++)  hash->state[i] += v[i];
+}
+
+void hashBytes(hashType *hash, const void *data, size_t numBytes)
+{
+    const unsigned char *bytes = data;
+    size_t numInBlock = hash->numBytes % 64, numCopied;
+    
+    hash->numBytes += numBytes;
+    if (numInBlock > 0)  {
+        numCopied = (numBytes < 64-numInBlock) ? numBytes : 64-numInBlock;
+        memcpy(hash->block + numInBlock, bytes, numCopied);
+        bytes += numCopied;
+        numBytes -= numCopied;
+        if (numInBlock + numCopied < 64)  return;
+        hashBlock(hash, hash->block);
+    }
+    
+    for (; numBytes >= 64; numBytes -= 64)  {
+        hashBlock(hash, bytes);
+        bytes += 64;     }
+    memcpy(hash->block, bytes, numBytes);
+}
+
+    // pads the message with a 1 bit, 0s and its length in bits, and writes out the big-endian digest
+
+void finishHash(hashType *hash, unsigned char *digest)
+{
+    unsigned char padding[72] = { 0x80 };
+    uint64_t numBits = hash->numBytes*8;
+    size_t numPadding = 64 - (hash->numBytes + 8) % 64;
+    int i;
+    
+    for (i = 0; i < 8; i++)  padding[numPadding+i] = (unsigned char) (numBits >> (56-8*i));
+    hashBytes(hash, padding, numPadding + 8);
+    for (i = 0; i < 32; i++)  digest[i] = (unsigned char) (hash->state[i/4] >> (24-8*(i%4)));
+}
+
+    // the text that a cache entry has to match:  the URL, then each POST field's name and its value,
+    // or for a table its shape, all NUL-terminated; the table numbers themselves are only hashed
+
+char *listCacheFields(const char *url, postField *toPOST, int numPostFields, size_t *numChars)
+{
+    char *fields, shape[40];
+    const char *value;
+    int p, pass;
+    size_t numValueChars;
+    
+    fields = NULL;
+    for (pass = 0; pass < 2; pass++)  {
+        *numChars = strlen(url) + 1;
+        if (fields != NULL)  memcpy(fields, url, *numChars);
+        for (p = 0; p < numPostFields; p++)  {
+            numValueChars = strlen(toPOST[p].name) + 1;
+            if (fields != NULL)  memcpy(fields + *numChars, toPOST[p].name, numValueChars);
+            *numChars += numValueChars;
+            if (toPOST[p].table != NULL)  {
+                sprintf(shape, "%i x %i table", toPOST[p].table->dim1, toPOST[p].table->dim2);
+                value = shape;     }
+            else  value = *toPOST[p].data;
+            numValueChars = strlen(value) + 1;
+            if (fields != NULL)  memcpy(fields + *numChars, value, numValueChars);
+            *numChars += numValueChars;
+        }
+        if (pass == 0)  {
+            fields = malloc(*numChars);
+            if (fields == NULL)  return NULL;
+    }   }
+    
+    return fields;
+}
+
+    // the key is the SHA-256 hash as 64 hex digits; POST fields are hashed with their names,
+    // and tables by their shape and their numbers.  The entry header for storeCached() goes in header and *fields.
+
+void cacheKey(const char *url, postField *toPOST, int numPostFields, char *key, cacheHeaderType *header, char **fields)
+{
+    hashType hash;
+    unsigned char digest[32];
+    int p, shape[2];
+    size_t numFieldChars;
+    
+    initHash(&hash);
+    hashBytes(&hash, CDNN_CACHE_VERSION, sizeof(CDNN_CACHE_VERSION));
+    hashBytes(&hash, url, strlen(url)+1);
+    for (p = 0; p < numPostFields; p++)  {
+        hashBytes(&hash, toPOST[p].name, strlen(toPOST[p].name)+1);
+        if (toPOST[p].table != NULL)  {
+            shape[0] = toPOST[p].table->dim1;
+            shape[1] = toPOST[p].table->dim2;
+            hashBytes(&hash, shape, sizeof(shape));
+            hashBytes(&hash, toPOST[p].table->data, toPOST[p].table->numCells*sizeof(double));     }
+        else  hashBytes(&hash, *toPOST[p].data, strlen(*toPOST[p].data)+1);
+    }
+    
+    memset(header, 0, sizeof(cacheHeaderType));
+    strcpy(header->magic, CDNN_CACHE_VERSION);
+    header->numHashedBytes = hash.numBytes;
+    finishHash(&hash, digest);
+    for (p = 0; p < 32; p++)  sprintf(key + 2*p, "%02x", digest[p]);
+    
+    *fields = listCacheFields(url, toPOST, numPostFields, &numFieldChars);
+    header->numFieldChars = numFieldChars;
+    if (*fields == NULL)  key[0] = 0;
+}
+
+char *cachePath(const char *dirName, const char *key, const char *extension)
+{
+    char *path;
+    
+    path = malloc(strlen(dirName) + strlen(key) + strlen(extension) + 2);
+    if (path != NULL)  sprintf(path, "%s/%s%s", dirName, key, extension);
+    
+    return path;
+}
+
+    // the hash of a network as writeNetwork() writes it, and of its sample outputs
+
+void networkDigest(CDNN *NN, unsigned char *digest)
+{
+    hashType hash;
+    fileHeaderType fileHeader;
+    
+    fillFileHeader(NN, &fileHeader);
+    initHash(&hash);
+    hashBytes(&hash, &fileHeader, sizeof(fileHeader));
+    hashBytes(&hash, NN->model.modelData, NN->model.modelDataBytes);
+    finishHash(&hash, digest);
+}
+
+void outputsDigest(const double *sampleOutputs, uint64_t numOutputs, unsigned char *digest)
+{
+    hashType hash;
+    
+    initHash(&hash);
+    if (numOutputs > 0)  hashBytes(&hash, sampleOutputs, numOutputs*sizeof(double));
+    finishHash(&hash, digest);
+}
+
+    // loads a cached network, along with its sample outputs if sampleOutputs != NULL, if its entry header
+    // matches the request's:  the same number of bytes hashed, and the same POST fields.  The network
+    // (and the outputs, if read) then have to match the hashes stored with them.
+
+int loadCached(const char *dirName, const char *key, const cacheHeaderType *header, const char *fields,
+        CDNN *NN, double *sampleOutputs, int numSamples)
+{
+    char *path, *storedFields;
+    FILE *fileP;
+    fileHeaderType fileHeader;
+    cacheHeaderType storedHeader;
+    uint64_t numOutputs;
+    unsigned char digest[32];
+    int rtrn = CD_FILE_ERROR;
+    
+    path = cachePath(dirName, key, ".cdnn");
+    if (path == NULL)  return CD_OUT_OF_MEMORY_ERROR;
+    fileP = fopen(path, "rb");
+    if (fileP == NULL)  {
+        free(path);
+        return CD_FILE_ERROR;     }
+    
+    if ((fread(&fileHeader, sizeof(fileHeader), 1, fileP) == 1) && (fileHeader.endianTag == CDNN_ENDIAN_TAG) &&
+            (fseek(fileP, CDNN_FILE_HEADER_BYTES + fileHeader.modelDataBytes, SEEK_SET) == 0) &&
+            (fread(&storedHeader, sizeof(storedHeader), 1, fileP) == 1) &&
+            (memcmp(storedHeader.magic, header->magic, sizeof(header->magic)) == 0) &&
+            (storedHeader.numHashedBytes == header->numHashedBytes) && (storedHeader.numFieldChars == header->numFieldChars))  {
+        storedFields = malloc(header->numFieldChars);
+        if ((storedFields != NULL) && (fread(storedFields, 1, header->numFieldChars, fileP) == header->numFieldChars) &&
+                (memcmp(storedFields, fields, header->numFieldChars) == 0))  rtrn = 0;
+        free(storedFields);
+    }
+    if (rtrn == 0)  rtrn = CDNN_load(NN, path);
+    
+    if (rtrn == 0)  {
+        networkDigest(NN, digest);
+        if (memcmp(digest, storedHeader.networkDigest, sizeof(digest)) != 0)  rtrn = CD_FILE_ERROR;
+        if ((rtrn == 0) && (sampleOutputs != NULL))  {
+            numOutputs = (uint64_t) NN->model.layerSize[NN->model.numLayers-1]*numSamples;
+            if ((storedHeader.numOutputs != numOutputs) || (fread(sampleOutputs, sizeof(double), numOutputs, fileP) != numOutputs))  {
+                rtrn = CD_FILE_ERROR;     }
+            else  {
+                outputsDigest(sampleOutputs, numOutputs, digest);
+                if (memcmp(digest, storedHeader.outputsDigest, sizeof(digest)) != 0)  rtrn = CD_FILE_ERROR;
+        }   }
+        if (rtrn != 0)  free_CDNN(NN);
+    }
+    fclose(fileP);
+    
+#ifdef CDNN_CACHE_EVICTION
+    if (rtrn == 0)  utime(path, NULL);
+#endif
+    free(path);
+    
+    return rtrn;
+}
+
+#ifdef CDNN_CACHE_EVICTION
+typedef struct { char *path; time_t lastUsed; off_t numBytes; } cacheFileType;
+
+int compareLastUsed(const void *file1, const void *file2)
+{
+    time_t t1 = ((const cacheFileType *) file1)->lastUsed, t2 = ((const cacheFileType *) file2)->lastUsed;
+    
+    return (t1 > t2) - (t1 < t2);
+}
+
+void evictCache(const char *dirName, long long maxBytes)
+{
+    DIR *dirP;
+    struct dirent *entry;
+    struct stat fileStats;
+    cacheFileType *files = NULL, *newFiles;
+    int f, numFiles = 0, maxFiles = 0;
+    long long totalBytes = 0;
+    size_t nameLength;
+    
+    dirP = opendir(dirName);
+    if (dirP == NULL)  return;
+    while ((entry = readdir(dirP)) != NULL)  {
+        nameLength = strlen(entry->d_name);
+        if ((nameLength != CDNN_CACHE_KEY_CHARS-1 + 5) || (strcmp(entry->d_name + nameLength-5, ".cdnn") != 0))  continue;
+        if (numFiles == maxFiles)  {
+            maxFiles = 2*maxFiles + 16;
+            newFiles = realloc(files, maxFiles*sizeof(cacheFileType));
+            if (newFiles == NULL)  break;
+            files = newFiles;     }
+        files[numFiles].path = cachePath(dirName, entry->d_name, "");
+        if (files[numFiles].path == NULL)  break;
+        if (stat(files[numFiles].path, &fileStats) != 0)  {
+            free(files[numFiles].path);
+            continue;     }
+        files[numFiles].lastUsed = fileStats.st_mtime;
+        files[numFiles].numBytes = fileStats.st_size;
+        totalBytes += fileStats.st_size;
+        numFiles++;
+    }
+    closedir(dirP);
+    
+    qsort(files, numFiles, sizeof(cacheFileType), compareLastUsed);
+    for (f = 0; f < numFiles; f++)  {
+        if (totalBytes > maxBytes)  {
+        if (remove(files[f].path) == 0)  {
+            totalBytes -= files[f].numBytes;
+        }}
+        free(files[f].path);
+    }
+    free(files);
+}
+#endif
+
+    // writes to a temporary file that is renamed into place, so a cached network is never seen half-written
+
+void storeCached(const char *dirName, long long maxBytes, const char *key, const cacheHeaderType *header, const char *fields,
+        CDNN *NN, double *sampleOutputs, int numSamples)
+{
+    char *path, *tmpPath, tmpExtension[48];
+    FILE *fileP;
+    cacheHeaderType entryHeader = *header;
+    int rtrn;
+    
+#ifdef CDNN_CACHE_EVICTION
+    sprintf(tmpExtension, ".%li.%p.tmp", (long) getpid(), (void *) NN);
+#else
+    sprintf(tmpExtension, ".%p.tmp", (void *) NN);
+#endif
+    path = cachePath(dirName, key, ".cdnn");
+    tmpPath = cachePath(dirName, key, tmpExtension);
+    if ((path == NULL) || (tmpPath == NULL))  {
+        free(path);
+        free(tmpPath);
+        return;     }
+    
+    fileP = fopen(tmpPath, "wb");
+    if (fileP != NULL)  {
+        entryHeader.numOutputs = 0;
+        if (sampleOutputs != NULL)  entryHeader.numOutputs = (uint64_t) NN->model.layerSize[NN->model.numLayers-1]*numSamples;
+        networkDigest(NN, entryHeader.networkDigest);
+        outputsDigest(sampleOutputs, entryHeader.numOutputs, entryHeader.outputsDigest);
+        rtrn = writeNetwork(NN, fileP);
+        if ((rtrn == 0) && (fwrite(&entryHeader, sizeof(entryHeader), 1, fileP) != 1))  rtrn = CD_FILE_ERROR;
+        if ((rtrn == 0) && (fwrite(fields, 1, entryHeader.numFieldChars, fileP) != entryHeader.numFieldChars))  rtrn = CD_FILE_ERROR;
+        if ((rtrn == 0) && (entryHeader.numOutputs > 0) &&
+                (fwrite(sampleOutputs, sizeof(double), entryHeader.numOutputs, fileP) != entryHeader.numOutputs))  rtrn = CD_FILE_ERROR;
+        if (fclose(fileP) != 0)  rtrn = CD_FILE_ERROR;
+        if ((rtrn != 0) || (rename(tmpPath, path) != 0))  remove(tmpPath);
+    }
+    
+#ifdef CDNN_CACHE_EVICTION
+    if (maxBytes > 0)  evictCache(dirName, maxBytes);
+#endif
+    free(path);
+    free(tmpPath);
+}
+
+
+    // A request is one training run on the server:  its curl handle, the upload state of its training data,
+    // and the reader that fills in the network as the response arrives.  The _async() functions allocate
+    // a request and hand it to a session's curl multi handle; the synchronous ones run a request on the
+    // stack, in a session of their own.
+
+struct CDNN_request {
+    CDNN_session *session;
+    CURL *curlP;
+    curl_mime *mime;
+    NNreaderType reader;
+    tableType samplesTable, importancesTable;
+    int status;
+    CDNN_callback callback;
+    void *userData;
+    CDNN_request *next;
+    char errMsg[CDNN_ERR_MSG_CHARS];
+    char cacheKey[CDNN_CACHE_KEY_CHARS], *cacheFields;
+    cacheHeaderType cacheHeader;
+    int ifCached;
+    CDNN_build_stats stats;
+    long long startNs, transferNs, firstByteNs, lastByteNs, parsingNs;
+};
+
+#define CDNN_DEFAULT_URL "https://cdeeply.com/myNN.php"
+#define CDNN_MAX_IDLE_HANDLES 16
+
+    // A session's requests share its connections, DNS lookups and TLS sessions, so only the first request
+    // to a server pays for the handshake.  Finished requests leave their curl handles to the next ones.
+
+struct CDNN_session {
+    CURLM *multiP;
+    CURLSH *shareP;
+    CDNN_request *requests;         // submitted requests whose callbacks haven't been run yet
+    CURL *idleHandles[CDNN_MAX_IDLE_HANDLES];
+    int numIdleHandles;
+    char *url, *cacheDir;
+    long connectTimeoutMs, timeoutMs;
+    long long maxCacheBytes;
+};
+
+    // the response is parsed as it arrives; the time between the chunks is the download, less the parsing
+
+static size_t curlWriteCallback(void *newData, size_t typeSize, size_t dataLength, void *ptr)
+{
+    CDNN_request *request = (CDNN_request *) ptr;
+    size_t numBytes = dataLength*typeSize;
+    long long t0 = nanoseconds();
+    int rtrn;
+    
+    if (request->firstByteNs == 0)  request->firstByteNs = t0;
+    request->lastByteNs = t0;
+    rtrn = feedReader(&request->reader, (const char *) newData, numBytes);
+    request->parsingNs += nanoseconds() - t0;
+    
+    if (rtrn != 0)  return 0;
+    return numBytes;
+}
+
+    // the importances table only takes part in the statistics if it's used, when initTable() is called on it
+
+void initRequest(CDNN_request *request, CDNN *NN, double *sampleOutputs, int numSamples, int weightSparsity)
+{
+    memset(&request->stats, 0, sizeof(CDNN_build_stats));
+    request->startNs = nanoseconds();
+    request->transferNs = request->firstByteNs = request->lastByteNs = request->parsingNs = 0;
+    request->importancesTable.numChars = 0;
+    request->importancesTable.formattingNs = request->importancesTable.lastReadNs = 0;
+    request->status = CD_REQUEST_RUNNING;
+    request->errMsg[0] = 0;
+    request->curlP = NULL;
+    request->mime = NULL;
+    request->cacheKey[0] = 0;
+    request->cacheFields = NULL;
+    request->ifCached = 0;
+    initReader(&request->reader, NN, sampleOutputs, numSamples, weightSparsity, request->errMsg);
+}
+
+int startRequest(CDNN_request *request, CDNN_session *session, postField *toPOST, int numPostFields)
+{
+    int p, rtrn;
+    long long t0;
+    curl_mimepart *mimePart;
+    
+    if (session->cacheDir != NULL)  {
+        cacheKey(session->url, toPOST, numPostFields, request->cacheKey, &request->cacheHeader, &request->cacheFields);
+        if ((request->cacheKey[0] != 0) && (loadCached(session->cacheDir, request->cacheKey, &request->cacheHeader,
+                request->cacheFields, request->reader.NN, request->reader.sampleOutputs, request->reader.numSamples) == 0))  {
+            request->ifCached = 1;
+            return 0;
+    }   }
+    t0 = nanoseconds();
+    for (p = 0; p < numPostFields; p++)  {
+        if (toPOST[p].table != NULL)  measureTable(toPOST[p].table);     }
+    request->stats.sizingSeconds = secondsBetween(t0, nanoseconds());
+    
+    if (session->numIdleHandles > 0)  request->curlP = session->idleHandles[--session->numIdleHandles];
+    else  request->curlP = curl_easy_init();
+    if (request->curlP != NULL)  request->mime = curl_mime_init(request->curlP);
+    if ((request->curlP == NULL) || (request->mime == NULL))  return CD_OUT_OF_MEMORY_ERROR;
+    
+    curl_easy_setopt(request->curlP, CURLOPT_URL, session->url);
+    curl_easy_setopt(request->curlP, CURLOPT_SHARE, session->shareP);
+    curl_easy_setopt(request->curlP, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(request->curlP, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(request->curlP, CURLOPT_CONNECTTIMEOUT_MS, session->connectTimeoutMs);
+    curl_easy_setopt(request->curlP, CURLOPT_TIMEOUT_MS, session->timeoutMs);
+    
+    for (p = 0; p < numPostFields; p++)  {
+        mimePart = curl_mime_addpart(request->mime);
+        if (mimePart == NULL)  return CD_OUT_OF_MEMORY_ERROR;
+        rtrn = curl_mime_name(mimePart, toPOST[p].name);
+        if (rtrn != CURLE_OK)  return rtrn;
+        if (toPOST[p].table != NULL)  rtrn = curl_mime_data_cb(mimePart, toPOST[p].table->numChars,
+                tableReadCallback, tableSeekCallback, NULL, toPOST[p].table);
+        else  rtrn = curl_mime_data(mimePart, *toPOST[p].data, CURL_ZERO_TERMINATED);
+        if (rtrn != CURLE_OK)  return rtrn;
+    }
+    curl_easy_setopt(request->curlP, CURLOPT_MIMEPOST, request->mime);
+    
+    curl_easy_setopt(request->curlP, CURLOPT_WRITEFUNCTION, curlWriteCallback);
+    curl_easy_setopt(request->curlP, CURLOPT_WRITEDATA, (void *) request);
+    curl_easy_setopt(request->curlP, CURLOPT_PRIVATE, (void *) request);
+    
+    return 0;
+}
+
+
+    // The upload is timed from when the connection is ready to when the last of the training data
+    // is handed to curl, and the server from then to the first byte of the response.
+
+void finishStats(CDNN_request *request)
+{
+    CDNN_build_stats *stats = &request->stats;
+    long long uploadEndNs = request->samplesTable.lastReadNs;
+    double connectSeconds = 0.;
+    curl_off_t uploadBytes = 0;
+    
+    if (request->importancesTable.lastReadNs > uploadEndNs)  uploadEndNs = request->importancesTable.lastReadNs;
+    if (request->curlP != NULL)  {
+        curl_easy_getinfo(request->curlP, CURLINFO_PRETRANSFER_TIME, &connectSeconds);
+        curl_easy_getinfo(request->curlP, CURLINFO_SIZE_UPLOAD_T, &uploadBytes);     }
+    
+    stats->fromCache = request->ifCached;
+    stats->connectSeconds = connectSeconds;
+    stats->uploadSeconds = secondsBetween(request->transferNs, uploadEndNs) - connectSeconds;
+    if (stats->uploadSeconds < 0.)  stats->uploadSeconds = 0.;
+    stats->formattingSeconds = (request->samplesTable.formattingNs + request->importancesTable.formattingNs)*1e-9;
+    stats->serverSeconds = secondsBetween(uploadEndNs, request->firstByteNs);
+    stats->downloadSeconds = secondsBetween(request->firstByteNs, request->lastByteNs);
+    stats->parsingSeconds += request->parsingNs*1e-9;
+    stats->tableBytes = request->samplesTable.numChars + request->importancesTable.numChars;
+    stats->uploadBytes = uploadBytes;
+    stats->downloadBytes = request->reader.numCharsRead;
+    stats->totalSeconds = secondsBetween(request->startNs, nanoseconds());
+}
+
+
+    // curlCode is the result of the transfer, or of startRequest() if the transfer never started
+
+int finishRequest(CDNN_request *request, int curlCode)
+{
+    CDNN_session *session = request->session;
+    long long t0;
+    
+    if (request->ifCached)  {
+        free(request->cacheFields);
+        request->cacheFields = NULL;
+        finishStats(request);
+        request->status = 0;
+        return 0;     }
+    
+    if ((curlCode != CURLE_OK) && (request->reader.rtrn == 0))  request->reader.rtrn = curlCode;
+    
+    t0 = nanoseconds();
+    request->status = finishReader(&request->reader);
+    request->stats.parsingSeconds = secondsBetween(t0, nanoseconds());
+    if (request->status == CD_NN_READ_ERROR)  setErrMsg(request->errMsg, "Problem reading neural network from server");
+    if ((request->status == 0) && (request->cacheKey[0] != 0) && (session != NULL) && (session->cacheDir != NULL))  {
+        storeCached(session->cacheDir, session->maxCacheBytes, request->cacheKey, &request->cacheHeader, request->cacheFields,
+                request->reader.NN, request->reader.sampleOutputs, request->reader.numSamples);     }
+    free(request->cacheFields);
+    request->cacheFields = NULL;
+    finishStats(request);
+    
+    curl_mime_free(request->mime);
+    if ((request->curlP != NULL) && (session != NULL) && (session->numIdleHandles < CDNN_MAX_IDLE_HANDLES))  {
+        curl_easy_reset(request->curlP);
+        session->idleHandles[session->numIdleHandles++] = request->curlP;     }
+    else  curl_easy_cleanup(request->curlP);
+    request->mime = NULL;
+    request->curlP = NULL;
+    
+    return request->status;
+}
+
+
+    // Older versions of libcurl don't allow curl_global_init() and curl_global_cleanup() to be called
+    // from two threads at once, so sessions take turns.
+
+#ifdef CDNN_THREADS
+pthread_mutex_t curlGlobalLock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+void curlGlobal(int ifInit)
+{
+#ifdef CDNN_THREADS
+    pthread_mutex_lock(&curlGlobalLock);
+#endif
+    if (ifInit)  curl_global_init(CURL_GLOBAL_ALL);
+    else  curl_global_cleanup();
+#ifdef CDNN_THREADS
+    pthread_mutex_unlock(&curlGlobalLock);
+#endif
+}
+
+
+    // The server is CDNN_DEFAULT_URL unless the CDNN_URL environment variable or CDNN_session_set_url() says otherwise.
+    // Likewise networks are only cached if CDNN_CACHE_DIR is set (limited to CDNN_CACHE_BYTES), or CDNN_session_set_cache() is called.
+
+CDNN_session *CDNN_session_init(void)
+{
+    CDNN_session *session;
+    const char *url, *cacheDir, *maxCacheBytes;
+    
+    session = malloc(sizeof(CDNN_session));
+    if (session == NULL)  return NULL;
+    
+    url = getenv("CDNN_URL");
+    if ((url == NULL) || (url[0] == 0))  url = CDNN_DEFAULT_URL;
+    
+    curlGlobal(1);
+    session->multiP = curl_multi_init();
+    session->shareP = curl_share_init();
+    session->url = malloc(strlen(url)+1);
+    if ((session->multiP == NULL) || (session->shareP == NULL) || (session->url == NULL))  {
+        curl_multi_cleanup(session->multiP);
+        curl_share_cleanup(session->shareP);
+        free(session->url);
+        curlGlobal(0);
+        free(session);
+        return NULL;     }
+    
+    curl_share_setopt(session->shareP, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(session->shareP, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    strcpy(session->url, url);
+    session->requests = NULL;
+    session->numIdleHandles = 0;
+    session->connectTimeoutMs = session->timeoutMs = 0;
+    session->cacheDir = NULL;
+    
+    cacheDir = getenv("CDNN_CACHE_DIR");
+    maxCacheBytes = getenv("CDNN_CACHE_BYTES");
+    if ((cacheDir != NULL) && (cacheDir[0] != 0))  CDNN_session_set_cache(session, cacheDir,
+            ((maxCacheBytes != NULL) && (maxCacheBytes[0] != 0)) ? atoll(maxCacheBytes) : CDNN_DEFAULT_CACHE_BYTES);
+    
+    return session;
+}
+
+int CDNN_session_set_url(CDNN_session *session, const char *url)
+{
+    char *newURL;
+    
+    newURL = malloc(strlen(url)+1);
+    if (newURL == NULL)  return CD_OUT_OF_MEMORY_ERROR;
+    strcpy(newURL, url);
+    
+    free(session->url);
+    session->url = newURL;
+    
+    return 0;
+}
+
+    // dirName == NULL turns the cache off; maxBytes <= 0 means no limit
+
+int CDNN_session_set_cache(CDNN_session *session, const char *dirName, long long maxBytes)
+{
+    char *newDir = NULL;
+    
+    if (dirName != NULL)  {
+        newDir = malloc(strlen(dirName)+1);
+        if (newDir == NULL)  return CD_OUT_OF_MEMORY_ERROR;
+        strcpy(newDir, dirName);
+#ifdef CDNN_CACHE_EVICTION
+        mkdir(dirName, 0777);
+#endif
+    }
+    
+    free(session->cacheDir);
+    session->cacheDir = newDir;
+    session->maxCacheBytes = maxBytes;
+    
+    return 0;
+}
+
+    // 0 means no time limit.  The limits apply to requests submitted afterwards.
+
+void CDNN_session_set_timeouts(CDNN_session *session, long connectTimeoutMs, long timeoutMs)
+{
+    session->connectTimeoutMs = connectTimeoutMs;
+    session->timeoutMs = timeoutMs;
+}
+
+    // a request belongs to its session from when it's submitted until its callback is run
+
+void unlinkRequest(CDNN_request *request)
+{
+    CDNN_request **link;
+    
+    for (link = &request->session->requests; *link != NULL; link = &(*link)->next)  {
+    if (*link == request)  {
+        *link = request->next;
+        break;
+    }}
+    request->session = NULL;
+}
+
+void submitRequest(CDNN_session *session, CDNN_request *request, int rtrn, CDNN_callback callback, void *userData)
+{
+    request->session = session;
+    request->callback = callback;
+    request->userData = userData;
+    request->next = session->requests;
+    session->requests = request;
+    
+        // a request that couldn't be started, or was found in the cache, is reported by the next poll like any other
+    request->transferNs = nanoseconds();
+    if ((rtrn == 0) && !request->ifCached)  rtrn = curl_multi_add_handle(session->multiP, request->curlP);
+    if ((rtrn != 0) || request->ifCached)  finishRequest(request, rtrn);
+}
+
+
+    // Runs the session's transfers, waiting up to timeoutMs for network activity, then runs the callbacks of
+    // the requests that have finished.  Returns the number of requests still running.
+
+int CDNN_session_poll(CDNN_session *session, int timeoutMs)
+{
+    int numRunning, numMessages;
+    CURLMsg *msg;
+    CDNN_request *request;
+    
+    curl_multi_perform(session->multiP, &numRunning);
+    if ((numRunning > 0) && (timeoutMs > 0))  {
+        curl_multi_poll(session->multiP, NULL, 0, timeoutMs, NULL);
+        curl_multi_perform(session->multiP, &numRunning);
+    }
+    
+    while ((msg = curl_multi_info_read(session->multiP, &numMessages)) != NULL)  {
+    if (msg->msg == CURLMSG_DONE)  {
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **) &request);
+        curl_multi_remove_handle(session->multiP, msg->easy_handle);
+        finishRequest(request, msg->data.result);
+    }}
+    
+        // a callback may free its request or submit new ones, so the list is searched again after each one
+    for (;;)  {
+        for (request = session->requests; request != NULL; request = request->next)  {
+            if (request->status != CD_REQUEST_RUNNING)  break;     }
+        if (request == NULL)  break;
+        unlinkRequest(request);
+        if (request->callback != NULL)  request->callback(request, request->status, request->userData);
+    }
+    
+    numRunning = 0;
+    for (request = session->requests; request != NULL; request = request->next)  numRunning++;
+    
+    return numRunning;
+}
+
+    // waits for a request to finish and runs its callback, if that hasn't already happened
+
+int CDNN_request_wait(CDNN_request *request)
+{
+    int status;
+    
+    while ((request->session != NULL) && (request->status == CD_REQUEST_RUNNING))  {
+        CDNN_session_poll(request->session, 1000);     }
+    
+    status = request->status;
+    if (request->session != NULL)  CDNN_session_poll(request->session, 0);
+    
+    return status;
+}
+
+int CDNN_request_status(CDNN_request *request)  {  return request->status;  }
+const char *CDNN_request_error(CDNN_request *request)  {  return request->errMsg;  }
+
+    // The statistics are complete once the request has finished.  The synchronous functions leave theirs
+    // in a per-thread copy, like their error messages.
+
+CDNN_THREAD_LOCAL CDNN_build_stats lastBuildStats;
+
+void CDNN_request_stats(CDNN_request *request, CDNN_build_stats *stats)  {  *stats = request->stats;  }
+void CDNN_last_build_stats(CDNN_build_stats *stats)  {  *stats = lastBuildStats;  }
+
+
+    // a request that is still running is cancelled, without running its callback
+
+void cancelRequest(CDNN_request *request)
+{
+    if (request->status == CD_REQUEST_RUNNING)  {
+        curl_multi_remove_handle(request->session->multiP, request->curlP);
+        finishRequest(request, CURLE_ABORTED_BY_CALLBACK);     }
+    unlinkRequest(request);
+}
+
+void CDNN_request_free(CDNN_request *request)
+{
+    if (request->session != NULL)  cancelRequest(request);
+    free(request);
+}
+
+void CDNN_session_free(CDNN_session *session)
+{
+    while (session->requests != NULL)  cancelRequest(session->requests);
+    while (session->numIdleHandles > 0)  curl_easy_cleanup(session->idleHandles[--session->numIdleHandles]);
+    curl_multi_cleanup(session->multiP);
+    curl_share_cleanup(session->shareP);
+    free(session->url);
+    free(session->cacheDir);
+    curlGlobal(0);
+    free(session);
+}
+
+
+char *const checked[3] = { "", "on", "off" };
+char *const vDists[2] = { "uniform", "normal" };
+char *const NNtypes[2] = { "autoencoder", "regressor" };
+char *const SubmitStr = "Submit";
+char *const sourceStr = "C_API";
+char *const rowcol[2] = { "rows", "columns" };
+
+int regressorRequest(CDNN_request *request, CDNN_session *session, CDNN *NN, int numInputs, int numOutputs, int numSamples,
+        double *trainingSamples, int indexOrder, int *outputRowsColumns, double *importances,
+        int maxWeights, int maxNeurons, int maxLayers, int maxWeightDepth, double maxActivationRate,
+        int maxWeightsHardLimit, int maxNeuronsHardLimit, int maxActivationsHardLimit,
+        AFlist allowedAFs, quantizationType weightQuantization, quantizationType activationQuantization,
+        int weightSparsity, int allowNegativeWeights, int hasBias, int allowIOconnections, double *sampleOutputs)
+{
+    int o, charIdx, rtrn;
+    char *outputRowsColsStr, *noImportancesStr = "", strs[280], *maxWeightsStr = &strs[0];
+    char *maxNeuronsStr = &strs[20], *maxLayersStr = &strs[40], *maxWeightDepthStr = &strs[60], *maxActivationRateStr = &strs[80];
+    char *wQuantBitsStr = &strs[120], *wQuantZeroStr = &strs[140], *wQuantRangeStr = &strs[160];
+    char *yQuantBitsStr = &strs[200], *yQuantZeroStr = &strs[220], *yQuantRangeStr = &strs[240];
+    postField toPOST[] = {
+        { "samples", NULL, &request->samplesTable },
+        { "importances", &noImportancesStr, (importances != NULL) ? &request->importancesTable : NULL },
+        { "rowscols", &rowcol[indexOrder], NULL },
+        { "rowcolRange", &outputRowsColsStr, NULL },
+        { "maxWeights", &maxWeightsStr, NULL },
+        { "maxNeurons", &maxNeuronsStr, NULL },
+        { "maxLayers", &maxLayersStr, NULL },
+        { "maxWeightDepth", &maxWeightDepthStr, NULL },
+        { "maxActivationRate", &maxActivationRateStr, NULL },
+        { "maxWeightsHardLimit", &checked[maxWeightsHardLimit], NULL },
+        { "maxNeuronsHardLimit", &checked[maxNeuronsHardLimit], NULL },
+        { "maxActivationsHardLimit", &checked[maxActivationsHardLimit], NULL },
+        { "step", &checked[allowedAFs.stepAF], NULL },
+        { "ReLU", &checked[allowedAFs.ReLUAF], NULL },
+        { "ReLU1", &checked[allowedAFs.ReLU1AF], NULL },
+        { "sigmoid", &checked[allowedAFs.sigmoidAF], NULL },
+        { "tanh", &checked[allowedAFs.tanhAF], NULL },
+        { "quantizeWeights", &checked[weightQuantization.ifQuantize], NULL },
+        { "wQuantBits", &wQuantBitsStr, NULL },
+        { "wQuantZero", &wQuantZeroStr, NULL },
+        { "wQuantRange", &wQuantRangeStr, NULL },
+        { "quantizeActivations", &checked[activationQuantization.ifQuantize], NULL },
+        { "yQuantBits", &yQuantBitsStr, NULL },
+        { "yQuantZero", &yQuantZeroStr, NULL },
+        { "yQuantRange", &yQuantRangeStr, NULL },
+        { "sparseWeights", &checked[weightSparsity], NULL },
+        { "allowNegativeWeights", &checked[allowNegativeWeights], NULL },
+        { "hasBias", &checked[hasBias], NULL },
+        { "allowIO", &checked[allowIOconnections], NULL },
+        { "submitStatus", &SubmitStr, NULL },
+        { "NNtype", &NNtypes[1], NULL },
+        { "formSource", &sourceStr, NULL }
+    };
+    
+    initRequest(request, NN, sampleOutputs, numSamples, weightSparsity);
+    initTable(&request->samplesTable, trainingSamples, numInputs+numOutputs, numSamples, indexOrder);
+    if (importances != NULL)  initTable(&request->importancesTable, importances, numOutputs, numSamples, indexOrder);
+    
+    outputRowsColsStr = malloc(numOutputs*20*sizeof(int));
+    if (outputRowsColsStr == NULL)  return CD_OUT_OF_MEMORY_ERROR;
+    
+    if (numOutputs <= 0)  {  charIdx = 0; outputRowsColsStr[0] = 0;  }
+    else  {
+        charIdx = sprintf(outputRowsColsStr, "%i", outputRowsColumns[0]+1);
+        for (o = 1; o < numOutputs; o++)  {
+            charIdx += sprintf(outputRowsColsStr + charIdx, ",%i", outputRowsColumns[o]+1);
+    }   }
+    
+    maxWeightsStr[0] = maxNeuronsStr[0] = maxLayersStr[0] = maxWeightDepthStr[0] = 0;
+    wQuantBitsStr[0] = wQuantZeroStr[0] = wQuantRangeStr[0] = 0;
+    yQuantBitsStr[0] = yQuantZeroStr[0] = yQuantRangeStr[0] = 0;
+    if (maxWeights >= 0)  sprintf((char *) maxWeightsStr, "%i", maxWeights);
+    if (maxNeurons >= 0)  sprintf(maxNeuronsStr, "%i", maxNeurons);
+    if (maxLayers >= 0)  sprintf(maxLayersStr, "%i", maxLayers);
+    if (maxWeightDepth >= 0)  sprintf(maxWeightDepthStr, "%i", maxWeightDepth);
+    sprintf(maxActivationRateStr, "%1.17g", maxActivationRate);
+    if (weightQuantization.ifQuantize)  {
+        sprintf(wQuantBitsStr, "%i", weightQuantization.bits);
+        sprintf(wQuantZeroStr, "%i", weightQuantization.zeroInt);
+        sprintf(wQuantRangeStr, "%1.17g", weightQuantization.range);
+    }
+    if (activationQuantization.ifQuantize)  {
+        sprintf(yQuantBitsStr, "%i", activationQuantization.bits);
+        sprintf(yQuantZeroStr, "%i", activationQuantization.zeroInt);
+        sprintf(yQuantRangeStr, "%1.17g", activationQuantization.range);
+    }
+    
+    rtrn = startRequest(request, session, toPOST, sizeof(toPOST)/sizeof(postField));
+    
+    free(outputRowsColsStr);
+    
+    return rtrn;
+}
+
+int encoderRequest(CDNN_request *request, CDNN_session *session, CDNN *NN, int numFeatures, int numSamples,
+        double *trainingSamples, int indexOrder, double *importances,
+        int doEncoder, int doDecoder, int numEncodingFeatures, int numVariationalFeatures, int variationalDist,
+        int maxWeights, int maxNeurons, int maxLayers, int maxWeightDepth, double maxActivationRate,
+        int maxWeightsHardLimit, int maxNeuronsHardLimit, int maxActivationsHardLimit,
+        AFlist allowedAFs, quantizationType weightQuantization, quantizationType activationQuantization,
+        int weightSparsity, int allowNegativeWeights, int hasBias, double *sampleOutputs)
+{
+    int rtrn;
+    char *noImportancesStr = "", strs[320], *numEncodingFeaturesStr = &strs[0];
+    char *numVFsStr = &strs[20], *maxWeightsStr = &strs[40], *maxNeuronsStr = &strs[60];
+    char *maxLayersStr = &strs[80], *maxWeightDepthStr = &strs[100], *maxActivationRateStr = &strs[120];
+    char *wQuantBitsStr = &strs[160], *wQuantZeroStr = &strs[180], *wQuantRangeStr = &strs[200];
+    char *yQuantBitsStr = &strs[240], *yQuantZeroStr = &strs[260], *yQuantRangeStr = &strs[280];
+    postField toPOST[] = {
+        { "samples", NULL, &request->samplesTable },
+        { "importances", &noImportancesStr, (importances != NULL) ? &request->importancesTable : NULL },
+        { "rowscols", &rowcol[indexOrder], NULL },
+        { "numFeatures", &numEncodingFeaturesStr, NULL },
+        { "doEncoder", &checked[doEncoder], NULL },
+        { "doDecoder", &checked[doDecoder], NULL },
+        { "numVPs", &numVFsStr, NULL },
+        { "variationalDist", &vDists[variationalDist], NULL },
+        { "maxWeights", &maxWeightsStr, NULL },
+        { "maxNeurons", &maxNeuronsStr, NULL },
+        { "maxLayers", &maxLayersStr, NULL },
+        { "maxWeightDepth", &maxWeightDepthStr, NULL },
+        { "maxActivationRate", &maxActivationRateStr, NULL },
+        { "maxWeightsHardLimit", &checked[maxWeightsHardLimit], NULL },
+        { "maxNeuronsHardLimit", &checked[maxNeuronsHardLimit], NULL },
+        { "maxActivationsHardLimit", &checked[maxActivationsHardLimit], NULL },
+        { "step", &checked[allowedAFs.stepAF], NULL },
+        { "ReLU", &checked[allowedAFs.ReLUAF], NULL },
+        { "ReLU1", &checked[allowedAFs.ReLU1AF], NULL },
+        { "sigmoid", &checked[allowedAFs.sigmoidAF], NULL },
+        { "tanh", &checked[allowedAFs.tanhAF], NULL },
+        { "quantizeWeights", &checked[weightQuantization.ifQuantize], NULL },
+        { "wQuantBits", &wQuantBitsStr, NULL },
+        { "wQuantZero", &wQuantZeroStr, NULL },
+        { "wQuantRange", &wQuantRangeStr, NULL },
+        { "quantizeActivations", &checked[activationQuantization.ifQuantize], NULL },
+        { "yQuantBits", &yQuantBitsStr, NULL },
+        { "yQuantZero", &yQuantZeroStr, NULL },
+        { "yQuantRange", &yQuantRangeStr, NULL },
+        { "sparseWeights", &checked[weightSparsity], NULL },
+        { "allowNegativeWeights", &checked[allowNegativeWeights], NULL },
+        { "hasBias", &checked[hasBias], NULL },
+        { "submitStatus", &SubmitStr, NULL },
+        { "NNtype", &NNtypes[0], NULL },
+        { "formSource", &sourceStr, NULL }
+    };
+    
+    initRequest(request, NN, sampleOutputs, numSamples, weightSparsity);
+    initTable(&request->samplesTable, trainingSamples, numFeatures, numSamples, indexOrder);
+    if (importances != NULL)  initTable(&request->importancesTable, importances, numFeatures, numSamples, indexOrder);
+    
+    sprintf(numEncodingFeaturesStr, "%i", numEncodingFeatures);
+    sprintf(numVFsStr, "%i", numVariationalFeatures);
+    maxWeightsStr[0] = maxNeuronsStr[0] = maxLayersStr[0] = maxWeightDepthStr[0] = 0;
+    wQuantBitsStr[0] = wQuantZeroStr[0] = wQuantRangeStr[0] = 0;
+    yQuantBitsStr[0] = yQuantZeroStr[0] = yQuantRangeStr[0] = 0;
+    if (maxWeights >= 0)  sprintf(maxWeightsStr, "%i", maxWeights);
+    if (maxNeurons >= 0)  sprintf(maxNeuronsStr, "%i", maxNeurons);
+    if (maxLayers >= 0)  sprintf(maxLayersStr, "%i", maxLayers);
+    if (maxWeightDepth >= 0)  sprintf(maxWeightDepthStr, "%i", maxWeightDepth);
+    sprintf(maxActivationRateStr, "%1.17g", maxActivationRate);
+    if (weightQuantization.ifQuantize)  {
+        sprintf(wQuantBitsStr, "%i", weightQuantization.bits);
+        sprintf(wQuantZeroStr, "%i", weightQuantization.zeroInt);
+        sprintf(wQuantRangeStr, "%1.17g", weightQuantization.range);
+    }
+    if (activationQuantization.ifQuantize)  {
+        sprintf(yQuantBitsStr, "%i", activationQuantization.bits);
+        sprintf(yQuantZeroStr, "%i", activationQuantization.zeroInt);
+        sprintf(yQuantRangeStr, "%1.17g", activationQuantization.range);
+    }
+    
+    rtrn = startRequest(request, session, toPOST, sizeof(toPOST)/sizeof(postField));
+    
+    return rtrn;
+}
+
+
+int CDNN_tabular_regressor(CDNN *NN, int numInputs, int numOutputs, int numSamples,
+        double *trainingSamples, int indexOrder, int *outputRowsColumns, double *importances,
+        int maxWeights, int maxNeurons, int maxLayers, int maxWeightDepth, double maxActivationRate,
+        int maxWeightsHardLimit, int maxNeuronsHardLimit, int maxActivationsHardLimit,
+        AFlist allowedAFs, quantizationType weightQuantization, quantizationType activationQuantization,
+        int weightSparsity, int allowNegativeWeights, int hasBias, int allowIOconnections, double *sampleOutputs, char **errMsg)
+{
+    CDNN_session *session;
+    CDNN_request request;
+    int rtrn;
+    
+    session = CDNN_session_init();
+    if (session == NULL)  return CD_OUT_OF_MEMORY_ERROR;
+    
+    rtrn = regressorRequest(&request, session, NN, numInputs, numOutputs, numSamples,
+            trainingSamples, indexOrder, outputRowsColumns, importances,
+            maxWeights, maxNeurons, maxLayers, maxWeightDepth, maxActivationRate,
+            maxWeightsHardLimit, maxNeuronsHardLimit, maxActivationsHardLimit,
+            allowedAFs, weightQuantization, activationQuantization,
+            weightSparsity, allowNegativeWeights, hasBias, allowIOconnections, sampleOutputs);
+    submitRequest(session, &request, rtrn, NULL, NULL);
+    rtrn = CDNN_request_wait(&request);
+    CDNN_session_free(session);
+    
+    memcpy(errMsgChars, request.errMsg, CDNN_ERR_MSG_CHARS);
+    if (errMsg != NULL)  *errMsg = &errMsgChars[0];
+    lastBuildStats = request.stats;
+    
+    return rtrn;
+}
+
+int CDNN_tabular_encoder(CDNN *NN, int numFeatures, int numSamples,
+        double *trainingSamples, int indexOrder, double *importances,
+        int doEncoder, int doDecoder, int numEncodingFeatures, int numVariationalFeatures, int variationalDist,
+        int maxWeights, int maxNeurons, int maxLayers, int maxWeightDepth, double maxActivationRate,
+        int maxWeightsHardLimit, int maxNeuronsHardLimit, int maxActivationsHardLimit,
+        AFlist allowedAFs, quantizationType weightQuantization, quantizationType activationQuantization,
+        int weightSparsity, int allowNegativeWeights, int hasBias, double *sampleOutputs, char **errMsg)
+{
+    CDNN_session *session;
+    CDNN_request request;
+    int rtrn;
+    
+    session = CDNN_session_init();
+    if (session == NULL)  return CD_OUT_OF_MEMORY_ERROR;
+    
+    rtrn = encoderRequest(&request, session, NN, numFeatures, numSamples,
+            trainingSamples, indexOrder, importances,
+            doEncoder, doDecoder, numEncodingFeatures, numVariationalFeatures, variationalDist,
+            maxWeights, maxNeurons, maxLayers, maxWeightDepth, maxActivationRate,
+            maxWeightsHardLimit, maxNeuronsHardLimit, maxActivationsHardLimit,
+            allowedAFs, weightQuantization, activationQuantization,
+            weightSparsity, allowNegativeWeights, hasBias, sampleOutputs);
+    submitRequest(session, &request, rtrn, NULL, NULL);
+    rtrn = CDNN_request_wait(&request);
+    CDNN_session_free(session);
+    
+    memcpy(errMsgChars, request.errMsg, CDNN_ERR_MSG_CHARS);
+    if (errMsg != NULL)  *errMsg = &errMsgChars[0];
+    lastBuildStats = request.stats;
+    
+    return rtrn;
+}
+
+
+    // The _async() versions return as soon as the request is sent off; it's run by CDNN_session_poll()
+    // and CDNN_request_wait().  They return NULL only if out of memory.
+
+CDNN_request *CDNN_tabular_regressor_async(CDNN_session *session, CDNN *NN, int numInputs, int numOutputs, int numSamples,
+        double *trainingSamples, int indexOrder, int *outputRowsColumns, double *importances,
+        int maxWeights, int maxNeurons, int maxLayers, int maxWeightDepth, double maxActivationRate,
+        int maxWeightsHardLimit, int maxNeuronsHardLimit, int maxActivationsHardLimit,
+        AFlist allowedAFs, quantizationType weightQuantization, quantizationType activationQuantization,
+        int weightSparsity, int allowNegativeWeights, int hasBias, int allowIOconnections, double *sampleOutputs,
+        CDNN_callback callback, void *userData)
+{
+    CDNN_request *request;
+    int rtrn;
+    
+    request = malloc(sizeof(CDNN_request));
+    if (request == NULL)  return NULL;
+    
+    rtrn = regressorRequest(request, session, NN, numInputs, numOutputs, numSamples,
+            trainingSamples, indexOrder, outputRowsColumns, importances,
+            maxWeights, maxNeurons, maxLayers, maxWeightDepth, maxActivationRate,
+            maxWeightsHardLimit, maxNeuronsHardLimit, maxActivationsHardLimit,
+            allowedAFs, weightQuantization, activationQuantization,
+            weightSparsity, allowNegativeWeights, hasBias, allowIOconnections, sampleOutputs);
+    submitRequest(session, request, rtrn, callback, userData);
+    
+    return request;
+}
+
+CDNN_request *CDNN_tabular_encoder_async(CDNN_session *session, CDNN *NN, int numFeatures, int numSamples,
+        double *trainingSamples, int indexOrder, double *importances,
+        int doEncoder, int doDecoder, int numEncodingFeatures, int numVariationalFeatures, int variationalDist,
+        int maxWeights, int maxNeurons, int maxLayers, int maxWeightDepth, double maxActivationRate,
+        int maxWeightsHardLimit, int maxNeuronsHardLimit, int maxActivationsHardLimit,
+        AFlist allowedAFs, quantizationType weightQuantization, quantizationType activationQuantization,
+        int weightSparsity, int allowNegativeWeights, int hasBias, double *sampleOutputs,
+        CDNN_callback callback, void *userData)
+{
+    CDNN_request *request;
+    int rtrn;
+    
+    request = malloc(sizeof(CDNN_request));
+    if (request == NULL)  return NULL;
+    
+    rtrn = encoderRequest(request, session, NN, numFeatures, numSamples,
+            trainingSamples, indexOrder, importances,
+            doEncoder, doDecoder, numEncodingFeatures, numVariationalFeatures, variationalDist,
+            maxWeights, maxNeurons, maxLayers, maxWeightDepth, maxActivationRate,
+            maxWeightsHardLimit, maxNeuronsHardLimit, maxActivationsHardLimit,
+            allowedAFs, weightQuantization, activationQuantization,
+            weightSparsity, allowNegativeWeights, hasBias, sampleOutputs);
+    submitRequest(session, request, rtrn, callback, userData);
+    
+    return request;
+}
+
+
+
+
+    // Activation functions are applied to a whole layer at a time, so the choice of function is made once per layer.
+    // Unless a network is set to exact mode, sigmoid and tanh are computed from exp() approximated by
+    // a degree-12 polynomial, in vectors where the CPU allows, to within 1e-15 of the libm functions;
+    // in exact mode they call libm, and the outputs are bit for bit those of the per-neuron libm calls.
+
+#define LINEAR_AF 0
+#define STEP_AF 1
+#define RELU_AF 2
+#define RELU1_AF 3
+#define SIGMOID_AF 4
+#define TANH_AF 5
+
+#define CDNN_EXP_LIMIT 708.
+#define CDNN_LOG2E 1.4426950408889634
+#define CDNN_LN2_HI 6.93145751953125e-1
+#define CDNN_LN2_LO 1.42860682030941723212e-6
+
+    // 1/n! for n = 12 down to 0, for Horner's rule
+static const double expPoly[13] = { 2.08767569878680989792e-9, 2.50521083854417187751e-8, 2.75573192239858906526e-7,
+        2.75573192239858906526e-6, 2.48015873015873015873e-5, 1.98412698412698412698e-4, 1.38888888888888888889e-3,
+        8.33333333333333333333e-3, 4.16666666666666666667e-2, 1.66666666666666666667e-1, 0.5, 1., 1. };
+
+    // exp(x) for |x| <= CDNN_EXP_LIMIT:  2^k exp(r), with |r| <= ln(2)/2
+
+static inline double fastExp(double x)
+{
+    int i;
+    double k, r, p;
+    union { double d; long long i; } scale;
+    
+    k = floor(x*CDNN_LOG2E + 0.5);
+    r = (x - k*CDNN_LN2_HI) - k*CDNN_LN2_LO;
+    p = expPoly[0];
+    for (i = 1; i < 13; i++)  p = p*r + expPoly[i];
+    scale.i = ((long long) k + 1023) << 52;
+    
+    return p*scale.d;
+}
+
+static inline double clampExp(double x)
+{
+    if (x > CDNN_EXP_LIMIT)  return CDNN_EXP_LIMIT;
+    else if (x < -CDNN_EXP_LIMIT)  return -CDNN_EXP_LIMIT;
+    else  return x;
+}
+
+void sigmoidAF_scalar(double *y, int n)
+{
+    int i;
+    
+    for (i = 0; i < n; i++)  {
+    if (y[i] == y[i])  {
+        y[i] = 1. / (1. + fastExp(clampExp(-y[i])));
+}}  }
+
+    // tanh(x) = (1 - e^-2|x|) / (1 + e^-2|x|), with the sign of x
+void tanhAF_scalar(double *y, int n)
+{
+    int i;
+    double e;
+    
+    for (i = 0; i < n; i++)  {
+    if (y[i] == y[i])  {
+        e = fastExp(clampExp(-2.*fabs(y[i])));
+        y[i] = copysign((1. - e) / (1. + e), y[i]);
+}}  }
+    
+    // Dense-layer kernels:  denseMV() is y[i] += sum_i0 w[i][i0]*x[i0], and denseMM() is the same
+    // over a tile of samples stored neuron-major with a stride of CDNN_BATCH_TILE.
+    // The SIMD versions are compiled for their instruction sets individually and chosen at run time,
+    // so they can differ from the scalar kernels only in the rounding of the sums.
+    // The ...f() kernels are the same in single precision, for networks converted by CDNN_make_f32(),
+    // and dotI8MM(), dotI16MM() and dotI8x8MM() take one row of the integer weights of a network converted by
+    // CDNN_make_quantized() against a tile of quantized samples, xStride elements apart, into one sum per sample.
+    // bitMV() sums the binary weights of networks converted by CDNN_make_bitpacked() with popcounts,
+    // and columnMV() adds up the weight columns of active inputs for networks converted by CDNN_make_event_driven().
+
+#define CDNN_BATCH_TILE 64
+
+void denseMV_scalar(const double *w, const double *x, double *y, int numOut, int numIn)
+{
+    int i, i0;
+    
+    for (i = 0; i < numOut; i++)  {
+    for (i0 = 0; i0 < numIn; i0++)  {
+        y[i] += (*w) * x[i0];
+        w++;
+    }}
+}
+
+void denseMM_scalar(const double *w, const double *x, double *y, int numOut, int numIn, int numTile)
+{
+    int i, i0, s;
+    double *yOut;
+    const double *yIn;
+    
+    for (i = 0; i < numOut; i++)  {
+        yOut = y + i*CDNN_BATCH_TILE;
+        for (i0 = 0; i0 < numIn; i0++)  {
+            yIn = x + i0*CDNN_BATCH_TILE;
+            for (s = 0; s < numTile; s++)  yOut[s] += (*w) * yIn[s];
+            w++;
+    }   }
+}
+    
+    
+    // sparseMV() runs over a sparse block whose weights are sorted by output neuron, so that
+    // rowStart[i]..rowStart[i+1] index the weights of neuron i and each output is written once
+
+void sparseMV_scalar(const double *w, const int *n0, const int *rowStart, const double *x, double *y, int numOut)
+{
+    int i, j;
+    double sum;
+    
+    for (i = 0; i < numOut; i++)  {
+        sum = 0.;
+        for (j = rowStart[i]; j < rowStart[i+1]; j++)  sum += w[j] * x[n0[j]];
+        y[i] += sum;
+}   }
+
+void denseMVf_scalar(const float *w, const float *x, float *y, int numOut, int numIn)
+{
+    int i, i0;
+    
+    for (i = 0; i < numOut; i++)  {
+    for (i0 = 0; i0 < numIn; i0++)  {
+        y[i] += (*w) * x[i0];
+        w++;
+    }}
+}
+
+void denseMMf_scalar(const float *w, const float *x, float *y, int numOut, int numIn, int numTile)
+{
+    int i, i0, s;
+    float *yOut;
+    const float *yIn;
+    
+    for (i = 0; i < numOut; i++)  {
+        yOut = y + i*CDNN_BATCH_TILE;
+        for (i0 = 0; i0 < numIn; i0++)  {
+            yIn = x + i0*CDNN_BATCH_TILE;
+            for (s = 0; s < numTile; s++)  yOut[s] += (*w) * yIn[s];
+            w++;
+    }   }
+}
+
+void sparseMVf_scalar(const float *w, const int *n0, const int *rowStart, const float *x, float *y, int numOut)
+{
+    int i, j;
+    float sum;
+    
+    for (i = 0; i < numOut; i++)  {
+        sum = 0.f;
+        for (j = rowStart[i]; j < rowStart[i+1]; j++)  sum += w[j] * x[n0[j]];
+        y[i] += sum;
+}   }
+
+void dotI8MM_scalar(const signed char *w, const short *x, int xStride, int n, int numTile, long long *sums)
+{
+    int s, i;
+    long long sum;
+    
+    for (s = 0; s < numTile; s++)  {
+        sum = 0;
+        for (i = 0; i < n; i++)  sum += w[i] * x[i];
+        sums[s] = sum;
+        x += xStride;
+}   }
+
+void dotI16MM_scalar(const short *w, const short *x, int xStride, int n, int numTile, long long *sums)
+{
+    int s, i;
+    long long sum;
+    
+    for (s = 0; s < numTile; s++)  {
+        sum = 0;
+        for (i = 0; i < n; i++)  sum += w[i] * x[i];
+        sums[s] = sum;
+        x += xStride;
+}   }
+
+void dotI8x8MM_scalar(const signed char *w, const signed char *x, int xStride, int n, int numTile, long long *sums)
+{
+    int s, i;
+    long long sum;
+    
+    for (s = 0; s < numTile; s++)  {
+        sum = 0;
+        for (i = 0; i < n; i++)  sum += w[i] * x[i];
+        sums[s] = sum;
+        x += xStride;
+}   }
+
+    // Bit-packed activations:  row i of a block whose weights are all 0, scale or -scale has a mask of its positive
+    // weights and one of its negative weights, numWords words each, and y[i] += scale * (the bits of x set in the
+    // first, less those set in the second)
+
+int countBits(uint64_t x)
+{
+#ifdef __GNUC__
+    return __builtin_popcountll(x);
+#else
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    return (int) ((x * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+void bitMV_scalar(const uint64_t *pos, const uint64_t *neg, const uint64_t *x, double scale, double *y, int numOut, int numWords)
+{
+    int i, k;
+    long long count;
+    
+    for (i = 0; i < numOut; i++)  {
+        count = 0;
+        for (k = 0; k < numWords; k++)  count += countBits(pos[k] & x[k]) - countBits(neg[k] & x[k]);
+        y[i] += scale*count;
+        pos += numWords;
+        neg += numWords;
+}   }
+
+    // Event-driven propagation:  wT is a block's weights stored column by column, numOut to a column, and
+    // y[i] += sum_k wT[active[k]][i]*x[active[k]] over the numActive inputs in active[].  The columns are
+    // added four at a time, so that y is read and written once for every four of them.
+
+void columnMV_scalar(const double *wT, const int *active, int numActive, const double *x, double *y, int numOut)
+{
+    int i, k;
+    double a0, a1, a2, a3;
+    const double *c0, *c1, *c2, *c3;
+    
+    for (k = 0; k+4 <= numActive; k += 4)  {
+        a0 = x[active[k]];  a1 = x[active[k+1]];  a2 = x[active[k+2]];  a3 = x[active[k+3]];
+        c0 = wT + (long) active[k]*numOut;  c1 = wT + (long) active[k+1]*numOut;
+        c2 = wT + (long) active[k+2]*numOut;  c3 = wT + (long) active[k+3]*numOut;
+        for (i = 0; i < numOut; i++)  y[i] += a0*c0[i] + a1*c1[i] + a2*c2[i] + a3*c3[i];
+    }
+    for (; k < numActive; k++)  {
+        a0 = x[active[k]];
+        c0 = wT + (long) active[k]*numOut;
+        for (i = 0; i < numOut; i++)  y[i] += a0*c0[i];
+}   }
+
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CDNN_X86_SIMD
+#include <immintrin.h>
+
+__attribute__((target("sse2")))
+void denseMV_sse2(const double *w, const double *x, double *y, int numOut, int numIn)
+{
+    int i, i0;
+    double sum[2];
+    __m128d acc;
+    
+    for (i = 0; i < numOut; i++)  {
+        acc = _mm_setzero_pd();
+        for (i0 = 0; i0+2 <= numIn; i0 += 2)  {
+            acc = _mm_add_pd(acc, _mm_mul_pd(_mm_loadu_pd(w+i0), _mm_loadu_pd(x+i0)));
+        }
+        _mm_storeu_pd(sum, acc);
+        sum[0] += sum[1];
+        for (; i0 < numIn; i0++)  sum[0] += w[i0] * x[i0];
+        y[i] += sum[0];
+        w += numIn;
+}   }
+
+__attribute__((target("sse2")))
+void denseMM_sse2(const double *w, const double *x, double *y, int numOut, int numIn, int numTile)
+{
+    int i, i0, s;
+    double *yOut;
+    __m128d wi, acc0, acc1, acc2, acc3;
+    
+    numTile = (numTile+7) & ~7;
+    for (i = 0; i < numOut; i++)  {
+        yOut = y + i*CDNN_BATCH_TILE;
+        for (s = 0; s < numTile; s += 8)  {
+            acc0 = _mm_loadu_pd(yOut+s);
+            acc1 = _mm_loadu_pd(yOut+s+2);
+            acc2 = _mm_loadu_pd(yOut+s+4);
+            acc3 = _mm_loadu_pd(yOut+s+6);
+            for (i0 = 0; i0 < numIn; i0++)  {
+                const double *yIn = x + i0*CDNN_BATCH_TILE + s;
+                wi = _mm_set1_pd(w[i0]);
+                acc0 = _mm_add_pd(acc0, _mm_mul_pd(wi, _mm_loadu_pd(yIn)));
+                acc1 = _mm_add_pd(acc1, _mm_mul_pd(wi, _mm_loadu_pd(yIn+2)));
+                acc2 = _mm_add_pd(acc2, _mm_mul_pd(wi, _mm_loadu_pd(yIn+4)));
+                acc3 = _mm_add_pd(acc3, _mm_mul_pd(wi, _mm_loadu_pd(yIn+6)));
+            }
+            _mm_storeu_pd(yOut+s, acc0);
+            _mm_storeu_pd(yOut+s+2, acc1);
+            _mm_storeu_pd(yOut+s+4, acc2);
+            _mm_storeu_pd(yOut+s+6, acc3);
+        }
+        w += numIn;
+}   }
+
+__attribute__((target("avx2,fma")))
+static inline double hsum256(__m256d v)
+{
+    __m128d lo = _mm256_castpd256_pd128(v), hi = _mm256_extractf128_pd(v, 1);
+    lo = _mm_add_pd(lo, hi);
+    return _mm_cvtsd_f64(_mm_add_sd(lo, _mm_unpackhi_pd(lo, lo)));
+}
+
+__attribute__((target("avx2,fma")))
+void denseMV_avx2(const double *w, const double *x, double *y, int numOut, int numIn)
+{
+    int i, i0;
+    double sum0, sum1, sum2, sum3;
+    __m256d xv, acc0, acc1, acc2, acc3;
+    const double *w1, *w2, *w3;
+    
+        // four rows at a time, so that each load of x feeds four FMAs
+    for (i = 0; i+4 <= numOut; i += 4)  {
+        w1 = w+numIn;  w2 = w1+numIn;  w3 = w2+numIn;
+        acc0 = acc1 = acc2 = acc3 = _mm256_setzero_pd();
+        for (i0 = 0; i0+4 <= numIn; i0 += 4)  {
+            xv = _mm256_loadu_pd(x+i0);
+            acc0 = _mm256_fmadd_pd(_mm256_loadu_pd(w+i0), xv, acc0);
+            acc1 = _mm256_fmadd_pd(_mm256_loadu_pd(w1+i0), xv, acc1);
+            acc2 = _mm256_fmadd_pd(_mm256_loadu_pd(w2+i0), xv, acc2);
+            acc3 = _mm256_fmadd_pd(_mm256_loadu_pd(w3+i0), xv, acc3);
+        }
+        sum0 = hsum256(acc0);  sum1 = hsum256(acc1);  sum2 = hsum256(acc2);  sum3 = hsum256(acc3);
+        for (; i0 < numIn; i0++)  {
+            sum0 += w[i0] * x[i0];
+            sum1 += w1[i0] * x[i0];
+            sum2 += w2[i0] * x[i0];
+            sum3 += w3[i0] * x[i0];
+        }
+        y[i] += sum0;  y[i+1] += sum1;  y[i+2] += sum2;  y[i+3] += sum3;
+        w += 4*numIn;
+    }
+    for (; i < numOut; i++)  {
+        acc0 = _mm256_setzero_pd();
+        for (i0 = 0; i0+4 <= numIn; i0 += 4)  {
+            acc0 = _mm256_fmadd_pd(_mm256_loadu_pd(w+i0), _mm256_loadu_pd(x+i0), acc0);
+        }
+        sum0 = hsum256(acc0);
+        for (; i0 < numIn; i0++)  sum0 += w[i0] * x[i0];
+        y[i] += sum0;
+        w += numIn;
+}   }
+
+__attribute__((target("avx2,fma")))
+void sparseMV_avx2(const double *w, const int *n0, const int *rowStart, const double *x, double *y, int numOut)
+{
+    int i, j;
+    double sum;
+    __m256d acc;
+    
+    for (i = 0; i < numOut; i++)  {
+        acc = _mm256_setzero_pd();
+        for (j = rowStart[i]; j+4 <= rowStart[i+1]; j += 4)  {
+            acc = _mm256_fmadd_pd(_mm256_loadu_pd(w+j),
+                    _mm256_i32gather_pd(x, _mm_loadu_si128((const __m128i *) (n0+j)), 8), acc);
+        }
+        sum = hsum256(acc);
+        for (; j < rowStart[i+1]; j++)  sum += w[j] * x[n0[j]];
+        y[i] += sum;
+}   }
+
+__attribute__((target("avx2,fma")))
+void denseMM_avx2(const double *w, const double *x, double *y, int numOut, int numIn, int numTile)
+{
+    int i, i0, s;
+    double *yOut;
+    __m256d wi, acc0, acc1, acc2, acc3;
+    
+    numTile = (numTile+15) & ~15;
+    for (i = 0; i < numOut; i++)  {
+        yOut = y + i*CDNN_BATCH_TILE;
+        for (s = 0; s < numTile; s += 16)  {
+            acc0 = _mm256_loadu_pd(yOut+s);
+            acc1 = _mm256_loadu_pd(yOut+s+4);
+            acc2 = _mm256_loadu_pd(yOut+s+8);
+            acc3 = _mm256_loadu_pd(yOut+s+12);
+            for (i0 = 0; i0 < numIn; i0++)  {
+                const double *yIn = x + i0*CDNN_BATCH_TILE + s;
+                wi = _mm256_broadcast_sd(w+i0);
+                acc0 = _mm256_fmadd_pd(wi, _mm256_loadu_pd(yIn), acc0);
+                acc1 = _mm256_fmadd_pd(wi, _mm256_loadu_pd(yIn+4), acc1);
+                acc2 = _mm256_fmadd_pd(wi, _mm256_loadu_pd(yIn+8), acc2);
+                acc3 = _mm256_fmadd_pd(wi, _mm256_loadu_pd(yIn+12), acc3);
+            }
+            _mm256_storeu_pd(yOut+s, acc0);
+            _mm256_storeu_pd(yOut+s+4, acc1);
+            _mm256_storeu_pd(yOut+s+8, acc2);
+            _mm256_storeu_pd(yOut+s+12, acc3);
+        }
+        w += numIn;
+}   }
+
+__attribute__((target("avx512f")))
+void denseMV_avx512(const double *w, const double *x, double *y, int numOut, int numIn)
+{
+    int i, i0;
+    __mmask8 tailMask = (__mmask8) ((1 << (numIn & 7)) - 1);
+    __m512d xv, acc0, acc1;
+    const double *w1;
+    
+    for (i = 0; i+2 <= numOut; i += 2)  {
+        w1 = w+numIn;
+        acc0 = acc1 = _mm512_setzero_pd();
+        for (i0 = 0; i0+8 <= numIn; i0 += 8)  {
+            xv = _mm512_loadu_pd(x+i0);
+            acc0 = _mm512_fmadd_pd(_mm512_loadu_pd(w+i0), xv, acc0);
+            acc1 = _mm512_fmadd_pd(_mm512_loadu_pd(w1+i0), xv, acc1);
+        }
+        if (tailMask != 0)  {
+            xv = _mm512_maskz_loadu_pd(tailMask, x+i0);
+            acc0 = _mm512_fmadd_pd(_mm512_maskz_loadu_pd(tailMask, w+i0), xv, acc0);
+            acc1 = _mm512_fmadd_pd(_mm512_maskz_loadu_pd(tailMask, w1+i0), xv, acc1);
+        }
+        y[i] += _mm512_reduce_add_pd(acc0);
+        y[i+1] += _mm512_reduce_add_pd(acc1);
+        w += 2*numIn;
+    }
+    if (i < numOut)  {
+        acc0 = _mm512_setzero_pd();
+        for (i0 = 0; i0+8 <= numIn; i0 += 8)  {
+            acc0 = _mm512_fmadd_pd(_mm512_loadu_pd(w+i0), _mm512_loadu_pd(x+i0), acc0);
+        }
+        if (tailMask != 0)  acc0 = _mm512_fmadd_pd(_mm512_maskz_loadu_pd(tailMask, w+i0),
+                _mm512_maskz_loadu_pd(tailMask, x+i0), acc0);
+        y[i] += _mm512_reduce_add_pd(acc0);
+}   }
+
+__attribute__((target("avx512f")))
+void sparseMV_avx512(const double *w, const int *n0, const int *rowStart, const double *x, double *y, int numOut)
+{
+    int i, j;
+    double sum;
+    __m512d acc;
+    
+    for (i = 0; i < numOut; i++)  {
+        acc = _mm512_setzero_pd();
+        for (j = rowStart[i]; j+8 <= rowStart[i+1]; j += 8)  {
+            acc = _mm512_fmadd_pd(_mm512_loadu_pd(w+j),
+                    _mm512_i32gather_pd(_mm256_loadu_si256((const __m256i *) (n0+j)), x, 8), acc);
+        }
+        sum = _mm512_reduce_add_pd(acc);
+        for (; j < rowStart[i+1]; j++)  sum += w[j] * x[n0[j]];
+        y[i] += sum;
+}   }
+
+__attribute__((target("avx512f")))
+void denseMM_avx512(const double *w, const double *x, double *y, int numOut, int numIn, int numTile)
+{
+    int i, i0, s;
+    double *yOut;
+    __m512d wi, acc0, acc1, acc2, acc3;
+    
+    numTile = (numTile+31) & ~31;
+    for (i = 0; i < numOut; i++)  {
+        yOut = y + i*CDNN_BATCH_TILE;
+        for (s = 0; s < numTile; s += 32)  {
+            acc0 = _mm512_loadu_pd(yOut+s);
+            acc1 = _mm512_loadu_pd(yOut+s+8);
+            acc2 = _mm512_loadu_pd(yOut+s+16);
+            acc3 = _mm512_loadu_pd(yOut+s+24);
+            for (i0 = 0; i0 < numIn; i0++)  {
+                const double *yIn = x + i0*CDNN_BATCH_TILE + s;
+                wi = _mm512_set1_pd(w[i0]);
+                acc0 = _mm512_fmadd_pd(wi, _mm512_loadu_pd(yIn), acc0);
+                acc1 = _mm512_fmadd_pd(wi, _mm512_loadu_pd(yIn+8), acc1);
+                acc2 = _mm512_fmadd_pd(wi, _mm512_loadu_pd(yIn+16), acc2);
+                acc3 = _mm512_fmadd_pd(wi, _mm512_loadu_pd(yIn+24), acc3);
+            }
+            _mm512_storeu_pd(yOut+s, acc0);
+            _mm512_storeu_pd(yOut+s+8, acc1);
+            _mm512_storeu_pd(yOut+s+16, acc2);
+            _mm512_storeu_pd(yOut+s+24, acc3);
+        }
+        w += numIn;
+}   }
+
+__attribute__((target("sse2")))
+void denseMVf_sse2(const float *w, const float *x, float *y, int numOut, int numIn)
+{
+    int i, i0;
+    float sum[4];
+    __m128 acc;
+    
+    for (i = 0; i < numOut; i++)  {
+        acc = _mm_setzero_ps();
+        for (i0 = 0; i0+4 <= numIn; i0 += 4)  {
+            acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(w+i0), _mm_loadu_ps(x+i0)));
+        }
+        _mm_storeu_ps(sum, acc);
+        sum[0] += sum[1] + sum[2] + sum[3];
+        for (; i0 < numIn; i0++)  sum[0] += w[i0] * x[i0];
+        y[i] += sum[0];
+        w += numIn;
+}   }
+
+__attribute__((target("sse2")))
+void denseMMf_sse2(const float *w, const float *x, float *y, int numOut, int numIn, int numTile)
+{
+    int i, i0, s;
+    float *yOut;
+    __m128 wi, acc0, acc1, acc2, acc3;
+    
+    numTile = (numTile+15) & ~15;
+    for (i = 0; i < numOut; i++)  {
+        yOut = y + i*CDNN_BATCH_TILE;
+        for (s = 0; s < numTile; s += 16)  {
+            acc0 = _mm_loadu_ps(yOut+s);
+            acc1 = _mm_loadu_ps(yOut+s+4);
+            acc2 = _mm_loadu_ps(yOut+s+8);
+            acc3 = _mm_loadu_ps(yOut+s+12);
+            for (i0 = 0; i0 < numIn; i0++)  {
+                const float *yIn = x + i0*CDNN_BATCH_TILE + s;
+                wi = _mm_set1_ps(w[i0]);
+                acc0 = _mm_add_ps(acc0, _mm_mul_ps(wi, _mm_loadu_ps(yIn)));
+                acc1 = _mm_add_ps(acc1, _mm_mul_ps(wi, _mm_loadu_ps(yIn+4)));
+                acc2 = _mm_add_ps(acc2, _mm_mul_ps(wi, _mm_loadu_ps(yIn+8)));
+                acc3 = _mm_add_ps(acc3, _mm_mul_ps(wi, _mm_loadu_ps(yIn+12)));
+            }
+            _mm_storeu_ps(yOut+s, acc0);
+            _mm_storeu_ps(yOut+s+4, acc1);
+            _mm_storeu_ps(yOut+s+8, acc2);
+            _mm_storeu_ps(yOut+s+12, acc3);
+        }
+        w += numIn;
+}   }
+
+__attribute__((target("avx2,fma")))
+static inline __m256d fastExp_avx2(__m256d x)
+{
+    int i;
+    __m256d k, r, p;
+    __m256i scale;
+    
+    x = _mm256_max_pd(_mm256_min_pd(x, _mm256_set1_pd(CDNN_EXP_LIMIT)), _mm256_set1_pd(-CDNN_EXP_LIMIT));
+    k = _mm256_round_pd(_mm256_mul_pd(x, _mm256_set1_pd(CDNN_LOG2E)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    r = _mm256_fnmadd_pd(k, _mm256_set1_pd(CDNN_LN2_HI), x);
+    r = _mm256_fnmadd_pd(k, _mm256_set1_pd(CDNN_LN2_LO), r);
+    p = _mm256_set1_pd(expPoly[0]);
+    for (i = 1; i < 13; i++)  p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(expPoly[i]));
+    scale = _mm256_cvtepi32_epi64(_mm256_cvtpd_epi32(k));
+    scale = _mm256_slli_epi64(_mm256_add_epi64(scale, _mm256_set1_epi64x(1023)), 52);
+    
+    return _mm256_mul_pd(p, _mm256_castsi256_pd(scale));
+}
+
+    // NaNs are passed through, as libm does
+__attribute__((target("avx2,fma")))
+void sigmoidAF_avx2(double *y, int n)
+{
+    int i;
+    __m256d x, one = _mm256_set1_pd(1.);
+    
+    for (i = 0; i+4 <= n; i += 4)  {
+        x = _mm256_loadu_pd(y+i);
+        x = _mm256_blendv_pd(_mm256_div_pd(one, _mm256_add_pd(one, fastExp_avx2(_mm256_sub_pd(_mm256_setzero_pd(), x)))),
+                x, _mm256_cmp_pd(x, x, _CMP_UNORD_Q));
+        _mm256_storeu_pd(y+i, x);
+    }
+    sigmoidAF_scalar(y+i, n-i);
+}
+
+__attribute__((target("avx2,fma")))
+void tanhAF_avx2(double *y, int n)
+{
+    int i;
+    __m256d x, e, t, one = _mm256_set1_pd(1.), signBit = _mm256_set1_pd(-0.);
+    
+    for (i = 0; i+4 <= n; i += 4)  {
+        x = _mm256_loadu_pd(y+i);
+        e = fastExp_avx2(_mm256_mul_pd(_mm256_set1_pd(-2.), _mm256_andnot_pd(signBit, x)));
+        t = _mm256_div_pd(_mm256_sub_pd(one, e), _mm256_add_pd(one, e));
+        t = _mm256_or_pd(t, _mm256_and_pd(signBit, x));
+        _mm256_storeu_pd(y+i, _mm256_blendv_pd(t, x, _mm256_cmp_pd(x, x, _CMP_UNORD_Q)));
+    }
+    tanhAF_scalar(y+i, n-i);
+}
+
+    // The integer kernels run four samples at a time against each load of the weights; the rows past the end of
+    // the tile repeat the first sample, and their sums are dropped.
+    // pmaddwd sums pairs of int16 products into int32 lanes.  An int8 weight times an int16 activation is
+    // under 2^22 in size, so the int32 lanes can take CDNN_DOT_I8_CHUNK of them before they're added up in 64 bits;
+    // int16 weights fill the lanes at once, so their pair sums are widened straight away.
+    // Two int8 numbers are multiplied by pmaddubsw, which takes unsigned bytes on one side, so the weight's sign
+    // is moved onto the activation; the pair sums are under 2*127^2, so they can't saturate.  VNNI does the same
+    // multiply and the sum into int32 lanes in one instruction.
+
+#define CDNN_DOT_I8_CHUNK 2048
+
+static inline void storeSums4(long long *sums, int s, int numTile, long long t0, long long t1, long long t2, long long t3)
+{
+    sums[s] = t0;
+    if (s+1 < numTile)  sums[s+1] = t1;
+    if (s+2 < numTile)  sums[s+2] = t2;
+    if (s+3 < numTile)  sums[s+3] = t3;
+}
+
+__attribute__((target("sse2")))
+static inline long long sumI32_sse2(__m128i acc)
+{
+    int lanes[4];
+    
+    _mm_storeu_si128((__m128i *) lanes, acc);
+    return (long long) lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+__attribute__((target("sse2")))
+static inline __m128i addI64_sse2(__m128i acc64, __m128i prod)
+{
+    __m128i sign = _mm_srai_epi32(prod, 31);
+    
+    acc64 = _mm_add_epi64(acc64, _mm_unpacklo_epi32(prod, sign));
+    return _mm_add_epi64(acc64, _mm_unpackhi_epi32(prod, sign));
+}
+
+__attribute__((target("sse2")))
+static inline long long sumI64_sse2(__m128i acc64)
+{
+    long long lanes[2];
+    
+    _mm_storeu_si128((__m128i *) lanes, acc64);
+    return lanes[0] + lanes[1];
+}
+
+__attribute__((target("sse2")))
+void dotI8MM_sse2(const signed char *w, const short *x, int xStride, int n, int numTile, long long *sums)
+{
+    int s, i, i1;
+    long long t0, t1, t2, t3;
+    const short *x0, *x1, *x2, *x3;
+    __m128i wv, acc0, acc1, acc2, acc3;
+    
+    for (s = 0; s < numTile; s += 4)  {
+        x0 = x + (long) s*xStride;
+        x1 = (s+1 < numTile) ? x0 + xStride : x0;
+        x2 = (s+2 < numTile) ? x1 + xStride : x0;
+        x3 = (s+3 < numTile) ? x2 + xStride : x0;
+        t0 = t1 = t2 = t3 = 0;
+        for (i = 0; i+8 <= n; )  {
+            acc0 = acc1 = acc2 = acc3 = _mm_setzero_si128();
+            for (i1 = 0; (i1 < CDNN_DOT_I8_CHUNK) && (i+8 <= n); i1 += 8, i += 8)  {
+                wv = _mm_loadl_epi64((const __m128i *) (w+i));
+                wv = _mm_srai_epi16(_mm_unpacklo_epi8(wv, wv), 8);
+                acc0 = _mm_add_epi32(acc0, _mm_madd_epi16(wv, _mm_loadu_si128((const __m128i *) (x0+i))));
+                acc1 = _mm_add_epi32(acc1, _mm_madd_epi16(wv, _mm_loadu_si128((const __m128i *) (x1+i))));
+                acc2 = _mm_add_epi32(acc2, _mm_madd_epi16(wv, _mm_loadu_si128((const __m128i *) (x2+i))));
+                acc3 = _mm_add_epi32(acc3, _mm_madd_epi16(wv, _mm_loadu_si128((const __m128i *) (x3+i))));
+            }
+            t0 += sumI32_sse2(acc0);
+            t1 += sumI32_sse2(acc1);
+            t2 += sumI32_sse2(acc2);
+            t3 += sumI32_sse2(acc3);
+        }
+        for (; i < n; i++)  {
+            t0 += w[i] * x0[i];
+            t1 += w[i] * x1[i];
+            t2 += w[i] * x2[i];
+            t3 += w[i] * x3[i];     }
+        storeSums4(sums, s, numTile, t0, t1, t2, t3);
+}   }
+
+__attribute__((target("sse2")))
+void dotI16MM_sse2(const short *w, const short *x, int xStride, int n, int numTile, long long *sums)
+{
+    int s, i;
+    long long t0, t1, t2, t3;
+    const short *x0, *x1, *x2, *x3;
+    __m128i wv, acc0, acc1, acc2, acc3;
+    
+    for (s = 0; s < numTile; s += 4)  {
+        x0 = x + (long) s*xStride;
+        x1 = (s+1 < numTile) ? x0 + xStride : x0;
+        x2 = (s+2 < numTile) ? x1 + xStride : x0;
+        x3 = (s+3 < numTile) ? x2 + xStride : x0;
+        acc0 = acc1 = acc2 = acc3 = _mm_setzero_si128();
+        for (i = 0; i+8 <= n; i += 8)  {
+            wv = _mm_loadu_si128((const __m128i *) (w+i));
+            acc0 = addI64_sse2(acc0, _mm_madd_epi16(wv, _mm_loadu_si128((const __m128i *) (x0+i))));
+            acc1 = addI64_sse2(acc1, _mm_madd_epi16(wv, _mm_loadu_si128((const __m128i *) (x1+i))));
+            acc2 = addI64_sse2(acc2, _mm_madd_epi16(wv, _mm_loadu_si128((const __m128i *) (x2+i))));
+            acc3 = addI64_sse2(acc3, _mm_madd_epi16(wv, _mm_loadu_si128((const __m128i *) (x3+i))));
+        }
+        t0 = sumI64_sse2(acc0);
+        t1 = sumI64_sse2(acc1);
+        t2 = sumI64_sse2(acc2);
+        t3 = sumI64_sse2(acc3);
+        for (; i < n; i++)  {
+            t0 += w[i] * x0[i];
+            t1 += w[i] * x1[i];
+            t2 += w[i] * x2[i];
+            t3 += w[i] * x3[i];     }
+        storeSums4(sums, s, numTile, t0, t1, t2, t3);
+}   }
+
+    // SSE2 has no pmaddubsw, so both sides are widened to int16
+
+__attribute__((target("sse2")))
+static inline __m128i loadI8asI16_sse2(const signed char *x)
+{
+    __m128i v = _mm_loadl_epi64((const __m128i *) x);
+    
+    return _mm_srai_epi16(_mm_unpacklo_epi8(v, v), 8);
+}
+
+__attribute__((target("sse2")))
+void dotI8x8MM_sse2(const signed char *w, const signed char *x, int xStride, int n, int numTile, long long *sums)
+{
+    int s, i, i1;
+    long long t0, t1, t2, t3;
+    const signed char *x0, *x1, *x2, *x3;
+    __m128i wv, acc0, acc1, acc2, acc3;
+    
+    for (s = 0; s < numTile; s += 4)  {
+        x0 = x + (long) s*xStride;
+        x1 = (s+1 < numTile) ? x0 + xStride : x0;
+        x2 = (s+2 < numTile) ? x1 + xStride : x0;
+        x3 = (s+3 < numTile) ? x2 + xStride : x0;
+        t0 = t1 = t2 = t3 = 0;
+        for (i = 0; i+8 <= n; )  {
+            acc0 = acc1 = acc2 = acc3 = _mm_setzero_si128();
+            for (i1 = 0; (i1 < CDNN_DOT_I8_CHUNK) && (i+8 <= n); i1 += 8, i += 8)  {
+                wv = loadI8asI16_sse2(w+i);
+                acc0 = _mm_add_epi32(acc0, _mm_madd_epi16(wv, loadI8asI16_sse2(x0+i)));
+                acc1 = _mm_add_epi32(acc1, _mm_madd_epi16(wv, loadI8asI16_sse2(x1+i)));
+                acc2 = _mm_add_epi32(acc2, _mm_madd_epi16(wv, loadI8asI16_sse2(x2+i)));
+                acc3 = _mm_add_epi32(acc3, _mm_madd_epi16(wv, loadI8asI16_sse2(x3+i)));
+            }
+            t0 += sumI32_sse2(acc0);
+            t1 += sumI32_sse2(acc1);
+            t2 += sumI32_sse2(acc2);
+            t3 += sumI32_sse2(acc3);
+        }
+        for (; i < n; i++)  {
+            t0 += w[i] * x0[i];
+            t1 += w[i] * x1[i];
+            t2 += w[i] * x2[i];
+            t3 += w[i] * x3[i];     }
+        storeSums4(sums, s, numTile, t0, t1, t2, t3);
+}   }
+
+__attribute__((target("avx2,fma")))
+static inline long long sumI32_avx2(__m256i acc)
+{
+    int lanes[8];
+    
+    _mm256_storeu_si256((__m256i *) lanes, acc);
+    return (long long) lanes[0] + lanes[1] + lanes[2] + lanes[3] + lanes[4] + lanes[5] + lanes[6] + lanes[7];
+}
+
+__attribute__((target("avx2,fma")))
+static inline __m256i addI64_avx2(__m256i acc64, __m256i prod)
+{
+    acc64 = _mm256_add_epi64(acc64, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(prod)));
+    return _mm256_add_epi64(acc64, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(prod, 1)));
+}
+
+__attribute__((target("avx2,fma")))
+static inline long long sumI64_avx2(__m256i acc64)
+{
+    long long lanes[4];
+    
+    _mm256_storeu_si256((__m256i *) lanes, acc64);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+__attribute__((target("avx2,fma")))
+void dotI8MM_avx2(const signed char *w, const short *x, int xStride, int n, int numTile, long long *sums)
+{
+    int s, i, i1;
+    long long t0, t1, t2, t3;
+    const short *x0, *x1, *x2, *x3;
+    __m256i wv, acc0, acc1, acc2, acc3;
+    
+    for (s = 0; s < numTile; s += 4)  {
+        x0 = x + (long) s*xStride;
+        x1 = (s+1 < numTile) ? x0 + xStride : x0;
+        x2 = (s+2 < numTile) ? x1 + xStride : x0;
+        x3 = (s+3 < numTile) ? x2 + xStride : x0;
+        t0 = t1 = t2 = t3 = 0;
+        for (i = 0; i+16 <= n; )  {
+            acc0 = acc1 = acc2 = acc3 = _mm256_setzero_si256();
+            for (i1 = 0; (i1 < CDNN_DOT_I8_CHUNK) && (i+16 <= n); i1 += 16, i += 16)  {
+                wv = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *) (w+i)));
+                acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(wv, _mm256_loadu_si256((const __m256i *) (x0+i))));
+                acc1 = _mm256_add_epi32(acc1, _mm256_madd_epi16(wv, _mm256_loadu_si256((const __m256i *) (x1+i))));
+                acc2 = _mm256_add_epi32(acc2, _mm256_madd_epi16(wv, _mm256_loadu_si256((const __m256i *) (x2+i))));
+                acc3 = _mm256_add_epi32(acc3, _mm256_madd_epi16(wv, _mm256_loadu_si256((const __m256i *) (x3+i))));
+            }
+            t0 += sumI32_avx2(acc0);
+            t1 += sumI32_avx2(acc1);
+            t2 += sumI32_avx2(acc2);
+            t3 += sumI32_avx2(acc3);
+        }
+        for (; i < n; i++)  {
+            t0 += w[i] * x0[i];
+            t1 += w[i] * x1[i];
+            t2 += w[i] * x2[i];
+            t3 += w[i] * x3[i];     }
+        storeSums4(sums, s, numTile, t0, t1, t2, t3);
+}   }
+
+__attribute__((target("avx2,fma")))
+void dotI16MM_avx2(const short *w, const short *x, int xStride, int n, int numTile, long long *sums)
+{
+    int s, i;
+    long long t0, t1, t2, t3;
+    const short *x0, *x1, *x2, *x3;
+    __m256i wv, acc0, acc1, acc2, acc3;
+    
+    for (s = 0; s < numTile; s += 4)  {
+        x0 = x + (long) s*xStride;
+        x1 = (s+1 < numTile) ? x0 + xStride : x0;
+        x2 = (s+2 < numTile) ? x1 + xStride : x0;
+        x3 = (s+3 < numTile) ? x2 + xStride : x0;
+        acc0 = acc1 = acc2 = acc3 = _mm256_setzero_si256();
+        for (i = 0; i+16 <= n; i += 16)  {
+            wv = _mm256_loadu_si256((const __m256i *) (w+i));
+            acc0 = addI64_avx2(acc0, _mm256_madd_epi16(wv, _mm256_loadu_si256((const __m256i *) (x0+i))));
+            acc1 = addI64_avx2(acc1, _mm256_madd_epi16(wv, _mm256_loadu_si256((const __m256i *) (x1+i))));
+            acc2 = addI64_avx2(acc2, _mm256_madd_epi16(wv, _mm256_loadu_si256((const __m256i *) (x2+i))));
+            acc3 = addI64_avx2(acc3, _mm256_madd_epi16(wv, _mm256_loadu_si256((const __m256i *) (x3+i))));
+        }
+        t0 = sumI64_avx2(acc0);
+        t1 = sumI64_avx2(acc1);
+        t2 = sumI64_avx2(acc2);
+        t3 = sumI64_avx2(acc3);
+        for (; i < n; i++)  {
+            t0 += w[i] * x0[i];
+            t1 += w[i] * x1[i];
+            t2 += w[i] * x2[i];
+            t3 += w[i] * x3[i];     }
+        storeSums4(sums, s, numTile, t0, t1, t2, t3);
+}   }
+
+__attribute__((target("avx2,fma")))
+void dotI8x8MM_avx2(const signed char *w, const signed char *x, int xStride, int n, int numTile, long long *sums)
+{
+    int s, i, i1;
+    long long t0, t1, t2, t3;
+    const signed char *x0, *x1, *x2, *x3;
+    __m256i wv, wAbs, ones = _mm256_set1_epi16(1), acc0, acc1, acc2, acc3;
+    
+    for (s = 0; s < numTile; s += 4)  {
+        x0 = x + (long) s*xStride;
+        x1 = (s+1 < numTile) ? x0 + xStride : x0;
+        x2 = (s+2 < numTile) ? x1 + xStride : x0;
+        x3 = (s+3 < numTile) ? x2 + xStride : x0;
+        t0 = t1 = t2 = t3 = 0;
+        for (i = 0; i+32 <= n; )  {
+            acc0 = acc1 = acc2 = acc3 = _mm256_setzero_si256();
+            for (i1 = 0; (i1 < CDNN_DOT_I8_CHUNK) && (i+32 <= n); i1 += 32, i += 32)  {
+                wv = _mm256_loadu_si256((const __m256i *) (w+i));
+                wAbs = _mm256_abs_epi8(wv);
+                acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(_mm256_maddubs_epi16(wAbs,
+                        _mm256_sign_epi8(_mm256_loadu_si256((const __m256i *) (x0+i)), wv)), ones));
+                acc1 = _mm256_add_epi32(acc1, _mm256_madd_epi16(_mm256_maddubs_epi16(wAbs,
+                        _mm256_sign_epi8(_mm256_loadu_si256((const __m256i *) (x1+i)), wv)), ones));
+                acc2 = _mm256_add_epi32(acc2, _mm256_madd_epi16(_mm256_maddubs_epi16(wAbs,
+                        _mm256_sign_epi8(_mm256_loadu_si256((const __m256i *) (x2+i)), wv)), ones));
+                acc3 = _mm256_add_epi32(acc3, _mm256_madd_epi16(_mm256_maddubs_epi16(wAbs,
+                        _mm256_sign_epi8(_mm256_loadu_si256((const __m256i *) (x3+i)), wv)), ones));
+            }
+            t0 += sumI32_avx2(acc0);
+            t1 += sumI32_avx2(acc1);
+            t2 += sumI32_avx2(acc2);
+            t3 += sumI32_avx2(acc3);
+        }
+        for (; i < n; i++)  {
+            t0 += w[i] * x0[i];
+            t1 += w[i] * x1[i];
+            t2 += w[i] * x2[i];
+            t3 += w[i] * x3[i];     }
+        storeSums4(sums, s, numTile, t0, t1, t2, t3);
+}   }
+
+    // the AVX-512 integer kernels need AVX512BW on top of AVX512F, so they have their own rows of quantKernels[]
+
+__attribute__((target("avx512f")))
+static inline long long sumI32_avx512(__m512i acc)
+{
+    return _mm512_reduce_add_epi64(_mm512_add_epi64(_mm512_cvtepi32_epi64(_mm512_castsi512_si256(acc)),
+            _mm512_cvtepi32_epi64(_mm512_extracti64x4_epi64(acc, 1))));
+}
+
+__attribute__((target("avx512f")))
+static inline __m512i addI64_avx512(__m512i acc64, __m512i prod)
+{
+    acc64 = _mm512_add_epi64(acc64, _mm512_cvtepi32_epi64(_mm512_castsi512_si256(prod)));
+    return _mm512_add_epi64(acc64, _mm512_cvtepi32_epi64(_mm512_extracti64x4_epi64(prod, 1)));
+}
+
+__attribute__((target("avx512f,avx512bw")))
+void dotI8MM_avx512(const signed char *w, const short *x, int xStride, int n, int numTile, long long *sums)
+{
+    int s, i, i1;
+    long long t0, t1, t2, t3;
+    const short *x0, *x1, *x2, *x3;
+    __m512i wv, acc0, acc1, acc2, acc3;
+    
+    for (s = 0; s < numTile; s += 4)  {
+        x0 = x + (long) s*xStride;
+        x1 = (s+1 < numTile) ? x0 + xStride : x0;
+        x2 = (s+2 < numTile) ? x1 + xStride : x0;
+        x3 = (s+3 < numTile) ? x2 + xStride : x0;
+        t0 = t1 = t2 = t3 = 0;
+        for (i = 0; i+32 <= n; )  {
+            acc0 = acc1 = acc2 = acc3 = _mm512_setzero_si512();
+            for (i1 = 0; (i1 < CDNN_DOT_I8_CHUNK) && (i+32 <= n); i1 += 32, i += 32)  {
+                wv = _mm512_cvtepi8_epi16(_mm256_loadu_si256((const __m256i *) (w+i)));
+                acc0 = _mm512_add_epi32(acc0, _mm512_madd_epi16(wv, _mm512_loadu_si512(x0+i)));
+                acc1 = _mm512_add_epi32(acc1, _mm512_madd_epi16(wv, _mm512_loadu_si512(x1+i)));
+                acc2 = _mm512_add_epi32(acc2, _mm512_madd_epi16(wv, _mm512_loadu_si512(x2+i)));
+                acc3 = _mm512_add_epi32(acc3, _mm512_madd_epi16(wv, _mm512_loadu_si512(x3+i)));
+            }
+            t0 += sumI32_avx512(acc0);
+            t1 += sumI32_avx512(acc1);
+            t2 += sumI32_avx512(acc2);
+            t3 += sumI32_avx512(acc3);
+        }
+        for (; i < n; i++)  {
+            t0 += w[i] * x0[i];
+            t1 += w[i] * x1[i];
+            t2 += w[i] * x2[i];
+            t3 += w[i] * x3[i];     }
+        storeSums4(sums, s, numTile, t0, t1, t2, t3);
+}   }
+
+__attribute__((target("avx512f,avx512bw")))
+void dotI16MM_avx512(const short *w, const short *x, int xStride, int n, int numTile, long long *sums)
+{
+    int s, i;
+    long long t0, t1, t2, t3;
+    const short *x0, *x1, *x2, *x3;
+    __m512i wv, acc0, acc1, acc2, acc3;
+    
+    for (s = 0; s < numTile; s += 4)  {
+        x0 = x + (long) s*xStride;
+        x1 = (s+1 < numTile) ? x0 + xStride : x0;
+        x2 = (s+2 < numTile) ? x1 + xStride : x0;
+        x3 = (s+3 < numTile) ? x2 + xStride : x0;
+        acc0 = acc1 = acc2 = acc3 = _mm512_setzero_si512();
+        for (i = 0; i+32 <= n; i += 32)  {
+            wv = _mm512_loadu_si512(w+i);
+            acc0 = addI64_avx512(acc0, _mm512_madd_epi16(wv, _mm512_loadu_si512(x0+i)));
+            acc1 = addI64_avx512(acc1, _mm512_madd_epi16(wv, _mm512_loadu_si512(x1+i)));
+            acc2 = addI64_avx512(acc2, _mm512_madd_epi16(wv, _mm512_loadu_si512(x2+i)));
+            acc3 = addI64_avx512(acc3, _mm512_madd_epi16(wv, _mm512_loadu_si512(x3+i)));
+        }
+        t0 = _mm512_reduce_add_epi64(acc0);
+        t1 = _mm512_reduce_add_epi64(acc1);
+        t2 = _mm512_reduce_add_epi64(acc2);
+        t3 = _mm512_reduce_add_epi64(acc3);
+        for (; i < n; i++)  {
+            t0 += w[i] * x0[i];
+            t1 += w[i] * x1[i];
+            t2 += w[i] * x2[i];
+            t3 += w[i] * x3[i];     }
+        storeSums4(sums, s, numTile, t0, t1, t2, t3);
+}   }
+
+    // AVX-512 has no psignb, so the activations are negated under a mask of the negative weights
+
+__attribute__((target("avx512f,avx512bw")))
+void dotI8x8MM_avx512(const signed char *w, const signed char *x, int xStride, int n, int numTile, long long *sums)
+{
+    int s, i, i1;
+    long long t0, t1, t2, t3;
+    const signed char *x0, *x1, *x2, *x3;
+    __mmask64 neg;
+    __m512i wv, wAbs, xv, zero = _mm512_setzero_si512(), ones = _mm512_set1_epi16(1), acc0, acc1, acc2, acc3;
+    
+    for (s = 0; s < numTile; s += 4)  {
+        x0 = x + (long) s*xStride;
+        x1 = (s+1 < numTile) ? x0 + xStride : x0;
+        x2 = (s+2 < numTile) ? x1 + xStride : x0;
+        x3 = (s+3 < numTile) ? x2 + xStride : x0;
+        t0 = t1 = t2 = t3 = 0;
+        for (i = 0; i+64 <= n; )  {
+            acc0 = acc1 = acc2 = acc3 = _mm512_setzero_si512();
+            for (i1 = 0; (i1 < CDNN_DOT_I8_CHUNK) && (i+64 <= n); i1 += 64, i += 64)  {
+                wv = _mm512_loadu_si512(w+i);
+                neg = _mm512_movepi8_mask(wv);
+                wAbs = _mm512_abs_epi8(wv);
+                xv = _mm512_loadu_si512(x0+i);
+                acc0 = _mm512_add_epi32(acc0, _mm512_madd_epi16(_mm512_maddubs_epi16(wAbs, _mm512_mask_sub_epi8(xv, neg, zero, xv)), ones));
+                xv = _mm512_loadu_si512(x1+i);
+                acc1 = _mm512_add_epi32(acc1, _mm512_madd_epi16(_mm512_maddubs_epi16(wAbs, _mm512_mask_sub_epi8(xv, neg, zero, xv)), ones));
+                xv = _mm512_loadu_si512(x2+i);
+                acc2 = _mm512_add_epi32(acc2, _mm512_madd_epi16(_mm512_maddubs_epi16(wAbs, _mm512_mask_sub_epi8(xv, neg, zero, xv)), ones));
+                xv = _mm512_loadu_si512(x3+i);
+                acc3 = _mm512_add_epi32(acc3, _mm512_madd_epi16(_mm512_maddubs_epi16(wAbs, _mm512_mask_sub_epi8(xv, neg, zero, xv)), ones));
+            }
+            t0 += sumI32_avx512(acc0);
+            t1 += sumI32_avx512(acc1);
+            t2 += sumI32_avx512(acc2);
+            t3 += sumI32_avx512(acc3);
+        }
+        for (; i < n; i++)  {
+            t0 += w[i] * x0[i];
+            t1 += w[i] * x1[i];
+            t2 += w[i] * x2[i];
+            t3 += w[i] * x3[i];     }
+        storeSums4(sums, s, numTile, t0, t1, t2, t3);
+}   }
+
+__attribute__((target("avx512f,avx512bw,avx512vnni")))
+void dotI8x8MM_vnni(const signed char *w, const signed char *x, int xStride, int n, int numTile, long long *sums)
+{
+    int s, i, i1;
+    long long t0, t1, t2, t3;
+    const signed char *x0, *x1, *x2, *x3;
+    __mmask64 neg;
+    __m512i wv, wAbs, xv, zero = _mm512_setzero_si512(), acc0, acc1, acc2, acc3;
+    
+    for (s = 0; s < numTile; s += 4)  {
+        x0 = x + (long) s*xStride;
+        x1 = (s+1 < numTile) ? x0 + xStride : x0;
+        x2 = (s+2 < numTile) ? x1 + xStride : x0;
+        x3 = (s+3 < numTile) ? x2 + xStride : x0;
+        t0 = t1 = t2 = t3 = 0;
+        for (i = 0; i+64 <= n; )  {
+            acc0 = acc1 = acc2 = acc3 = _mm512_setzero_si512();
+            for (i1 = 0; (i1 < CDNN_DOT_I8_CHUNK) && (i+64 <= n); i1 += 64, i += 64)  {
+                wv = _mm512_loadu_si512(w+i);
+                neg = _mm512_movepi8_mask(wv);
+                wAbs = _mm512_abs_epi8(wv);
+                xv = _mm512_loadu_si512(x0+i);
+                acc0 = _mm512_dpbusd_epi32(acc0, wAbs, _mm512_mask_sub_epi8(xv, neg, zero, xv));
+                xv = _mm512_loadu_si512(x1+i);
+                acc1 = _mm512_dpbusd_epi32(acc1, wAbs, _mm512_mask_sub_epi8(xv, neg, zero, xv));
+                xv = _mm512_loadu_si512(x2+i);
+                acc2 = _mm512_dpbusd_epi32(acc2, wAbs, _mm512_mask_sub_epi8(xv, neg, zero, xv));
+                xv = _mm512_loadu_si512(x3+i);
+                acc3 = _mm512_dpbusd_epi32(acc3, wAbs, _mm512_mask_sub_epi8(xv, neg, zero, xv));
+            }
+            t0 += sumI32_avx512(acc0);
+            t1 += sumI32_avx512(acc1);
+            t2 += sumI32_avx512(acc2);
+            t3 += sumI32_avx512(acc3);
+        }
+        for (; i < n; i++)  {
+            t0 += w[i] * x0[i];
+            t1 += w[i] * x1[i];
+            t2 += w[i] * x2[i];
+            t3 += w[i] * x3[i];     }
+        storeSums4(sums, s, numTile, t0, t1, t2, t3);
+}   }
+
+    // every CPU with AVX2 has the popcnt instruction
+
+__attribute__((target("popcnt")))
+void bitMV_popcnt(const uint64_t *pos, const uint64_t *neg, const uint64_t *x, double scale, double *y, int numOut, int numWords)
+{
+    int i, k;
+    long long count;
+    
+    for (i = 0; i < numOut; i++)  {
+        count = 0;
+        for (k = 0; k < numWords; k++)  count += __builtin_popcountll(pos[k] & x[k]) - __builtin_popcountll(neg[k] & x[k]);
+        y[i] += scale*count;
+        pos += numWords;
+        neg += numWords;
+}   }
+
+__attribute__((target("avx2,fma")))
+void columnMV_avx2(const double *wT, const int *active, int numActive, const double *x, double *y, int numOut)
+{
+    int i, k;
+    double a0, a1, a2, a3;
+    const double *c0, *c1, *c2, *c3;
+    __m256d yv, av0, av1, av2, av3;
+    
+    for (k = 0; k+4 <= numActive; k += 4)  {
+        a0 = x[active[k]];  a1 = x[active[k+1]];  a2 = x[active[k+2]];  a3 = x[active[k+3]];
+        c0 = wT + (long) active[k]*numOut;  c1 = wT + (long) active[k+1]*numOut;
+        c2 = wT + (long) active[k+2]*numOut;  c3 = wT + (long) active[k+3]*numOut;
+        av0 = _mm256_set1_pd(a0);  av1 = _mm256_set1_pd(a1);  av2 = _mm256_set1_pd(a2);  av3 = _mm256_set1_pd(a3);
+        for (i = 0; i+4 <= numOut; i += 4)  {
+            yv = _mm256_fmadd_pd(av0, _mm256_loadu_pd(c0+i), _mm256_loadu_pd(y+i));
+            yv = _mm256_fmadd_pd(av1, _mm256_loadu_pd(c1+i), yv);
+            yv = _mm256_fmadd_pd(av2, _mm256_loadu_pd(c2+i), yv);
+            _mm256_storeu_pd(y+i, _mm256_fmadd_pd(av3, _mm256_loadu_pd(c3+i), yv));
+        }
+        for (; i < numOut; i++)  y[i] += a0*c0[i] + a1*c1[i] + a2*c2[i] + a3*c3[i];
+    }
+    for (; k < numActive; k++)  {
+        a0 = x[active[k]];
+        c0 = wT + (long) active[k]*numOut;
+        av0 = _mm256_set1_pd(a0);
+        for (i = 0; i+4 <= numOut; i += 4)  _mm256_storeu_pd(y+i, _mm256_fmadd_pd(av0, _mm256_loadu_pd(c0+i), _mm256_loadu_pd(y+i)));
+        for (; i < numOut; i++)  y[i] += a0*c0[i];
+}   }
+
+__attribute__((target("avx512f")))
+void columnMV_avx512(const double *wT, const int *active, int numActive, const double *x, double *y, int numOut)
+{
+    int i, k;
+    __mmask8 tailMask = (__mmask8) ((1 << (numOut & 7)) - 1);
+    const double *c0, *c1, *c2, *c3;
+    __m512d yv, av0, av1, av2, av3;
+    
+    for (k = 0; k+4 <= numActive; k += 4)  {
+        c0 = wT + (long) active[k]*numOut;  c1 = wT + (long) active[k+1]*numOut;
+        c2 = wT + (long) active[k+2]*numOut;  c3 = wT + (long) active[k+3]*numOut;
+        av0 = _mm512_set1_pd(x[active[k]]);  av1 = _mm512_set1_pd(x[active[k+1]]);
+        av2 = _mm512_set1_pd(x[active[k+2]]);  av3 = _mm512_set1_pd(x[active[k+3]]);
+        for (i = 0; i+8 <= numOut; i += 8)  {
+            yv = _mm512_fmadd_pd(av0, _mm512_loadu_pd(c0+i), _mm512_loadu_pd(y+i));
+            yv = _mm512_fmadd_pd(av1, _mm512_loadu_pd(c1+i), yv);
+            yv = _mm512_fmadd_pd(av2, _mm512_loadu_pd(c2+i), yv);
+            _mm512_storeu_pd(y+i, _mm512_fmadd_pd(av3, _mm512_loadu_pd(c3+i), yv));
+        }
+        if (tailMask != 0)  {
+            yv = _mm512_fmadd_pd(av0, _mm512_maskz_loadu_pd(tailMask, c0+i), _mm512_maskz_loadu_pd(tailMask, y+i));
+            yv = _mm512_fmadd_pd(av1, _mm512_maskz_loadu_pd(tailMask, c1+i), yv);
+            yv = _mm512_fmadd_pd(av2, _mm512_maskz_loadu_pd(tailMask, c2+i), yv);
+            _mm512_mask_storeu_pd(y+i, tailMask, _mm512_fmadd_pd(av3, _mm512_maskz_loadu_pd(tailMask, c3+i), yv));
+    }   }
+    for (; k < numActive; k++)  {
+        c0 = wT + (long) active[k]*numOut;
+        av0 = _mm512_set1_pd(x[active[k]]);
+        for (i = 0; i+8 <= numOut; i += 8)  _mm512_storeu_pd(y+i, _mm512_fmadd_pd(av0, _mm512_loadu_pd(c0+i), _mm512_loadu_pd(y+i)));
+        if (tailMask != 0)  _mm512_mask_storeu_pd(y+i, tailMask,
+                _mm512_fmadd_pd(av0, _mm512_maskz_loadu_pd(tailMask, c0+i), _mm512_maskz_loadu_pd(tailMask, y+i)));
+}   }
+
+__attribute__((target("avx2,fma")))
+static inline float hsum256f(__m256 v)
+{
+    __m128 lo = _mm256_castps256_ps128(v), hi = _mm256_extractf128_ps(v, 1);
+    lo = _mm_add_ps(lo, hi);
+    lo = _mm_add_ps(lo, _mm_movehl_ps(lo, lo));
+    return _mm_cvtss_f32(_mm_add_ss(lo, _mm_shuffle_ps(lo, lo, 1)));
+}
+
+__attribute__((target("avx2,fma")))
+void denseMVf_avx2(const float *w, const float *x, float *y, int numOut, int numIn)
+{
+    int i, i0;
+    float sum0, sum1, sum2, sum3;
+    __m256 xv, acc0, acc1, acc2, acc3;
+    const float *w1, *w2, *w3;
+    
+    for (i = 0; i+4 <= numOut; i += 4)  {
+        w1 = w+numIn;  w2 = w1+numIn;  w3 = w2+numIn;
+        acc0 = acc1 = acc2 = acc3 = _mm256_setzero_ps();
+        for (i0 = 0; i0+8 <= numIn; i0 += 8)  {
+            xv = _mm256_loadu_ps(x+i0);
+            acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(w+i0), xv, acc0);
+            acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(w1+i0), xv, acc1);
+            acc2 = _mm256_fmadd_ps(_mm256_loadu_ps(w2+i0), xv, acc2);
+            acc3 = _mm256_fmadd_ps(_mm256_loadu_ps(w3+i0), xv, acc3);
+        }
+        sum0 = hsum256f(acc0);  sum1 = hsum256f(acc1);  sum2 = hsum256f(acc2);  sum3 = hsum256f(acc3);
+        for (; i0 < numIn; i0++)  {
+            sum0 += w[i0] * x[i0];
+            sum1 += w1[i0] * x[i0];
+            sum2 += w2[i0] * x[i0];
+            sum3 += w3[i0] * x[i0];
+        }
+        y[i] += sum0;  y[i+1] += sum1;  y[i+2] += sum2;  y[i+3] += sum3;
+        w += 4*numIn;
+    }
+    for (; i < numOut; i++)  {
+        acc0 = _mm256_setzero_ps();
+        for (i0 = 0; i0+8 <= numIn; i0 += 8)  {
+            acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(w+i0), _mm256_loadu_ps(x+i0), acc0);
+        }
+        sum0 = hsum256f(acc0);
+        for (; i0 < numIn; i0++)  sum0 += w[i0] * x[i0];
+        y[i] += sum0;
+        w += numIn;
+}   }
+
+__attribute__((target("avx2,fma")))
+void sparseMVf_avx2(const float *w, const int *n0, const int *rowStart, const float *x, float *y, int numOut)
+{
+    int i, j;
+    float sum;
+    __m256 acc;
+    
+    for (i = 0; i < numOut; i++)  {
+        acc = _mm256_setzero_ps();
+        for (j = rowStart[i]; j+8 <= rowStart[i+1]; j += 8)  {
+            acc = _mm256_fmadd_ps(_mm256_loadu_ps(w+j),
+                    _mm256_i32gather_ps(x, _mm256_loadu_si256((const __m256i *) (n0+j)), 4), acc);
+        }
+        sum = hsum256f(acc);
+        for (; j < rowStart[i+1]; j++)  sum += w[j] * x[n0[j]];
+        y[i] += sum;
+}   }
+
+__attribute__((target("avx2,fma")))
+void denseMMf_avx2(const float *w, const float *x, float *y, int numOut, int numIn, int numTile)
+{
+    int i, i0, s;
+    float *yOut;
+    __m256 wi, acc0, acc1, acc2, acc3;
+    
+    numTile = (numTile+31) & ~31;
+    for (i = 0; i < numOut; i++)  {
+        yOut = y + i*CDNN_BATCH_TILE;
+        for (s = 0; s < numTile; s += 32)  {
+            acc0 = _mm256_loadu_ps(yOut+s);
+            acc1 = _mm256_loadu_ps(yOut+s+8);
+            acc2 = _mm256_loadu_ps(yOut+s+16);
+            acc3 = _mm256_loadu_ps(yOut+s+24);
+            for (i0 = 0; i0 < numIn; i0++)  {
+                const float *yIn = x + i0*CDNN_BATCH_TILE + s;
+                wi = _mm256_broadcast_ss(w+i0);
+                acc0 = _mm256_fmadd_ps(wi, _mm256_loadu_ps(yIn), acc0);
+                acc1 = _mm256_fmadd_ps(wi, _mm256_loadu_ps(yIn+8), acc1);
+                acc2 = _mm256_fmadd_ps(wi, _mm256_loadu_ps(yIn+16), acc2);
+                acc3 = _mm256_fmadd_ps(wi, _mm256_loadu_ps(yIn+24), acc3);
+            }
+            _mm256_storeu_ps(yOut+s, acc0);
+            _mm256_storeu_ps(yOut+s+8, acc1);
+            _mm256_storeu_ps(yOut+s+16, acc2);
+            _mm256_storeu_ps(yOut+s+24, acc3);
+        }
+        w += numIn;
+}   }
+
+__attribute__((target("avx512f")))
+void denseMVf_avx512(const float *w, const float *x, float *y, int numOut, int numIn)
+{
+    int i, i0;
+    __mmask16 tailMask = (__mmask16) ((1 << (numIn & 15)) - 1);
+    __m512 xv, acc0, acc1;
+    const float *w1;
+    
+    for (i = 0; i+2 <= numOut; i += 2)  {
+        w1 = w+numIn;
+        acc0 = acc1 = _mm512_setzero_ps();
+        for (i0 = 0; i0+16 <= numIn; i0 += 16)  {
+            xv = _mm512_loadu_ps(x+i0);
+            acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(w+i0), xv, acc0);
+            acc1 = _mm512_fmadd_ps(_mm512_loadu_ps(w1+i0), xv, acc1);
+        }
+        if (tailMask != 0)  {
+            xv = _mm512_maskz_loadu_ps(tailMask, x+i0);
+            acc0 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(tailMask, w+i0), xv, acc0);
+            acc1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(tailMask, w1+i0), xv, acc1);
+        }
+        y[i] += _mm512_reduce_add_ps(acc0);
+        y[i+1] += _mm512_reduce_add_ps(acc1);
+        w += 2*numIn;
+    }
+    if (i < numOut)  {
+        acc0 = _mm512_setzero_ps();
+        for (i0 = 0; i0+16 <= numIn; i0 += 16)  {
+            acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(w+i0), _mm512_loadu_ps(x+i0), acc0);
+        }
+        if (tailMask != 0)  acc0 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(tailMask, w+i0),
+                _mm512_maskz_loadu_ps(tailMask, x+i0), acc0);
+        y[i] += _mm512_reduce_add_ps(acc0);
+}   }
+
+__attribute__((target("avx512f")))
+void sparseMVf_avx512(const float *w, const int *n0, const int *rowStart, const float *x, float *y, int numOut)
+{
+    int i, j;
+    float sum;
+    __m512 acc;
+    
+    for (i = 0; i < numOut; i++)  {
+        acc = _mm512_setzero_ps();
+        for (j = rowStart[i]; j+16 <= rowStart[i+1]; j += 16)  {
+            acc = _mm512_fmadd_ps(_mm512_loadu_ps(w+j),
+                    _mm512_i32gather_ps(_mm512_loadu_si512((const void *) (n0+j)), x, 4), acc);
+        }
+        sum = _mm512_reduce_add_ps(acc);
+        for (; j < rowStart[i+1]; j++)  sum += w[j] * x[n0[j]];
+        y[i] += sum;
+}   }
+
+__attribute__((target("avx512f")))
+void denseMMf_avx512(const float *w, const float *x, float *y, int numOut, int numIn, int numTile)
+{
+    int i, i0, s;
+    float *yOut;
+    __m512 wi, acc0, acc1, acc2, acc3;
+    
+        // four vectors at a time over whole blocks of 64 samples, then one at a time over the rest of a partial tile
+    numTile = (numTile+15) & ~15;
+    for (i = 0; i < numOut; i++)  {
+        yOut = y + i*CDNN_BATCH_TILE;
+        for (s = 0; s+64 <= numTile; s += 64)  {
+            acc0 = _mm512_loadu_ps(yOut+s);
+            acc1 = _mm512_loadu_ps(yOut+s+16);
+            acc2 = _mm512_loadu_ps(yOut+s+32);
+            acc3 = _mm512_loadu_ps(yOut+s+48);
+            for (i0 = 0; i0 < numIn; i0++)  {
+                const float *yIn = x + i0*CDNN_BATCH_TILE + s;
+                wi = _mm512_set1_ps(w[i0]);
+                acc0 = _mm512_fmadd_ps(wi, _mm512_loadu_ps(yIn), acc0);
+                acc1 = _mm512_fmadd_ps(wi, _mm512_loadu_ps(yIn+16), acc1);
+                acc2 = _mm512_fmadd_ps(wi, _mm512_loadu_ps(yIn+32), acc2);
+                acc3 = _mm512_fmadd_ps(wi, _mm512_loadu_ps(yIn+48), acc3);
+            }
+            _mm512_storeu_ps(yOut+s, acc0);
+            _mm512_storeu_ps(yOut+s+16, acc1);
+            _mm512_storeu_ps(yOut+s+32, acc2);
+            _mm512_storeu_ps(yOut+s+48, acc3);
+        }
+        for (; s < numTile; s += 16)  {
+            acc0 = _mm512_loadu_ps(yOut+s);
+            for (i0 = 0; i0 < numIn; i0++)  {
+                acc0 = _mm512_fmadd_ps(_mm512_set1_ps(w[i0]), _mm512_loadu_ps(x + i0*CDNN_BATCH_TILE + s), acc0);     }
+            _mm512_storeu_ps(yOut+s, acc0);
+        }
+        w += numIn;
+}   }
+
+#endif
+
+
+typedef struct {
+    void (*denseMV)(const double *, const double *, double *, int, int);
+    void (*denseMM)(const double *, const double *, double *, int, int, int);
+    void (*sparseMV)(const double *, const int *, const int *, const double *, double *, int);
+    void (*denseMVf)(const float *, const float *, float *, int, int);
+    void (*denseMMf)(const float *, const float *, float *, int, int, int);
+    void (*sparseMVf)(const float *, const int *, const int *, const float *, float *, int);
+    void (*sigmoidAF)(double *, int);
+    void (*tanhAF)(double *, int);
+    void (*bitMV)(const uint64_t *, const uint64_t *, const uint64_t *, double, double *, int, int);
+    void (*columnMV)(const double *, const int *, int, const double *, double *, int);
+} kernelList;
+
+#ifdef CDNN_X86_SIMD
+const kernelList kernels[4] = {
+    { &denseMV_scalar, &denseMM_scalar, &sparseMV_scalar, &denseMVf_scalar, &denseMMf_scalar, &sparseMVf_scalar,
+            &sigmoidAF_scalar, &tanhAF_scalar, &bitMV_scalar, &columnMV_scalar },
+    { &denseMV_sse2, &denseMM_sse2, &sparseMV_scalar, &denseMVf_sse2, &denseMMf_sse2, &sparseMVf_scalar,
+            &sigmoidAF_scalar, &tanhAF_scalar, &bitMV_scalar, &columnMV_scalar },
+    { &denseMV_avx2, &denseMM_avx2, &sparseMV_avx2, &denseMVf_avx2, &denseMMf_avx2, &sparseMVf_avx2,
+            &sigmoidAF_avx2, &tanhAF_avx2, &bitMV_popcnt, &columnMV_avx2 },
+    { &denseMV_avx512, &denseMM_avx512, &sparseMV_avx512, &denseMVf_avx512, &denseMMf_avx512, &sparseMVf_avx512,
+            &sigmoidAF_avx2, &tanhAF_avx2, &bitMV_popcnt, &columnMV_avx512 }
+};
+#else
+const kernelList kernels[1] = {
+    { &denseMV_scalar, &denseMM_scalar, &sparseMV_scalar, &denseMVf_scalar, &denseMMf_scalar, &sparseMVf_scalar,
+            &sigmoidAF_scalar, &tanhAF_scalar, &bitMV_scalar, &columnMV_scalar }
+};
+#endif
+
+    // The integer kernels have two more rows past CDNN_SIMD_AVX512, for CPUs that also have AVX512BW, and AVX512-VNNI
+    // on top of that; CDNN_set_simd_level() picks the row once and keeps it in the model's quantSimdLevel.
+
+typedef struct {
+    void (*dotI8MM)(const signed char *, const short *, int, int, int, long long *);
+    void (*dotI16MM)(const short *, const short *, int, int, int, long long *);
+    void (*dotI8x8MM)(const signed char *, const signed char *, int, int, int, long long *);
+} quantKernelList;
+
+#define CDNN_QUANT_AVX512BW 4
+#define CDNN_QUANT_AVX512VNNI 5
+
+#ifdef CDNN_X86_SIMD
+const quantKernelList quantKernels[6] = {
+    { &dotI8MM_scalar, &dotI16MM_scalar, &dotI8x8MM_scalar },
+    { &dotI8MM_sse2, &dotI16MM_sse2, &dotI8x8MM_sse2 },
+    { &dotI8MM_avx2, &dotI16MM_avx2, &dotI8x8MM_avx2 },
+    { &dotI8MM_avx2, &dotI16MM_avx2, &dotI8x8MM_avx2 },
+    { &dotI8MM_avx512, &dotI16MM_avx512, &dotI8x8MM_avx512 },
+    { &dotI8MM_avx512, &dotI16MM_avx512, &dotI8x8MM_vnni }
+};
+#else
+const quantKernelList quantKernels[1] = {
+    { &dotI8MM_scalar, &dotI16MM_scalar, &dotI8x8MM_scalar }
+};
+#endif
+
+
+int CDNN_max_simd_level(void)
+{
+#ifdef CDNN_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))  return CDNN_SIMD_AVX512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))  return CDNN_SIMD_AVX2;
+    if (__builtin_cpu_supports("sse2"))  return CDNN_SIMD_SSE2;
+#endif
+    return CDNN_SIMD_SCALAR;
+}
+
+    // the row of quantKernels[] to use at a given SIMD level
+
+int quantKernelRow(int level)
+{
+#ifdef CDNN_X86_SIMD
+    if ((level == CDNN_SIMD_AVX512) && __builtin_cpu_supports("avx512bw"))  {
+        if (__builtin_cpu_supports("avx512vnni"))  return CDNN_QUANT_AVX512VNNI;
+        return CDNN_QUANT_AVX512BW;
+    }
+#endif
+    return level;
+}
+
+int CDNN_set_simd_level(CDNN_model *model, int level)
+{
+    int maxLevel = CDNN_max_simd_level();
+    
+    if ((level < 0) || (level > maxLevel))  level = maxLevel;
+    model->simdLevel = level;
+    model->quantSimdLevel = quantKernelRow(level);
+    
+    return level;
+}
+
+
+int CDNN_set_exact_activations(CDNN_model *model, int ifExact)
+{
+    int wasExact = model->exactAFs;
+    
+    model->exactAFs = (ifExact != 0);
+    
+    return wasExact;
+}
+
+
+void applyAF(const CDNN_model *NN, int AF, double *y, int n)
+{
+    int i;
+    
+    switch (AF)  {
+        case STEP_AF:
+            for (i = 0; i < n; i++)  y[i] = (y[i] <= 0.) ? 0. : 1.;
+            break;
+        case RELU_AF:
+            for (i = 0; i < n; i++)  y[i] = (y[i] <= 0.) ? 0. : y[i];
+            break;
+        case RELU1_AF:
+            for (i = 0; i < n; i++)  y[i] = (y[i] <= 0.) ? 0. : ((y[i] >= 1.) ? 1. : y[i]);
+            break;
+        case SIGMOID_AF:
+            if (NN->exactAFs)  {  for (i = 0; i < n; i++)  y[i] = 1. / (1. + exp(-y[i]));  }
+            else  kernels[NN->simdLevel].sigmoidAF(y, n);
+            break;
+        case TANH_AF:
+            if (NN->exactAFs)  {  for (i = 0; i < n; i++)  y[i] = tanh(y[i]);  }
+            else  kernels[NN->simdLevel].tanhAF(y, n);
+            break;
+}   }
+
+    // single precision always uses libm's float functions
+
+void applyAFf(int AF, float *y, int n)
+{
+    int i;
+    
+    switch (AF)  {
+        case STEP_AF:
+            for (i = 0; i < n; i++)  y[i] = (y[i] <= 0.f) ? 0.f : 1.f;
+            break;
+        case RELU_AF:
+            for (i = 0; i < n; i++)  y[i] = (y[i] <= 0.f) ? 0.f : y[i];
+            break;
+        case RELU1_AF:
+            for (i = 0; i < n; i++)  y[i] = (y[i] <= 0.f) ? 0.f : ((y[i] >= 1.f) ? 1.f : y[i]);
+            break;
+        case SIGMOID_AF:
+            for (i = 0; i < n; i++)  y[i] = 1.f / (1.f + expf(-y[i]));
+            break;
+        case TANH_AF:
+            for (i = 0; i < n; i++)  y[i] = tanhf(y[i]);
+            break;
+}   }
+
+
+int CDNN_context_init(CDNN_context *ctx, const CDNN_model *model)
+{
+    int l;
+    long yOffset;
+    
+    ctx->model = model;
+    ctx->ty = NULL;
+    ctx->yF32 = ctx->tyF32 = NULL;
+    ctx->yQ = NULL;
+    ctx->yBits = NULL;
+    ctx->active = NULL;
+    ctx->numActive = NULL;
+    ctx->events.numSamples = ctx->events.MACs = ctx->events.skippedMACs = 0;
+    ctx->profile = NULL;
+    ctx->y = malloc(model->numLayers*sizeof(double *));
+    if (ctx->y == NULL)  return CD_OUT_OF_MEMORY_ERROR;
+    
+    yOffset = 0;
+    for (l = 0; l < model->numLayers; l++)  yOffset += model->layerSize[l];
+    ctx->y[0] = malloc(yOffset*sizeof(double));
+    if (ctx->y[0] == NULL)  {
+        free(ctx->y);
+        ctx->y = NULL;
+        return CD_OUT_OF_MEMORY_ERROR;     }
+    
+    for (l = 1; l < model->numLayers; l++)  ctx->y[l] = ctx->y[l-1] + model->layerSize[l-1];
+    
+    return 0;
+}
+
+
+void CDNN_context_free(CDNN_context *ctx)
+{
+    if (ctx->y != NULL)  free(ctx->y[0]);
+    free(ctx->y);
+    if (ctx->ty != NULL)  free(ctx->ty[0]);
+    free(ctx->ty);
+    ctx->y = ctx->ty = NULL;
+    if (ctx->yF32 != NULL)  free(ctx->yF32[0]);
+    free(ctx->yF32);
+    if (ctx->tyF32 != NULL)  free(ctx->tyF32[0]);
+    free(ctx->tyF32);
+    ctx->yF32 = ctx->tyF32 = NULL;
+    if (ctx->yQ != NULL)  free(ctx->yQ[0]);
+    free(ctx->yQ);
+    ctx->yQ = NULL;
+    if (ctx->yBits != NULL)  free(ctx->yBits[0]);
+    free(ctx->yBits);
+    ctx->yBits = NULL;
+    if (ctx->active != NULL)  free(ctx->active[0]);
+    free(ctx->active);
+    free(ctx->numActive);
+    ctx->active = NULL;
+    ctx->numActive = NULL;
+    free(ctx->profile);
+    ctx->profile = NULL;
+}
+
+
+    // Profiling:  each layer that is run is timed, and its multiply-accumulates and nonzero activations counted.
+    // Profiling is off while the profile is NULL, which costs a test per layer.  Turning it on again zeroes the counters.
+
+int setProfile(CDNN_layer_profile **profile, int numLayers, int ifProfile)
+{
+    if (!ifProfile)  {
+        free(*profile);
+        *profile = NULL;
+        return 0;     }
+    
+    if (*profile == NULL)  *profile = malloc(numLayers*sizeof(CDNN_layer_profile));
+    if (*profile == NULL)  return CD_OUT_OF_MEMORY_ERROR;
+    memset(*profile, 0, numLayers*sizeof(CDNN_layer_profile));
+    
+    return 0;
+}
+
+int CDNN_context_profile(CDNN_context *ctx, int ifProfile)  {  return setProfile(&ctx->profile, ctx->model->numLayers, ifProfile);  }
+int CDNN_profile(CDNN *NN, int ifProfile)  {  return setProfile(&NN->profile, NN->model.numLayers, ifProfile);  }
+
+    // the weights a layer's kernels run over per sample, which for a sparse block expanded to dense is the whole block
+
+long long layerMACs(const CDNN_model *NN, int l)
+{
+    int li, l0;
+    long long numMACs = 0;
+    
+    for (li = 0; li < NN->numLayerInputs[l]; li++)  {
+        l0 = NN->layerInputs[l][li];
+        if ((NN->n0 != NULL) && (NN->denseWeights[l][li] == NULL))  numMACs += NN->wSize[l][li];
+        else  numMACs += (long long) NN->layerSize[l]*NN->layerSize[l0];
+    }
+    
+    return numMACs;
+}
+
+void profileLayer(const CDNN_model *NN, CDNN_layer_profile *profile, int l, int numSamples, long long ns, long long numNonzero)
+{
+    profile[l].numSamples += numSamples;
+    profile[l].ns += ns;
+    profile[l].MACs += layerMACs(NN, l)*numSamples;
+    profile[l].numNonzero += numNonzero;
+}
+
+long long countNonzero(const double *y, int n)
+{
+    int i;
+    long long numNonzero = 0;
+    
+    for (i = 0; i < n; i++)  numNonzero += (y[i] != 0.);
+    
+    return numNonzero;
+}
+
+long long countNonzeroF32(const float *y, int n)
+{
+    int i;
+    long long numNonzero = 0;
+    
+    for (i = 0; i < n; i++)  numNonzero += (y[i] != 0.f);
+    
+    return numNonzero;
+}
+
+
+    // rows row0 to row1-1 of layer l; each row comes out the same whichever range it's run in,
+    // so long as row0 is a multiple of CDNN_CHUNK_ALIGN (see run_CDNN_pool_ctx())
+
+void runBlockRows(const CDNN_model *NN, double **y, int l, int li, int row0, int row1)
+{
+    int l0 = NN->layerInputs[l][li], numRows = row1-row0;
+    double *w = NN->weights[l][li];
+    
+    if (NN->n0 != NULL)  {
+        if (NN->denseWeights[l][li] != NULL)  kernels[NN->simdLevel].denseMV(
+                NN->denseWeights[l][li] + (long) row0*NN->layerSize[l0], y[l0], y[l]+row0, numRows, NN->layerSize[l0]);
+        else  kernels[NN->simdLevel].sparseMV(w, NN->n0[l][li], NN->rowStart[l][li]+row0, y[l0], y[l]+row0, numRows);
+    }
+    else  kernels[NN->simdLevel].denseMV(w + (long) row0*NN->layerSize[l0], y[l0], y[l]+row0, numRows, NN->layerSize[l0]);
+}
+
+void runLayerRows(const CDNN_model *NN, double **y, int l, int row0, int row1)
+{
+    int li, n;
+    
+    for (n = row0; n < row1; n++)  y[l][n] = 0.;
+    for (li = 0; li < NN->numLayerInputs[l]; li++)  runBlockRows(NN, y, l, li, row0, row1);
+    applyAF(NN, NN->layerAFs[l], y[l]+row0, row1-row0);
+}
+
+void runLayers(const CDNN_model *NN, double **y, CDNN_layer_profile *profile)
+{
+    int l;
+    long long t0 = 0;
+    
+    for (l = 2; l < NN->numLayers; l++)  {
+    if (l != NN->variationalLayer)  {
+        if (profile != NULL)  t0 = nanoseconds();
+        runLayerRows(NN, y, l, 0, NN->layerSize[l]);
+        if (profile != NULL)  profileLayer(NN, profile, l, 1, nanoseconds()-t0, countNonzero(y[l], NN->layerSize[l]));
+    }}
+}
+
+void setInputs(const CDNN_model *NN, double **y, const double *inputs)
+{
+    y[0][0] = 1;
+    memcpy(y[1], inputs, NN->layerSize[1]*sizeof(double));
+    if (NN->variationalLayer > 0)  memcpy(y[NN->variationalLayer],
+            inputs+NN->layerSize[1], NN->layerSize[NN->variationalLayer]*sizeof(double));
+}
+
+
+double *run_CDNN_ctx(const CDNN_model *NN, CDNN_context *ctx, const double *inputs, double *outputs)
+{
+    double **y = ctx->y;
+    
+    setInputs(NN, y, inputs);
+    runLayers(NN, y, ctx->profile);
+    
+    if (outputs == NULL)  return y[NN->numLayers-1];
+    memcpy(outputs, y[NN->numLayers-1], NN->layerSize[NN->numLayers-1]*sizeof(double));
+    return outputs;
+}
+
+
+double *run_CDNN(CDNN *NN, double *inputs)
+{
+    CDNN_context ctx;
+    
+    ctx.model = &NN->model;
+    ctx.y = NN->y;
+    ctx.ty = NULL;
+    ctx.yF32 = ctx.tyF32 = NULL;
+    ctx.yQ = NULL;
+    ctx.yBits = NULL;
+    ctx.active = NULL;
+    ctx.numActive = NULL;
+    ctx.profile = NN->profile;
+    
+    return run_CDNN_ctx(&NN->model, &ctx, inputs, NULL);
+}
+
+
+    // the bytes that a context's batch tile buffers take in double precision (half that in single precision),
+    // either sharing memory as planned by planActivations() or with a buffer for each layer
+
+size_t CDNN_activation_bytes(const CDNN_model *NN, int ifPlanned)
+{
+    int l;
+    long numNeurons = 0;
+    
+    if (ifPlanned)  numNeurons = NN->yPlanSize;
+    else  for (l = 0; l < NN->numLayers; l++)  numNeurons += NN->layerSize[l];
+    
+    return (size_t) numNeurons*CDNN_BATCH_TILE*sizeof(double);
+}
+
+
+    // the layers share one pool, as planned by planActivations(); it is zero-filled so that the padding lanes
+    // the SIMD kernels run over only ever hold zeros or earlier activations
+
+double **allocTileLayers(const CDNN_model *NN)
+{
+    int l;
+    double **ty;
+    
+    ty = malloc(NN->numLayers*sizeof(double *));
+    if (ty == NULL)  return NULL;
+    ty[0] = calloc(NN->yPlanSize*CDNN_BATCH_TILE, sizeof(double));
+    if (ty[0] == NULL)  {
+        free(ty);
+        return NULL;     }
+    for (l = 1; l < NN->numLayers; l++)  ty[l] = ty[0] + NN->yPlan[l]*CDNN_BATCH_TILE;
+    
+    return ty;
+}
+    
+    
+    // activations are laid out neuron-major within a tile (ty[l][n*CDNN_BATCH_TILE + s]),
+    // so each weight is loaded once per tile and the inner sample loop runs over contiguous memory
+
+int run_CDNN_batch_ctx(const CDNN_model *NN, CDNN_context *ctx, const double *inputs, int numSamples, int indexOrder, double *outputs)
+{
+    int l, li, l0, n, i, j, s, s0, numTile, numInputs, numOutputs, sparseWeights = (NN->n0 != NULL);
+    long long t0 = 0, t1, numNonzero;
+    double *w, *yIn, *yOut, **ty;
+    
+    if (ctx->ty == NULL)  ctx->ty = allocTileLayers(NN);
+    if (ctx->ty == NULL)  return CD_OUT_OF_MEMORY_ERROR;
+    ty = ctx->ty;
+    
+    numInputs = NN->layerSize[1];
+    if (NN->variationalLayer > 0)  numInputs += NN->layerSize[NN->variationalLayer];
+    numOutputs = NN->layerSize[NN->numLayers-1];
+    
+    for (s0 = 0; s0 < numSamples; s0 += CDNN_BATCH_TILE)  {
+        numTile = numSamples-s0;
+        if (numTile > CDNN_BATCH_TILE)  numTile = CDNN_BATCH_TILE;
+        
+            // the bias layer's memory may have been reused by the last tile
+        for (s = 0; s < CDNN_BATCH_TILE; s++)  ty[0][s] = 1.;
+        for (i = 0; i < numInputs; i++)  {
+            if (i < NN->layerSize[1])  yOut = ty[1] + i*CDNN_BATCH_TILE;
+            else  yOut = ty[NN->variationalLayer] + (i-NN->layerSize[1])*CDNN_BATCH_TILE;
+            for (s = 0; s < numTile; s++)  {
+                if (indexOrder == FEATURE_SAMPLE_ARRAY)  yOut[s] = inputs[(long) i*numSamples + s0+s];
+                else  yOut[s] = inputs[(long) (s0+s)*numInputs + i];
+        }   }
+        
+        for (l = 2; l < NN->numLayers; l++)  {
+        if (l != NN->variationalLayer)  {
+            if (ctx->profile != NULL)  t0 = nanoseconds();
+            for (n = 0; n < NN->layerSize[l]*CDNN_BATCH_TILE; n++)  ty[l][n] = 0.;
+            for (li = 0; li < NN->numLayerInputs[l]; li++)  {
+                l0 = NN->layerInputs[l][li];
+                w = NN->weights[l][li];
+                if (sparseWeights)  {
+                    int *n0 = NN->n0[l][li], *rowStart = NN->rowStart[l][li];
+                    if (NN->denseWeights[l][li] != NULL)  kernels[NN->simdLevel].denseMM(
+                            NN->denseWeights[l][li], ty[l0], ty[l], NN->layerSize[l], NN->layerSize[l0], numTile);
+                    else  {
+                    for (i = 0; i < NN->layerSize[l]; i++)  {
+                        yOut = ty[l] + i*CDNN_BATCH_TILE;
+                        for (j = rowStart[i]; j < rowStart[i+1]; j++)  {
+                            yIn = ty[l0] + n0[j]*CDNN_BATCH_TILE;
+                            for (s = 0; s < numTile; s++)  yOut[s] += w[j] * yIn[s];
+                }   }}  }
+                else  kernels[NN->simdLevel].denseMM(w, ty[l0], ty[l], NN->layerSize[l], NN->layerSize[l0], numTile);
+            }
+            for (i = 0; i < NN->layerSize[l]; i++)  {
+                yOut = ty[l] + i*CDNN_BATCH_TILE;
+                applyAF(NN, NN->layerAFs[l], yOut, numTile);
+            }
+            if (ctx->profile != NULL)  {
+                t1 = nanoseconds();
+                numNonzero = 0;
+                for (i = 0; i < NN->layerSize[l]; i++)  numNonzero += countNonzero(ty[l] + i*CDNN_BATCH_TILE, numTile);
+                profileLayer(NN, ctx->profile, l, numTile, t1-t0, numNonzero);
+        }}  }
+        
+        for (i = 0; i < numOutputs; i++)  {
+            yOut = ty[NN->numLayers-1] + i*CDNN_BATCH_TILE;
+            for (s = 0; s < numTile; s++)  {
+                if (indexOrder == FEATURE_SAMPLE_ARRAY)  outputs[(long) i*numSamples + s0+s] = yOut[s];
+                else  outputs[(long) (s0+s)*numOutputs + i] = yOut[s];
+    }   }   }
+    
+    return 0;
+}
+
+
+int run_CDNN_batch(CDNN *NN, double *inputs, int numSamples, int indexOrder, double *outputs)
+{
+    int rtrn;
+    CDNN_context ctx;
+    
+    ctx.model = &NN->model;
+    ctx.y = NN->y;
+    ctx.ty = NULL;
+    ctx.yF32 = ctx.tyF32 = NULL;
+    ctx.yQ = NULL;
+    ctx.yBits = NULL;
+    ctx.active = NULL;
+    ctx.numActive = NULL;
+    ctx.profile = NN->profile;
+    
+    rtrn = run_CDNN_batch_ctx(&NN->model, &ctx, inputs, numSamples, indexOrder, outputs);
+    
+    if (ctx.ty != NULL)  free(ctx.ty[0]);
+    free(ctx.ty);
+    
+    return rtrn;
+}
+
+
+    // Intra-sample parallelism:  a CDNN_pool runs the layers of one sample on several threads, starting each layer once
+    // the layers it reads from are done, and splitting a wide layer into chunks of rows.  Each thread works from the bottom
+    // of its own deque of chunks, onto which it pushes the chunks of the layers it unblocks, and an idle thread steals from
+    // the top of the others'.  Between samples the threads spin for a while before they sleep.
+    // Chunks start on multiples of CDNN_CHUNK_ALIGN rows, so the kernels group rows and activation lanes as they do for
+    // a whole layer, and the outputs are identical to run_CDNN_ctx()'s.  A layer with fewer than 2*CDNN_CHUNK_MACS
+    // multiply-accumulates isn't split, and a network with too little work in all runs serially on the calling thread.
+
+#define CDNN_CHUNK_ALIGN 8
+#define CDNN_CHUNK_MACS 16384
+#define CDNN_CHUNKS_PER_THREAD 4
+#define CDNN_CHUNK_BITS 12
+#define CDNN_POOL_SPINS 20000
+
+#ifdef CDNN_THREADS
+typedef struct {
+    int *tasks, top, bottom;
+    pthread_mutex_t lock;
+} dequeType;
+
+typedef struct {
+    CDNN_pool *pool;
+    int index;
+} poolWorkerType;
+#endif
+
+struct CDNN_pool {
+    int numThreads;
+#ifdef CDNN_THREADS
+    pthread_t threads[CDNN_MAX_THREADS];
+    poolWorkerType workers[CDNN_MAX_THREADS];
+    dequeType deques[CDNN_MAX_THREADS];
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    int generation, ifJobOpen, ifStopping, numBusy;
+    const CDNN_model *NN;
+    double **y;
+    int layersLeft, *depsLeft, *chunksLeft, *numChunks, *chunkRows, *consumerStart, *consumers;
+    int *jobInts, *tasks;
+    long jobCapacity, taskCapacity;
+#endif
+};
+
+
+#ifdef CDNN_THREADS
+void cpuRelax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+int reserveInts(int **ints, long *capacity, long numInts)
+{
+    int *newInts;
+    
+    if (numInts <= *capacity)  return 0;
+    newInts = realloc(*ints, numInts*sizeof(int));
+    if (newInts == NULL)  return CD_OUT_OF_MEMORY_ERROR;
+    *ints = newInts;
+    *capacity = numInts;
+    
+    return 0;
+}
+
+    // works out the chunks and dependencies of each layer, and deals out the layers that can start right away;
+    // returns 0 if the network should just run serially
+
+int planPoolJob(CDNN_pool *pool, const CDNN_model *NN)
+{
+    int l, li, l0, c, t, numChunks, numRows, numLayers = NN->numLayers, numBlocks = 0, numTasks = 0, seedThread = 0;
+    long long numMACs, totalMACs = 0;
+    
+    if (pool->numThreads < 2)  return 0;
+    
+    for (l = 2; l < numLayers; l++)  numBlocks += NN->numLayerInputs[l];
+    if (reserveInts(&pool->jobInts, &pool->jobCapacity, 5*(numLayers+1L)+numBlocks) != 0)  return 0;
+    pool->depsLeft = pool->jobInts;
+    pool->chunksLeft = pool->depsLeft + numLayers;
+    pool->numChunks = pool->chunksLeft + numLayers;
+    pool->chunkRows = pool->numChunks + numLayers;
+    pool->consumerStart = pool->chunkRows + numLayers;
+    pool->consumers = pool->consumerStart + numLayers+1;
+    
+    for (l = 0; l <= numLayers; l++)  pool->consumerStart[l] = 0;
+    pool->layersLeft = 0;
+    for (l = 0; l < numLayers; l++)  {
+        pool->depsLeft[l] = pool->chunksLeft[l] = pool->numChunks[l] = 0;
+        if ((l < 2) || (l == NN->variationalLayer))  continue;
+        
+        numMACs = layerMACs(NN, l);
+        numRows = NN->layerSize[l];
+        totalMACs += numMACs;
+        numChunks = (int) (numMACs/CDNN_CHUNK_MACS);
+        if (numChunks > CDNN_CHUNKS_PER_THREAD*pool->numThreads)  numChunks = CDNN_CHUNKS_PER_THREAD*pool->numThreads;
+        if (numChunks > numRows/CDNN_CHUNK_ALIGN)  numChunks = numRows/CDNN_CHUNK_ALIGN;
+        if (numChunks < 1)  numChunks = 1;
+        pool->chunkRows[l] = (numRows+numChunks-1)/numChunks;
+        pool->chunkRows[l] = (pool->chunkRows[l]+CDNN_CHUNK_ALIGN-1)/CDNN_CHUNK_ALIGN*CDNN_CHUNK_ALIGN;
+        if (pool->chunkRows[l] == 0)  pool->chunkRows[l] = CDNN_CHUNK_ALIGN;
+        pool->numChunks[l] = (numRows+pool->chunkRows[l]-1)/pool->chunkRows[l];
+        if (pool->numChunks[l] == 0)  pool->numChunks[l] = 1;
+        pool->chunksLeft[l] = pool->numChunks[l];
+        numTasks += pool->numChunks[l];
+        pool->layersLeft++;
+        
+        for (li = 0; li < NN->numLayerInputs[l]; li++)  {
+            l0 = NN->layerInputs[l][li];
+            if ((l0 >= 2) && (l0 != NN->variationalLayer))  {
+                pool->depsLeft[l]++;
+                pool->consumerStart[l0+1]++;
+    }   }   }
+    
+    if (totalMACs < 2*CDNN_CHUNK_MACS)  return 0;
+    
+        // consumers[consumerStart[l0]..consumerStart[l0+1]-1] are the layers that wait on layer l0
+    for (l = 0; l < numLayers; l++)  pool->consumerStart[l+1] += pool->consumerStart[l];
+    for (l = numLayers-1; l >= 2; l--)  {
+    for (li = 0; li < NN->numLayerInputs[l]; li++)  {
+        l0 = NN->layerInputs[l][li];
+        if ((l != NN->variationalLayer) && (l0 >= 2) && (l0 != NN->variationalLayer))  pool->consumers[pool->consumerStart[l0]++] = l;
+    }}
+    for (l = numLayers; l > 0; l--)  pool->consumerStart[l] = pool->consumerStart[l-1];
+    pool->consumerStart[0] = 0;
+    
+    if (reserveInts(&pool->tasks, &pool->taskCapacity, (long) numTasks*pool->numThreads) != 0)  return 0;
+    for (t = 0; t < pool->numThreads; t++)  {
+        pool->deques[t].tasks = pool->tasks + (long) numTasks*t;
+        pool->deques[t].top = pool->deques[t].bottom = 0;
+    }
+    
+    for (l = 2; l < numLayers; l++)  {
+    if ((l != NN->variationalLayer) && (pool->depsLeft[l] == 0))  {
+        for (c = 0; c < pool->numChunks[l]; c++)  {
+            t = seedThread++ % pool->numThreads;
+            pool->deques[t].tasks[pool->deques[t].bottom++] = (l << CDNN_CHUNK_BITS) | c;
+    }}  }
+    
+    pool->NN = NN;
+    
+    return 1;
+}
+
+void pushLayer(CDNN_pool *pool, int worker, int l)
+{
+    int c;
+    dequeType *deque = &pool->deques[worker];
+    
+    pthread_mutex_lock(&deque->lock);
+    for (c = 0; c < pool->numChunks[l]; c++)  deque->tasks[deque->bottom++] = (l << CDNN_CHUNK_BITS) | c;
+    pthread_mutex_unlock(&deque->lock);
+}
+
+int takeTask(dequeType *deque, int ifSteal)
+{
+    int task = -1;
+    
+    pthread_mutex_lock(&deque->lock);
+    if (deque->bottom > deque->top)  {
+        if (ifSteal)  task = deque->tasks[deque->top++];
+        else  task = deque->tasks[--deque->bottom];
+    }
+    pthread_mutex_unlock(&deque->lock);
+    
+    return task;
+}
+
+    // runs one chunk; whoever finishes the last chunk of a layer releases the layers waiting on it
+
+void runTask(CDNN_pool *pool, int worker, int task)
+{
+    int c, l = task >> CDNN_CHUNK_BITS, row0, row1;
+    const CDNN_model *NN = pool->NN;
+    
+    row0 = (task & ((1 << CDNN_CHUNK_BITS)-1))*pool->chunkRows[l];
+    row1 = row0+pool->chunkRows[l];
+    if (row1 > NN->layerSize[l])  row1 = NN->layerSize[l];
+    runLayerRows(NN, pool->y, l, row0, row1);
+    
+    if (__atomic_sub_fetch(&pool->chunksLeft[l], 1, __ATOMIC_ACQ_REL) > 0)  return;
+    for (c = pool->consumerStart[l]; c < pool->consumerStart[l+1]; c++)  {
+        if (__atomic_sub_fetch(&pool->depsLeft[pool->consumers[c]], 1, __ATOMIC_ACQ_REL) == 0)  pushLayer(pool, worker, pool->consumers[c]);
+    }
+    __atomic_sub_fetch(&pool->layersLeft, 1, __ATOMIC_ACQ_REL);
+}
+
+void runPoolTasks(CDNN_pool *pool, int worker)
+{
+    int t, task;
+    
+    while (__atomic_load_n(&pool->layersLeft, __ATOMIC_ACQUIRE) > 0)  {
+        task = takeTask(&pool->deques[worker], 0);
+        for (t = 1; (task < 0) && (t < pool->numThreads); t++)  task = takeTask(&pool->deques[(worker+t) % pool->numThreads], 1);
+        if (task >= 0)  runTask(pool, worker, task);
+        else  cpuRelax();
+    }
+}
+
+    // A thread joins a sample only while the caller holds it open, so once the caller has closed the sample
+    // and seen numBusy fall to 0, it can set up the next one without any thread still looking at this one.
+
+void *poolThread(void *ptr)
+{
+    poolWorkerType *worker = (poolWorkerType *) ptr;
+    CDNN_pool *pool = worker->pool;
+    int spin, generation = 0, ifJoined, ifStopping;
+    
+    for (;;)  {
+        for (spin = 0; (spin < CDNN_POOL_SPINS) && (__atomic_load_n(&pool->generation, __ATOMIC_ACQUIRE) == generation); spin++)  cpuRelax();
+        pthread_mutex_lock(&pool->lock);
+        while (pool->generation == generation)  pthread_cond_wait(&pool->wake, &pool->lock);
+        generation = pool->generation;
+        ifJoined = pool->ifJobOpen;
+        if (ifJoined)  __atomic_add_fetch(&pool->numBusy, 1, __ATOMIC_RELAXED);
+        ifStopping = pool->ifStopping;
+        pthread_mutex_unlock(&pool->lock);
+        
+        if (ifStopping)  return NULL;
+        if (ifJoined)  {
+            runPoolTasks(pool, worker->index);
+            __atomic_sub_fetch(&pool->numBusy, 1, __ATOMIC_RELEASE);
+    }   }
+}
+
+void runPoolJob(CDNN_pool *pool, double **y)
+{
+    pool->y = y;
+    pthread_mutex_lock(&pool->lock);
+    pool->ifJobOpen = 1;
+    __atomic_store_n(&pool->generation, pool->generation+1, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+    
+    runPoolTasks(pool, 0);
+    
+    pthread_mutex_lock(&pool->lock);
+    pool->ifJobOpen = 0;
+    pthread_mutex_unlock(&pool->lock);
+    while (__atomic_load_n(&pool->numBusy, __ATOMIC_ACQUIRE) > 0)  cpuRelax();
+}
+#endif
+
+
+    // numThreads counts the calling thread; 0 means one per CPU
+
+CDNN_pool *CDNN_pool_init(int numThreads)
+{
+    CDNN_pool *pool;
+#ifdef CDNN_THREADS
+    int t;
+#endif
+    
+    pool = malloc(sizeof(CDNN_pool));
+    if (pool == NULL)  return NULL;
+    pool->numThreads = 1;
+    
+#ifdef CDNN_THREADS
+    if (numThreads <= 0)  numThreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (numThreads > CDNN_MAX_THREADS)  numThreads = CDNN_MAX_THREADS;
+    pool->generation = pool->ifJobOpen = pool->ifStopping = pool->numBusy = 0;
+    pool->layersLeft = 0;
+    pool->jobInts = pool->tasks = NULL;
+    pool->jobCapacity = pool->taskCapacity = 0;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    for (t = 0; t < CDNN_MAX_THREADS; t++)  pthread_mutex_init(&pool->deques[t].lock, NULL);
+    
+    for (t = 1; t < numThreads; t++)  {
+        pool->workers[t].pool = pool;
+        pool->workers[t].index = t;
+        if (pthread_create(&pool->threads[t], NULL, poolThread, &pool->workers[t]) != 0)  break;
+        pool->numThreads++;
+    }
+#endif
+    
+    return pool;
+}
+
+int CDNN_pool_threads(CDNN_pool *pool)  {  return pool->numThreads;  }
+
+double *run_CDNN_pool_ctx(const CDNN_model *NN, CDNN_context *ctx, CDNN_pool *pool, const double *inputs, double *outputs)
+{
+    int ifParallel = 0;
+    double **y = ctx->y;
+    
+    setInputs(NN, y, inputs);
+#ifdef CDNN_THREADS
+    if ((pool != NULL) && (ctx->profile == NULL))  ifParallel = planPoolJob(pool, NN);
+    if (ifParallel)  runPoolJob(pool, y);
+#endif
+    if (!ifParallel)  runLayers(NN, y, ctx->profile);
+    
+    if (outputs == NULL)  return y[NN->numLayers-1];
+    memcpy(outputs, y[NN->numLayers-1], NN->layerSize[NN->numLayers-1]*sizeof(double));
+    return outputs;
+}
+
+double *run_CDNN_pool(CDNN *NN, CDNN_pool *pool, double *inputs)
+{
+    CDNN_context ctx;
+    
+    ctx.model = &NN->model;
+    ctx.y = NN->y;
+    ctx.ty = NULL;
+    ctx.yF32 = ctx.tyF32 = NULL;
+    ctx.yQ = NULL;
+    ctx.yBits = NULL;
+    ctx.active = NULL;
+    ctx.numActive = NULL;
+    ctx.profile = NN->profile;
+    
+    return run_CDNN_pool_ctx(&NN->model, &ctx, pool, inputs, NULL);
+}
+
+void CDNN_pool_free(CDNN_pool *pool)
+{
+#ifdef CDNN_THREADS
+    int t;
+#endif
+    
+    if (pool == NULL)  return;
+    
+#ifdef CDNN_THREADS
+    pthread_mutex_lock(&pool->lock);
+    pool->ifStopping = 1;
+    __atomic_store_n(&pool->generation, pool->generation+1, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+    for (t = 1; t < pool->numThreads; t++)  pthread_join(pool->threads[t], NULL);
+    
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->wake);
+    for (t = 0; t < CDNN_MAX_THREADS; t++)  pthread_mutex_destroy(&pool->deques[t].lock);
+    free(pool->jobInts);
+    free(pool->tasks);
+#endif
+    
+    free(pool);
+}
+
+
+    // Single precision:  CDNN_make_f32() converts a network's weights to float, in an arena of their own
+    // alongside the double-precision model, and the _f32() functions run the converted network.
+    // The float weights and activations take half the memory bandwidth, and the kernels work on twice
+    // as many lanes at a time.  The sparse blocks keep using the model's n0[] and rowStart[].
+    // CDNN_f32_deviation() reports how far the outputs are from run_CDNN_batch() over a set of samples.
+
+void layoutF32(CDNN *NN, arenaType *arena)
+{
+    int l, li, l0, numWeights, ifPlace = (arena->base != NULL), sparseWeights = (NN->model.n0 != NULL);
+    float ***weightsTable, ***denseTable = NULL, **yTable;
+    
+    weightsTable = arenaAlloc(arena, NN->model.numLayers*sizeof(float **));
+    if (sparseWeights)  denseTable = arenaAlloc(arena, NN->model.numLayers*sizeof(float **));
+    yTable = arenaAlloc(arena, NN->model.numLayers*sizeof(float *));
+    if (ifPlace)  {
+        NN->model.weightsF32 = weightsTable;
+        NN->model.denseWeightsF32 = denseTable;
+        NN->yF32 = yTable;
+    }
+    
+    for (l = 0; l < NN->model.numLayers; l++)  {
+        float **weightPtrs = arenaAlloc(arena, NN->model.numLayerInputs[l]*sizeof(float *)), **densePtrs = NULL;
+        
+        if (sparseWeights)  densePtrs = arenaAlloc(arena, NN->model.numLayerInputs[l]*sizeof(float *));
+        if (ifPlace)  {
+            weightsTable[l] = weightPtrs;
+            if (sparseWeights)  denseTable[l] = densePtrs;
+        }
+        
+        for (li = 0; li < NN->model.numLayerInputs[l]; li++)  {
+            float *weights, *dense = NULL;
+            
+            l0 = NN->model.layerInputs[l][li];
+            if (sparseWeights)  numWeights = NN->model.wSize[l][li];
+            else  numWeights = NN->model.layerSize[l]*NN->model.layerSize[l0];
+            
+            weights = arenaAlloc(arena, numWeights*sizeof(float));
+            if (sparseWeights && (NN->model.denseWeights[l][li] != NULL))  {
+                dense = arenaAlloc(arena, (size_t) NN->model.layerSize[l]*NN->model.layerSize[l0]*sizeof(float));
+            }
+            if (ifPlace)  {
+                weightPtrs[li] = weights;
+                if (sparseWeights)  densePtrs[li] = dense;
+    }   }   }
+    
+    for (l = 0; l < NN->model.numLayers; l++)  {
+        float *y = arenaAlloc(arena, NN->model.layerSize[l]*sizeof(float));
+        if (ifPlace)  NN->yF32[l] = y;
+}   }
+
+
+int CDNN_make_f32(CDNN *NN)
+{
+    int l, li, l0, numWeights, sparseWeights = (NN->model.n0 != NULL);
+    long j;
+    arenaType arena;
+    
+    alignedFree(NN->model.f32Arena);
+    NN->model.f32Arena = NULL;
+    NN->model.weightsF32 = NN->model.denseWeightsF32 = NULL;
+    NN->yF32 = NULL;
+    
+    arena.base = NULL;
+    arena.numBytes = 0;
+    layoutF32(NN, &arena);
+    if ((arena.base = alignedAlloc(arena.numBytes)) == NULL)  return CD_OUT_OF_MEMORY_ERROR;
+    NN->model.f32Arena = arena.base;
+    arena.numBytes = 0;
+    layoutF32(NN, &arena);
+    
+    for (l = 0; l < NN->model.numLayers; l++)  {
+    for (li = 0; li < NN->model.numLayerInputs[l]; li++)  {
+        l0 = NN->model.layerInputs[l][li];
+        if (sparseWeights)  numWeights = NN->model.wSize[l][li];
+        else  numWeights = NN->model.layerSize[l]*NN->model.layerSize[l0];
+        
+        for (j = 0; j < numWeights; j++)  NN->model.weightsF32[l][li][j] = (float) NN->model.weights[l][li][j];
+        if (sparseWeights && (NN->model.denseWeights[l][li] != NULL))  {
+            for (j = 0; j < (long) NN->model.layerSize[l]*NN->model.layerSize[l0]; j++)  {
+                NN->model.denseWeightsF32[l][li][j] = (float) NN->model.denseWeights[l][li][j];
+    }   }}  }
+    
+    return 0;
+}
+
+
+void runLayersF32(const CDNN_model *NN, float **y, CDNN_layer_profile *profile)
+{
+    int l, li, l0, n, sparseWeights = (NN->n0 != NULL);
+    long long t0 = 0;
+    float *w;
+    
+    for (l = 2; l < NN->numLayers; l++)  {
+    if (l != NN->variationalLayer)  {
+        if (profile != NULL)  t0 = nanoseconds();
+        for (n = 0; n < NN->layerSize[l]; n++)  y[l][n] = 0.f;
+        for (li = 0; li < NN->numLayerInputs[l]; li++)  {
+            l0 = NN->layerInputs[l][li];
+            w = NN->weightsF32[l][li];
+            if (sparseWeights)  {
+                if (NN->denseWeightsF32[l][li] != NULL)  kernels[NN->simdLevel].denseMVf(
+                        NN->denseWeightsF32[l][li], y[l0], y[l], NN->layerSize[l], NN->layerSize[l0]);
+                else  kernels[NN->simdLevel].sparseMVf(w, NN->n0[l][li], NN->rowStart[l][li], y[l0], y[l], NN->layerSize[l]);
+            }
+            else  kernels[NN->simdLevel].denseMVf(w, y[l0], y[l], NN->layerSize[l], NN->layerSize[l0]);
+        }
+        applyAFf(NN->layerAFs[l], y[l], NN->layerSize[l]);
+        if (profile != NULL)  profileLayer(NN, profile, l, 1, nanoseconds()-t0, countNonzeroF32(y[l], NN->layerSize[l]));
+    }}
+}
+
+
+    // allocates layers of numPerNeuron floats per neuron, in one block; if ifPlanned the layers share memory
+    // as planned by planActivations(), otherwise each layer has its own
+
+float **allocF32Layers(const CDNN_model *NN, int numPerNeuron, int ifPlanned)
+{
+    int l;
+    long yOffset;
+    float **y;
+    
+    y = malloc(NN->numLayers*sizeof(float *));
+    if (y == NULL)  return NULL;
+    
+    yOffset = 0;
+    if (ifPlanned)  yOffset = NN->yPlanSize*numPerNeuron;
+    else  for (l = 0; l < NN->numLayers; l++)  yOffset += NN->layerSize[l]*numPerNeuron;
+    y[0] = calloc(yOffset, sizeof(float));
+    if (y[0] == NULL)  {
+        free(y);
+        return NULL;     }
+    
+    for (l = 1; l < NN->numLayers; l++)  {
+        if (ifPlanned)  y[l] = y[0] + NN->yPlan[l]*numPerNeuron;
+        else  y[l] = y[l-1] + NN->layerSize[l-1]*numPerNeuron;
+    }
+    
+    return y;
+}
+
+
+    // returns NULL if the network hasn't been converted, or if out of memory
+
+float *run_CDNN_f32_ctx(const CDNN_model *NN, CDNN_context *ctx, const float *inputs, float *outputs)
+{
+    float **y;
+    
+    if (NN->weightsF32 == NULL)  return NULL;
+    if (ctx->yF32 == NULL)  ctx->yF32 = allocF32Layers(NN, 1, 0);
+    if (ctx->yF32 == NULL)  return NULL;
+    y = ctx->yF32;
+    
+    y[0][0] = 1.f;
+    memcpy(y[1], inputs, NN->layerSize[1]*sizeof(float));
+    if (NN->variationalLayer > 0)  memcpy(y[NN->variationalLayer],
+            inputs+NN->layerSize[1], NN->layerSize[NN->variationalLayer]*sizeof(float));
+    
+    runLayersF32(NN, y, ctx->profile);
+    
+    if (outputs == NULL)  return y[NN->numLayers-1];
+    memcpy(outputs, y[NN->numLayers-1], NN->layerSize[NN->numLayers-1]*sizeof(float));
+    return outputs;
+}
+
+
+float *run_CDNN_f32(CDNN *NN, const float *inputs)
+{
+    CDNN_context ctx;
+    
+    ctx.model = &NN->model;
+    ctx.y = ctx.ty = NULL;
+    ctx.yF32 = NN->yF32;
+    ctx.tyF32 = NULL;
+    ctx.yQ = NULL;
+    ctx.yBits = NULL;
+    ctx.active = NULL;
+    ctx.numActive = NULL;
+    ctx.profile = NN->profile;
+    
+    if (NN->yF32 == NULL)  return NULL;
+    return run_CDNN_f32_ctx(&NN->model, &ctx, inputs, NULL);
+}
+
+
+int run_CDNN_batch_f32_ctx(const CDNN_model *NN, CDNN_context *ctx, const float *inputs, int numSamples, int indexOrder, float *outputs)
+{
+    int l, li, l0, n, i, j, s, s0, numTile, numInputs, numOutputs, sparseWeights = (NN->n0 != NULL);
+    long long t0 = 0, t1, numNonzero;
+    float *w, *yIn, *yOut, **ty;
+    
+    if (NN->weightsF32 == NULL)  return CD_PARAMS_ERR;
+    if (ctx->tyF32 == NULL)  ctx->tyF32 = allocF32Layers(NN, CDNN_BATCH_TILE, 1);
+    if (ctx->tyF32 == NULL)  return CD_OUT_OF_MEMORY_ERROR;
+    ty = ctx->tyF32;
+    
+    numInputs = NN->layerSize[1];
+    if (NN->variationalLayer > 0)  numInputs += NN->layerSize[NN->variationalLayer];
+    numOutputs = NN->layerSize[NN->numLayers-1];
+    
+    for (s0 = 0; s0 < numSamples; s0 += CDNN_BATCH_TILE)  {
+        numTile = numSamples-s0;
+        if (numTile > CDNN_BATCH_TILE)  numTile = CDNN_BATCH_TILE;
+        
+        for (s = 0; s < CDNN_BATCH_TILE; s++)  ty[0][s] = 1.f;
+        for (i = 0; i < numInputs; i++)  {
+            if (i < NN->layerSize[1])  yOut = ty[1] + i*CDNN_BATCH_TILE;
+            else  yOut = ty[NN->variationalLayer] + (i-NN->layerSize[1])*CDNN_BATCH_TILE;
+            for (s = 0; s < numTile; s++)  {
+                if (indexOrder == FEATURE_SAMPLE_ARRAY)  yOut[s] = inputs[(long) i*numSamples + s0+s];
+                else  yOut[s] = inputs[(long) (s0+s)*numInputs + i];
+        }   }
+        
+        for (l = 2; l < NN->numLayers; l++)  {
+        if (l != NN->variationalLayer)  {
+            if (ctx->profile != NULL)  t0 = nanoseconds();
+            for (n = 0; n < NN->layerSize[l]*CDNN_BATCH_TILE; n++)  ty[l][n] = 0.f;
+            for (li = 0; li < NN->numLayerInputs[l]; li++)  {
+                l0 = NN->layerInputs[l][li];
+                w = NN->weightsF32[l][li];
+                if (sparseWeights)  {
+                    int *n0 = NN->n0[l][li], *rowStart = NN->rowStart[l][li];
+                    if (NN->denseWeightsF32[l][li] != NULL)  kernels[NN->simdLevel].denseMMf(
+                            NN->denseWeightsF32[l][li], ty[l0], ty[l], NN->layerSize[l], NN->layerSize[l0], numTile);
+                    else  {
+                    for (i = 0; i < NN->layerSize[l]; i++)  {
+                        yOut = ty[l] + i*CDNN_BATCH_TILE;
+                        for (j = rowStart[i]; j < rowStart[i+1]; j++)  {
+                            yIn = ty[l0] + n0[j]*CDNN_BATCH_TILE;
+                            for (s = 0; s < numTile; s++)  yOut[s] += w[j] * yIn[s];
+                }   }}  }
+                else  kernels[NN->simdLevel].denseMMf(w, ty[l0], ty[l], NN->layerSize[l], NN->layerSize[l0], numTile);
+            }
+            for (i = 0; i < NN->layerSize[l]; i++)  {
+                yOut = ty[l] + i*CDNN_BATCH_TILE;
+                applyAFf(NN->layerAFs[l], yOut, numTile);
+            }
+            if (ctx->profile != NULL)  {
+                t1 = nanoseconds();
+                numNonzero = 0;
+                for (i = 0; i < NN->layerSize[l]; i++)  numNonzero += countNonzeroF32(ty[l] + i*CDNN_BATCH_TILE, numTile);
+                profileLayer(NN, ctx->profile, l, numTile, t1-t0, numNonzero);
+        }}  }
+        
+        for (i = 0; i < numOutputs; i++)  {
+            yOut = ty[NN->numLayers-1] + i*CDNN_BATCH_TILE;
+            for (s = 0; s < numTile; s++)  {
+                if (indexOrder == FEATURE_SAMPLE_ARRAY)  outputs[(long) i*numSamples + s0+s] = yOut[s];
+                else  outputs[(long) (s0+s)*numOutputs + i] = yOut[s];
+    }   }   }
+    
+    return 0;
+}
+
+
+int run_CDNN_batch_f32(CDNN *NN, const float *inputs, int numSamples, int indexOrder, float *outputs)
+{
+    int rtrn;
+    CDNN_context ctx;
+    
+    ctx.model = &NN->model;
+    ctx.y = ctx.ty = NULL;
+    ctx.yF32 = NN->yF32;
+    ctx.tyF32 = NULL;
+    ctx.yQ = NULL;
+    ctx.yBits = NULL;
+    ctx.active = NULL;
+    ctx.numActive = NULL;
+    ctx.profile = NN->profile;
+    
+    rtrn = run_CDNN_batch_f32_ctx(&NN->model, &ctx, inputs, numSamples, indexOrder, outputs);
+    
+    if (ctx.tyF32 != NULL)  free(ctx.tyF32[0]);
+    free(ctx.tyF32);
+    
+    return rtrn;
+}
+
+
+    // *maxDeviation is the largest absolute difference of any output, with the inputs in run_CDNN_batch() order
+
+int CDNN_f32_deviation(CDNN *NN, const double *inputs, int numSamples, int indexOrder, double *maxDeviation)
+{
+    int rtrn, numInputs, numOutputs;
+    long i;
+    float *inputsF32, *outputsF32;
+    double *outputs;
+
+    *maxDeviation = 0.;
+    if (NN->model.weightsF32 == NULL)  return CD_PARAMS_ERR;
+    
+    numInputs = NN->model.layerSize[1];
+    if (NN->model.variationalLayer > 0)  numInputs += NN->model.layerSize[NN->model.variationalLayer];
+    numOutputs = NN->model.layerSize[NN->model.numLayers-1];
+    
+    inputsF32 = malloc((long) numInputs*numSamples*sizeof(float) + 1);
+    outputsF32 = malloc((long) numOutputs*numSamples*sizeof(float) + 1);
+    outputs = malloc((long) numOutputs*numSamples*sizeof(double) + 1);
+    if ((inputsF32 == NULL) || (outputsF32 == NULL) || (outputs == NULL))  {
+        free(inputsF32);  free(outputsF32);  free(outputs);
+        return CD_OUT_OF_MEMORY_ERROR;     }
+    
+    for (i = 0; i < (long) numInputs*numSamples; i++)  inputsF32[i] = (float) inputs[i];
+    
+    rtrn = run_CDNN_batch(NN, (double *) inputs, numSamples, indexOrder, outputs);
+    if (rtrn == 0)  rtrn = run_CDNN_batch_f32(NN, inputsF32, numSamples, indexOrder, outputsF32);
+    if (rtrn == 0)  {
+    for (i = 0; i < (long) numOutputs*numSamples; i++)  {
+        if (fabs(outputs[i] - outputsF32[i]) > *maxDeviation)  *maxDeviation = fabs(outputs[i] - outputsF32[i]);
+    }}
+    
+    free(inputsF32);
+    free(outputsF32);
+    free(outputs);
+    
+    return rtrn;
+}
+
+
+    // Integer inference:  CDNN_make_quantized() converts the weights to int8 or int16, and the _quantized()
+    // functions carry the activations from layer to layer as fixed-point numbers, so the dot products
+    // run on integer SIMD instructions over a quarter or an eighth of the memory that double weights take.
+    // Each row of a weight block has its own scale, and each layer's activations have theirs.  With int8 weights,
+    // a layer whose activations fit in [-127, 127] keeps them in int8 too; otherwise they are int16.
+    // Sparse blocks with at least 1/CDNN_Q_DENSE_RATIO of their weights nonzero are run from a dense int copy.
+    // The quantizationType fields are read as the server's training arguments:  with QUANTIZE and a range > 0,
+    // the values are (q - zeroInt)*range/(2^bits - 1) for q = 0..2^bits-1, and weights that already lie on
+    // that grid are stored exactly.  Otherwise the weights are scaled by the largest one in each row,
+    // and activations by the largest value each layer takes over a set of calibration samples, in bits bits
+    // if QUANTIZE is set (8 for weights left to the default, 16 for activations).  The inputs are scaled by the
+    // calibration samples if there are any.
+
+#define CDNN_Q_INT16_MAX 32767
+#define CDNN_Q_INT8_MAX 127
+#define CDNN_Q_DENSE_RATIO 32
+
+short quantizeQ(double y, double scale, int minQ, int maxQ)
+{
+    double k = floor(y/scale + 0.5);
+    
+    if (k > maxQ)  return maxQ;
+    else if (k >= minQ)  return (short) k;
+    else  return minQ;
+}
+
+int ifOnGrid(const double *w, long numWeights, double step, int maxQ)
+{
+    long j;
+    double k;
+    
+    for (j = 0; j < numWeights; j++)  {
+        k = w[j]/step;
+        if ((fabs(k) > maxQ) || (fabs(k - floor(k + 0.5)) > 1e-6*(1. + fabs(k))))  return 0;
+    }
+    
+    return 1;
+}
+
+    // a tile of activations in yQ[l] has CDNN_BATCH_TILE rows, one per sample, of strideQ(layerSize[l]) elements each,
+    // and a row of a dense block has strideQ(numIn) weights; the padding is left at zero, so the kernels never reach
+    // their tail loops
+
+int strideQ(int n)
+{
+    return (n + 63) & ~63;
+}
+
+    // a sparse block gets a dense int copy if it has a double one, or if it's dense enough that the SIMD kernels
+    // beat looking up its inputs one at a time
+
+int ifDenseQ(const CDNN *NN, int l, int li)
+{
+    int l0 = NN->model.layerInputs[l][li];
+    
+    if (NN->model.denseWeights[l][li] != NULL)  return 1;
+    return ((long) NN->model.wSize[l][li]*CDNN_Q_DENSE_RATIO >= (long) NN->model.layerSize[l]*NN->model.layerSize[l0]);
+}
+
+void layoutQuantized(CDNN *NN, arenaType *arena, int elementBytes)
+{
+    int l, li, l0, numWeights, ifPlace = (arena->base != NULL), sparseWeights = (NN->model.n0 != NULL);
+    int *yMin, *yMax;
+    double *yScale, ***scaleTable;
+    void ***weightsTable, ***denseTable = NULL;
+    short **yTable;
+    
+    yScale = arenaAlloc(arena, NN->model.numLayers*sizeof(double));
+    yMin = arenaAlloc(arena, NN->model.numLayers*sizeof(int));
+    yMax = arenaAlloc(arena, NN->model.numLayers*sizeof(int));
+    weightsTable = arenaAlloc(arena, NN->model.numLayers*sizeof(void **));
+    scaleTable = arenaAlloc(arena, NN->model.numLayers*sizeof(double **));
+    if (sparseWeights)  denseTable = arenaAlloc(arena, NN->model.numLayers*sizeof(void **));
+    yTable = arenaAlloc(arena, NN->model.numLayers*sizeof(short *));
+    if (ifPlace)  {
+        NN->model.yScaleQ = yScale;
+        NN->model.yMinQ = yMin;
+        NN->model.yMaxQ = yMax;
+        NN->model.weightsQ = weightsTable;
+        NN->model.rowScaleQ = scaleTable;
+        NN->model.denseWeightsQ = denseTable;
+        NN->yQ = yTable;
+    }
+    
+    for (l = 0; l < NN->model.numLayers; l++)  {
+        void **weightPtrs = arenaAlloc(arena, NN->model.numLayerInputs[l]*sizeof(void *)), **densePtrs = NULL;
+        double **scalePtrs = arenaAlloc(arena, NN->model.numLayerInputs[l]*sizeof(double *));
+        
+        if (sparseWeights)  densePtrs = arenaAlloc(arena, NN->model.numLayerInputs[l]*sizeof(void *));
+        if (ifPlace)  {
+            weightsTable[l] = weightPtrs;
+            scaleTable[l] = scalePtrs;
+            if (sparseWeights)  denseTable[l] = densePtrs;
+        }
+        
+        for (li = 0; li < NN->model.numLayerInputs[l]; li++)  {
+            void *weights, *dense = NULL;
+            double *rowScale;
+            
+            l0 = NN->model.layerInputs[l][li];
+            if (sparseWeights)  numWeights = NN->model.wSize[l][li];
+            else  numWeights = NN->model.layerSize[l]*strideQ(NN->model.layerSize[l0]);
+            
+            weights = arenaAlloc(arena, (size_t) numWeights*elementBytes);
+            rowScale = arenaAlloc(arena, NN->model.layerSize[l]*sizeof(double));
+            if (sparseWeights && ifDenseQ(NN, l, li))  {
+                dense = arenaAlloc(arena, (size_t) NN->model.layerSize[l]*strideQ(NN->model.layerSize[l0])*elementBytes);
+            }
+            if (ifPlace)  {
+                weightPtrs[li] = weights;
+                scalePtrs[li] = rowScale;
+                if (sparseWeights)  densePtrs[li] = dense;
+    }   }   }
+    
+    for (l = 0; l < NN->model.numLayers; l++)  {
+        short *y = arenaAlloc(arena, (size_t) strideQ(NN->model.layerSize[l])*CDNN_BATCH_TILE*sizeof(short));
+        if (ifPlace)  NN->yQ[l] = y;
+}   }
+
+
+    // row i of a sparse block's dense copy:  either from its double dense copy, or added up into rowBuf[]
+
+const double *denseRow(const double *w, const int *rowStart, const int *n0, const double *dense, int i, int numIn, double *rowBuf)
+{
+    int j;
+    
+    if (dense != NULL)  return dense + (long) i*numIn;
+    
+    for (j = 0; j < numIn; j++)  rowBuf[j] = 0.;
+    for (j = rowStart[i]; j < rowStart[i+1]; j++)  rowBuf[n0[j]] += w[j];
+    
+    return rowBuf;
+}
+
+
+    // element k of an int8 or int16 array
+
+void setQ(void *q, long k, int elementBytes, short value)
+{
+    if (elementBytes == 1)  ((signed char *) q)[k] = value;
+    else  ((short *) q)[k] = value;
+}
+
+    // quantizes one weight block:  w[] and dense[] (if it isn't NULL) are row-major with numIn weights per row,
+    // unless rowStart != NULL; a sparse block's dense int copy is filled in if it has one
+
+void quantizeBlock(CDNN_model *model, int l, int li, const double *w, const int *rowStart, const int *n0, const double *dense,
+        int numOut, int numIn, quantizationType weightQuantization, double *rowBuf)
+{
+    int i, elementBytes = (model->quantBits <= 8) ? 1 : 2, maxQ = (1 << (model->quantBits-1)) - 1;
+    int ifDense = (rowStart != NULL) && (model->denseWeightsQ[l][li] != NULL), gridMax, stride = strideQ(numIn);
+    long j, numWeights, start, end;
+    double rowMax, step, *rowScale = model->rowScaleQ[l][li];
+    const double *row;
+    
+    numWeights = (rowStart != NULL) ? rowStart[numOut] : (long) numOut*numIn;
+    gridMax = (elementBytes == 1) ? CDNN_Q_INT8_MAX : CDNN_Q_INT16_MAX;
+    
+    step = 0.;
+    if (weightQuantization.ifQuantize && (weightQuantization.range > 0.))  {
+        step = weightQuantization.range/((1 << weightQuantization.bits) - 1);
+        if (!ifOnGrid(w, numWeights, step, gridMax))  step = 0.;
+        if (ifDense)  {
+        for (i = 0; (i < numOut) && (step > 0.); i++)  {
+            if (!ifOnGrid(denseRow(w, rowStart, n0, dense, i, numIn, rowBuf), numIn, step, gridMax))  step = 0.;
+    }}  }
+    if (step > 0.)  maxQ = gridMax;
+    
+    for (i = 0; i < numOut; i++)  {
+        start = (rowStart != NULL) ? rowStart[i] : (long) i*numIn;
+        end = (rowStart != NULL) ? rowStart[i+1] : (long) (i+1)*numIn;
+        row = ifDense ? denseRow(w, rowStart, n0, dense, i, numIn, rowBuf) : NULL;
+        
+        if (step > 0.)  rowScale[i] = step;
+        else  {
+            rowMax = 0.;
+            for (j = start; j < end; j++)  if (fabs(w[j]) > rowMax)  rowMax = fabs(w[j]);
+            if (ifDense)  {
+            for (j = 0; j < numIn; j++)  {
+                if (fabs(row[j]) > rowMax)  rowMax = fabs(row[j]);
+            }}
+            if (rowMax > 0.)  rowScale[i] = rowMax/maxQ;
+            else  rowScale[i] = 1.;
+        }
+        
+        if (rowStart != NULL)  {
+            for (j = start; j < end; j++)  setQ(model->weightsQ[l][li], j, elementBytes, quantizeQ(w[j], rowScale[i], -maxQ, maxQ));     }
+        else  {
+            for (j = 0; j < stride; j++)  {
+                setQ(model->weightsQ[l][li], (long) i*stride + j, elementBytes, (j < numIn) ? quantizeQ(w[start+j], rowScale[i], -maxQ, maxQ) : 0);
+        }   }
+        if (ifDense)  {
+        for (j = 0; j < stride; j++)  {
+            setQ(model->denseWeightsQ[l][li], (long) i*stride + j, elementBytes, (j < numIn) ? quantizeQ(row[j], rowScale[i], -maxQ, maxQ) : 0);
+    }   }}
+}
+
+
+    // the largest absolute activation of each layer over the calibration samples
+
+int calibrateLayers(CDNN *NN, const double *sampleInputs, int numSamples, int indexOrder, double *layerMax)
+{
+    int l, n, s, i, numInputs;
+    double *sample;
+    CDNN_context ctx;
+    
+    numInputs = NN->model.layerSize[1];
+    if (NN->model.variationalLayer > 0)  numInputs += NN->model.layerSize[NN->model.variationalLayer];
+    
+    sample = malloc(numInputs*sizeof(double));
+    if ((sample == NULL) || (CDNN_context_init(&ctx, &NN->model) != 0))  {
+        free(sample);
+        return CD_OUT_OF_MEMORY_ERROR;     }
+    
+    for (l = 0; l < NN->model.numLayers; l++)  layerMax[l] = 0.;
+    for (s = 0; s < numSamples; s++)  {
+        for (i = 0; i < numInputs; i++)  {
+            if (indexOrder == FEATURE_SAMPLE_ARRAY)  sample[i] = sampleInputs[(long) i*numSamples + s];
+            else  sample[i] = sampleInputs[(long) s*numInputs + i];     }
+        run_CDNN_ctx(&NN->model, &ctx, sample, NULL);
+        for (l = 0; l < NN->model.numLayers; l++)  {
+        for (n = 0; n < NN->model.layerSize[l]; n++)  {
+            if (fabs(ctx.y[l][n]) > layerMax[l])  layerMax[l] = fabs(ctx.y[l][n]);
+    }}  }
+    
+    CDNN_context_free(&ctx);
+    free(sample);
+    
+    return 0;
+}
+
+
+    // sampleInputs (numSamples of them, in indexOrder) may be NULL if activationQuantization has a range
+
+int CDNN_make_quantized(CDNN *NN, quantizationType weightQuantization, quantizationType activationQuantization,
+        const double *sampleInputs, int numSamples, int indexOrder)
+{
+    int l, li, l0, rtrn, maxQ, maxLayerSize, ifGrid, ifCalibrated, sparseWeights = (NN->model.n0 != NULL);
+    double *layerMax = NULL, *rowBuf;
+    arenaType arena;
+    CDNN_model *model = &NN->model;
+    
+    if (weightQuantization.ifQuantize && ((weightQuantization.bits < 2) || (weightQuantization.bits > 16)))  return CD_PARAMS_ERR;
+    if (activationQuantization.ifQuantize && ((activationQuantization.bits < 2) || (activationQuantization.bits > 16)))  return CD_PARAMS_ERR;
+    ifGrid = (activationQuantization.ifQuantize && (activationQuantization.range > 0.));
+    ifCalibrated = ((sampleInputs != NULL) && (numSamples > 0));
+    if (!ifGrid && !ifCalibrated)  return CD_PARAMS_ERR;
+    
+    alignedFree(model->quantArena);
+    model->quantArena = NULL;
+    model->quantBits = 0;
+    NN->yQ = NULL;
+    
+    maxLayerSize = 0;
+    for (l = 0; l < NN->model.numLayers; l++)  if (NN->model.layerSize[l] > maxLayerSize)  maxLayerSize = NN->model.layerSize[l];
+    rowBuf = malloc(maxLayerSize*sizeof(double));
+    if (rowBuf == NULL)  return CD_OUT_OF_MEMORY_ERROR;
+    
+    if (ifCalibrated)  {
+        layerMax = malloc(NN->model.numLayers*sizeof(double));
+        if (layerMax == NULL)  {
+            free(rowBuf);
+            return CD_OUT_OF_MEMORY_ERROR;     }
+        rtrn = calibrateLayers(NN, sampleInputs, numSamples, indexOrder, layerMax);
+        if (rtrn != 0)  {
+            free(layerMax);
+            free(rowBuf);
+            return rtrn;
+    }   }
+    
+    model->quantBits = weightQuantization.ifQuantize ? weightQuantization.bits : 8;
+    arena.base = NULL;
+    arena.numBytes = 0;
+    layoutQuantized(NN, &arena, (model->quantBits <= 8) ? 1 : 2);
+    if ((arena.base = alignedAlloc(arena.numBytes)) == NULL)  {
+        model->quantBits = 0;
+        free(layerMax);
+        free(rowBuf);
+        return CD_OUT_OF_MEMORY_ERROR;     }
+    model->quantArena = arena.base;
+    arena.numBytes = 0;
+    layoutQuantized(NN, &arena, (model->quantBits <= 8) ? 1 : 2);
+    
+        // the bias neuron is exact (and int8 alongside int8 weights); the inputs are scaled like the hidden layers
+        // unless they're calibrated
+    maxQ = (model->quantBits <= 8) ? CDNN_Q_INT8_MAX : CDNN_Q_INT16_MAX;
+    model->yScaleQ[0] = 1./maxQ;
+    model->yMinQ[0] = -maxQ;
+    model->yMaxQ[0] = maxQ;
+    for (l = 1; l < NN->model.numLayers; l++)  {
+        if (ifGrid && !(ifCalibrated && ((l == 1) || (l == NN->model.variationalLayer))))  {
+            model->yScaleQ[l] = activationQuantization.range/((1 << activationQuantization.bits) - 1);
+            model->yMinQ[l] = -activationQuantization.zeroInt;
+            model->yMaxQ[l] = (1 << activationQuantization.bits) - 1 - activationQuantization.zeroInt;
+            if (model->yMinQ[l] < -CDNN_Q_INT16_MAX)  model->yMinQ[l] = -CDNN_Q_INT16_MAX;
+            if (model->yMaxQ[l] > CDNN_Q_INT16_MAX)  model->yMaxQ[l] = CDNN_Q_INT16_MAX;
+        }
+        else  {
+            maxQ = activationQuantization.ifQuantize ? (1 << (activationQuantization.bits-1)) - 1 : CDNN_Q_INT16_MAX;
+            model->yScaleQ[l] = (layerMax[l] > 0.) ? layerMax[l]/maxQ : 1.;
+            model->yMinQ[l] = -maxQ;
+            model->yMaxQ[l] = maxQ;
+    }   }
+    free(layerMax);
+    
+    for (l = 0; l < NN->model.numLayers; l++)  {
+    for (li = 0; li < NN->model.numLayerInputs[l]; li++)  {
+        l0 = NN->model.layerInputs[l][li];
+        quantizeBlock(model, l, li, NN->model.weights[l][li], sparseWeights ? model->rowStart[l][li] : NULL,
+                sparseWeights ? model->n0[l][li] : NULL, sparseWeights ? model->denseWeights[l][li] : NULL,
+                NN->model.layerSize[l], NN->model.layerSize[l0], weightQuantization, rowBuf);
+    }}
+    free(rowBuf);
+    
+    return 0;
+}
+
+
+int ifBytesQ(const CDNN_model *NN, int l)
+{
+    return (NN->quantBits <= 8) && (NN->yMinQ[l] >= -CDNN_Q_INT8_MAX) && (NN->yMaxQ[l] <= CDNN_Q_INT8_MAX);
+}
+
+    // row s of the tile of layer l, in int8 or int16
+
+void *tileRowQ(const CDNN_model *NN, short **yQ, int l, int s)
+{
+    long offset = (long) s*strideQ(NN->layerSize[l]);
+    
+    if (ifBytesQ(NN, l))  return (signed char *) yQ[l] + offset;
+    return yQ[l] + offset;
+}
+
+    // quantizes the n activations y[i*yStride] of layer l into one row of its tile, like quantizeQ() but without
+    // a division or a call to floor():  the value is clamped first, so truncating it after an offset rounds it down
+
+void quantizeRowQ(const CDNN_model *NN, int l, const double *y, long yStride, int n, void *yQ)
+{
+    int i, ifBytes = ifBytesQ(NN, l);
+    short q;
+    double k, invScale = 1./NN->yScaleQ[l], minQ = NN->yMinQ[l], maxQ = NN->yMaxQ[l];
+    
+    for (i = 0; i < n; i++)  {
+        k = y[i*yStride]*invScale;
+        if (k > maxQ)  k = maxQ;
+        else if (!(k >= minQ))  k = minQ;
+        q = (int) (k + (CDNN_Q_INT16_MAX + 1.5)) - (CDNN_Q_INT16_MAX + 1);
+        if (ifBytes)  ((signed char *) yQ)[i] = q;
+        else  ((short *) yQ)[i] = q;
+}   }
+
+    // the weights of rowStart[i]..rowStart[i+1] of a block that is too sparse for its dense int copy,
+    // against one row of quantized activations
+
+long long sparseDotQ(const CDNN_model *NN, const void *w, const int *n0, long start, long end, const void *x, int ifBytes)
+{
+    long j;
+    long long sum = 0;
+    
+    if (NN->quantBits > 8)  {
+        for (j = start; j < end; j++)  sum += ((const short *) w)[j] * ((const short *) x)[n0[j]];     }
+    else if (ifBytes)  {
+        for (j = start; j < end; j++)  sum += ((const signed char *) w)[j] * ((const signed char *) x)[n0[j]];     }
+    else  {
+        for (j = start; j < end; j++)  sum += ((const signed char *) w)[j] * ((const short *) x)[n0[j]];     }
+    
+    return sum;
+}
+
+
+    // runs a tile of numTile samples whose inputs are already quantized into the rows of yQ[1] (and of the variational
+    // layer):  y[l][i*yStride + s] gets the double-precision activation of neuron i for sample s, which is then
+    // quantized into row s of yQ[l], except in the last layer
+
+void runQuantizedTile(const CDNN_model *NN, short **yQ, double **y, int yStride, int numTile, CDNN_layer_profile *profile)
+{
+    int l, li, l0, i, s, numIn, stride, ifBytes, sparseWeights = (NN->n0 != NULL);
+    long long sums[CDNN_BATCH_TILE], t0 = 0, numNonzero;
+    double scale, *rowScale, *yRow;
+    const void *w;
+    void (*dotI8MM)(const signed char *, const short *, int, int, int, long long *) = quantKernels[NN->quantSimdLevel].dotI8MM;
+    void (*dotI16MM)(const short *, const short *, int, int, int, long long *) = quantKernels[NN->quantSimdLevel].dotI16MM;
+    void (*dotI8x8MM)(const signed char *, const signed char *, int, int, int, long long *) = quantKernels[NN->quantSimdLevel].dotI8x8MM;
+    
+    for (s = 0; s < numTile; s++)  {
+        if (ifBytesQ(NN, 0))  *(signed char *) tileRowQ(NN, yQ, 0, s) = NN->yMaxQ[0];
+        else  *(short *) tileRowQ(NN, yQ, 0, s) = NN->yMaxQ[0];
+    }
+    
+    for (l = 2; l < NN->numLayers; l++)  {
+    if (l != NN->variationalLayer)  {
+        if (profile != NULL)  t0 = nanoseconds();
+        for (i = 0; i < NN->layerSize[l]; i++)  {
+        for (s = 0; s < numTile; s++)  {
+            y[l][(long) i*yStride + s] = 0.;
+        }}
+        for (li = 0; li < NN->numLayerInputs[l]; li++)  {
+            l0 = NN->layerInputs[l][li];
+            numIn = NN->layerSize[l0];
+            stride = strideQ(numIn);
+            ifBytes = ifBytesQ(NN, l0);
+            rowScale = NN->rowScaleQ[l][li];
+            
+            if (sparseWeights && (NN->denseWeightsQ[l][li] == NULL))  {
+                int *n0 = NN->n0[l][li], *rowStart = NN->rowStart[l][li];
+                for (i = 0; i < NN->layerSize[l]; i++)  {
+                    scale = rowScale[i]*NN->yScaleQ[l0];
+                    for (s = 0; s < numTile; s++)  {
+                        y[l][(long) i*yStride + s] += scale*sparseDotQ(NN, NN->weightsQ[l][li], n0, rowStart[i], rowStart[i+1],
+                                (const char *) yQ[l0] + (long) s*stride*(ifBytes ? 1 : 2), ifBytes);
+            }   }   }
+            else  {
+                w = sparseWeights ? NN->denseWeightsQ[l][li] : NN->weightsQ[l][li];
+                for (i = 0; i < NN->layerSize[l]; i++)  {
+                        // the bias is the same in every sample, so it isn't worth a kernel call over its padding
+                    if (l0 == 0)  {
+                        if (NN->quantBits > 8)  sums[0] = ((const short *) w)[(long) i*stride] * NN->yMaxQ[0];
+                        else  sums[0] = ((const signed char *) w)[(long) i*stride] * NN->yMaxQ[0];
+                        for (s = 1; s < numTile; s++)  sums[s] = sums[0];
+                    }
+                    else if (NN->quantBits > 8)  dotI16MM((const short *) w + (long) i*stride, yQ[l0], stride, stride, numTile, sums);
+                    else if (ifBytes)  dotI8x8MM((const signed char *) w + (long) i*stride, (const signed char *) yQ[l0], stride, stride, numTile, sums);
+                    else  dotI8MM((const signed char *) w + (long) i*stride, yQ[l0], stride, stride, numTile, sums);
+                    scale = rowScale[i]*NN->yScaleQ[l0];
+                    yRow = y[l] + (long) i*yStride;
+                    for (s = 0; s < numTile; s++)  yRow[s] += sums[s]*scale;
+        }   }   }
+        
+        if (numTile == yStride)  applyAF(NN, NN->layerAFs[l], y[l], NN->layerSize[l]*numTile);
+        else  {
+            for (i = 0; i < NN->layerSize[l]; i++)  applyAF(NN, NN->layerAFs[l], y[l] + (long) i*yStride, numTile);     }
+        if (l < NN->numLayers-1)  {
+            for (s = 0; s < numTile; s++)  quantizeRowQ(NN, l, y[l] + s, yStride, NN->layerSize[l], tileRowQ(NN, yQ, l, s));     }
+        if (profile != NULL)  {
+            numNonzero = 0;
+            for (i = 0; i < NN->layerSize[l]; i++)  numNonzero += countNonzero(y[l] + (long) i*yStride, numTile);
+            profileLayer(NN, profile, l, numTile, nanoseconds()-t0, numNonzero);
+    }}  }
+}
+
+
+    // allocates the tiles of int8 or int16 activations, in one block
+
+short **allocQuantizedLayers(const CDNN_model *NN)
+{
+    int l;
+    long yOffset;
+    short **y;
+    
+    y = malloc(NN->numLayers*sizeof(short *));
+    if (y == NULL)  return NULL;
+    
+    yOffset = 0;
+    for (l = 0; l < NN->numLayers; l++)  yOffset += (long) strideQ(NN->layerSize[l])*CDNN_BATCH_TILE;
+    y[0] = calloc(yOffset, sizeof(short));
+    if (y[0] == NULL)  {
+        free(y);
+        return NULL;     }
+    
+    for (l = 1; l < NN->numLayers; l++)  y[l] = y[l-1] + (long) strideQ(NN->layerSize[l-1])*CDNN_BATCH_TILE;
+    
+    return y;
+}
+
+
+    // the outputs are the last layer before it is quantized, so they are in double precision;
+    // returns NULL if the network hasn't been quantized, or if out of memory
+
+double *run_CDNN_quantized_ctx(const CDNN_model *NN, CDNN_context *ctx, const double *inputs, double *outputs)
+{
+    if (NN->quantBits == 0)  return NULL;
+    if (ctx->yQ == NULL)  ctx->yQ = allocQuantizedLayers(NN);
+    if (ctx->yQ == NULL)  return NULL;
+    
+    quantizeRowQ(NN, 1, inputs, 1, NN->layerSize[1], tileRowQ(NN, ctx->yQ, 1, 0));
+    if (NN->variationalLayer > 0)  {
+        quantizeRowQ(NN, NN->variationalLayer, inputs + NN->layerSize[1], 1, NN->layerSize[NN->variationalLayer],
+                tileRowQ(NN, ctx->yQ, NN->variationalLayer, 0));     }
+    runQuantizedTile(NN, ctx->yQ, ctx->y, 1, 1, ctx->profile);
+    
+    if (outputs == NULL)  return ctx->y[NN->numLayers-1];
+    memcpy(outputs, ctx->y[NN->numLayers-1], NN->layerSize[NN->numLayers-1]*sizeof(double));
+    return outputs;
+}
+
+
+double *run_CDNN_quantized(CDNN *NN, const double *inputs)
+{
+    CDNN_context ctx;
+    
+    ctx.model = &NN->model;
+    ctx.y = NN->y;
+    ctx.ty = NULL;
+    ctx.yF32 = ctx.tyF32 = NULL;
+    ctx.yQ = NN->yQ;
+    ctx.yBits = NULL;
+    ctx.active = NULL;
+    ctx.numActive = NULL;
+    ctx.profile = NN->profile;
+    
+    if (NN->yQ == NULL)  return NULL;
+    return run_CDNN_quantized_ctx(&NN->model, &ctx, inputs, NULL);
+}
+
+
+    // runs the samples a tile at a time, with the double-precision sums in the context's batch tiles
+
+int run_CDNN_batch_quantized_ctx(const CDNN_model *NN, CDNN_context *ctx, const double *inputs, int numSamples, int indexOrder, double *outputs)
+{
+    int s, s0, i, l, numTile, numInputs, numOutputs;
+    long inputStride;
+    const double *yIn;
+    double *yOut;
+    
+    if (NN->quantBits == 0)  return CD_PARAMS_ERR;
+    if (ctx->yQ == NULL)  ctx->yQ = allocQuantizedLayers(NN);
+    if (ctx->yQ == NULL)  return CD_OUT_OF_MEMORY_ERROR;
+    if (ctx->ty == NULL)  ctx->ty = allocTileLayers(NN);
+    if (ctx->ty == NULL)  return CD_OUT_OF_MEMORY_ERROR;
+    
+    numInputs = NN->layerSize[1];
+    if (NN->variationalLayer > 0)  numInputs += NN->layerSize[NN->variationalLayer];
+    numOutputs = NN->layerSize[NN->numLayers-1];
+    inputStride = (indexOrder == FEATURE_SAMPLE_ARRAY) ? numSamples : 1;
+    
+    for (s0 = 0; s0 < numSamples; s0 += CDNN_BATCH_TILE)  {
+        numTile = numSamples-s0;
+        if (numTile > CDNN_BATCH_TILE)  numTile = CDNN_BATCH_TILE;
+        
+        for (s = 0; s < numTile; s++)  {
+            if (indexOrder == FEATURE_SAMPLE_ARRAY)  yIn = inputs + s0+s;
+            else  yIn = inputs + (long) (s0+s)*numInputs;
+            quantizeRowQ(NN, 1, yIn, inputStride, NN->layerSize[1], tileRowQ(NN, ctx->yQ, 1, s));
+            if (NN->variationalLayer > 0)  {
+                l = NN->variationalLayer;
+                quantizeRowQ(NN, l, yIn + NN->layerSize[1]*inputStride, inputStride, NN->layerSize[l], tileRowQ(NN, ctx->yQ, l, s));
+        }   }
+        
+        runQuantizedTile(NN, ctx->yQ, ctx->ty, CDNN_BATCH_TILE, numTile, ctx->profile);
+        
+        for (i = 0; i < numOutputs; i++)  {
+            yOut = ctx->ty[NN->numLayers-1] + i*CDNN_BATCH_TILE;
+            for (s = 0; s < numTile; s++)  {
+                if (indexOrder == FEATURE_SAMPLE_ARRAY)  outputs[(long) i*numSamples + s0+s] = yOut[s];
+                else  outputs[(long) (s0+s)*numOutputs + i] = yOut[s];
+    }   }   }
+    
+    return 0;
+}
+
+
+int run_CDNN_batch_quantized(CDNN *NN, const double *inputs, int numSamples, int indexOrder, double *outputs)
+{
+    int rtrn;
+    CDNN_context ctx;
+    
+    ctx.model = &NN->model;
+    ctx.y = NN->y;
+    ctx.ty = NULL;
+    ctx.yF32 = ctx.tyF32 = NULL;
+    ctx.yQ = NN->yQ;
+    ctx.yBits = NULL;
+    ctx.active = NULL;
+    ctx.numActive = NULL;
+    ctx.profile = NN->profile;
+    
+    rtrn = run_CDNN_batch_quantized_ctx(&NN->model, &ctx, inputs, numSamples, indexOrder, outputs);
+    
+    if (ctx.ty != NULL)  free(ctx.ty[0]);
+    free(ctx.ty);
+    
+    return rtrn;
+}
+
+
+    // *maxDeviation is the largest absolute difference from referenceOutputs (the sampleOutputs that the server
+    // sent back, say), or from run_CDNN_batch() if referenceOutputs == NULL; all in the same index order
+
+int CDNN_quantized_deviation(CDNN *NN, const double *inputs, const double *referenceOutputs, int numSamples, int indexOrder,
+        double *maxDeviation)
+{
+    int rtrn = 0, numOutputs;
+    long i;
+    double *outputs, *reference = NULL;
+
+    *maxDeviation = 0.;
+    if (NN->model.quantBits == 0)  return CD_PARAMS_ERR;
+    
+    numOutputs = NN->model.layerSize[NN->model.numLayers-1];
+    outputs = malloc((long) numOutputs*numSamples*sizeof(double) + 1);
+    if (referenceOutputs == NULL)  reference = malloc((long) numOutputs*numSamples*sizeof(double) + 1);
+    if ((outputs == NULL) || ((referenceOutputs == NULL) && (reference == NULL)))  {
+        free(outputs);  free(reference);
+        return CD_OUT_OF_MEMORY_ERROR;     }
+    
+    if (referenceOutputs == NULL)  {
+        rtrn = run_CDNN_batch(NN, (double *) inputs, numSamples, indexOrder, reference);
+        referenceOutputs = reference;     }
+    if (rtrn == 0)  rtrn = run_CDNN_batch_quantized(NN, inputs, numSamples, indexOrder, outputs);
+    if (rtrn == 0)  {
+    for (i = 0; i < (long) numOutputs*numSamples; i++)  {
+        if (fabs(outputs[i] - referenceOutputs[i]) > *maxDeviation)  *maxDeviation = fabs(outputs[i] - referenceOutputs[i]);
+    }}
+    
+    free(outputs);
+    free(reference);
+    
+    return rtrn;
+}
+
+
+    // Bit-packed step layers:  CDNN_make_bitpacked() sets up run_CDNN_bitpacked(), which stores the activations of each
+    // hidden step-function layer as a bitset, one bit per neuron.  A block that reads such a layer and whose weights are
+    // all 0, c or -c (as with 1-bit weight quantization) is converted to two bit masks per row, and is run with popcounts.
+    // The other blocks that read it sum their weights over its set bits when fewer than CDNN_MASKED_DENSITY of them are set,
+    // and otherwise multiply by its 0/1 activations as run_CDNN() does, which is faster with SIMD.
+    // The outputs agree with run_CDNN()'s up to the rounding of the sums.
+
+#define CDNN_MASKED_DENSITY 0.25
+
+int ifStepLayer(const CDNN_model *NN, int l)
+{
+    return (l >= 2) && (l != NN->variationalLayer) && (NN->layerAFs[l] == STEP_AF);
+}
+
+int bitWords(int numBits)  {  return (numBits+63)/64;  }
+
+    // the c if every weight of block (l, li) is 0, c or -c, else -1
+
+double binaryScale(const CDNN_model *NN, int l, int li)
+{
+    long j, numWeights;
+    double c = 0.;
+    
+    if (NN->n0 != NULL)  numWeights = NN->wSize[l][li];
+    else  numWeights = (long) NN->layerSize[l]*NN->layerSize[NN->layerInputs[l][li]];
+    
+    for (j = 0; j < numWeights; j++)  {
+            // a repeated sparse entry would sum to 2c (the entries are sorted by row, then input neuron)
+        if ((NN->n0 != NULL) && (j > 0) && (NN->n0[l][li][j] == NN->n0[l][li][j-1]) && (NN->nf[l][li][j] == NN->nf[l][li][j-1]))  return -1.;
+        if (NN->weights[l][li][j] == 0.)  continue;
+        if (c == 0.)  c = fabs(NN->weights[l][li][j]);
+        else if (fabs(NN->weights[l][li][j]) != c)  return -1.;
+    }
+    
+    return c;
+}
+
+void layoutBits(CDNN *NN, arenaType *arena)
+{
+    int l, li, l0, ifPlace = (arena->base != NULL);
+    int *wordsTable;
+    uint64_t ***posTable, ***negTable, **yTable;
+    double **scaleTable;
+    
+    wordsTable = arenaAlloc(arena, NN->model.numLayers*sizeof(int));
+    posTable = arenaAlloc(arena, NN->model.numLayers*sizeof(uint64_t **));
+    negTable = arenaAlloc(arena, NN->model.numLayers*sizeof(uint64_t **));
+    scaleTable = arenaAlloc(arena, NN->model.numLayers*sizeof(double *));
+    yTable = arenaAlloc(arena, NN->model.numLayers*sizeof(uint64_t *));
+    if (ifPlace)  {
+        NN->model.stepWords = wordsTable;
+        NN->model.posBits = posTable;
+        NN->model.negBits = negTable;
+        NN->model.bitScale = scaleTable;
+        NN->yBits = yTable;
+        for (l = 0; l < NN->model.numLayers; l++)  wordsTable[l] = ifStepLayer(&NN->model, l) ? bitWords(NN->model.layerSize[l]) : 0;
+    }
+    
+    for (l = 0; l < NN->model.numLayers; l++)  {
+        uint64_t **posPtrs = arenaAlloc(arena, NN->model.numLayerInputs[l]*sizeof(uint64_t *));
+        uint64_t **negPtrs = arenaAlloc(arena, NN->model.numLayerInputs[l]*sizeof(uint64_t *));
+        double *scales = arenaAlloc(arena, NN->model.numLayerInputs[l]*sizeof(double));
+        
+        if (ifPlace)  {
+            posTable[l] = posPtrs;
+            negTable[l] = negPtrs;
+            scaleTable[l] = scales;
+        }
+        
+        for (li = 0; li < NN->model.numLayerInputs[l]; li++)  {
+            uint64_t *pos = NULL, *neg = NULL;
+            double c = -1.;
+            
+            l0 = NN->model.layerInputs[l][li];
+            if (ifStepLayer(&NN->model, l0))  c = binaryScale(&NN->model, l, li);
+            if (c >= 0.)  {
+                pos = arenaAlloc(arena, (size_t) NN->model.layerSize[l]*bitWords(NN->model.layerSize[l0])*sizeof(uint64_t));
+                neg = arenaAlloc(arena, (size_t) NN->model.layerSize[l]*bitWords(NN->model.layerSize[l0])*sizeof(uint64_t));
+            }
+            if (ifPlace)  {
+                posPtrs[li] = pos;
+                negPtrs[li] = neg;
+                scales[li] = c;
+    }   }   }
+    
+    for (l = 0; l < NN->model.numLayers; l++)  {
+        uint64_t *y = arenaAlloc(arena, bitWords(NN->model.layerSize[l])*sizeof(uint64_t));
+        if (ifPlace)  NN->yBits[l] = y;
+}   }
+
+
+int CDNN_make_bitpacked(CDNN *NN)
+{
+    int l, li, numWords, sparseWeights = (NN->model.n0 != NULL);
+    long i, j, numIn, row;
+    double w;
+    arenaType arena;
+    
+    alignedFree(NN->model.bitArena);
+    NN->model.bitArena = NULL;
+    NN->yBits = NULL;
+    
+    arena.base = NULL;
+    arena.numBytes = 0;
+    layoutBits(NN, &arena);
+    if ((arena.base = alignedAlloc(arena.numBytes)) == NULL)  return CD_OUT_OF_MEMORY_ERROR;
+    NN->model.bitArena = arena.base;
+    arena.numBytes = 0;
+    layoutBits(NN, &arena);
+    
+    for (l = 0; l < NN->model.numLayers; l++)  {
+    for (li = 0; li < NN->model.numLayerInputs[l]; li++)  {
+    if (NN->model.posBits[l][li] != NULL)  {
+        numIn = NN->model.layerSize[NN->model.layerInputs[l][li]];
+        numWords = bitWords(numIn);
+        memset(NN->model.posBits[l][li], 0, (size_t) NN->model.layerSize[l]*numWords*sizeof(uint64_t));
+        memset(NN->model.negBits[l][li], 0, (size_t) NN->model.layerSize[l]*numWords*sizeof(uint64_t));
+        for (j = 0; j < (sparseWeights ? NN->model.wSize[l][li] : NN->model.layerSize[l]*numIn); j++)  {
+            w = NN->model.weights[l][li][j];
+            row = sparseWeights ? NN->model.nf[l][li][j] : j/numIn;
+            i = sparseWeights ? NN->model.n0[l][li][j] : j%numIn;
+            if (w > 0.)  NN->model.posBits[l][li][row*numWords + i/64] |= (uint64_t) 1 << (i%64);
+            if (w < 0.)  NN->model.negBits[l][li][row*numWords + i/64] |= (uint64_t) 1 << (i%64);
+    }}}}
+    
+    return 0;
+}
+
+
+int lowestBit(uint64_t x)
+{
+#ifdef __GNUC__
+    return __builtin_ctzll(x);
+#else
+    int b = 0;
+    
+    while (!(x & 1))  {
+        x >>= 1;
+        b++;     }
+    return b;
+#endif
+}
+
+    // y[i] += the sum of row i's weights over the set bits of x, for rows of numIn weights
+
+void maskedDenseMV(const double *w, const uint64_t *x, double *y, int numOut, int numIn)
+{
+    int i, k;
+    uint64_t bits;
+    double sum;
+    
+    for (i = 0; i < numOut; i++)  {
+        sum = 0.;
+        for (k = 0; k < bitWords(numIn); k++)  {
+            for (bits = x[k]; bits != 0; bits &= bits-1)  sum += w[64*k + lowestBit(bits)];
+        }
+        y[i] += sum;
+        w += numIn;
+}   }
+
+void maskedSparseMV(const double *w, const int *n0, const int *rowStart, const uint64_t *x, double *y, int numOut)
+{
+    int i, j;
+    double sum;
+    
+    for (i = 0; i < numOut; i++)  {
+        sum = 0.;
+        for (j = rowStart[i]; j < rowStart[i+1]; j++)  {
+            if ((x[n0[j] >> 6] >> (n0[j] & 63)) & 1)  sum += w[j];
+        }
+        y[i] += sum;
+}   }
+
+void packBits(const double *y, uint64_t *bits, int n)
+{
+    int i;
+    
+    for (i = 0; i < bitWords(n); i++)  bits[i] = 0;
+    for (i = 0; i < n; i++)  bits[i >> 6] |= (uint64_t) (y[i] != 0.) << (i & 63);
+}
+
+int countSetBits(const uint64_t *bits, int numWords)
+{
+    int k, count = 0;
+    
+    for (k = 0; k < numWords; k++)  count += countBits(bits[k]);
+    return count;
+}
+
+void runLayersBits(const CDNN_model *NN, double **y, uint64_t **yBits, CDNN_layer_profile *profile)
+{
+    int l, li, l0, n, sparseWeights = (NN->n0 != NULL);
+    long long t0 = 0;
+    
+    for (l = 2; l < NN->numLayers; l++)  {
+    if (l != NN->variationalLayer)  {
+        if (profile != NULL)  t0 = nanoseconds();
+        for (n = 0; n < NN->layerSize[l]; n++)  y[l][n] = 0.;
+        for (li = 0; li < NN->numLayerInputs[l]; li++)  {
+            l0 = NN->layerInputs[l][li];
+            if (NN->stepWords[l0] == 0)  runBlockRows(NN, y, l, li, 0, NN->layerSize[l]);
+            else if ((NN->posBits[l][li] == NULL) && (countSetBits(yBits[l0], NN->stepWords[l0]) >= CDNN_MASKED_DENSITY*NN->layerSize[l0]))
+                runBlockRows(NN, y, l, li, 0, NN->layerSize[l]);
+            else if (NN->posBits[l][li] != NULL)  kernels[NN->simdLevel].bitMV(NN->posBits[l][li], NN->negBits[l][li], yBits[l0],
+                    NN->bitScale[l][li], y[l], NN->layerSize[l], NN->stepWords[l0]);
+            else if (sparseWeights && (NN->denseWeights[l][li] == NULL))  maskedSparseMV(NN->weights[l][li], NN->n0[l][li],
+                    NN->rowStart[l][li], yBits[l0], y[l], NN->layerSize[l]);
+            else  maskedDenseMV(sparseWeights ? NN->denseWeights[l][li] : NN->weights[l][li], yBits[l0], y[l], NN->layerSize[l], NN->layerSize[l0]);
+        }
+        applyAF(NN, NN->layerAFs[l], y[l], NN->layerSize[l]);
+        if (NN->stepWords[l] > 0)  packBits(y[l], yBits[l], NN->layerSize[l]);
+        if (profile != NULL)  profileLayer(NN, profile, l, 1, nanoseconds()-t0, countNonzero(y[l], NN->layerSize[l]));
+    }}
+}
+
+
+    // returns NULL if the network hasn't been converted, or if out of memory
+
+double *run_CDNN_bitpacked_ctx(const CDNN_model *NN, CDNN_context *ctx, const double *inputs, double *outputs)
+{
+    int l;
+    long numWords = 0;
+    
+    if (NN->bitArena == NULL)  return NULL;
+    if (ctx->yBits == NULL)  {
+        for (l = 0; l < NN->numLayers; l++)  numWords += NN->stepWords[l];
+        ctx->yBits = malloc(NN->numLayers*sizeof(uint64_t *));
+        if (ctx->yBits == NULL)  return NULL;
+        ctx->yBits[0] = malloc((numWords+1)*sizeof(uint64_t));
+        if (ctx->yBits[0] == NULL)  {
+            free(ctx->yBits);
+            ctx->yBits = NULL;
+            return NULL;     }
+        for (l = 1; l < NN->numLayers; l++)  ctx->yBits[l] = ctx->yBits[l-1] + NN->stepWords[l-1];
+    }
+    
+    setInputs(NN, ctx->y, inputs);
+    runLayersBits(NN, ctx->y, ctx->yBits, ctx->profile);
+    
+    if (outputs == NULL)  return ctx->y[NN->numLayers-1];
+    memcpy(outputs, ctx->y[NN->numLayers-1], NN->layerSize[NN->numLayers-1]*sizeof(double));
+    return outputs;
+}
+
+
+double *run_CDNN_bitpacked(CDNN *NN, const double *inputs)
+{
+    CDNN_context ctx;
+    
+    ctx.model = &NN->model;
+    ctx.y = NN->y;
+    ctx.ty = NULL;
+    ctx.yF32 = ctx.tyF32 = NULL;
+    ctx.yQ = NULL;
+    ctx.yBits = NN->yBits;
+    ctx.active = NULL;
+    ctx.numActive = NULL;
+    ctx.profile = NN->profile;
+    
+    if (NN->yBits == NULL)  return NULL;
+    return run_CDNN_bitpacked_ctx(&NN->model, &ctx, inputs, NULL);
+}
+
+
+    // Event-driven propagation:  CDNN_make_event_driven() sets up run_CDNN_events(), which lists the nonzero activations
+    // of each layer once it has been computed.  A block that reads a layer with few enough active neurons adds up only
+    // the weight columns of those neurons, from a copy of its weights stored column by column:  column-major for dense
+    // blocks (and sparse blocks that run as dense), and sorted by input neuron for the others, with colStart[] indexing
+    // each neuron's weights.  Dense blocks switch to columns below CDNN_EVENT_DENSITY active inputs, and sparse ones below
+    // CDNN_SPARSE_EVENT_DENSITY, past which sparseMV() is as fast.  Layers with sigmoid or tanh activations are never 0
+    // in practice, so the blocks that read them get no copies and always run as in run_CDNN().
+    // The outputs agree with run_CDNN()'s up to the rounding of the sums.
+
+#define CDNN_EVENT_DENSITY 0.5
+#define CDNN_SPARSE_EVENT_DENSITY 0.3
+
+int ifEventInput(const CDNN_model *NN, int l0)
+{
+    if ((l0 == 0) || (l0 == NN->numLayers-1))  return 0;
+    if ((l0 == 1) || (l0 == NN->variationalLayer))  return 1;
+    return (NN->layerAFs[l0] != SIGMOID_AF) && (NN->layerAFs[l0] != TANH_AF);
+}
+
+int ifDenseColumns(const CDNN_model *NN, int l, int li)
+{
+    return (NN->n0 == NULL) || (NN->denseWeights[l][li] != NULL);
+}
+
+void layoutEvents(CDNN *NN, arenaType *arena)
+{
+    int l, li, l0, ifPlace = (arena->base != NULL);
+    int ***startTable, ***rowsTable, **activeTable, *countTable;
+    double ***weightsTable;
+    
+    weightsTable = arenaAlloc(arena, NN->model.numLayers*sizeof(double **));
+    startTable = arenaAlloc(arena, NN->model.numLayers*sizeof(int **));
+    rowsTable = arenaAlloc(arena, NN->model.numLayers*sizeof(int **));
+    activeTable = arenaAlloc(arena, NN->model.numLayers*sizeof(int *));
+    countTable = arenaAlloc(arena, NN->model.numLayers*sizeof(int));
+    if (ifPlace)  {
+        NN->model.colWeights = weightsTable;
+        NN->model.colStart = startTable;
+        NN->model.colRows = rowsTable;
+        NN->active = activeTable;
+        NN->numActive = countTable;
+    }
+    
+    for (l = 0; l < NN->model.numLayers; l++)  {
+        double **weightPtrs = arenaAlloc(arena, NN->model.numLayerInputs[l]*sizeof(double *));
+        int **startPtrs = arenaAlloc(arena, NN->model.numLayerInputs[l]*sizeof(int *));
+        int **rowPtrs = arenaAlloc(arena, NN->model.numLayerInputs[l]*sizeof(int *));
+        
+        if (ifPlace)  {
+            weightsTable[l] = weightPtrs;
+            startTable[l] = startPtrs;
+            rowsTable[l] = rowPtrs;
+        }
+        
+        for (li = 0; li < NN->model.numLayerInputs[l]; li++)  {
+            double *w = NULL;
+            int *start = NULL, *rows = NULL;
+            
+            l0 = NN->model.layerInputs[l][li];
+            if (ifEventInput(&NN->model, l0) && ifDenseColumns(&NN->model, l, li))  {
+                w = arenaAlloc(arena, (size_t) NN->model.layerSize[l]*NN->model.layerSize[l0]*sizeof(double));
+            }
+            else if (ifEventInput(&NN->model, l0))  {
+                w = arenaAlloc(arena, NN->model.wSize[l][li]*sizeof(double));
+                start = arenaAlloc(arena, (NN->model.layerSize[l0]+1)*sizeof(int));
+                rows = arenaAlloc(arena, NN->model.wSize[l][li]*sizeof(int));
+            }
+            if (ifPlace)  {
+                weightPtrs[li] = w;
+                startPtrs[li] = start;
+                rowPtrs[li] = rows;
+    }   }   }
+    
+    for (l = 0; l < NN->model.numLayers; l++)  {
+        int *active = arenaAlloc(arena, NN->model.layerSize[l]*sizeof(int));
+        if (ifPlace)  activeTable[l] = active;
+}   }
+
+
+int CDNN_make_event_driven(CDNN *NN)
+{
+    int l, li, l0, i, i0, numOut, numIn;
+    long j;
+    int *start, *rows;
+    double *src, *w;
+    arenaType arena;
+    
+    alignedFree(NN->model.eventArena);
+    NN->model.eventArena = NULL;
+    NN->active = NULL;
+    NN->numActive = NULL;
+    NN->events.numSamples = NN->events.MACs = NN->events.skippedMACs = 0;
+    
+    arena.base = NULL;
+    arena.numBytes = 0;
+    layoutEvents(NN, &arena);
+    if ((arena.base = alignedAlloc(arena.numBytes)) == NULL)  return CD_OUT_OF_MEMORY_ERROR;
+    NN->model.eventArena = arena.base;
+    arena.numBytes = 0;
+    layoutEvents(NN, &arena);
+    
+    for (l = 0; l < NN->model.numLayers; l++)  {
+    for (li = 0; li < NN->model.numLayerInputs[l]; li++)  {
+    if (NN->model.colWeights[l][li] != NULL)  {
+        l0 = NN->model.layerInputs[l][li];
+        numOut = NN->model.layerSize[l];
+        numIn = NN->model.layerSize[l0];
+        w = NN->model.colWeights[l][li];
+        if (ifDenseColumns(&NN->model, l, li))  {
+            src = (NN->model.n0 == NULL) ? NN->model.weights[l][li] : NN->model.denseWeights[l][li];
+            for (i = 0; i < numOut; i++)  {
+            for (i0 = 0; i0 < numIn; i0++)  {
+                w[(long) i0*numOut + i] = src[(long) i*numIn + i0];
+        }}  }
+        else  {
+                // a counting sort by input neuron, which keeps each column's weights in order of output neuron
+            start = NN->model.colStart[l][li];
+            rows = NN->model.colRows[l][li];
+            for (i0 = 0; i0 <= numIn; i0++)  start[i0] = 0;
+            for (j = 0; j < NN->model.wSize[l][li]; j++)  start[NN->model.n0[l][li][j]+1]++;
+            for (i0 = 0; i0 < numIn; i0++)  start[i0+1] += start[i0];
+            for (j = 0; j < NN->model.wSize[l][li]; j++)  {
+                i0 = NN->model.n0[l][li][j];
+                rows[start[i0]] = NN->model.nf[l][li][j];
+                w[start[i0]] = NN->model.weights[l][li][j];
+                start[i0]++;     }
+            for (i0 = numIn; i0 > 0; i0--)  start[i0] = start[i0-1];
+            start[0] = 0;
+    }}}}
+    
+    return 0;
+}
+
+
+    // adds the columns of the active inputs of a block stored sorted by input neuron, and returns the number of weights read
+
+long long sparseColumnMV(const double *w, const int *colStart, const int *colRows, const int *active, int numActive,
+        const double *x, double *y)
+{
+    int k, j;
+    long long numWeights = 0;
+    double a;
+    
+    for (k = 0; k < numActive; k++)  {
+        a = x[active[k]];
+        for (j = colStart[active[k]]; j < colStart[active[k]+1]; j++)  y[colRows[j]] += w[j]*a;
+        numWeights += colStart[active[k]+1] - colStart[active[k]];
+    }
+    
+    return numWeights;
+}
+
+int listActive(const double *y, int *active, int n)
+{
+    int i, numActive = 0;
+    
+    for (i = 0; i < n; i++)  {
+    if (y[i] != 0.)  {
+        active[numActive] = i;
+        numActive++;
+    }}
+    
+    return numActive;
+}
+
+void runLayersEvents(const CDNN_model *NN, double **y, int **active, int *numActive, CDNN_event_stats *events, CDNN_layer_profile *profile)
+{
+    int l, li, l0, n, sparseWeights = (NN->n0 != NULL);
+    long long t0 = 0, numMACs, MACsRun;
+    double maxDensity;
+    
+    for (l = 1; l < NN->numLayers; l++)  {
+    if ((l == 1) || (l == NN->variationalLayer))  {
+        if (ifEventInput(NN, l))  numActive[l] = listActive(y[l], active[l], NN->layerSize[l]);
+    }}
+    
+    for (l = 2; l < NN->numLayers; l++)  {
+    if (l != NN->variationalLayer)  {
+        if (profile != NULL)  t0 = nanoseconds();
+        for (n = 0; n < NN->layerSize[l]; n++)  y[l][n] = 0.;
+        for (li = 0; li < NN->numLayerInputs[l]; li++)  {
+            l0 = NN->layerInputs[l][li];
+            if (sparseWeights && (NN->denseWeights[l][li] == NULL))  numMACs = NN->wSize[l][li];
+            else  numMACs = (long long) NN->layerSize[l]*NN->layerSize[l0];
+            
+            maxDensity = (NN->colStart[l][li] == NULL) ? CDNN_EVENT_DENSITY : CDNN_SPARSE_EVENT_DENSITY;
+            if ((NN->colWeights[l][li] == NULL) || (numActive[l0] >= maxDensity*NN->layerSize[l0]))  {
+                runBlockRows(NN, y, l, li, 0, NN->layerSize[l]);
+                MACsRun = numMACs;
+            }
+            else if (NN->colStart[l][li] == NULL)  {
+                kernels[NN->simdLevel].columnMV(NN->colWeights[l][li], active[l0], numActive[l0], y[l0], y[l], NN->layerSize[l]);
+                MACsRun = (long long) numActive[l0]*NN->layerSize[l];
+            }
+            else  MACsRun = sparseColumnMV(NN->colWeights[l][li], NN->colStart[l][li], NN->colRows[l][li],
+                    active[l0], numActive[l0], y[l0], y[l]);
+            
+            events->MACs += MACsRun;
+            events->skippedMACs += numMACs - MACsRun;
+        }
+        applyAF(NN, NN->layerAFs[l], y[l], NN->layerSize[l]);
+        if (ifEventInput(NN, l))  numActive[l] = listActive(y[l], active[l], NN->layerSize[l]);
+        if (profile != NULL)  profileLayer(NN, profile, l, 1, nanoseconds()-t0, countNonzero(y[l], NN->layerSize[l]));
+    }}
+    events->numSamples++;
+}
+
+
+    // returns NULL if the network hasn't been converted, or if out of memory
+
+double *run_CDNN_events_ctx(const CDNN_model *NN, CDNN_context *ctx, const double *inputs, double *outputs)
+{
+    int l;
+    long numNeurons = 0;
+    
+    if (NN->eventArena == NULL)  return NULL;
+    if (ctx->active == NULL)  {
+        for (l = 0; l < NN->numLayers; l++)  numNeurons += NN->layerSize[l];
+        ctx->active = malloc(NN->numLayers*sizeof(int *));
+        ctx->numActive = malloc(NN->numLayers*sizeof(int));
+        if ((ctx->active == NULL) || (ctx->numActive == NULL))  {
+            free(ctx->active);
+            free(ctx->numActive);
+            ctx->active = NULL;
+            ctx->numActive = NULL;
+            return NULL;     }
+        ctx->active[0] = malloc(numNeurons*sizeof(int));
+        if (ctx->active[0] == NULL)  {
+            free(ctx->active);
+            free(ctx->numActive);
+            ctx->active = NULL;
+            ctx->numActive = NULL;
+            return NULL;     }
+        for (l = 1; l < NN->numLayers; l++)  ctx->active[l] = ctx->active[l-1] + NN->layerSize[l-1];
+    }
+    
+    setInputs(NN, ctx->y, inputs);
+    runLayersEvents(NN, ctx->y, ctx->active, ctx->numActive, &ctx->events, ctx->profile);
+    
+    if (outputs == NULL)  return ctx->y[NN->numLayers-1];
+    memcpy(outputs, ctx->y[NN->numLayers-1], NN->layerSize[NN->numLayers-1]*sizeof(double));
+    return outputs;
+}
+
+
+double *run_CDNN_events(CDNN *NN, const double *inputs)
+{
+    double *outputs;
+    CDNN_context ctx;
+    
+    ctx.model = &NN->model;
+    ctx.y = NN->y;
+    ctx.ty = NULL;
+    ctx.yF32 = ctx.tyF32 = NULL;
+    ctx.yQ = NULL;
+    ctx.yBits = NULL;
+    ctx.active = NN->active;
+    ctx.numActive = NN->numActive;
+    ctx.events = NN->events;
+    ctx.profile = NN->profile;
+    
+    if (NN->active == NULL)  return NULL;
+    outputs = run_CDNN_events_ctx(&NN->model, &ctx, inputs, NULL);
+    NN->events = ctx.events;
+    
+    return outputs;
+}
+
+
+    // the fraction of the multiply-accumulates that were skipped
+
+double CDNN_skip_ratio(const CDNN_event_stats *events)
+{
+    if (events->MACs + events->skippedMACs == 0)  return 0.;
+    return ((double) events->skippedMACs)/(events->MACs + events->skippedMACs);
+}
+
+
+    // Graph optimization:  CDNN_optimize() rewrites a network with its exact-zero weights dropped, each layer that has
+    // a linear activation function multiplied into the layers that read it (where that doesn't add weights), and the
+    // neurons removed whose outputs are always 0 or never reach the output layer, along with any layer left empty.
+    // The bias, input, variational, encoder and output layers keep all their neurons.  The weights are then stored sparse
+    // if any block is below CDNN_DENSE_BLOCK_DENSITY, and dense otherwise.
+    // The work is done on a copy of the network whose blocks have their rows compressed; the network is then rebuilt in
+    // a new arena, which drops the single-precision and quantized copies and the profile.
+
+typedef struct {
+    int l0, *rowStart, *n0;
+    double *w;
+} optBlockType;
+
+typedef struct {
+    int size, AF, numBlocks, ifInput, ifFixed, ifRemoved;
+    optBlockType *blocks;
+    char *ifZero, *ifKept;
+} optLayerType;
+
+void freeOptBlock(optBlockType *block)
+{
+    free(block->rowStart);
+    free(block->n0);
+    free(block->w);
+    block->rowStart = block->n0 = NULL;
+    block->w = NULL;
+}
+
+void freeOptLayers(optLayerType *layers, int numLayers)
+{
+    int l, b;
+    
+    for (l = 0; l < numLayers; l++)  {
+        if (layers[l].blocks != NULL)  {
+            for (b = 0; b < layers[l].numBlocks; b++)  freeOptBlock(&layers[l].blocks[b]);     }
+        free(layers[l].blocks);
+        free(layers[l].ifZero);
+        free(layers[l].ifKept);
+    }
+    free(layers);
+}
+
+int allocOptBlock(optBlockType *block, int l0, int numOut, int numW)
+{
+    block->l0 = l0;
+    block->rowStart = malloc((numOut+1)*sizeof(int));
+    block->n0 = malloc((numW+1)*sizeof(int));
+    block->w = malloc((numW+1)*sizeof(double));
+    if ((block->rowStart == NULL) || (block->n0 == NULL) || (block->w == NULL))  {
+        freeOptBlock(block);
+        return CD_OUT_OF_MEMORY_ERROR;     }
+    
+    return 0;
+}
+
+int optBlockWeights(const optBlockType *block, int numOut)  {  return block->rowStart[numOut];  }
+
+    // copies each block without its zeros
+
+int loadOptLayers(CDNN *NN, optLayerType *layers, long long *numZeros)
+{
+    int l, li, i, j, numIn, numW, sparseWeights = (NN->model.n0 != NULL);
+    const double *w;
+    optBlockType *block;
+    
+    for (l = 0; l < NN->model.numLayers; l++)  {
+        layers[l].size = NN->model.layerSize[l];
+        layers[l].AF = NN->model.layerAFs[l];
+        layers[l].numBlocks = NN->model.numLayerInputs[l];
+        layers[l].ifInput = ((l < 2) || (l == NN->model.variationalLayer));
+        layers[l].ifFixed = (layers[l].ifInput || (l == NN->model.encoderLayer) || (l == NN->model.numLayers-1));
+        layers[l].ifRemoved = 0;
+        layers[l].blocks = calloc(NN->model.numLayerInputs[l]+1, sizeof(optBlockType));
+        layers[l].ifZero = malloc(NN->model.layerSize[l]);
+        layers[l].ifKept = malloc(NN->model.layerSize[l]);
+        if ((layers[l].blocks == NULL) || (layers[l].ifZero == NULL) || (layers[l].ifKept == NULL))  return CD_OUT_OF_MEMORY_ERROR;
+    }
+    
+    for (l = 0; l < NN->model.numLayers; l++)  {
+    for (li = 0; li < NN->model.numLayerInputs[l]; li++)  {
+        numIn = NN->model.layerSize[NN->model.layerInputs[l][li]];
+        w = NN->model.weights[l][li];
+        block = &layers[l].blocks[li];
+        
+        numW = 0;
+        if (sparseWeights)  {  for (j = 0; j < NN->model.wSize[l][li]; j++)  numW += (w[j] != 0.);  }
+        else  {  for (j = 0; j < NN->model.layerSize[l]*numIn; j++)  numW += (w[j] != 0.);  }
+        *numZeros += (sparseWeights ? NN->model.wSize[l][li] : NN->model.layerSize[l]*numIn) - numW;
+        if (allocOptBlock(block, NN->model.layerInputs[l][li], NN->model.layerSize[l], numW) != 0)  return CD_OUT_OF_MEMORY_ERROR;
+        
+        numW = 0;
+        for (i = 0; i < NN->model.layerSize[l]; i++)  {
+            block->rowStart[i] = numW;
+            if (sparseWeights)  {
+            for (j = NN->model.rowStart[l][li][i]; j < NN->model.rowStart[l][li][i+1]; j++)  {
+            if (w[j] != 0.)  {
+                block->n0[numW] = NN->model.n0[l][li][j];
+                block->w[numW++] = w[j];
+            }}}
+            else  {
+            for (j = 0; j < numIn; j++)  {
+            if (w[(long) i*numIn + j] != 0.)  {
+                block->n0[numW] = j;
+                block->w[numW++] = w[(long) i*numIn + j];
+        }}} }
+        block->rowStart[NN->model.layerSize[l]] = numW;
+    }}
+    
+    return 0;
+}
+
+    // product = a*b + c, where a is numOut x numMid, b is numMid x numIn, and c (numOut x numIn) may be NULL;
+    // acc[] and ifTouched[] are scratch space of numIn elements.  Entries that sum to 0 are left out.
+
+int multiplyOptBlocks(const optBlockType *a, const optBlockType *b, const optBlockType *c, int numOut, int numIn,
+        double *acc, char *ifTouched, optBlockType *product)
+{
+    int i, j, k, n, pass, numW = 0;
+    
+        // counts the entries, then fills them in
+    for (pass = 0; pass < 2; pass++)  {
+        if ((pass == 1) && (allocOptBlock(product, b->l0, numOut, numW) != 0))  return CD_OUT_OF_MEMORY_ERROR;
+        numW = 0;
+        
+        for (i = 0; i < numOut; i++)  {
+            for (n = 0; n < numIn; n++)  {  acc[n] = 0.;  ifTouched[n] = 0;  }
+            for (j = a->rowStart[i]; j < a->rowStart[i+1]; j++)  {
+            for (k = b->rowStart[a->n0[j]]; k < b->rowStart[a->n0[j]+1]; k++)  {
+                acc[b->n0[k]] += a->w[j] * b->w[k];
+                ifTouched[b->n0[k]] = 1;
+            }}
+            if (c != NULL)  {
+            for (k = c->rowStart[i]; k < c->rowStart[i+1]; k++)  {
+                acc[c->n0[k]] += c->w[k];
+                ifTouched[c->n0[k]] = 1;
+            }}
+            
+            if (pass == 1)  product->rowStart[i] = numW;
+            for (n = 0; n < numIn; n++)  {
+            if (ifTouched[n] && (acc[n] != 0.))  {
+                if (pass == 1)  {
+                    product->n0[numW] = n;
+                    product->w[numW] = acc[n];     }
+                numW++;
+        }}  }
+        if (pass == 1)  product->rowStart[numOut] = numW;
+    }
+    
+    return 0;
+}
+
+int ifRepeatedInput(const optLayerType *layer)
+{
+    int b, b2;
+    
+    for (b = 0; b < layer->numBlocks; b++)  {
+    for (b2 = 0; b2 < b; b2++)  {
+        if (layer->blocks[b].l0 == layer->blocks[b2].l0)  return 1;
+    }}
+    
+    return 0;
+}
+
+    // Multiplies linear layer L into each layer that reads it, if the new blocks hold no more weights than
+    // L's own blocks and the blocks that read L did.  Returns 1 if L was folded (and so nothing reads it any more).
+
+int foldLinearLayer(optLayerType *layers, int numLayers, int L, double *acc, char *ifTouched, int *rtrn)
+{
+    int l, b, b2, k, p, numProducts = 0, numInputs = layers[L].numBlocks;
+    long long oldWeights = 0, newWeights = 0;
+    optBlockType *products, *existing, *newBlocks, swapBlock;
+    
+    if (ifRepeatedInput(&layers[L]))  return 0;
+    for (l = L+1; l < numLayers; l++)  {
+    for (b = 0; b < layers[l].numBlocks; b++)  {
+    if (layers[l].blocks[b].l0 == L)  {
+        if (ifRepeatedInput(&layers[l]))  return 0;
+        numProducts += numInputs;
+    }}}
+    if (numProducts == 0)  return 0;
+    
+    products = calloc(numProducts, sizeof(optBlockType));
+    if (products == NULL)  {
+        *rtrn = CD_OUT_OF_MEMORY_ERROR;
+        return 0;     }
+    
+    for (k = 0; k < numInputs; k++)  oldWeights += optBlockWeights(&layers[L].blocks[k], layers[L].size);
+    p = 0;
+    for (l = L+1; (l < numLayers) && (*rtrn == 0); l++)  {
+    for (b = 0; (b < layers[l].numBlocks) && (*rtrn == 0); b++)  {
+    if (layers[l].blocks[b].l0 == L)  {
+        oldWeights += optBlockWeights(&layers[l].blocks[b], layers[l].size);
+        for (k = 0; (k < numInputs) && (*rtrn == 0); k++)  {
+            existing = NULL;
+            for (b2 = 0; b2 < layers[l].numBlocks; b2++)  {
+                if (layers[l].blocks[b2].l0 == layers[L].blocks[k].l0)  existing = &layers[l].blocks[b2];     }
+            *rtrn = multiplyOptBlocks(&layers[l].blocks[b], &layers[L].blocks[k], existing,
+                    layers[l].size, layers[layers[L].blocks[k].l0].size, acc, ifTouched, &products[p]);
+            if (*rtrn != 0)  break;
+            newWeights += optBlockWeights(&products[p], layers[l].size);
+            if (existing != NULL)  newWeights -= optBlockWeights(existing, layers[l].size);
+            p++;
+    }}}}
+    
+    if ((*rtrn != 0) || (newWeights > oldWeights))  {
+        for (p = 0; p < numProducts; p++)  freeOptBlock(&products[p]);
+        free(products);
+        return 0;     }
+    
+        // each product replaces the block it was summed with or is added, the block from L is dropped,
+        // and the blocks are put back in order of their input layers
+    p = 0;
+    for (l = L+1; l < numLayers; l++)  {
+    for (b = 0; b < layers[l].numBlocks; b++)  {
+    if (layers[l].blocks[b].l0 == L)  {
+        newBlocks = calloc(layers[l].numBlocks + numInputs, sizeof(optBlockType));
+        if (newBlocks == NULL)  {
+            for (; p < numProducts; p++)  freeOptBlock(&products[p]);
+            free(products);
+            *rtrn = CD_OUT_OF_MEMORY_ERROR;
+            return 0;     }
+        
+        freeOptBlock(&layers[l].blocks[b]);
+        layers[l].blocks[b] = layers[l].blocks[--layers[l].numBlocks];
+        memcpy(newBlocks, layers[l].blocks, layers[l].numBlocks*sizeof(optBlockType));
+        free(layers[l].blocks);
+        layers[l].blocks = newBlocks;
+        for (k = 0; k < numInputs; k++)  {
+            for (b2 = 0; (b2 < layers[l].numBlocks) && (newBlocks[b2].l0 != products[p].l0); b2++);
+            if (b2 < layers[l].numBlocks)  freeOptBlock(&newBlocks[b2]);
+            else  layers[l].numBlocks++;
+            newBlocks[b2] = products[p++];
+        }
+        
+        for (b2 = 1; b2 < layers[l].numBlocks; b2++)  {
+        for (k = b2; (k > 0) && (newBlocks[k-1].l0 > newBlocks[k].l0); k--)  {
+            swapBlock = newBlocks[k];
+            newBlocks[k] = newBlocks[k-1];
+            newBlocks[k-1] = swapBlock;
+        }}
+        break;
+    }}}
+    free(products);
+    
+    return 1;
+}
+
+    // Marks the neurons to keep:  a neuron is always 0 if its activation function maps 0 to 0 and it reads only
+    // from neurons that are always 0, and it reaches the outputs if a kept neuron reads it.  Then drops the others,
+    // the weights that read from them, and any block or layer that is left empty.
+
+int pruneOptLayers(optLayerType *layers, int numLayers, int *numRemoved)
+{
+    int l, b, i, j, n, numW, *newIndex, maxSize = 0;
+    optBlockType *block;
+    
+    for (l = 0; l < numLayers; l++)  {
+        if (layers[l].size > maxSize)  maxSize = layers[l].size;
+        for (i = 0; i < layers[l].size; i++)  {
+            layers[l].ifZero[i] = !layers[l].ifInput && (layers[l].AF != SIGMOID_AF);
+            layers[l].ifKept[i] = layers[l].ifFixed;
+        }
+        for (b = 0; b < layers[l].numBlocks; b++)  {
+            block = &layers[l].blocks[b];
+            for (i = 0; i < layers[l].size; i++)  {
+            for (j = block->rowStart[i]; j < block->rowStart[i+1]; j++)  {
+                if (!layers[block->l0].ifZero[block->n0[j]])  layers[l].ifZero[i] = 0;
+    }}  }   }
+    
+    for (l = numLayers-1; l >= 2; l--)  {
+    for (b = 0; b < layers[l].numBlocks; b++)  {
+        block = &layers[l].blocks[b];
+        for (i = 0; i < layers[l].size; i++)  {
+        if (layers[l].ifKept[i])  {
+            for (j = block->rowStart[i]; j < block->rowStart[i+1]; j++)  {
+                if (!layers[block->l0].ifZero[block->n0[j]])  layers[block->l0].ifKept[block->n0[j]] = 1;
+    }}  }}}
+    
+    newIndex = malloc((maxSize+1)*sizeof(int));
+    if (newIndex == NULL)  return CD_OUT_OF_MEMORY_ERROR;
+    
+        // compacts each block in place, which is safe because a row's entries never move past where they're read from
+    for (l = 0; l < numLayers; l++)  {
+    for (b = 0; b < layers[l].numBlocks; b++)  {
+        block = &layers[l].blocks[b];
+        for (n = 0, i = 0; i < layers[block->l0].size; i++)  newIndex[i] = layers[block->l0].ifKept[i] ? n++ : -1;
+        numW = 0;
+        for (n = 0, i = 0; i < layers[l].size; i++)  {
+            j = block->rowStart[i];
+            block->rowStart[n] = numW;
+            if (!layers[l].ifKept[i])  continue;
+            for (; j < block->rowStart[i+1]; j++)  {
+            if (newIndex[block->n0[j]] >= 0)  {
+                block->n0[numW] = newIndex[block->n0[j]];
+                block->w[numW++] = block->w[j];
+            }}
+            n++;
+        }
+        block->rowStart[n] = numW;
+    }}
+    free(newIndex);
+    
+        // only then are the sizes updated, as the blocks above were read with the old ones
+    for (l = 0; l < numLayers; l++)  {
+        for (n = 0, i = 0; i < layers[l].size; i++)  n += layers[l].ifKept[i];
+        *numRemoved += layers[l].size - n;
+        layers[l].size = n;
+        if (n == 0)  layers[l].ifRemoved = 1;
+        for (b = 0; b < layers[l].numBlocks; )  {
+            if (optBlockWeights(&layers[l].blocks[b], n) > 0)  b++;
+            else  {
+                freeOptBlock(&layers[l].blocks[b]);
+                layers[l].numBlocks--;
+                memmove(&layers[l].blocks[b], &layers[l].blocks[b+1], (layers[l].numBlocks-b)*sizeof(optBlockType));
+    }   }   }
+    
+    return 0;
+}
+
+    // builds the optimized network in newNN the way the reader builds one:  the topology, then the arena, then the weights
+
+int rebuildOptLayers(CDNN *NN, optLayerType *layers, CDNN *newNN)
+{
+    int l, b, i, j, k, numIn, numLayers = 0, numBlocks = 0, weightSparsity = NONSPARSE_WEIGHTS, *layerIndex, *topology, rtrn;
+    double *w;
+    optBlockType *block;
+    
+    layerIndex = malloc(NN->model.numLayers*sizeof(int));
+    if (layerIndex == NULL)  return CD_OUT_OF_MEMORY_ERROR;
+    for (l = 0; l < NN->model.numLayers; l++)  {
+        layerIndex[l] = layers[l].ifRemoved ? -1 : numLayers++;
+        for (b = 0; b < layers[l].numBlocks; b++)  {
+            block = &layers[l].blocks[b];
+            if (!ifDenseBlock(optBlockWeights(block, layers[l].size), layers[l].size, layers[block->l0].size))  weightSparsity = SPARSE_WEIGHTS;
+        }
+        numBlocks += layers[l].numBlocks;
+    }
+    
+    topology = malloc((3*numLayers + 2*numBlocks)*sizeof(int));
+    if (topology == NULL)  {
+        free(layerIndex);
+        return CD_OUT_OF_MEMORY_ERROR;     }
+    k = 3*numLayers;
+    for (l = 0; l < NN->model.numLayers; l++)  {
+    if (!layers[l].ifRemoved)  {
+        topology[layerIndex[l]] = layers[l].size;
+        topology[numLayers+layerIndex[l]] = layers[l].AF;
+        topology[2*numLayers+layerIndex[l]] = layers[l].numBlocks;
+        for (b = 0; b < layers[l].numBlocks; b++)  {
+            topology[k] = layerIndex[layers[l].blocks[b].l0];
+            topology[k+numBlocks] = (weightSparsity == SPARSE_WEIGHTS) ? optBlockWeights(&layers[l].blocks[b], layers[l].size) : 0;
+            k++;
+    }}  }
+    
+    initArenas(newNN);
+    newNN->model.numLayers = numLayers;
+    newNN->model.encoderLayer = ((NN->model.encoderLayer > 0) && (NN->model.encoderLayer < NN->model.numLayers)) ? layerIndex[NN->model.encoderLayer] : NN->model.encoderLayer;
+    newNN->model.variationalLayer = (NN->model.variationalLayer > 0) ? layerIndex[NN->model.variationalLayer] : NN->model.variationalLayer;
+    newNN->model.simdLevel = NN->model.simdLevel;
+    newNN->model.quantSimdLevel = NN->model.quantSimdLevel;
+    newNN->model.exactAFs = NN->model.exactAFs;
+    rtrn = allocModel(newNN, topology, weightSparsity, NULL, 0);
+    free(topology);
+    if (rtrn != 0)  {
+        free(layerIndex);
+        freeArena(&newNN->model);
+        return rtrn;     }
+    
+    for (l = 0; l < NN->model.numLayers; l++)  {
+    for (b = 0; (b < layers[l].numBlocks) && !layers[l].ifRemoved; b++)  {
+        block = &layers[l].blocks[b];
+        numIn = layers[block->l0].size;
+        w = newNN->model.weights[layerIndex[l]][b];
+        if (weightSparsity != SPARSE_WEIGHTS)  memset(w, 0, (size_t) layers[l].size*numIn*sizeof(double));
+        for (i = 0; i < layers[l].size; i++)  {
+        for (j = block->rowStart[i]; j < block->rowStart[i+1]; j++)  {
+            if (weightSparsity != SPARSE_WEIGHTS)  w[(long) i*numIn + block->n0[j]] += block->w[j];
+            else  {
+                newNN->model.n0[layerIndex[l]][b][j] = block->n0[j];
+                newNN->model.nf[layerIndex[l]][b][j] = i;
+                w[j] = block->w[j];
+    }}  }}}
+    free(layerIndex);
+    
+    if (weightSparsity == SPARSE_WEIGHTS)  rtrn = makeSparseRows(&newNN->model);
+    if (rtrn != 0)  freeArena(&newNN->model);
+    
+    return rtrn;
+}
+
+    // the weights stored, and the multiply-accumulates per sample
+
+void countWeights(const CDNN_model *NN, long long *numWeights, long long *numMACs)
+{
+    int l, li;
+
+    *numWeights = *numMACs = 0;
+    for (l = 2; l < NN->numLayers; l++)  {
+    if (l != NN->variationalLayer)  {
+        *numMACs += layerMACs(NN, l);
+        for (li = 0; li < NN->numLayerInputs[l]; li++)  {
+            if (NN->n0 != NULL)  *numWeights += NN->wSize[l][li];
+            else  *numWeights += (long long) NN->layerSize[l]*NN->layerSize[NN->layerInputs[l][li]];
+    }}  }
+}
+
+int CDNN_optimize(CDNN *NN, CDNN_optimize_stats *stats)
+{
+    int l, maxSize = 0, rtrn;
+    double *acc;
+    char *ifTouched;
+    optLayerType *layers;
+    CDNN_optimize_stats results;
+    CDNN newNN;
+    
+    memset(&results, 0, sizeof(results));
+    countWeights(&NN->model, &results.weightsBefore, &results.MACsBefore);
+    
+    for (l = 0; l < NN->model.numLayers; l++)  {
+        if (NN->model.layerSize[l] > maxSize)  maxSize = NN->model.layerSize[l];     }
+    layers = calloc(NN->model.numLayers, sizeof(optLayerType));
+    acc = malloc(maxSize*sizeof(double));
+    ifTouched = malloc(maxSize);
+    if ((layers == NULL) || (acc == NULL) || (ifTouched == NULL))  rtrn = CD_OUT_OF_MEMORY_ERROR;
+    else  rtrn = loadOptLayers(NN, layers, &results.zeroWeights);
+    
+    if (rtrn == 0)  rtrn = pruneOptLayers(layers, NN->model.numLayers, &results.neuronsRemoved);
+    for (l = 2; (l < NN->model.numLayers) && (rtrn == 0); l++)  {
+    if (!layers[l].ifFixed && !layers[l].ifRemoved && (layers[l].AF == LINEAR_AF))  {
+        results.layersFolded += foldLinearLayer(layers, NN->model.numLayers, l, acc, ifTouched, &rtrn);
+    }}
+    if ((rtrn == 0) && (results.layersFolded > 0))  rtrn = pruneOptLayers(layers, NN->model.numLayers, &results.neuronsRemoved);
+    if (rtrn == 0)  rtrn = rebuildOptLayers(NN, layers, &newNN);
+    
+    if (layers != NULL)  freeOptLayers(layers, NN->model.numLayers);
+    free(acc);
+    free(ifTouched);
+    if (rtrn != 0)  return rtrn;
+    
+    results.layersRemoved = NN->model.numLayers - newNN.model.numLayers;
+    results.ifSparse = (newNN.model.n0 != NULL);
+    countWeights(&newNN.model, &results.weightsAfter, &results.MACsAfter);
+    free_CDNN(NN);
+    *NN = newNN;
+    shareModelFields(NN);
+    if (stats != NULL)  *stats = results;
+    
+    return 0;
+}
+
+
+    // Exports a network as C source:  one function, functionName(const double *inputs, double *outputs),
+    // with the layer sizes as constants, the dense weight blocks (and dense expansions) in static arrays,
+    // and the other sparse blocks written out term by term.  The sums are in the same order as the scalar kernels', and the activation
+    // functions are libm's, so the function returns what run_CDNN() does in exact mode at CDNN_SIMD_SCALAR
+    // (if it's compiled without contracting multiplies and adds into FMAs).  The file compiles as C or C++.
+
+#define CDNN_EXPORT_TERMS_PER_LINE 8
+
+    // a C double literal
+void writeLiteral(FILE *fileP, double theDouble)
+{
+    char c[CDNN_MAX_NUM_CHARS+2];
+    int numChars;
+    
+    if (theDouble != theDouble)  {
+        fputs("NAN", fileP);
+        return;     }
+    if (isinf(theDouble))  {
+        fputs((theDouble < 0.) ? "-INFINITY" : "INFINITY", fileP);
+        return;     }
+    
+    numChars = formatDouble(theDouble, c);
+    c[numChars] = 0;
+    if (strpbrk(c, ".e") == NULL)  strcat(c, ".");
+    fputs(c, fileP);
+}
+
+    // a dense block, transposed so that the loop over the output neurons is the inner one:  then each output
+    // is still summed in input order, and the compiler can vectorize across the outputs without reordering the sums
+
+void writeWeightArray(FILE *fileP, const char *functionName, int l, int li, const double *w, int numOut, int numIn)
+{
+    int i, i0;
+    long j = 0;
+    
+    fprintf(fileP, "static const double %s_w%i_%i[%li] = {", functionName, l, li, (long) numOut*numIn);
+    for (i0 = 0; i0 < numIn; i0++)  {
+    for (i = 0; i < numOut; i++)  {
+        fputs((j % CDNN_EXPORT_TERMS_PER_LINE == 0) ? "\n    " : " ", fileP);
+        writeLiteral(fileP, w[(long) i*numIn + i0]);
+        if (++j < (long) numOut*numIn)  fputc(',', fileP);
+    }}
+    fputs("\n};\n\n", fileP);
+}
+
+    // one row of a sparse block, summed as sparseMV() does, a few terms per statement
+
+void writeRow(FILE *fileP, int l, int l0, int i, const double *w, const int *n0, int numTerms)
+{
+    int j;
+    
+    if (numTerms == 0)  return;
+    for (j = 0; j < numTerms; j++)  {
+        if (j % CDNN_EXPORT_TERMS_PER_LINE == 0)  {
+            if (j > 0)  fputs(";\n", fileP);
+            fputs((j == 0) ? "    sum =" : "    sum = sum", fileP);     }
+        if (j > 0)  fputs((w[j] < 0.) ? " - " : " + ", fileP);
+        else  fputs((w[j] < 0.) ? " -" : " ", fileP);
+        writeLiteral(fileP, fabs(w[j]));
+        fprintf(fileP, "*y%i[%i]", l0, n0[j]);
+    }
+    fprintf(fileP, ";\n    y%i[%i] += sum;\n", l, i);
+}
+
+int CDNN_export_c(CDNN *NN, const char *fileName, const char *functionName)
+{
+    const char *AFcode[6] = { NULL, "(y%i[i] <= 0.) ? 0. : 1.", "(y%i[i] <= 0.) ? 0. : y%i[i]",
+            "(y%i[i] <= 0.) ? 0. : ((y%i[i] >= 1.) ? 1. : y%i[i])", "1. / (1. + exp(-y%i[i]))", "tanh(y%i[i])" };
+    int l, li, l0, i, numInputs, sparseWeights = (NN->model.n0 != NULL), ifSparseRows = 0;
+    const double *dense;
+    int *rowStart;
+    FILE *fileP;
+    
+    for (i = 0; functionName[i] != 0; i++)  {
+    if (!((functionName[i] == '_') || ((functionName[i] >= 'a') && (functionName[i] <= 'z'))
+            || ((functionName[i] >= 'A') && (functionName[i] <= 'Z')) || ((i > 0) && (functionName[i] >= '0') && (functionName[i] <= '9'))))  {
+        return CD_PARAMS_ERR;
+    }}
+    if (i == 0)  return CD_PARAMS_ERR;
+    
+    fileP = fopen(fileName, "w");
+    if (fileP == NULL)  return CD_FILE_ERROR;
+    
+    numInputs = NN->model.layerSize[1];
+    if (NN->model.variationalLayer > 0)  numInputs += NN->model.layerSize[NN->model.variationalLayer];
+    
+    fprintf(fileP, "/*\n *  Generated by CDNN_export_c() from a network of %i layers.\n *  \n", NN->model.numLayers);
+    fprintf(fileP, " *  void %s(const double *inputs, double *outputs);\n *  \n", functionName);
+    fprintf(fileP, " *  inputs[] holds the %i inputs", NN->model.layerSize[1]);
+    if (NN->model.variationalLayer > 0)  fprintf(fileP, " followed by the %i variational layer inputs", NN->model.layerSize[NN->model.variationalLayer]);
+    fprintf(fileP, ", and outputs[] gets the %i outputs.\n */\n\n#include <math.h>\n\n", NN->model.layerSize[NN->model.numLayers-1]);
+    
+    fputs("enum {", fileP);
+    for (l = 0; l < NN->model.numLayers; l++)  fprintf(fileP, "%s%s_L%i = %i", (l > 0) ? ", " : " ", functionName, l, NN->model.layerSize[l]);
+    fputs(" };\n\n", fileP);
+    
+    for (l = 2; l < NN->model.numLayers; l++)  {
+    if (l != NN->model.variationalLayer)  {
+    for (li = 0; li < NN->model.numLayerInputs[l]; li++)  {
+        l0 = NN->model.layerInputs[l][li];
+        dense = sparseWeights ? NN->model.denseWeights[l][li] : NN->model.weights[l][li];
+        if (dense != NULL)  writeWeightArray(fileP, functionName, l, li, dense, NN->model.layerSize[l], NN->model.layerSize[l0]);
+        else  ifSparseRows = 1;
+    }}}
+    
+    fprintf(fileP, "#ifdef __cplusplus\nextern \"C\"\n#endif\nvoid %s(const double *inputs, double *outputs)\n{\n", functionName);
+    for (l = 0; l < NN->model.numLayers; l++)  fprintf(fileP, "    double y%i[%s_L%i];\n", l, functionName, l);
+    fprintf(fileP, "    int i, i0;\n%s    \n", ifSparseRows ? "    double sum;\n" : "");
+    fprintf(fileP, "    y0[0] = 1.;\n    for (i = 0; i < %s_L1; i++)  y1[i] = inputs[i];\n", functionName);
+    if (NN->model.variationalLayer > 0)  fprintf(fileP, "    for (i = 0; i < %s_L%i; i++)  y%i[i] = inputs[%s_L1 + i];\n",
+            functionName, NN->model.variationalLayer, NN->model.variationalLayer, functionName);
+    
+    for (l = 2; l < NN->model.numLayers; l++)  {
+    if (l != NN->model.variationalLayer)  {
+        fprintf(fileP, "    \n    for (i = 0; i < %s_L%i; i++)  y%i[i] = 0.;\n", functionName, l, l);
+        for (li = 0; li < NN->model.numLayerInputs[l]; li++)  {
+            l0 = NN->model.layerInputs[l][li];
+            if (!sparseWeights || (NN->model.denseWeights[l][li] != NULL))  {
+                fprintf(fileP, "    for (i0 = 0; i0 < %s_L%i; i0++)  {\n", functionName, l0);
+                fprintf(fileP, "    for (i = 0; i < %s_L%i; i++)  {\n", functionName, l);
+                fprintf(fileP, "        y%i[i] += %s_w%i_%i[i0*%s_L%i + i] * y%i[i0];\n    }}\n", l, functionName, l, li, functionName, l, l0);
+                continue;     }
+            
+            rowStart = NN->model.rowStart[l][li];
+            for (i = 0; i < NN->model.layerSize[l]; i++)  {
+                writeRow(fileP, l, l0, i, NN->model.weights[l][li] + rowStart[i], NN->model.n0[l][li] + rowStart[i], rowStart[i+1]-rowStart[i]);
+        }   }
+        if (NN->model.layerAFs[l] != LINEAR_AF)  {
+            fprintf(fileP, "    for (i = 0; i < %s_L%i; i++)  y%i[i] = ", functionName, l, l);
+            fprintf(fileP, AFcode[NN->model.layerAFs[l]], l, l, l);
+            fputs(";\n", fileP);
+    }}  }
+    
+    fprintf(fileP, "    \n    for (i = 0; i < %s_L%i; i++)  outputs[i] = y%i[i];\n}\n",
+            functionName, NN->model.numLayers-1, NN->model.numLayers-1);
+    
+    if (ferror(fileP))  {
+        fclose(fileP);
+        return CD_FILE_ERROR;     }
+    if (fclose(fileP) != 0)  return CD_FILE_ERROR;
+    
+    return 0;
+}
+
+
+void free_CDNN(CDNN *NN)
+{
+    freeArena(&NN->model);
+    free(NN->profile);
+    NN->profile = NULL;
 }
@@ -1,6 +1,9 @@
 #ifndef cdeeply_h
 #define cdeeply_h
 
+#include <stddef.h>
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -41,11 +44,25 @@ extern "C" {
 #define NO_MAX -1
 
 
+// Arguments to CDNN_set_simd_level()
+
+#define CDNN_SIMD_SCALAR 0
+#define CDNN_SIMD_SSE2 1
+#define CDNN_SIMD_AVX2 2
+#define CDNN_SIMD_AVX512 3
+#define CDNN_SIMD_BEST -1
+
+
 // Error codes, not including the error codes that libcurl returns
 
 #define CD_OUT_OF_MEMORY_ERROR 100
 #define CD_PARAMS_ERR 101
 #define CD_NN_READ_ERROR 102
+#define CD_FILE_ERROR 103
+
+// Returned by CDNN_request_status() while a request is running
+
+#define CD_REQUEST_RUNNING -1
 
 typedef struct {
     int stepAF, ReLUAF, ReLU1AF, sigmoidAF, tanhAF;
@@ -56,15 +73,105 @@ typedef struct {
     double range;
 } quantizationType;
 
+// The trained network.  A CDNN_model is never written to by the run_CDNN*() functions,
+// so one model can be shared by any number of threads, each having its own CDNN_context.
+
+typedef struct {
+    int numLayers, encoderLayer, variationalLayer;
+    int *layerSize, *layerAFs, *numLayerInputs;
+    int **layerInputs, **wSize;
+    int ***n0, ***nf;
+    double ***weights;
+    int ***rowStart;
+    double ***denseWeights;
+    int simdLevel, quantSimdLevel, exactAFs, arenaKind, dataKind;
+    char *arena, *modelData;
+    size_t arenaBytes, modelDataBytes;
+    float ***weightsF32, ***denseWeightsF32;
+    char *f32Arena;
+    int quantBits, *yMinQ, *yMaxQ;
+    void ***weightsQ, ***denseWeightsQ;
+    double ***rowScaleQ, *yScaleQ;
+    char *quantArena;
+    int *stepWords;
+    uint64_t ***posBits, ***negBits;
+    double **bitScale;
+    char *bitArena;
+    double ***colWeights;
+    int ***colStart, ***colRows;
+    char *eventArena;
+    int *lastConsumer;
+    long *yPlan, yPlanSize;
+} CDNN_model;
+
+// Per-layer counters, kept once profiling is turned on by CDNN_context_profile() or CDNN_profile()
+
+typedef struct {
+    long long numSamples, ns, MACs, numNonzero;
+} CDNN_layer_profile;
+
+// What the run_CDNN_events*() functions did:  the multiply-accumulates they ran, and those they skipped because their inputs were 0
+
 typedef struct {
+    long long numSamples, MACs, skippedMACs;
+} CDNN_event_stats;
+
+typedef struct {
+    const CDNN_model *model;
+    double **y, **ty;
+    float **yF32, **tyF32;
+    short **yQ;
+    uint64_t **yBits;
+    int **active, *numActive;
+    CDNN_event_stats events;
+    CDNN_layer_profile *profile;
+} CDNN_context;
+
+// Asynchronous training requests, which a CDNN_session runs side by side
+
+typedef struct CDNN_session CDNN_session;
+typedef struct CDNN_request CDNN_request;
+typedef void (*CDNN_callback)(CDNN_request *, int, void *);
+
+// A thread pool for running the layers of one sample in parallel
+
+typedef struct CDNN_pool CDNN_pool;
+
+// The seconds and bytes that each phase of a training request took.  The training data is formatted
+// while it uploads, and the network is parsed while it downloads, so those phases overlap.
+
+typedef struct {
+    int fromCache;
+    double sizingSeconds, connectSeconds, uploadSeconds, formattingSeconds;
+    double serverSeconds, downloadSeconds, parsingSeconds, totalSeconds;
+    long long tableBytes, uploadBytes, downloadBytes;
+} CDNN_build_stats;
+
+// The model, plus copies of its topology and weight pointers (which point into the same arena) under their original names
+
+typedef struct {
+    CDNN_model model;
     int numLayers, encoderLayer, variationalLayer;
     int *layerSize, *layerAFs, *numLayerInputs;
     int **layerInputs, **wSize;
     int ***n0, ***nf;
     double ***weights;
     double **y;
+    float **yF32;
+    short **yQ;
+    uint64_t **yBits;
+    int **active, *numActive;
+    CDNN_event_stats events;
+    CDNN_layer_profile *profile;
 } CDNN;
 
+// What CDNN_optimize() removed:  the weights stored and the multiply-accumulates per sample (half the FLOPs) before and after
+
+typedef struct {
+    long long weightsBefore, weightsAfter, MACsBefore, MACsAfter, zeroWeights;
+    int neuronsRemoved, layersFolded, layersRemoved, ifSparse;
+} CDNN_optimize_stats;
+
 
 extern int CDNN_tabular_regressor(CDNN *, int, int, int, double *, int, int *, double *,
         int, int, int, int, double, int, int, int, AFlist, quantizationType, quantizationType,
@@ -72,7 +179,64 @@ extern int CDNN_tabular_regressor(CDNN *, int, int, int, double *, int, int *, d
 extern int CDNN_tabular_encoder(CDNN *, int, int, double *, int, double *,
         int, int, int, int, int, int, int, int, int, double, int, int, int, AFlist, quantizationType, quantizationType,
         int, int, int, double *, char **);
+extern CDNN_session *CDNN_session_init(void);
+extern int CDNN_session_set_url(CDNN_session *, const char *);
+extern void CDNN_session_set_timeouts(CDNN_session *, long, long);
+extern int CDNN_session_set_cache(CDNN_session *, const char *, long long);
+extern CDNN_request *CDNN_tabular_regressor_async(CDNN_session *, CDNN *, int, int, int, double *, int, int *, double *,
+        int, int, int, int, double, int, int, int, AFlist, quantizationType, quantizationType,
+        int, int, int, int, double *, CDNN_callback, void *);
+extern CDNN_request *CDNN_tabular_encoder_async(CDNN_session *, CDNN *, int, int, double *, int, double *,
+        int, int, int, int, int, int, int, int, int, double, int, int, int, AFlist, quantizationType, quantizationType,
+        int, int, int, double *, CDNN_callback, void *);
+extern int CDNN_session_poll(CDNN_session *, int);
+extern int CDNN_request_wait(CDNN_request *);
+extern int CDNN_request_status(CDNN_request *);
+extern const char *CDNN_request_error(CDNN_request *);
+extern void CDNN_request_stats(CDNN_request *, CDNN_build_stats *);
+extern void CDNN_last_build_stats(CDNN_build_stats *);
+extern void CDNN_request_free(CDNN_request *);
+extern void CDNN_session_free(CDNN_session *);
 extern double *run_CDNN(CDNN *, double *);
+extern int run_CDNN_batch(CDNN *, double *, int, int, double *);
+extern int CDNN_context_init(CDNN_context *, const CDNN_model *);
+extern double *run_CDNN_ctx(const CDNN_model *, CDNN_context *, const double *, double *);
+extern int run_CDNN_batch_ctx(const CDNN_model *, CDNN_context *, const double *, int, int, double *);
+extern void CDNN_context_free(CDNN_context *);
+extern CDNN_pool *CDNN_pool_init(int);
+extern int CDNN_pool_threads(CDNN_pool *);
+extern double *run_CDNN_pool(CDNN *, CDNN_pool *, double *);
+extern double *run_CDNN_pool_ctx(const CDNN_model *, CDNN_context *, CDNN_pool *, const double *, double *);
+extern void CDNN_pool_free(CDNN_pool *);
+extern int CDNN_context_profile(CDNN_context *, int);
+extern int CDNN_profile(CDNN *, int);
+extern int CDNN_make_f32(CDNN *);
+extern float *run_CDNN_f32(CDNN *, const float *);
+extern int run_CDNN_batch_f32(CDNN *, const float *, int, int, float *);
+extern float *run_CDNN_f32_ctx(const CDNN_model *, CDNN_context *, const float *, float *);
+extern int run_CDNN_batch_f32_ctx(const CDNN_model *, CDNN_context *, const float *, int, int, float *);
+extern int CDNN_f32_deviation(CDNN *, const double *, int, int, double *);
+extern int CDNN_make_quantized(CDNN *, quantizationType, quantizationType, const double *, int, int);
+extern double *run_CDNN_quantized(CDNN *, const double *);
+extern int run_CDNN_batch_quantized(CDNN *, const double *, int, int, double *);
+extern double *run_CDNN_quantized_ctx(const CDNN_model *, CDNN_context *, const double *, double *);
+extern int run_CDNN_batch_quantized_ctx(const CDNN_model *, CDNN_context *, const double *, int, int, double *);
+extern int CDNN_quantized_deviation(CDNN *, const double *, const double *, int, int, double *);
+extern int CDNN_make_bitpacked(CDNN *);
+extern double *run_CDNN_bitpacked(CDNN *, const double *);
+extern double *run_CDNN_bitpacked_ctx(const CDNN_model *, CDNN_context *, const double *, double *);
+extern int CDNN_make_event_driven(CDNN *);
+extern double *run_CDNN_events(CDNN *, const double *);
+extern double *run_CDNN_events_ctx(const CDNN_model *, CDNN_context *, const double *, double *);
+extern double CDNN_skip_ratio(const CDNN_event_stats *);
+extern int CDNN_max_simd_level(void);
+extern int CDNN_set_simd_level(CDNN_model *, int);
+extern int CDNN_set_exact_activations(CDNN_model *, int);
+extern size_t CDNN_activation_bytes(const CDNN_model *, int);
+extern int CDNN_save(CDNN *, const char *);
+extern int CDNN_load(CDNN *, const char *);
+extern int CDNN_export_c(CDNN *, const char *, const char *);
+extern int CDNN_optimize(CDNN *, CDNN_optimize_stats *);
 extern void free_CDNN(CDNN *);
 
 